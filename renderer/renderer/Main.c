@@ -1,7 +1,13 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <limits.h>
 #include <stdint.h>
 #include <stdbool.h>
-#include <sdl.h>
+#include <string.h>
+#ifndef RENDERER_HEADLESS
+#include <SDL.h>		// SDL renames main() to SDL_main on Windows
+#endif
 #include "mesh.h"
 #include "material.h"
 #include "array.h"
@@ -15,6 +21,18 @@
 #include "texture.h"
 #include "light.h"
 #include "pbr.h"
+#include "shadow.h"
+#include "backend.h"
+#include "scene.h"
+#include "benchmark.h"
+#include "stats.h"
+#include "heatmap.h"
+#include "pipeline.h"
+#include "job.h"
+#include "texture_cache.h"
+#include "mesh_cache.h"
+#include "texture_file.h"
+#include "texture_stream.h"
 
 
 //////////////////////////////////////////////////////////////////////////////////
@@ -22,17 +40,33 @@
 //////////////////////////////////////////////////////////////////////////////////
 
 bool is_running = false;
-int previous_frame_time = 0;
+const char* scene_name = DEFAULT_SCENE;
 float delta_time = 0;
 
 
 //////////////////////////////////////////////////////////////////////////////////
-// Array of triangles that should be rendered frame by frame
+// Array of triangles that should be rendered frame by frame, double buffered:
+// the geometry stage fills triangles_to_render while the raster stage draws
+// triangles_to_draw, the buffers are swapped by publish_frame()
 //////////////////////////////////////////////////////////////////////////////////
 
 #define MAX_TRIANGLES_PER_MESH 500000
-triangle_t triangles_to_render[MAX_TRIANGLES_PER_MESH];
+triangle_t triangle_buffers[2][MAX_TRIANGLES_PER_MESH];
+triangle_t* triangles_to_render = triangle_buffers[0];
 int num_triangles_to_render = 0;
+triangle_t* triangles_to_draw = triangle_buffers[1];
+int num_triangles_to_draw = 0;
+
+//////////////////////////////////////////////////////////////////////////////////
+// Array of unique mesh edges drawn by the wireframe modes frame by frame
+//////////////////////////////////////////////////////////////////////////////////
+
+#define MAX_LINES_PER_MESH 750000
+line_t line_buffers[2][MAX_LINES_PER_MESH];
+line_t* lines_to_render = line_buffers[0];
+int num_lines_to_render = 0;
+line_t* lines_to_draw = line_buffers[1];
+int num_lines_to_draw = 0;
 
 //////////////////////////////////////////////////////////////////////////////////
 // Declaration of our global transformation matrices
@@ -43,6 +77,14 @@ mat4_t view_matrix;
 mat4_t proj_matrix;
 mat4_t normal_matrix;
 
+//////////////////////////////////////////////////////////////////////////////////
+// Camera space vertex streams of the mesh currently going through the pipeline
+//////////////////////////////////////////////////////////////////////////////////
+
+vect4_stream_t view_vertices;
+vect3_stream_t view_normals;
+vect3_stream_t view_tangents;
+vect3_stream_t view_bitangents;
 
 //////////////////////////////////////////////////////////////////////////////////
 // setup functions to initialize variables and objects
@@ -52,6 +94,11 @@ void setup()
 	//Initialize light direction and light color
 	init_light(vect3_new(0.0f, 0.0f, 1.0f), vect3_new(1.0f, 1.0f, 1.0f), 0.2);
 	
+	//Initialize the point and spot lights, they are culled into screen tiles every frame
+	add_point_light(vect3_new(-1.5f, 1.0f, 2.0f), vect3_new(1.0f, 0.6f, 0.3f), 4.0f, 4.0f);
+	add_spot_light(vect3_new(1.5f, 1.5f, 1.0f), vect3_new(-0.5f, -0.5f, 1.0f), vect3_new(0.3f, 0.5f, 1.0f), 6.0f, 6.0f,
+		3.1415926f / 12.0f, 3.1415926f / 6.0f);
+
 	//Initialize material
 	init_material(0xFFFFFFFF, 128.0f, 0.3f);
 
@@ -77,142 +124,22 @@ void setup()
 	float z_far = 20.0f;
 
 	proj_matrix = mat4_make_perspective(fov_y, aspect_y, z_near, z_far);
+	set_camera_projection(proj_matrix, get_window_width(), get_window_height());
+
+	//Initialize the shadow map of the directional light
+	init_shadow_map(DEFAULT_SHADOW_MAP_RESOLUTION);
 
 	//Initialize the frustum plane with a point and normal
 	init_frustum_planes(fov_x, fov_y, z_near, z_far);
 
-	//Loads the vertex and faces values for the mesh data structure
-	//load_mesh("./assets/runway.obj", "./assets/runway.png", vect3_new(1, 1, 1), vect3_new(0, -1.5, +23), vect3_new(0, 0, 0));
-	//load_mesh("./assets/f22.obj", "./assets/f22.png", vect3_new(1, 1, 1), vect3_new(0, -1.3, +5), vect3_new(0, -M_PI/2, 0));
-	//load_mesh("./assets/efa.obj", "./assets/efa.png", vect3_new(1, 1, 1), vect3_new(-2, -1.3, +9), vect3_new(0, -M_PI/2, 0));
-	//load_mesh("./assets/f117.obj", "./assets/f117.png", vect3_new(1, 1, 1), vect3_new(+2, -1.3, +9), vect3_new(0, -M_PI/2, 0));
-	
-	//load_mesh("./assets/helmet.obj", "./assets/helmet_D.png", vect3_new(1, 1, 1), vect3_new(0, 0, +5), vect3_new(0, 2.5, 0));
-	//load_mesh("./assets/f117.obj", "./assets/f117.png", vect3_new(1, 1, 1), vect3_new(0, 0, +5), vect3_new(0, 0, 0));
-	//load_mesh("./assets/efa.obj", "./assets/efa.png", vect3_new(1, 1, 1), vect3_new(0, 0, +5), vect3_new(0, 0, 0));
-	//load_mesh("./assets/ak47.obj", "./assets/cube.png", vect3_new(2, 2, 2), vect3_new(0, 0, +3), vect3_new(0, 0, 0));
-	//load_mesh("./assets/crab.obj", "./assets/crab.png", vect3_new(1, 1, 1), vect3_new(0, 0, +5), vect3_new(0, 0, 0));
-	//load_mesh("./assets/drone.obj", "./assets/drone.png", vect3_new(1, 1, 1), vect3_new(0, 0, +5), vect3_new(0, 0, 0));
-	//load_mesh("./assets/shiba.obj", "./assets/shiba_diffuse.png", vect3_new(1, 1, 1), vect3_new(0, 0, +5), vect3_new(0, 0,0));
-	//load_mesh("./assets/Lighter.obj", "./assets/cube.png", vect3_new(1, 1, 1), vect3_new(0, 0, +3), vect3_new(0, 0,0));
-	//
-
-	//load_mesh_with_pbr(
-	//	"./assets/Dolphin.obj",					
-	//	"./assets/Dolphin_Diffuse@1.png", 
-	//	"./assets/Dolphin_Normal@1.png", 
-	//	"./assets/Dolphin_Glow@1.png",
-	//	"./assets/Dolphin_Roughness@1.png",
-	//	"./assets/Dolphin_Diffuse@1.png",
-	//	"./assets/Dolphin_Diffuse@1.png",
-	//	vect3_new(1, 1, 1),		
-	//	vect3_new(0, 0, +2.5), 
-	//	vect3_new(-1, 0, 0)
-	//);
-
-	//load_mesh_with_pbr(
-	//	"./assets/gun.obj",
-	//	"./assets/gun_diffuse.png",
-	//	"./assets/gun_normal.png",
-	//	"./assets/gun_metallic.png",
-	//	"./assets/gun_roughness.png",
-	//	"./assets/gun_metallic.png",
-	//	"./assets/gun_diffuse.png",
-	//	vect3_new(1, 1,   1),
-	//	vect3_new(0, 0,  +6),
-	//	vect3_new(0, 0,   0)
-	//);
-
-	//load_mesh_with_normalmap(
-	//"./assets/snowman.obj",
-	//"./assets/snowman_diffuse.png",
-	//"./assets/snowman_normal.png",
-	//"./assets/snowman_metallic.png",
-	//"./assets/snowman_metallic.png",
-	//vect3_new(1, 1, 1),
-	//vect3_new(0, 0, +3.2),
-	//vect3_new(0, 0, 0)
-	//);
-
-	//load_mesh_with_pbr(
-	//	"./assets/helmet.obj",
-	//	"./assets/helmet_D.png",
-	//	"./assets/helmet_N.png",
-	//	"./assets/helmet_D.png",
-	//	"./assets/helmet_R.png",
-	//	"./assets/helmet_M.png",
-	//	"./assets/helmet_D.png",
-	//	vect3_new(1, 1, 1),
-	//	vect3_new(0, 0, +5),
-	//	vect3_new(0, -1, 0)
-	//);
-
-
-	//load_mesh_with_pbr(
-	//	"./assets/rivet.obj",
-	//	"./assets/rivet_diffuse.png",
-	//	"./assets/rivet_normal.png",
-	//	"./assets/rivet_diffuse.png",
-	//	"./assets/rivet_roughness.png",
-	//	"./assets/rivet_metallic.png",
-	//	"./assets/rivet_diffuse.png",
-	//	vect3_new(1, 1, 1),
-	//	vect3_new(0, 0, +3.5),
-	//	vect3_new(0.3, 1.8, 0.3)
-	//);
-
-	load_mesh_with_pbr(
-		"./assets/Lighter.obj",
-		"./assets/Lighter_B.png",
-		"./assets/Lighter_N.png",
-		"./assets/Lighter_B.png",
-		"./assets/Lighter_R.png",
-		"./assets/Lighter_M.png",
-		"./assets/Lighter_B.png",
-		vect3_new(1, 1, 1),
-		vect3_new(0, 0, +3),
-		vect3_new(0.0, 1.3, 0.0)
-	);
-
-
-	//load_mesh_with_pbr(
-	//	"./assets/car.obj",
-	//	"./assets/car_B.png",
-	//	"./assets/car_N.png",
-	//	"./assets/car_G.png",
-	//	"./assets/car_R.png",
-	//	"./assets/car_M.png",
-	//	"./assets/car_B.png",
-	//	vect3_new(1, 1, 1),
-	//	vect3_new(0, 0, +4),
-	//	vect3_new(0.0, 2.5, 0.0)
-	//);
-
-	/*load_mesh_with_pbr(
-		"./assets/ironman.obj",
-		"./assets/ironman_b.png",
-		"./assets/ironman_n.png",
-		"./assets/ironman_b.png",
-		"./assets/ironman_r.png",
-		"./assets/ironman_m.png",
-		"./assets/ironman_a.png",
-		vect3_new(1, 1, 1),
-		vect3_new(0, 0, +2),
-		vect3_new(0, 3.2, 0)
-	);*/
-
-	//load multiply mesh
-	for (int mesh_index = 0; mesh_index < get_num_meshes(); mesh_index++){
-
-		mesh_t* mesh = get_mesh(mesh_index);
-
-		//load mesh vertex normal to mesh normal array
-		calculate_vertex_normal(mesh);
-		/*for (int i = 0; i <mesh->num_vertices ; i++) {
-			printf("Mesh Normal %d: (%f, %f, %f)\n", i, mesh->normals[i].x, mesh->normals[i].y, mesh->normals[i].z);
-			printf("Mesh Vertices %d:(%f, %f, %f)\n", i, mesh->vertices[i].x, mesh->vertices[i].y, mesh->vertices[i].z);
-		}*/
-		calculate_tangents_and_bitangents(mesh);
+	//Load the meshes of the selected scene (see the scene table in scene.c) and prepare them for rendering,
+	//on the job threads. A display shows every mesh once it is loaded, offscreen frames wait for all of them.
+	init_texture_cache();
+	init_texture_streaming();
+	start_job_system(0);
+	load_scene(scene_name);
+	if (!get_display_backend()->paced) {
+		wait_for_meshes_loaded();
 	}
 }
 
@@ -221,101 +148,124 @@ void setup()
 //////////////////////////////////////////////////////////////////////////////////
 void process_input(void)
 {
-	SDL_Event event;
-	while (SDL_PollEvent(&event)) {
+	backend_event_t event;
+	while (platform_poll_event(&event)) {
 
 		switch (event.type){
-		case SDL_QUIT:
+		case EVENT_QUIT:
 			is_running = false;
 			break;
-		case SDL_KEYDOWN:
-			if (event.key.keysym.sym == SDLK_ESCAPE){
+		case EVENT_KEY_DOWN:
+			if (event.key == KEY_ESCAPE){
 				is_running = false;
 				break;
 			}
-			if (event.key.keysym.sym == SDLK_1){
+			if (event.key == KEY_1){
 				set_render_method(RENDER_WIRE_VERTEX);
 				break;
 			}
-			if (event.key.keysym.sym == SDLK_2){
+			if (event.key == KEY_2){
 				set_render_method(RENDER_WIRE);
 				break;
 			}
-			if (event.key.keysym.sym == SDLK_3){
+			if (event.key == KEY_3){
 				set_render_method(RENDER_FILL_TRIANGLE);
 			}
 			
-			if (event.key.keysym.sym == SDLK_4){
+			if (event.key == KEY_4){
 				set_render_method(RENDER_FILL_TRIANGLE_WIRE);
 				break;
 			}
-			if (event.key.keysym.sym == SDLK_5){
+			if (event.key == KEY_5){
 				set_render_method(RENDER_TEXTURED);
 				break;
 			}
 
-			if (event.key.keysym.sym == SDLK_6){
+			if (event.key == KEY_6){
 				set_render_method(RENDER_TEXTURED_WIRE);
 				break;
 			}
 
-			if (event.key.keysym.sym == SDLK_7){
+			if (event.key == KEY_7){
 				set_cull_method(CULL_BACKFACE);
 				break;
 			}
-			if (event.key.keysym.sym == SDLK_8){
+			if (event.key == KEY_8){
 				set_cull_method(CULL_NONE);
 				break;
 			}
 
-			if (event.key.keysym.sym == SDLK_9) {
+			if (event.key == KEY_9) {
 				set_render_method(RENDER_AABB_TRIANGLE);
 			}
 
 
-			if (event.key.keysym.sym == SDLK_0) {
+			if (event.key == KEY_0) {
 				set_render_method(RENDER_AABB_TEXTURED_TRIANGLE);
 			}
 
 
-			if (event.key.keysym.sym == SDLK_F11) {
+			//heatmap debug view, pressing again cycles overdraw, shading and tile cycles
+			if (event.key == KEY_F1) {
+				if (should_render_heatmap()) {
+					set_heatmap_view((get_heatmap_view() + 1) % NUM_HEATMAP_VIEWS);
+				}
+				set_render_method(RENDER_HEATMAP);
+				fprintf(stderr, "Heatmap: %s\n", get_heatmap_view_name(get_heatmap_view()));
+				break;
+			}
+			if (event.key == KEY_F4) {
+				set_depth_format((get_depth_format() + 1) % NUM_DEPTH_FORMATS);
+				fprintf(stderr, "Depth format: %s\n", get_depth_format_name(get_depth_format()));
+				break;
+			}
+			if (event.key == KEY_F5) {
+				set_shadows_enabled(!is_shadows_enabled());
+				break;
+			}
+			if (event.key == KEY_F6) {
+				set_shadow_pcf(!is_shadow_pcf_enabled());
+				break;
+			}
+
+			if (event.key == KEY_F11) {
 				set_camera_position_y(get_camera_position().y + 3.0 * delta_time);
 				break;		
 			}
-			if (event.key.keysym.sym == SDLK_F12) {
+			if (event.key == KEY_F12) {
 				set_camera_position_y(get_camera_position().y - 3.0 * delta_time);
 				break;
 			}
-			if (event.key.keysym.sym == SDLK_F7) {
+			if (event.key == KEY_F7) {
 				set_camera_position_x(get_camera_position().x + 3.0 * delta_time);
 				break;
 			}
-			if (event.key.keysym.sym == SDLK_F8) {
+			if (event.key == KEY_F8) {
 				set_camera_position_x(get_camera_position().x - 3.0 * delta_time);
 				break;
 			}
-			if (event.key.keysym.sym == SDLK_F9) {
+			if (event.key == KEY_F9) {
 				set_camera_pitch(get_camera_pitch() + 1.0 * delta_time);
 				break;
 			}
-			if (event.key.keysym.sym == SDLK_F10) {
+			if (event.key == KEY_F10) {
 				set_camera_pitch(get_camera_pitch() - 1.0 * delta_time);
 				break;
 			}
-			if (event.key.keysym.sym == SDLK_LEFT) {
+			if (event.key == KEY_LEFT) {
 				set_camera_yaw(get_camera_yaw() + 1.0 * delta_time);	
 				break;
 			}
-			if (event.key.keysym.sym == SDLK_RIGHT) {
+			if (event.key == KEY_RIGHT) {
 				set_camera_yaw(get_camera_yaw() - 1.0 * delta_time);
 				break;
 			}
-			if (event.key.keysym.sym == SDLK_UP) {
+			if (event.key == KEY_UP) {
 				set_camera_fwd_velocity (vect3_mul(get_camera_direction(), 3.0 * delta_time));
 				set_camera_position(vect3_add(get_camera_position(), get_camera_fwd_velocity()));
 				break;
 			}
-			if (event.key.keysym.sym == SDLK_DOWN) {
+			if (event.key == KEY_DOWN) {
 				set_camera_fwd_velocity(vect3_mul(get_camera_direction(), 3.0 * delta_time));
 				set_camera_position(vect3_sub(get_camera_position(), get_camera_fwd_velocity()));
 				break;
@@ -325,6 +275,13 @@ void process_input(void)
 	};
 }
 
+//////////////////////////////////////////////////////////////////////////////////
+// Only the textured PBR rasterizer samples the shadow map
+//////////////////////////////////////////////////////////////////////////////////
+bool should_render_shadows(void) {
+	return is_shadows_enabled() && should_render_aabb_texture_triangle();
+}
+
 //////////////////////////////////////////////////////////////////////////////////
 //  +--------------+
 //  |  Model space | <-- original mesh vertices
@@ -349,7 +306,78 @@ void process_input(void)
 //				            +--------------+				
 //////////////////////////////////////////////////////////////////////////////////
 
+//////////////////////////////////////////////////////////////////////////////////
+// Project a camera space point into screen space
+//////////////////////////////////////////////////////////////////////////////////
+vect4_t project_to_screen(vect4_t point){
+	//Project the current vertex using a perspective projection matrix
+	vect4_t projected_point = mat4_mul_vect4(proj_matrix, point);
+
+	//Perform perspective divide -> which means all vertices are now in NDC (normalized device coordinates)
+	if (projected_point.w != 0) {
+		projected_point.x /= projected_point.w;
+		projected_point.y /= projected_point.w;
+		projected_point.z /= projected_point.w;
+	}
+	//Invert the y value to account for flipped screen y coordinate
+	projected_point.y *= -1;
+
+	//Scale into the viewport -> all vertices are now in screen space
+	projected_point.x *= (get_window_width() / 2.0);
+	projected_point.y *= (get_window_height() / 2.0);
+
+	//Translate the projected points to the middle of the screen
+	projected_point.x += (get_window_width() / 2.0);
+	projected_point.y += (get_window_height() / 2.0);
+
+	return projected_point;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+// Queue the edges of the faces that survived culling, each edge only once
+//////////////////////////////////////////////////////////////////////////////////
+// Round a screen coordinate, clamped first so the conversion is defined and the
+// 64-bit viewport clip of draw_line can not overflow. NaN ends up at the low clamp.
+static int to_line_coordinate(float value) {
+	value = fmaxf(value, (float)(-INT_MAX / 2));
+	value = fminf(value, (float)(INT_MAX / 2));
+	return (int)lrintf(value);
+}
+
+void collect_visible_edges(mesh_t* mesh){
+	for (int i = 0; i < mesh->num_edges; i++) {
+		if (!mesh->visible_edges[i]) {
+			continue;
+		}
+		int a = mesh->edges[i].a;
+		int b = mesh->edges[i].b;
+		vect3_t point_a = vect3_new(view_vertices.x[a], view_vertices.y[a], view_vertices.z[a]);
+		vect3_t point_b = vect3_new(view_vertices.x[b], view_vertices.y[b], view_vertices.z[b]);
+
+		//Only the depth planes are clipped here, draw_line clips against the viewport
+		if (!clip_line_depth(&point_a, &point_b)) {
+			continue;
+		}
+
+		vect4_t projected_a = project_to_screen(vect4_from_vect3(point_a));
+		vect4_t projected_b = project_to_screen(vect4_from_vect3(point_b));
+
+		if (num_lines_to_render < MAX_LINES_PER_MESH) {
+			line_t line = {
+				to_line_coordinate(projected_a.x), to_line_coordinate(projected_a.y),
+				to_line_coordinate(projected_b.x), to_line_coordinate(projected_b.y),
+				1.0f / projected_a.w, 1.0f / projected_b.w
+			};
+			lines_to_render[num_lines_to_render] = line;
+			num_lines_to_render++;
+		}
+	}
+}
+
+
 void process_graphic_pipeline_stages(mesh_t* mesh){
+	//Stage timer for the benchmark, every stage_add() charges the time since the previous one
+	uint64_t stage_start = stage_clock();
 
 	//Create  scale, rotation and translation matrix that will be used to multiply the mesh vertices
 	mat4_t scale_matrix = mat4_make_scale(mesh->scale.x, mesh->scale.y, mesh->scale.z);
@@ -358,113 +386,79 @@ void process_graphic_pipeline_stages(mesh_t* mesh){
 	mat4_t rotation_matrix_z = mat4_make_rotation_z(mesh->rotation.z);
 	mat4_t translation_matrix = mat4_make_translation(mesh->translation.x,mesh->translation.y, mesh->translation.z);
 
-	//Update camera look at target to create view matrix
-	vect3_t target = get_camera_look_at_target();
-	vect3_t up_direction = { 0, 1, 0 };
-	view_matrix = mat4_look_at(get_camera_position(), target, up_direction);
+	//Create a world matrix combining scale, rotation and translation
+	world_matrix = mat4_identity();
+
+	//Multiply all matrices and load the world matrix
+	//*order matters: first scale, next rotate, then translate >>> [T]*[R]*[S]*v
+	world_matrix = mat4_mul_mat4(scale_matrix, world_matrix);
+	world_matrix = mat4_mul_mat4(rotation_matrix_z, world_matrix);
+	world_matrix = mat4_mul_mat4(rotation_matrix_y, world_matrix);
+	world_matrix = mat4_mul_mat4(rotation_matrix_x, world_matrix);
+	world_matrix = mat4_mul_mat4(translation_matrix, world_matrix);
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	///Calculate the normal matrix -> transpose of inverse of world matrix (model matrix) >>> [Tranpose]*[Inverse]*[World]
+	//This transformation ensures that the normals remain perpendicular to the surface after non-uniform scaling transformations.
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	normal_matrix = mat4_make_inverse(world_matrix);
+	normal_matrix = mat4_make_transpose(normal_matrix);
+
+	//Concatenate world and view so every vertex only needs one matrix multiplication to reach camera space
+	mat4_t world_view_matrix = mat4_mul_mat4(view_matrix, world_matrix);
+
+	//Normals, tangents and bitangents only use the 3x3 part of the normal and view matrices
+	mat4_t normal_view_matrix = mat4_mul_mat4(mat4_make_linear(view_matrix), mat4_make_linear(normal_matrix));
+
+	//Batch transform all vertex streams of the mesh to camera space (4 or 8 vertices per SIMD instruction)
+	mat4_mul_vect3_stream(world_view_matrix, &mesh->vertex_stream, &view_vertices);
+	mat4_mul_vect3_stream_no_translation(normal_view_matrix, &mesh->model_normal_stream, &view_normals);
+	mat4_mul_vect3_stream_no_translation(normal_view_matrix, &mesh->tangent_stream, &view_tangents);
+	mat4_mul_vect3_stream_no_translation(normal_view_matrix, &mesh->bitangent_stream, &view_bitangents);
+	stage_add(STAGE_TRANSFORM, &stage_start);
+
+	//Every mesh casts shadows, including the faces culled or clipped for the camera
+	if (should_render_shadows()) {
+		submit_shadow_casters(&view_vertices, mesh->faces, mesh->num_faces);
+	}
+	stage_add(STAGE_SHADE, &stage_start);
+
+	//Reset the edge flags, the face loop sets them again for the faces that survive culling
+	memset(mesh->visible_edges, 0, mesh->num_edges);
+
+	//Screen area of the emitted triangles, the texture streaming serves the largest meshes first
+	float screen_area = 0.0f;
 
 	//Loop all triangle faces of object mesh
+	STAT_ADD(faces_processed, mesh->num_faces);
 	for (int i = 0; i < mesh->num_faces; i++) {
 		face_t mesh_face = mesh->faces[i];
 
-		vect3_t face_vertices[3];
-		face_vertices[0] = mesh->vertices[mesh_face.a];
-		face_vertices[1] = mesh->vertices[mesh_face.b];
-		face_vertices[2] = mesh->vertices[mesh_face.c];
+		int vertex_indices[3] = { mesh_face.a, mesh_face.b, mesh_face.c };
 
 		vect4_t transformed_vertices[3];
-
-
-		///Process normals
-		vect3_t vertex_normals[3];
-
-		//Calculated vertex normal from face normal use vertex indices
-	/*	vertex_normals[0] = mesh->normals[mesh_face.a];
-		vertex_normals[1] = mesh->normals[mesh_face.b];
-		vertex_normals[2] = mesh->normals[mesh_face.c];*/
-
-		//Loaded model normal from obj file
-		vertex_normals[0] = mesh->model_normals[mesh_face.n0];
-		vertex_normals[1] = mesh->model_normals[mesh_face.n1];
-		vertex_normals[2] = mesh->model_normals[mesh_face.n2];
-
 		vect3_t transformed_vertex_normals[3];
-
-		///load vertex tangents 
-		vect3_t vertex_tangents[3];
-		vertex_tangents[0] = mesh->tangents[mesh_face.a];
-		vertex_tangents[1] = mesh->tangents[mesh_face.b];
-		vertex_tangents[2] = mesh->tangents[mesh_face.c];
-
 		vect3_t transformed_vertex_tangents[3];
-
-		///load vertex bitangents
-		vect3_t vertex_bitangents[3];
-		vertex_bitangents[0] = mesh->bitangents[mesh_face.a];
-		vertex_bitangents[1] = mesh->bitangents[mesh_face.b];
-		vertex_bitangents[2] = mesh->bitangents[mesh_face.c];
-
 		vect3_t transformed_vertex_bitangents[3];
 
-	
 		//initialize vertex colors
 		vect4_t vertex_colors[3];
 		vertex_colors[0] = vect4_new(0.0, 0.0, 0.0, 0.0);
 		vertex_colors[1] = vect4_new(0.0, 0.0, 0.0, 0.0);
 		vertex_colors[2] = vect4_new(0.0, 0.0, 0.0, 0.0);
 
-		//Loop through all three vertices of this current face and apply transformation
+		//Gather the already transformed position, normal, tangent and bitangent of the three face vertices,
+		//the faces are in vertex cache order so the gathers walk the streams mostly forward
 		for (int j = 0; j < 3; j++) {
+			int v = vertex_indices[j];
 
-			//load each vertex of triangle of position, normal, tangent and bitangent values
-			vect4_t transformed_vertex = vect4_from_vect3(face_vertices[j]);
-			vect3_t transformed_vertex_normal = vertex_normals[j];
-			vect3_t transformed_vertex_tangent = vertex_tangents[j];
-			vect3_t transformed_vertex_bitangent = vertex_bitangents[j];
-
-			//Create a world matrix combining scale, rotation and translation
-			world_matrix = mat4_identity();
-
-			//Multiply all matrices and load the world matrix
-			//*order matters: first scale, next rotate, then translate >>> [T]*[R]*[S]*v
-			world_matrix = mat4_mul_mat4(scale_matrix, world_matrix);
-			world_matrix = mat4_mul_mat4(rotation_matrix_z, world_matrix);
-			world_matrix = mat4_mul_mat4(rotation_matrix_y, world_matrix);
-			world_matrix = mat4_mul_mat4(rotation_matrix_x, world_matrix);
-			world_matrix = mat4_mul_mat4(translation_matrix, world_matrix);
-
-			////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-			///Calculate the normal matrix -> transpose of inverse of world matrix (model matrix) >>> [Tranpose]*[Inverse]*[World]
-			//This transformation ensures that the normals remain perpendicular to the surface after non-uniform scaling transformations.
-			////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-			normal_matrix = mat4_make_inverse(world_matrix);
-			normal_matrix = mat4_make_transpose(normal_matrix);
-			
-			//Multiply the world matrix with the original vertex vector
-			transformed_vertex = mat4_mul_vect4(world_matrix, transformed_vertex);
-			
-			//Multiply the view matrix with the world matrix transformed vector to transform the scene to camera space
-			transformed_vertex = mat4_mul_vect4(view_matrix, transformed_vertex);
-			
-
-			//Multiply the normal matrix with the original normal vector
-			transformed_vertex_normal = mat4_mul_vect3_no_translation(normal_matrix, transformed_vertex_normal);
-			transformed_vertex_tangent = mat4_mul_vect3_no_translation(normal_matrix,  transformed_vertex_tangent);
-			transformed_vertex_bitangent = mat4_mul_vect3_no_translation(normal_matrix, transformed_vertex_bitangent);
-
-			//Multiply the view matrix with the normal matrix transformed vector to transform the normals to camera space
-			transformed_vertex_normal = mat4_mul_vect3_no_translation(view_matrix, transformed_vertex_normal);
-			transformed_vertex_tangent = mat4_mul_vect3_no_translation(view_matrix, transformed_vertex_tangent);
-			transformed_vertex_bitangent = mat4_mul_vect3_no_translation(view_matrix, transformed_vertex_bitangent);
-
-			//Save transformed vertex in the array of transformed vertices
-			transformed_vertices[j] = transformed_vertex;
+			transformed_vertices[j] = vect4_new(view_vertices.x[v], view_vertices.y[v], view_vertices.z[v], view_vertices.w[v]);
 
-			//Save transformed vertex normal in the array of transfored normals
-			transformed_vertex_normals[j] = transformed_vertex_normal;
+			//Loaded model normal from obj file
+			transformed_vertex_normals[j] = vect3_new(view_normals.x[v], view_normals.y[v], view_normals.z[v]);
 
-			transformed_vertex_tangents[j] = transformed_vertex_tangent;
-			transformed_vertex_bitangents[j] = transformed_vertex_bitangent;
+			transformed_vertex_tangents[j] = vect3_new(view_tangents.x[v], view_tangents.y[v], view_tangents.z[v]);
+			transformed_vertex_bitangents[j] = vect3_new(view_bitangents.x[v], view_bitangents.y[v], view_bitangents.z[v]);
 		}
 
 		//Calculate the triangle normal
@@ -481,18 +475,21 @@ void process_graphic_pipeline_stages(mesh_t* mesh){
 		if (is_cull_backface()) {
 			//Bypassing the triangles that looking away from the camera
 			if (dot_normal_cam < 0) {
+				STAT_ADD(faces_culled, 1);
+				stage_add(STAGE_CULL, &stage_start);
 				continue;
 			}
 		}
+		stage_add(STAGE_CULL, &stage_start);
 
 		//Create a polygon from the original transformed triangle to be clipped
 		polygon_t polygon = polygon_from_triangle(
 			vect3_from_vect4(transformed_vertices[0]),
 			vect3_from_vect4(transformed_vertices[1]),
 			vect3_from_vect4(transformed_vertices[2]),
-			mesh_face.a_uv,
-			mesh_face.b_uv,
-			mesh_face.c_uv,
+			mesh->texcoords[mesh_face.a],
+			mesh->texcoords[mesh_face.b],
+			mesh->texcoords[mesh_face.c],
 			transformed_vertex_normals[0],
 			transformed_vertex_normals[1],
 			transformed_vertex_normals[2]
@@ -507,6 +504,14 @@ void process_graphic_pipeline_stages(mesh_t* mesh){
 
 		triangles_from_polygon(&polygon, triangles_after_clipping, &num_triangles_after_clipping);
 
+		//The face is at least partly visible, flag its three edges for the wireframe
+		if (num_triangles_after_clipping > 0) {
+			mesh->visible_edges[mesh->face_edges[i * 3 + 0]] = 1;
+			mesh->visible_edges[mesh->face_edges[i * 3 + 1]] = 1;
+			mesh->visible_edges[mesh->face_edges[i * 3 + 2]] = 1;
+		}
+		stage_add(STAGE_CLIP, &stage_start);
+
 		//Loops all the assembled triangles after clipping
 		for (int t = 0; t < num_triangles_after_clipping; t++) {
 
@@ -515,26 +520,9 @@ void process_graphic_pipeline_stages(mesh_t* mesh){
 
 			//Loop through all three vertices of this current face and apply projection
 			for (int j = 0; j < 3; j++) {
-				//Project the current vertex using a perspective projection matrix
-				projected_points[j] = mat4_mul_vect4(proj_matrix, triangle_after_clipping.points[j]);
-
-				//Perform perspective divide -> which means all vertices are now in NDC (normalized device coordinates)
-				if (projected_points[j].w != 0) {
-					projected_points[j].x /= projected_points[j].w;
-					projected_points[j].y /= projected_points[j].w;
-					projected_points[j].z /= projected_points[j].w;
-				}
-				//Invert the y value to account for flipped screen y coordinate
-				projected_points[j].y *= -1;
-
-				//Scale into the viewport -> all vertices are now in screen space
-				projected_points[j].x *= (get_window_width() / 2.0);
-				projected_points[j].y *= (get_window_height() / 2.0);
-
-				//Translate the projected points to the middle of the screen
-				projected_points[j].x += (get_window_width() / 2.0);
-				projected_points[j].y += (get_window_height() / 2.0);
+				projected_points[j] = project_to_screen(triangle_after_clipping.points[j]);
 			}
+			stage_add(STAGE_TRANSFORM, &stage_start);
 		
 			//Calculate how align the light direction is with the face normal (using dot product) -> shade frequency (flat shading)
 			vect3_t light_direction = get_light_direction();
@@ -614,6 +602,8 @@ void process_graphic_pipeline_stages(mesh_t* mesh){
 			//uint32_t triangle_color = pack_color(unpacked_color.x, unpacked_color.y, unpacked_color.z, 1.0); //Assuming full opacity
 
 
+			stage_add(STAGE_SHADE, &stage_start);
+
 			//Save the projected 2d vertex in the array of projected triangle points
 			triangle_t triangle_to_render = {
 				.points = {
@@ -664,36 +654,54 @@ void process_graphic_pipeline_stages(mesh_t* mesh){
 			if (num_triangles_to_render < MAX_TRIANGLES_PER_MESH) {
 				triangles_to_render[num_triangles_to_render] = triangle_to_render;
 				num_triangles_to_render++;
+				STAT_ADD(triangles_emitted, 1);
+				screen_area += fabsf((projected_points[1].x - projected_points[0].x) * (projected_points[2].y - projected_points[0].y) -
+					(projected_points[2].x - projected_points[0].x) * (projected_points[1].y - projected_points[0].y)) * 0.5f;
 			}
+			stage_add(STAGE_CLIP, &stage_start);
 		}
 	}
+	prioritize_mesh_textures(mesh, screen_area);
+
+	//Every visible edge becomes one line, shared edges are no longer drawn twice
+	if (should_render_wireframe()) {
+		collect_visible_edges(mesh);
+		stage_add(STAGE_CLIP, &stage_start);
+	}
 }
 
 //////////////////////////////////////////////////////////////////////////////////
 // Call update function every frame
 //////////////////////////////////////////////////////////////////////////////////
 void update(void){
-	
-	//Wait some time until reaching the target frame time in miliseconds
-	int time_to_wait = FRAME_TARGET_TIME - (SDL_GetTicks() - previous_frame_time);
-
-	//Only delay excution if running too fast
-	if (time_to_wait > 0 && time_to_wait <= FRAME_TARGET_TIME ){
-		SDL_Delay(time_to_wait);
-	}
-
-	//Get a delta time factor converted to seconds to be used to update our game object
-	delta_time = (SDL_GetTicks() - previous_frame_time) / 1000.0; //-> 1/framerate
-	
-	previous_frame_time = SDL_GetTicks();
 
 	//Initialize the counter of triangles to render for the current frame
 	num_triangles_to_render = 0;
+	num_lines_to_render = 0;
+
+	//Update camera look at target to create view matrix
+	vect3_t target = get_camera_look_at_target();
+	vect3_t up_direction = { 0, 1, 0 };
+	view_matrix = mat4_look_at(get_camera_position(), target, up_direction);
+
+	uint64_t stage_start = stage_clock();
+
+	//Assign the point and spot lights to the screen tiles they can reach
+	cull_lights_to_tiles(view_matrix, proj_matrix, get_window_width(), get_window_height());
+
+	//Start collecting the shadow casters seen from the directional light
+	begin_shadow_pass(get_light_direction());
+	stage_add(STAGE_SHADE, &stage_start);
 
 	//Loop all the meshes in the scene
 	for (int  mesh_index = 0; mesh_index < get_num_meshes(); mesh_index++){
 		mesh_t* mesh = get_mesh(mesh_index);
 
+		//Meshes still loading on the job threads are skipped
+		if (!is_mesh_loaded(mesh)) {
+			continue;
+		}
+
 		//Change the mesh scale/rotation values per second
 		//mesh->rotation.x += 0.5 * delta_time;
 		//mesh->rotation.y += 0.3 * delta_time;
@@ -712,16 +720,24 @@ void update(void){
 // Render function to draw objects on the display
 //////////////////////////////////////////////////////////////////////////////////
 void render(void){
+	uint64_t stage_start = stage_clock();
 
 	//Clear all the arrays to get ready for the next frame
 	clear_color_buffer(0x01010101);
 	clear_z_buffer();
+	clear_heatmap();
+	flush_texture_block_cache();
 
 	draw_grid();
 
+	//Depth-only pass from the light view, sampled later by the textured rasterizer
+	if (should_render_shadows()) {
+		render_shadow_map();
+	}
+
 	//Loop all projected triangles and render them
-	for (int i = 0; i < num_triangles_to_render; i++){
-		triangle_t triangle = triangles_to_render[i];
+	for (int i = 0; i < num_triangles_to_draw; i++){
+		triangle_t triangle = triangles_to_draw[i];
 
 		//draw filled triangle
 		if (should_render_fill_triangle()){
@@ -782,16 +798,6 @@ void render(void){
 			);
 		}
 
-		//draw triangle wireframe
-		if (should_render_wireframe()){
-			draw_triangle(
-				triangle.points[0].x, triangle.points[0].y, //VERTEX A
-				triangle.points[1].x, triangle.points[1].y, //VERTEX B
-				triangle.points[2].x, triangle.points[2].y, //VERTEX C
-				0xFFFFFFFF
-			);
-		}
-		
 		//draw vertex of triangle
 		if (should_render_wire_vertex()){
 			draw_rect(triangle.points[0].x - 3, triangle.points[0].y - 3, 6, 6, 0xFF0000FF); //draw vertex a
@@ -800,15 +806,66 @@ void render(void){
 		}	
 	}
 
-	//finally draw the color buffer to the SDL window
+	//draw the wireframe from the unique edges of all meshes, hidden behind the
+	//filled faces. Without a fill pass the z-buffer is clear and every edge shows.
+	if (should_render_wireframe()){
+		for (int i = 0; i < num_lines_to_draw; i++) {
+			draw_line_depth_tested(lines_to_draw[i], 0xFFFFFFFF);
+		}
+	}
+
+	//replace the shaded frame by the overdraw or shading cost view
+	if (should_render_heatmap()) {
+		draw_heatmap();
+	}
+	stage_add(STAGE_RASTER, &stage_start);
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+// Present the last swapped color buffer through the display backend, on the
+// present thread or, for backends bound to the main thread, inline
+//////////////////////////////////////////////////////////////////////////////////
+void present(void){
+	uint64_t stage_start = stage_clock();
 	render_color_buffer();
+	stage_add(STAGE_PRESENT, &stage_start);
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+// Hand the geometry of the frame to the raster stage, only while it is idle
+//////////////////////////////////////////////////////////////////////////////////
+void publish_frame(void){
+	triangle_t* triangles = triangles_to_draw;
+	triangles_to_draw = triangles_to_render;
+	num_triangles_to_draw = num_triangles_to_render;
+	triangles_to_render = triangles;
+
+	line_t* lines = lines_to_draw;
+	lines_to_draw = lines_to_render;
+	num_lines_to_draw = num_lines_to_render;
+	lines_to_render = lines;
+
+	publish_light_tiles();
+	publish_shadow_casters();
+
+	//finer texture levels that finished streaming are sampled from the next frame on
+	publish_texture_levels();
 }
 
 //////////////////////////////////////////////////////////////////////////////////
 // Free the memory that was dynamically allocated by the program
 //////////////////////////////////////////////////////////////////////////////////
 void free_resource(void){
+	vect4_stream_free(&view_vertices);
+	vect3_stream_free(&view_normals);
+	vect3_stream_free(&view_tangents);
+	vect3_stream_free(&view_bitangents);
+	free_shadow_map();
+	free_heatmap();
 	free_meshes();
+	stop_job_system();
+	free_texture_streaming();
+	free_texture_cache();
 	destroy_window();
 }
 
@@ -816,14 +873,166 @@ void free_resource(void){
 // Main funtion of this tiny software rasterazation renderer
 //////////////////////////////////////////////////////////////////////////////////
 
+//////////////////////////////////////////////////////////////////////////////////
+// Deterministic benchmark: every scene plays the scripted camera path for the
+// same number of fixed timestep frames and the per stage times are reported
+//////////////////////////////////////////////////////////////////////////////////
+void run_benchmark(const char* benchmark_scene, int frames, const char* report_path){
+	bool all_scenes = strcmp(benchmark_scene, "all") == 0;
+	int num_scenes = all_scenes ? get_num_scenes() : 1;
+
+	scene_name = all_scenes ? get_scene_name(0) : benchmark_scene;
+	setup();
+	wait_for_meshes_loaded();
+
+	//Textured PBR mode unless the scripted keys pick another one
+	set_render_method(RENDER_AABB_TEXTURED_TRIANGLE);
+	process_input();
+
+	begin_benchmark();
+	for (int scene_index = 0; scene_index < num_scenes && is_running; scene_index++) {
+		if (scene_index > 0) {
+			free_meshes();
+			scene_name = get_scene_name(scene_index);
+			load_scene(scene_name);
+			wait_for_meshes_loaded();
+		}
+
+		begin_benchmark_scene(scene_name);
+		for (int frame = 0; frame < frames; frame++) {
+			begin_benchmark_frame();
+			apply_benchmark_path(frame);
+
+			//fixed timestep and the stages run back to back, so the stage timers see one frame at a time
+			delta_time = BENCHMARK_TIMESTEP;
+			reset_pipeline_stats();
+			update();
+			publish_frame();
+			render();
+			swap_color_buffers();
+			present();
+			end_benchmark_frame();
+		}
+		end_benchmark_scene();
+	}
+	write_benchmark_report(report_path);
+	end_benchmark();
+}
+
 int main(int argc, char* args[]){	
+	bool depth_benchmark = false;
+	const char* benchmark_scene = NULL;
+	const char* report_path = NULL;
+	int frames = 0;
+
+	//Command line options, the offscreen ones also apply to the headless build
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(args[i], "--depth-benchmark") == 0) {
+			depth_benchmark = true;
+		}
+		else if (strcmp(args[i], "--headless") == 0) {
+			set_display_backend("offscreen");
+		}
+		else if (strcmp(args[i], "--size") == 0 && i + 1 < argc) {
+			int width = 0, height = 0;
+			if (sscanf(args[++i], "%dx%d", &width, &height) == 2) {
+				set_offscreen_resolution(width, height);
+			}
+		}
+		else if (strcmp(args[i], "--frames") == 0 && i + 1 < argc) {
+			frames = atoi(args[++i]);
+			set_offscreen_frame_count(frames);
+		}
+		else if (strcmp(args[i], "--output") == 0 && i + 1 < argc) {
+			set_offscreen_output(args[++i]);
+		}
+		else if (strcmp(args[i], "--keys") == 0 && i + 1 < argc) {
+			set_offscreen_keys(args[++i]);
+		}
+		else if (strcmp(args[i], "--scene") == 0 && i + 1 < argc) {
+			scene_name = args[++i];
+		}
+		else if (strcmp(args[i], "--benchmark") == 0 && i + 1 < argc) {
+			benchmark_scene = args[++i];
+		}
+		else if (strcmp(args[i], "--report") == 0 && i + 1 < argc) {
+			report_path = args[++i];
+		}
+		else if (strcmp(args[i], "--no-mesh-cache") == 0) {
+			set_mesh_cache_enabled(false);
+		}
+		else if (strcmp(args[i], "--no-texture-compression") == 0) {
+			set_texture_compression_enabled(false);
+		}
+		else if (strcmp(args[i], "--no-texture-cache") == 0) {
+			set_texture_file_enabled(false);
+		}
+		else {
+			fprintf(stderr, "Unknown option %s\n", args[i]);
+			fprintf(stderr, "Usage: renderer [--headless] [--size WxH] [--frames N] [--output frame_%%04d.png] [--keys 0,F5] [--scene name]\n"
+				"       [--benchmark name|all] [--report results.csv|results.json] [--depth-benchmark] [--no-mesh-cache]\n"
+				"       [--no-texture-compression] [--no-texture-cache]\n");
+			return 1;
+		}
+	}
+
 	is_running = initialize_window();
+
+	//Compare the depth buffer formats and quit
+	if (is_running && depth_benchmark) {
+		depth_format_timing_t timings[NUM_DEPTH_FORMATS];
+		benchmark_depth_formats(BENCHMARK_DEPTH_PASSES, timings);
+		printf("depth format     bytes/px   ns/px   GB/s\n");
+		for (int format = 0; format < NUM_DEPTH_FORMATS; format++) {
+			printf("%-16s %8d %7.2f %6.2f\n", get_depth_format_name(format), get_depth_format_bytes(format),
+				timings[format].ns_per_pixel, timings[format].gigabytes_per_second);
+		}
+		destroy_window();
+		return 0;
+	}
+
+	//Play the scripted benchmark path, --frames counts the frames of every scene
+	if (is_running && benchmark_scene != NULL) {
+		run_benchmark(benchmark_scene, frames > 0 ? frames : BENCHMARK_DEFAULT_FRAMES, report_path);
+		free_resource();
+		return 0;
+	}
+
 	setup();
+
+	//Frame pipeline: the raster thread draws frame N into one color buffer while frame N-1 is
+	//presented from the other and this thread runs the geometry of frame N+1. Without the
+	//threads the kicks run inline and the loop runs serially.
+	frame_pacer_t frame_pacer;
+	init_frame_pacer(&frame_pacer, FPS);
+	start_raster_thread(render);
+	start_present_thread(present, get_display_backend()->threaded_present);
+
+	bool frame_ready = false;
+	process_input();
+	update();
 	while(is_running){
-		process_input();
+		publish_frame();
+
+		//the counters of one iteration cover the raster of frame N and the geometry of frame N+1
+		reset_pipeline_stats();
+		kick_raster_stage();
+		if (frame_ready) {
+			kick_present_stage();
+		}
 		update();
-		render();
+		wait_raster_stage();
+
+		//one finished frame at most waits for the display, so the latency stays at one frame
+		wait_present_stage();
+		swap_color_buffers();
+		frame_ready = true;
+
+		delta_time = pace_frame(&frame_pacer);
+		process_input();
 	}
+	stop_present_thread();
+	stop_raster_thread();
 	free_resource();
 	return 0;
-}
\ No newline at end of file
+}
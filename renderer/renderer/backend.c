@@ -0,0 +1,102 @@
+#include <string.h>
+#include "backend.h"
+
+#ifndef RENDERER_HEADLESS
+static const display_backend_t* backend = &sdl_backend;
+#else
+static const display_backend_t* backend = &offscreen_backend;
+#endif
+
+static const display_backend_t* backends[] = {
+#ifndef RENDERER_HEADLESS
+	&sdl_backend,
+#endif
+	&offscreen_backend
+};
+
+bool set_display_backend(const char* name) {
+	for (int i = 0; i < (int)(sizeof(backends) / sizeof(backends[0])); i++) {
+		if (strcmp(backends[i]->name, name) == 0) {
+			backend = backends[i];
+			return true;
+		}
+	}
+	return false;
+}
+
+const display_backend_t* get_display_backend(void) {
+	return backend;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Timer and input of the active backend
+///////////////////////////////////////////////////////////////////////////////
+uint32_t platform_get_ticks(void) {
+	return (uint32_t)(backend->get_time_ns() / 1000000);
+}
+
+double platform_get_seconds(void) {
+	return backend->get_time_ns() / 1e9;
+}
+
+void platform_delay(uint32_t milliseconds) {
+	backend->delay(milliseconds);
+}
+
+bool platform_poll_event(backend_event_t* event) {
+	return backend->poll_event(event);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Frame pacer with nanosecond deadlines instead of whole millisecond delays
+///////////////////////////////////////////////////////////////////////////////
+#define PACER_SPIN_NS 2000000	// the OS sleep can overshoot, the last 2 ms are spun
+
+void init_frame_pacer(frame_pacer_t* pacer, int frames_per_second) {
+	pacer->frame_ns = 1000000000ull / frames_per_second;
+	pacer->previous_ns = backend->get_time_ns();
+	pacer->deadline_ns = pacer->previous_ns + pacer->frame_ns;
+}
+
+float pace_frame(frame_pacer_t* pacer) {
+	uint64_t now = backend->get_time_ns();
+
+	if (backend->paced && now < pacer->deadline_ns) {
+		uint64_t remaining = pacer->deadline_ns - now;
+		if (remaining > PACER_SPIN_NS) {
+			backend->delay((uint32_t)((remaining - PACER_SPIN_NS) / 1000000));
+		}
+		while ((now = backend->get_time_ns()) < pacer->deadline_ns) {
+		}
+		pacer->deadline_ns += pacer->frame_ns;
+	}
+	else {
+		//over budget (or not paced): no sleep and no catching up on the missed deadlines
+		pacer->deadline_ns = now + pacer->frame_ns;
+	}
+
+	float seconds = (now - pacer->previous_ns) / 1e9f;
+	pacer->previous_ns = now;
+	return seconds;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Key names used on the command line, e.g. "5", "F5", "LEFT"
+///////////////////////////////////////////////////////////////////////////////
+static const char* key_names[NUM_KEYS] = {
+	"UNKNOWN",
+	"ESCAPE",
+	"0", "1", "2", "3", "4", "5", "6", "7", "8", "9",
+	"F1", "F2", "F3", "F4", "F5", "F6",
+	"F7", "F8", "F9", "F10", "F11", "F12",
+	"LEFT", "RIGHT", "UP", "DOWN"
+};
+
+int get_key_from_name(const char* name) {
+	for (int key = 0; key < NUM_KEYS; key++) {
+		if (strcmp(key_names[key], name) == 0) {
+			return key;
+		}
+	}
+	return KEY_UNKNOWN;
+}
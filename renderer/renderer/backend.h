@@ -0,0 +1,83 @@
+#ifndef BACKEND_H
+#define BACKEND_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Display backends: the render core draws into its own color buffer and only
+// talks to the window system, the timer and the input through this interface.
+// Building with RENDERER_HEADLESS leaves the SDL backend out completely.
+///////////////////////////////////////////////////////////////////////////////
+
+// Platform independent key codes, every backend translates its own key events
+enum backend_key
+{
+	KEY_UNKNOWN,
+	KEY_ESCAPE,
+	KEY_0, KEY_1, KEY_2, KEY_3, KEY_4, KEY_5, KEY_6, KEY_7, KEY_8, KEY_9,
+	KEY_F1, KEY_F2, KEY_F3, KEY_F4, KEY_F5, KEY_F6,
+	KEY_F7, KEY_F8, KEY_F9, KEY_F10, KEY_F11, KEY_F12,
+	KEY_LEFT, KEY_RIGHT, KEY_UP, KEY_DOWN,
+	NUM_KEYS
+};
+
+enum backend_event_type
+{
+	EVENT_NONE,
+	EVENT_QUIT,
+	EVENT_KEY_DOWN
+};
+
+typedef struct {
+	int type;
+	int key;
+} backend_event_t;
+
+typedef struct {
+	const char* name;
+	bool (*initialize)(int* width, int* height);		// picks the frame size
+	bool (*lock_frame)(uint32_t** pixels, int* pitch);	// pitch in pixels
+	void (*unlock_frame)(void);							// shows or stores the locked frame
+	bool (*poll_event)(backend_event_t* event);
+	uint64_t (*get_time_ns)(void);
+	void (*delay)(uint32_t milliseconds);
+	void (*destroy)(void);
+	bool paced;											// frames are shown on a display and paced to FPS
+	bool threaded_present;								// lock_frame and unlock_frame may run on a worker thread
+} display_backend_t;
+
+// Frame pacer: coarse sleep plus a short spin up to the next frame deadline,
+// a frame that is already over budget starts the next one without waiting
+typedef struct {
+	uint64_t frame_ns;
+	uint64_t deadline_ns;
+	uint64_t previous_ns;
+} frame_pacer_t;
+
+#ifndef RENDERER_HEADLESS
+extern const display_backend_t sdl_backend;
+#endif
+extern const display_backend_t offscreen_backend;
+
+bool set_display_backend(const char* name);
+const display_backend_t* get_display_backend(void);
+
+// Offscreen backend settings, applied by its initialize
+void set_offscreen_resolution(int width, int height);
+void set_offscreen_output(const char* path_pattern);	// printf pattern taking the frame number, .ppm or .png
+void set_offscreen_frame_count(int frames);				// a quit event follows the last frame
+void set_offscreen_keys(const char* key_names);			// comma separated, sent before the first frame
+
+// Timer and input of the active backend
+uint32_t platform_get_ticks(void);
+double platform_get_seconds(void);
+void platform_delay(uint32_t milliseconds);
+bool platform_poll_event(backend_event_t* event);
+
+void init_frame_pacer(frame_pacer_t* pacer, int frames_per_second);
+float pace_frame(frame_pacer_t* pacer);		// returns the seconds since the previous frame
+
+int get_key_from_name(const char* name);
+
+#endif
@@ -0,0 +1,310 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "backend.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// Offscreen backend: frames go to plain memory and, when an output path is
+// set, to PPM or PNG files. No window system is needed at all.
+///////////////////////////////////////////////////////////////////////////////
+#define DEFAULT_OFFSCREEN_WIDTH 800
+#define DEFAULT_OFFSCREEN_HEIGHT 600
+#define MAX_OFFSCREEN_KEYS 32
+
+static int offscreen_width = DEFAULT_OFFSCREEN_WIDTH;
+static int offscreen_height = DEFAULT_OFFSCREEN_HEIGHT;
+static uint32_t* frame = NULL;
+static char output_pattern[512] = "";
+static int frame_count = 1;
+static int frames_presented = 0;
+static bool quit_sent = false;
+
+static int pending_keys[MAX_OFFSCREEN_KEYS];
+static int num_pending_keys = 0;
+static int next_pending_key = 0;
+
+void set_offscreen_resolution(int width, int height) {
+	if (width > 0 && height > 0) {
+		offscreen_width = width;
+		offscreen_height = height;
+	}
+}
+
+void set_offscreen_output(const char* path_pattern) {
+	snprintf(output_pattern, sizeof(output_pattern), "%s", path_pattern);
+}
+
+void set_offscreen_frame_count(int frames) {
+	frame_count = frames;
+}
+
+void set_offscreen_keys(const char* key_names) {
+	char name[16];
+	int length = 0;
+	num_pending_keys = 0;
+	next_pending_key = 0;
+
+	for (const char* c = key_names; ; c++) {
+		if (*c == ',' || *c == '\0') {
+			name[length] = '\0';
+			int key = get_key_from_name(name);
+			if (key == KEY_UNKNOWN) {
+				fprintf(stderr, "Unknown key name '%s'. \n", name);
+			}
+			else if (num_pending_keys < MAX_OFFSCREEN_KEYS) {
+				pending_keys[num_pending_keys++] = key;
+			}
+			length = 0;
+			if (*c == '\0') {
+				break;
+			}
+		}
+		else if (length < (int)sizeof(name) - 1) {
+			name[length++] = *c;
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Image writers, the color buffer holds 0xAARRGGBB pixels
+///////////////////////////////////////////////////////////////////////////////
+static bool write_ppm(const char* path, const uint32_t* pixels, int width, int height) {
+	FILE* file = fopen(path, "wb");
+	if (file == NULL) {
+		return false;
+	}
+	fprintf(file, "P6\n%d %d\n255\n", width, height);
+
+	unsigned char* row = (unsigned char*)malloc((size_t)width * 3);
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			uint32_t pixel = pixels[(size_t)width * y + x];
+			row[x * 3 + 0] = (unsigned char)(pixel >> 16);
+			row[x * 3 + 1] = (unsigned char)(pixel >> 8);
+			row[x * 3 + 2] = (unsigned char)pixel;
+		}
+		fwrite(row, 1, (size_t)width * 3, file);
+	}
+	free(row);
+	fclose(file);
+	return true;
+}
+
+static uint32_t crc_table[256];
+
+static uint32_t png_crc(uint32_t crc, const unsigned char* data, size_t length) {
+	if (crc_table[1] == 0) {
+		for (uint32_t n = 0; n < 256; n++) {
+			uint32_t c = n;
+			for (int k = 0; k < 8; k++) {
+				c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			}
+			crc_table[n] = c;
+		}
+	}
+	for (size_t i = 0; i < length; i++) {
+		crc = crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	}
+	return crc;
+}
+
+static void put_u32_be(unsigned char* destination, uint32_t value) {
+	destination[0] = (unsigned char)(value >> 24);
+	destination[1] = (unsigned char)(value >> 16);
+	destination[2] = (unsigned char)(value >> 8);
+	destination[3] = (unsigned char)value;
+}
+
+static void write_png_chunk(FILE* file, const char* type, const unsigned char* data, uint32_t length) {
+	unsigned char header[8];
+	put_u32_be(header, length);
+	memcpy(header + 4, type, 4);
+	fwrite(header, 1, 8, file);
+	if (length > 0) {
+		fwrite(data, 1, length, file);
+	}
+
+	unsigned char crc[4];
+	uint32_t value = png_crc(0xFFFFFFFFu, (const unsigned char*)type, 4);
+	value = png_crc(value, data, length) ^ 0xFFFFFFFFu;
+	put_u32_be(crc, value);
+	fwrite(crc, 1, 4, file);
+}
+
+// RGB PNG with stored (uncompressed) deflate blocks, so no zlib is needed
+static bool write_png(const char* path, const uint32_t* pixels, int width, int height) {
+	FILE* file = fopen(path, "wb");
+	if (file == NULL) {
+		return false;
+	}
+
+	//raw scanlines, each one starts with filter type 0
+	size_t row_size = (size_t)width * 3 + 1;
+	size_t raw_size = row_size * height;
+	unsigned char* raw = (unsigned char*)malloc(raw_size);
+	for (int y = 0; y < height; y++) {
+		unsigned char* row = raw + row_size * y;
+		row[0] = 0;
+		for (int x = 0; x < width; x++) {
+			uint32_t pixel = pixels[(size_t)width * y + x];
+			row[1 + x * 3 + 0] = (unsigned char)(pixel >> 16);
+			row[1 + x * 3 + 1] = (unsigned char)(pixel >> 8);
+			row[1 + x * 3 + 2] = (unsigned char)pixel;
+		}
+	}
+
+	//zlib stream: header, stored blocks of at most 65535 bytes, adler32
+	size_t num_blocks = raw_size / 65535 + 1;
+	size_t zlib_size = 2 + num_blocks * 5 + raw_size + 4;
+	unsigned char* zlib = (unsigned char*)malloc(zlib_size);
+	unsigned char* out = zlib;
+	*out++ = 0x78;
+	*out++ = 0x01;
+
+	uint32_t adler_a = 1, adler_b = 0;
+	size_t offset = 0;
+	for (size_t block = 0; block < num_blocks; block++) {
+		size_t length = raw_size - offset < 65535 ? raw_size - offset : 65535;
+		*out++ = (block == num_blocks - 1) ? 1 : 0;
+		*out++ = (unsigned char)length;
+		*out++ = (unsigned char)(length >> 8);
+		*out++ = (unsigned char)~length;
+		*out++ = (unsigned char)(~length >> 8);
+		memcpy(out, raw + offset, length);
+		out += length;
+
+		for (size_t i = 0; i < length; i++) {
+			adler_a = (adler_a + raw[offset + i]) % 65521;
+			adler_b = (adler_b + adler_a) % 65521;
+		}
+		offset += length;
+	}
+	put_u32_be(out, (adler_b << 16) | adler_a);
+	out += 4;
+
+	static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	fwrite(signature, 1, 8, file);
+
+	unsigned char ihdr[13];
+	put_u32_be(ihdr, (uint32_t)width);
+	put_u32_be(ihdr + 4, (uint32_t)height);
+	ihdr[8] = 8;	// bit depth
+	ihdr[9] = 2;	// color type RGB
+	ihdr[10] = 0;	// compression
+	ihdr[11] = 0;	// filter
+	ihdr[12] = 0;	// no interlace
+	write_png_chunk(file, "IHDR", ihdr, 13);
+	write_png_chunk(file, "IDAT", zlib, (uint32_t)(out - zlib));
+	write_png_chunk(file, "IEND", NULL, 0);
+
+	free(zlib);
+	free(raw);
+	fclose(file);
+	return true;
+}
+
+static void write_frame(const uint32_t* pixels, int frame_number) {
+	char path[600];
+	snprintf(path, sizeof(path), output_pattern, frame_number);
+
+	size_t length = strlen(path);
+	bool is_png = length >= 4 && strcmp(path + length - 4, ".png") == 0;
+	bool written = is_png ?
+		write_png(path, pixels, offscreen_width, offscreen_height) :
+		write_ppm(path, pixels, offscreen_width, offscreen_height);
+
+	if (!written) {
+		fprintf(stderr, "Error writing frame to %s. \n", path);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Backend functions
+///////////////////////////////////////////////////////////////////////////////
+static bool offscreen_initialize(int* width, int* height) {
+	frame = (uint32_t*)malloc(sizeof(uint32_t) * offscreen_width * offscreen_height);
+	if (frame == NULL) {
+		fprintf(stderr, "Error allocating the offscreen frame. \n");
+		return false;
+	}
+	frames_presented = 0;
+	quit_sent = false;
+	*width = offscreen_width;
+	*height = offscreen_height;
+	return true;
+}
+
+static bool offscreen_lock_frame(uint32_t** pixels, int* pitch) {
+	*pixels = frame;
+	*pitch = offscreen_width;
+	return true;
+}
+
+static void offscreen_unlock_frame(void) {
+	//the main loop finishes the frame it is in when the quit event arrives
+	bool requested = frame_count <= 0 || frames_presented < frame_count;
+	if (requested && output_pattern[0] != '\0') {
+		write_frame(frame, frames_presented);
+	}
+	frames_presented++;
+}
+
+// Scripted keys come first, a quit event follows once all frames are presented
+static bool offscreen_poll_event(backend_event_t* event) {
+	if (next_pending_key < num_pending_keys) {
+		event->type = EVENT_KEY_DOWN;
+		event->key = pending_keys[next_pending_key++];
+		return true;
+	}
+	if (frame_count > 0 && frames_presented >= frame_count && !quit_sent) {
+		quit_sent = true;
+		event->type = EVENT_QUIT;
+		event->key = KEY_UNKNOWN;
+		return true;
+	}
+	return false;
+}
+
+static uint64_t offscreen_get_time_ns(void) {
+#if defined(_WIN32)
+	LARGE_INTEGER counter, frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000000ull +
+		(uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000000ull / (uint64_t)frequency.QuadPart;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+#endif
+}
+
+// Nothing is shown on screen, so frames are not paced
+static void offscreen_delay(uint32_t milliseconds) {
+	(void)milliseconds;
+}
+
+static void offscreen_destroy(void) {
+	free(frame);
+	frame = NULL;
+}
+
+const display_backend_t offscreen_backend = {
+	.name = "offscreen",
+	.initialize = offscreen_initialize,
+	.lock_frame = offscreen_lock_frame,
+	.unlock_frame = offscreen_unlock_frame,
+	.poll_event = offscreen_poll_event,
+	.get_time_ns = offscreen_get_time_ns,
+	.delay = offscreen_delay,
+	.destroy = offscreen_destroy,
+	.paced = false,
+	.threaded_present = true,
+};
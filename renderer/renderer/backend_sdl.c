@@ -0,0 +1,160 @@
+#ifndef RENDERER_HEADLESS
+#include <stdio.h>
+#include <SDL.h>
+#include "backend.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// SDL backend: a borderless fullscreen window with a streaming texture
+///////////////////////////////////////////////////////////////////////////////
+static SDL_Window* window = NULL;
+static SDL_Renderer* renderer = NULL;
+static SDL_Texture* color_buffer_texture = NULL;
+
+static bool sdl_initialize(int* width, int* height) {
+	if (SDL_Init(SDL_INIT_EVERYTHING) != 0) {
+		fprintf(stderr, "Error initializing SDL. \n");
+		return false;
+	}
+
+	// Use SDL to query what is the fullscreen max. width and height
+	SDL_DisplayMode display_mode;
+	SDL_GetCurrentDisplayMode(0, &display_mode);
+	int fullscreen_width = display_mode.w;
+	int fullscreen_height = display_mode.h;
+	*width = fullscreen_width / 1;
+	*height = fullscreen_height / 1;
+
+	// Create a SDL window
+	window = SDL_CreateWindow(
+		NULL,
+		SDL_WINDOWPOS_CENTERED,
+		SDL_WINDOWPOS_CENTERED,
+		fullscreen_width,
+		fullscreen_height,
+		SDL_WINDOW_BORDERLESS
+	);
+	if (!window) {
+		fprintf(stderr, "Error creating SDL window. \n");
+		return false;
+	}
+
+	// Create a SDL renderer
+	renderer = SDL_CreateRenderer(window, -1, 0);
+
+	if (!renderer) {
+		fprintf(stderr, "Error creating SDL renderer. \n");
+		return false;
+	}
+
+	SDL_SetWindowFullscreen(window, SDL_WINDOW_FULLSCREEN);
+
+	// Creating a SDL texture that is used to display the color buffer
+	color_buffer_texture = SDL_CreateTexture(
+		renderer,
+		SDL_PIXELFORMAT_RGBA32,
+		SDL_TEXTUREACCESS_STREAMING,
+		*width,
+		*height
+	);
+
+	return true;
+}
+
+static bool sdl_lock_frame(uint32_t** pixels, int* pitch) {
+	void* texture_pixels = NULL;
+	int texture_pitch = 0;
+	if (SDL_LockTexture(color_buffer_texture, NULL, &texture_pixels, &texture_pitch) != 0) {
+		return false;
+	}
+	*pixels = (uint32_t*)texture_pixels;
+	*pitch = texture_pitch / (int)sizeof(uint32_t);
+	return true;
+}
+
+static void sdl_unlock_frame(void) {
+	SDL_UnlockTexture(color_buffer_texture);
+	SDL_RenderCopy(renderer, color_buffer_texture, NULL, NULL);
+	SDL_RenderPresent(renderer);
+}
+
+static int translate_key(SDL_Keycode key) {
+	switch (key) {
+	case SDLK_ESCAPE: return KEY_ESCAPE;
+	case SDLK_0: return KEY_0;
+	case SDLK_1: return KEY_1;
+	case SDLK_2: return KEY_2;
+	case SDLK_3: return KEY_3;
+	case SDLK_4: return KEY_4;
+	case SDLK_5: return KEY_5;
+	case SDLK_6: return KEY_6;
+	case SDLK_7: return KEY_7;
+	case SDLK_8: return KEY_8;
+	case SDLK_9: return KEY_9;
+	case SDLK_F1: return KEY_F1;
+	case SDLK_F2: return KEY_F2;
+	case SDLK_F3: return KEY_F3;
+	case SDLK_F4: return KEY_F4;
+	case SDLK_F5: return KEY_F5;
+	case SDLK_F6: return KEY_F6;
+	case SDLK_F7: return KEY_F7;
+	case SDLK_F8: return KEY_F8;
+	case SDLK_F9: return KEY_F9;
+	case SDLK_F10: return KEY_F10;
+	case SDLK_F11: return KEY_F11;
+	case SDLK_F12: return KEY_F12;
+	case SDLK_LEFT: return KEY_LEFT;
+	case SDLK_RIGHT: return KEY_RIGHT;
+	case SDLK_UP: return KEY_UP;
+	case SDLK_DOWN: return KEY_DOWN;
+	default: return KEY_UNKNOWN;
+	}
+}
+
+static bool sdl_poll_event(backend_event_t* event) {
+	SDL_Event sdl_event;
+	while (SDL_PollEvent(&sdl_event)) {
+		switch (sdl_event.type) {
+		case SDL_QUIT:
+			event->type = EVENT_QUIT;
+			event->key = KEY_UNKNOWN;
+			return true;
+		case SDL_KEYDOWN:
+			event->type = EVENT_KEY_DOWN;
+			event->key = translate_key(sdl_event.key.keysym.sym);
+			return true;
+		}
+	}
+	return false;
+}
+
+static uint64_t sdl_get_time_ns(void) {
+	uint64_t counter = SDL_GetPerformanceCounter();
+	uint64_t frequency = SDL_GetPerformanceFrequency();
+	return (counter / frequency) * 1000000000ull + (counter % frequency) * 1000000000ull / frequency;
+}
+
+static void sdl_delay(uint32_t milliseconds) {
+	SDL_Delay(milliseconds);
+}
+
+static void sdl_destroy(void) {
+	SDL_DestroyTexture(color_buffer_texture);
+	SDL_DestroyRenderer(renderer);
+	SDL_DestroyWindow(window);
+	SDL_Quit();
+}
+
+const display_backend_t sdl_backend = {
+	.name = "sdl",
+	.initialize = sdl_initialize,
+	.lock_frame = sdl_lock_frame,
+	.unlock_frame = sdl_unlock_frame,
+	.poll_event = sdl_poll_event,
+	.get_time_ns = sdl_get_time_ns,
+	.delay = sdl_delay,
+	.destroy = sdl_destroy,
+	.paced = true,
+	.threaded_present = false,	// the SDL renderer belongs to the thread that created it
+};
+
+#endif
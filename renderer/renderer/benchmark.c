@@ -0,0 +1,356 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "benchmark.h"
+#include "backend.h"
+#include "camera.h"
+#include "display.h"
+#include "mesh.h"
+#include "stats.h"
+
+#define MAX_BENCHMARK_SCENES 64
+#define MAX_BENCHMARK_MESHES 16
+
+typedef struct {
+	char scene[32];
+	int frames;
+	int width;
+	int height;
+	double stage_ms[NUM_PIPELINE_STAGES];	// average per frame
+	double frame_ms_mean;
+	double frame_ms_p50;
+	double frame_ms_p90;
+	double frame_ms_p99;
+	double frame_ms_max;
+	double triangles_per_frame;
+	double triangles_per_second;
+	double pixels_per_second;		// shaded pixels
+	pipeline_stats_t stats;			// summed over all frames
+	int depth_format;				// format at the end of the scene
+	depth_format_timing_t depth_timings[NUM_DEPTH_FORMATS];		// full screen sweep after the scene
+} benchmark_result_t;
+
+static const char* stage_names[NUM_PIPELINE_STAGES] = {
+	"transform", "cull", "clip", "shade", "raster", "present"
+};
+
+// Pipeline statistics reported as per frame averages, the texture fetches follow
+static const struct {
+	const char* name;
+	size_t offset;
+} stat_counters[] = {
+	{ "faces_processed", offsetof(pipeline_stats_t, faces_processed) },
+	{ "faces_culled", offsetof(pipeline_stats_t, faces_culled) },
+	{ "triangles_accepted", offsetof(pipeline_stats_t, triangles_accepted) },
+	{ "triangles_clipped", offsetof(pipeline_stats_t, triangles_clipped) },
+	{ "triangles_rejected", offsetof(pipeline_stats_t, triangles_rejected) },
+	{ "triangles_emitted", offsetof(pipeline_stats_t, triangles_emitted) },
+	{ "pixels_tested", offsetof(pipeline_stats_t, pixels_tested) },
+	{ "pixels_passed", offsetof(pipeline_stats_t, pixels_passed) },
+	{ "pixels_shaded", offsetof(pipeline_stats_t, pixels_shaded) },
+};
+
+#define NUM_STAT_COUNTERS ((int)(sizeof(stat_counters) / sizeof(stat_counters[0])))
+
+static bool benchmark_running = false;
+static uint64_t stage_ticks[NUM_PIPELINE_STAGES];
+
+//current scene
+static char scene_name[32];
+static uint64_t* frame_times_ns = NULL;
+static int num_frames = 0;
+static int frame_times_capacity = 0;
+static pipeline_stats_t scene_stats;
+static uint64_t frame_start_ns = 0;
+static uint64_t scene_start_ticks = 0;
+static uint64_t scene_start_ns = 0;
+static vect3_t base_rotations[MAX_BENCHMARK_MESHES];
+
+static benchmark_result_t results[MAX_BENCHMARK_SCENES];
+static int num_results = 0;
+
+const char* get_stage_name(int stage) {
+	return stage_names[stage];
+}
+
+static uint64_t read_ticks(void) {
+#if defined(STATS_HAS_CYCLE_COUNTER)
+	return read_cycle_counter();
+#else
+	return get_display_backend()->get_time_ns();
+#endif
+}
+
+bool is_benchmark_running(void) {
+	return benchmark_running;
+}
+
+uint64_t stage_clock(void) {
+	return benchmark_running ? read_ticks() : 0;
+}
+
+// Add the ticks since *start to the stage and restart the interval
+void stage_add(int stage, uint64_t* start) {
+	if (!benchmark_running) {
+		return;
+	}
+	uint64_t now = read_ticks();
+	stage_ticks[stage] += now - *start;
+	*start = now;
+}
+
+void begin_benchmark(void) {
+	benchmark_running = true;
+	num_results = 0;
+}
+
+void begin_benchmark_scene(const char* name) {
+	snprintf(scene_name, sizeof(scene_name), "%s", name);
+	memset(stage_ticks, 0, sizeof(stage_ticks));
+	num_frames = 0;
+	memset(&scene_stats, 0, sizeof(scene_stats));
+
+	for (int i = 0; i < get_num_meshes() && i < MAX_BENCHMARK_MESHES; i++) {
+		base_rotations[i] = get_mesh(i)->rotation;
+	}
+
+	scene_start_ticks = read_ticks();
+	scene_start_ns = get_display_backend()->get_time_ns();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Scripted camera and mesh animation, a pure function of the frame number so
+// every run and every machine renders the same images
+///////////////////////////////////////////////////////////////////////////////
+void apply_benchmark_path(int frame) {
+	float time = frame * BENCHMARK_TIMESTEP;
+	float phase = 2.0f * 3.1415926f * time / BENCHMARK_PATH_PERIOD;
+
+	//sway sideways, bob up and down and dolly back and forth while panning with the sway
+	set_camera_position(vect3_new(0.4f * sinf(phase), 0.2f * sinf(2.0f * phase), -0.6f * (1.0f - cosf(phase))));
+	set_camera_yaw(-0.1f * sinf(phase));
+	set_camera_pitch(0.0f);
+
+	//meshes spin around their y axis
+	for (int i = 0; i < get_num_meshes() && i < MAX_BENCHMARK_MESHES; i++) {
+		mesh_t* mesh = get_mesh(i);
+		mesh->rotation = base_rotations[i];
+		mesh->rotation.y += 0.6f * time;
+	}
+}
+
+void begin_benchmark_frame(void) {
+	frame_start_ns = get_display_backend()->get_time_ns();
+}
+
+void end_benchmark_frame(void) {
+	if (num_frames == frame_times_capacity) {
+		frame_times_capacity = frame_times_capacity ? frame_times_capacity * 2 : 256;
+		frame_times_ns = (uint64_t*)realloc(frame_times_ns, sizeof(uint64_t) * frame_times_capacity);
+	}
+	frame_times_ns[num_frames++] = get_display_backend()->get_time_ns() - frame_start_ns;
+
+	pipeline_stats_t frame_stats = get_pipeline_stats();
+	add_pipeline_stats(&scene_stats, &frame_stats);
+}
+
+static int compare_u64(const void* a, const void* b) {
+	uint64_t x = *(const uint64_t*)a;
+	uint64_t y = *(const uint64_t*)b;
+	return (x > y) - (x < y);
+}
+
+static double percentile_ms(const uint64_t* sorted, int count, double fraction) {
+	int index = (int)ceil(fraction * count) - 1;
+	if (index < 0) index = 0;
+	if (index >= count) index = count - 1;
+	return sorted[index] / 1e6;
+}
+
+void end_benchmark_scene(void) {
+	if (num_frames == 0 || num_results == MAX_BENCHMARK_SCENES) {
+		return;
+	}
+
+	//convert stage ticks to time with the ratio measured over the whole scene
+	uint64_t elapsed_ticks = read_ticks() - scene_start_ticks;
+	uint64_t elapsed_ns = get_display_backend()->get_time_ns() - scene_start_ns;
+	double ns_per_tick = elapsed_ticks ? (double)elapsed_ns / (double)elapsed_ticks : 1.0;
+
+	benchmark_result_t* result = &results[num_results++];
+	memset(result, 0, sizeof(*result));
+	snprintf(result->scene, sizeof(result->scene), "%s", scene_name);
+	result->frames = num_frames;
+	result->width = get_window_width();
+	result->height = get_window_height();
+
+	for (int stage = 0; stage < NUM_PIPELINE_STAGES; stage++) {
+		result->stage_ms[stage] = stage_ticks[stage] * ns_per_tick / 1e6 / num_frames;
+	}
+
+	double total_ns = 0;
+	for (int i = 0; i < num_frames; i++) {
+		total_ns += (double)frame_times_ns[i];
+	}
+	qsort(frame_times_ns, num_frames, sizeof(uint64_t), compare_u64);
+	result->frame_ms_mean = total_ns / 1e6 / num_frames;
+	result->frame_ms_p50 = percentile_ms(frame_times_ns, num_frames, 0.50);
+	result->frame_ms_p90 = percentile_ms(frame_times_ns, num_frames, 0.90);
+	result->frame_ms_p99 = percentile_ms(frame_times_ns, num_frames, 0.99);
+	result->frame_ms_max = frame_times_ns[num_frames - 1] / 1e6;
+
+	double seconds = total_ns / 1e9;
+	result->stats = scene_stats;
+	result->triangles_per_frame = (double)scene_stats.triangles_emitted / num_frames;
+	result->triangles_per_second = seconds > 0 ? scene_stats.triangles_emitted / seconds : 0;
+	result->pixels_per_second = seconds > 0 ? scene_stats.pixels_shaded / seconds : 0;
+
+	//the raster stage is idle between the scenes, the sweep leaves a cleared depth buffer
+	//and the color clear is only materialized early, the image is unchanged
+	result->depth_format = get_depth_format();
+	benchmark_depth_formats(BENCHMARK_DEPTH_PASSES, result->depth_timings);
+
+	fprintf(stderr, "benchmark %-10s %4d frames  %8.3f ms/frame  p99 %8.3f ms\n",
+		result->scene, result->frames, result->frame_ms_mean, result->frame_ms_p99);
+}
+
+void end_benchmark(void) {
+	benchmark_running = false;
+	free(frame_times_ns);
+	frame_times_ns = NULL;
+	frame_times_capacity = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Report writers
+///////////////////////////////////////////////////////////////////////////////
+static double stat_per_frame(const benchmark_result_t* result, int counter) {
+	const uint64_t* value = (const uint64_t*)((const char*)&result->stats + stat_counters[counter].offset);
+	return (double)*value / result->frames;
+}
+
+static double fetches_per_frame(const benchmark_result_t* result, int map) {
+	return (double)result->stats.texture_fetches[map] / result->frames;
+}
+
+// Full screen sweep of every depth format, reported per scene
+static const char* depth_columns[] = { "bytes_per_pixel", "ns_per_pixel", "gb_per_second" };
+#define NUM_DEPTH_COLUMNS ((int)(sizeof(depth_columns) / sizeof(depth_columns[0])))
+
+// Depth format names as column names, "reversed float" becomes reversed_float
+static void write_depth_format_key(FILE* file, int format) {
+	for (const char* c = get_depth_format_name(format); *c != '\0'; c++) {
+		fputc(*c == ' ' ? '_' : *c, file);
+	}
+}
+
+static void write_csv(FILE* file) {
+	fprintf(file, "scene,frames,width,height");
+	for (int stage = 0; stage < NUM_PIPELINE_STAGES; stage++) {
+		fprintf(file, ",%s_ms", stage_names[stage]);
+	}
+	fprintf(file, ",frame_ms_mean,frame_ms_p50,frame_ms_p90,frame_ms_p99,frame_ms_max,"
+		"triangles_per_frame,triangles_per_second,pixels_per_second");
+	for (int counter = 0; counter < NUM_STAT_COUNTERS; counter++) {
+		fprintf(file, ",%s", stat_counters[counter].name);
+	}
+	for (int map = 0; map < NUM_TEXTURE_MAPS; map++) {
+		fprintf(file, ",fetches_%s", get_texture_map_name(map));
+	}
+	fprintf(file, ",depth_format,depth_bytes_per_pixel");
+	for (int format = 0; format < NUM_DEPTH_FORMATS; format++) {
+		for (int column = 0; column < NUM_DEPTH_COLUMNS; column++) {
+			fprintf(file, ",depth_");
+			write_depth_format_key(file, format);
+			fprintf(file, "_%s", depth_columns[column]);
+		}
+	}
+	fprintf(file, "\n");
+
+	for (int i = 0; i < num_results; i++) {
+		benchmark_result_t* r = &results[i];
+		fprintf(file, "%s,%d,%d,%d", r->scene, r->frames, r->width, r->height);
+		for (int stage = 0; stage < NUM_PIPELINE_STAGES; stage++) {
+			fprintf(file, ",%.4f", r->stage_ms[stage]);
+		}
+		fprintf(file, ",%.4f,%.4f,%.4f,%.4f,%.4f,%.1f,%.0f,%.0f",
+			r->frame_ms_mean, r->frame_ms_p50, r->frame_ms_p90, r->frame_ms_p99, r->frame_ms_max,
+			r->triangles_per_frame, r->triangles_per_second, r->pixels_per_second);
+		for (int counter = 0; counter < NUM_STAT_COUNTERS; counter++) {
+			fprintf(file, ",%.1f", stat_per_frame(r, counter));
+		}
+		for (int map = 0; map < NUM_TEXTURE_MAPS; map++) {
+			fprintf(file, ",%.1f", fetches_per_frame(r, map));
+		}
+		fprintf(file, ",");
+		write_depth_format_key(file, r->depth_format);
+		fprintf(file, ",%d", get_depth_format_bytes(r->depth_format));
+		for (int format = 0; format < NUM_DEPTH_FORMATS; format++) {
+			fprintf(file, ",%d,%.3f,%.2f", get_depth_format_bytes(format),
+				r->depth_timings[format].ns_per_pixel, r->depth_timings[format].gigabytes_per_second);
+		}
+		fprintf(file, "\n");
+	}
+}
+
+static void write_json(FILE* file) {
+	fprintf(file, "{\n  \"timestep\": %.6f,\n  \"scenes\": [\n", BENCHMARK_TIMESTEP);
+	for (int i = 0; i < num_results; i++) {
+		benchmark_result_t* r = &results[i];
+		fprintf(file, "    {\n      \"scene\": \"%s\",\n      \"frames\": %d,\n      \"width\": %d,\n      \"height\": %d,\n",
+			r->scene, r->frames, r->width, r->height);
+		fprintf(file, "      \"stage_ms\": {");
+		for (int stage = 0; stage < NUM_PIPELINE_STAGES; stage++) {
+			fprintf(file, "%s\"%s\": %.4f", stage ? ", " : " ", stage_names[stage], r->stage_ms[stage]);
+		}
+		fprintf(file, " },\n");
+		fprintf(file, "      \"frame_ms\": { \"mean\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f },\n",
+			r->frame_ms_mean, r->frame_ms_p50, r->frame_ms_p90, r->frame_ms_p99, r->frame_ms_max);
+		fprintf(file, "      \"triangles_per_frame\": %.1f,\n      \"triangles_per_second\": %.0f,\n      \"pixels_per_second\": %.0f,\n",
+			r->triangles_per_frame, r->triangles_per_second, r->pixels_per_second);
+		fprintf(file, "      \"stats_per_frame\": {");
+		for (int counter = 0; counter < NUM_STAT_COUNTERS; counter++) {
+			fprintf(file, "%s\"%s\": %.1f", counter ? ", " : " ", stat_counters[counter].name, stat_per_frame(r, counter));
+		}
+		fprintf(file, " },\n      \"fetches_per_frame\": {");
+		for (int map = 0; map < NUM_TEXTURE_MAPS; map++) {
+			fprintf(file, "%s\"%s\": %.1f", map ? ", " : " ", get_texture_map_name(map), fetches_per_frame(r, map));
+		}
+		fprintf(file, " },\n");
+		fprintf(file, "      \"depth_format\": { \"name\": \"%s\", \"bytes_per_pixel\": %d },\n",
+			get_depth_format_name(r->depth_format), get_depth_format_bytes(r->depth_format));
+		fprintf(file, "      \"depth_formats\": [\n");
+		for (int format = 0; format < NUM_DEPTH_FORMATS; format++) {
+			fprintf(file, "        { \"name\": \"%s\", \"bytes_per_pixel\": %d, \"ns_per_pixel\": %.3f, \"gb_per_second\": %.2f }%s\n",
+				get_depth_format_name(format), get_depth_format_bytes(format), r->depth_timings[format].ns_per_pixel,
+				r->depth_timings[format].gigabytes_per_second, format + 1 < NUM_DEPTH_FORMATS ? "," : "");
+		}
+		fprintf(file, "      ]\n");
+		fprintf(file, "    }%s\n", i + 1 < num_results ? "," : "");
+	}
+	fprintf(file, "  ]\n}\n");
+}
+
+bool write_benchmark_report(const char* path) {
+	if (path == NULL) {
+		write_csv(stdout);
+		return true;
+	}
+
+	FILE* file = fopen(path, "w");
+	if (file == NULL) {
+		fprintf(stderr, "Error opening benchmark report %s. \n", path);
+		return false;
+	}
+	size_t length = strlen(path);
+	if (length >= 5 && strcmp(path + length - 5, ".json") == 0) {
+		write_json(file);
+	}
+	else {
+		write_csv(file);
+	}
+	fclose(file);
+	return true;
+}
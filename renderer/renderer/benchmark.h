@@ -0,0 +1,44 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BENCHMARK_DEFAULT_FRAMES 300
+#define BENCHMARK_TIMESTEP (1.0f / 60.0f)	// fixed simulation step, independent of the real frame time
+#define BENCHMARK_PATH_PERIOD 5.0f			// seconds for one loop of the camera path
+#define BENCHMARK_DEPTH_PASSES 20			// full screen passes per depth format after every scene
+
+///////////////////////////////////////////////////////////////////////////////
+// Pipeline stages timed by the benchmark, per pixel shading is fused into the
+// rasterizer loops and is therefore part of STAGE_RASTER
+///////////////////////////////////////////////////////////////////////////////
+enum pipeline_stage
+{
+	STAGE_TRANSFORM,	// world/view batch transforms and projection
+	STAGE_CULL,			// backface culling
+	STAGE_CLIP,			// frustum clipping and triangle assembly
+	STAGE_SHADE,		// per face/vertex lighting, light tiles and shadow casters
+	STAGE_RASTER,		// shadow map, triangles and lines
+	STAGE_PRESENT,		// resolve and hand the frame to the display backend
+	NUM_PIPELINE_STAGES
+};
+
+const char* get_stage_name(int stage);
+
+// Stage timers cost one branch while no benchmark is running
+bool is_benchmark_running(void);
+uint64_t stage_clock(void);
+void stage_add(int stage, uint64_t* start);
+
+void begin_benchmark(void);
+void begin_benchmark_scene(const char* scene_name);
+void apply_benchmark_path(int frame);
+void begin_benchmark_frame(void);
+void end_benchmark_frame(void);
+void end_benchmark_scene(void);
+void end_benchmark(void);
+
+// CSV or JSON chosen by the file extension, NULL prints CSV to stdout
+bool write_benchmark_report(const char* path);
+
+#endif
@@ -0,0 +1,338 @@
+#include <math.h>
+#include <string.h>
+#include <stdbool.h>
+#include "block_compression.h"
+
+#define POWER_ITERATIONS 4
+
+static inline int channel(uint32_t texel, int shift) {
+	return (int)((texel >> shift) & 0xFF);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// BC1
+///////////////////////////////////////////////////////////////////////////////
+static uint16_t pack_rgb565(int r, int g, int b) {
+	int r5 = (r * 31 + 127) / 255;
+	int g6 = (g * 63 + 127) / 255;
+	int b5 = (b * 31 + 127) / 255;
+	return (uint16_t)((r5 << 11) | (g6 << 5) | b5);
+}
+
+static void unpack_rgb565(uint16_t color, int rgb[3]) {
+	int r5 = (color >> 11) & 0x1F;
+	int g6 = (color >> 5) & 0x3F;
+	int b5 = color & 0x1F;
+	rgb[0] = (r5 << 3) | (r5 >> 2);
+	rgb[1] = (g6 << 2) | (g6 >> 4);
+	rgb[2] = (b5 << 3) | (b5 >> 2);
+}
+
+// The four colors of a block, the encoder picks its indices from the same palette the decoder builds
+static void bc1_palette(uint16_t color0, uint16_t color1, int palette[4][3]) {
+	unpack_rgb565(color0, palette[0]);
+	unpack_rgb565(color1, palette[1]);
+	for (int c = 0; c < 3; c++) {
+		if (color0 > color1) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+		}
+		else {
+			palette[2][c] = (palette[0][c] + palette[1][c] + 1) / 2;
+			palette[3][c] = 0;
+		}
+	}
+}
+
+// Picks the palette color of every texel by its position along the end point axis, returns the summed squared error
+static int bc1_select_indices(const int colors[16][3], uint16_t color0, uint16_t color1, uint32_t* indices) {
+	//level 0 is color1, level 3 is color0
+	static const int level_indices[4] = { 1, 3, 2, 0 };
+
+	int palette[4][3];
+	bc1_palette(color0, color1, palette);
+	int axis[3] = { palette[0][0] - palette[1][0], palette[0][1] - palette[1][1], palette[0][2] - palette[1][2] };
+	int length2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+	float scale = length2 > 0 ? 3.0f / (float)length2 : 0.0f;
+
+	int total_error = 0;
+	*indices = 0;
+	for (int i = 0; i < 16; i++) {
+		int projection = (colors[i][0] - palette[1][0]) * axis[0] + (colors[i][1] - palette[1][1]) * axis[1] +
+			(colors[i][2] - palette[1][2]) * axis[2];
+		int level = (int)(projection * scale + 0.5f);
+		level = level < 0 ? 0 : (level > 3 ? 3 : level);
+		int index = level_indices[level];
+
+		int dr = colors[i][0] - palette[index][0];
+		int dg = colors[i][1] - palette[index][1];
+		int db = colors[i][2] - palette[index][2];
+		*indices |= (uint32_t)index << (2 * i);
+		total_error += dr * dr + dg * dg + db * db;
+	}
+	return total_error;
+}
+
+// Least squares end points for fixed indices, false when all texels use the same weight
+static bool bc1_refine_endpoints(const int colors[16][3], uint32_t indices, uint16_t* color0, uint16_t* color1) {
+	static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+
+	float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+	float ax[3] = { 0.0f, 0.0f, 0.0f };
+	float bx[3] = { 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++) {
+		float a = weights[(indices >> (2 * i)) & 3];
+		float b = 1.0f - a;
+		aa += a * a;
+		bb += b * b;
+		ab += a * b;
+		for (int c = 0; c < 3; c++) {
+			ax[c] += a * colors[i][c];
+			bx[c] += b * colors[i][c];
+		}
+	}
+	float determinant = aa * bb - ab * ab;
+	if (fabsf(determinant) < 1e-6f) {
+		return false;
+	}
+
+	int endpoint0[3], endpoint1[3];
+	for (int c = 0; c < 3; c++) {
+		float e0 = (ax[c] * bb - bx[c] * ab) / determinant;
+		float e1 = (bx[c] * aa - ax[c] * ab) / determinant;
+		endpoint0[c] = (int)(fminf(fmaxf(e0, 0.0f), 255.0f) + 0.5f);
+		endpoint1[c] = (int)(fminf(fmaxf(e1, 0.0f), 255.0f) + 0.5f);
+	}
+	*color0 = pack_rgb565(endpoint0[0], endpoint0[1], endpoint0[2]);
+	*color1 = pack_rgb565(endpoint1[0], endpoint1[1], endpoint1[2]);
+	return true;
+}
+
+// Four color mode needs color0 > color1, swapping the end points swaps indices 0/1 and 2/3
+static void write_bc1_block(uint8_t* block, uint16_t color0, uint16_t color1, uint32_t indices) {
+	if (color0 < color1) {
+		uint16_t swap = color0;
+		color0 = color1;
+		color1 = swap;
+		indices ^= 0x55555555u;
+	}
+	else if (color0 == color1) {
+		indices = 0;
+	}
+	block[0] = (uint8_t)(color0 & 0xFF);
+	block[1] = (uint8_t)(color0 >> 8);
+	block[2] = (uint8_t)(color1 & 0xFF);
+	block[3] = (uint8_t)(color1 >> 8);
+	memcpy(block + 4, &indices, sizeof(indices));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// The end points start at the texels furthest apart along the principal axis
+// of the block colors, then one least squares pass fits them to the indices
+///////////////////////////////////////////////////////////////////////////////
+void encode_bc1_block(const uint32_t texels[16], uint8_t* block) {
+	int colors[16][3];
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++) {
+		colors[i][0] = channel(texels[i], 16);
+		colors[i][1] = channel(texels[i], 8);
+		colors[i][2] = channel(texels[i], 0);
+		for (int c = 0; c < 3; c++) {
+			mean[c] += colors[i][c];
+		}
+	}
+	for (int c = 0; c < 3; c++) {
+		mean[c] /= 16.0f;
+	}
+
+	//covariance matrix of the colors: xx, xy, xz, yy, yz, zz
+	float covariance[6] = { 0.0f };
+	for (int i = 0; i < 16; i++) {
+		float r = colors[i][0] - mean[0];
+		float g = colors[i][1] - mean[1];
+		float b = colors[i][2] - mean[2];
+		covariance[0] += r * r;
+		covariance[1] += r * g;
+		covariance[2] += r * b;
+		covariance[3] += g * g;
+		covariance[4] += g * b;
+		covariance[5] += b * b;
+	}
+
+	//principal axis by power iteration
+	float axis[3] = { 1.0f, 1.0f, 1.0f };
+	for (int iteration = 0; iteration < POWER_ITERATIONS; iteration++) {
+		float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+		float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+		float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+		float length = fmaxf(fabsf(x), fmaxf(fabsf(y), fabsf(z)));
+		if (length < 1e-6f) {
+			break;
+		}
+		axis[0] = x / length;
+		axis[1] = y / length;
+		axis[2] = z / length;
+	}
+
+	int min_texel = 0, max_texel = 0;
+	float min_projection = 1e30f, max_projection = -1e30f;
+	for (int i = 0; i < 16; i++) {
+		float projection = colors[i][0] * axis[0] + colors[i][1] * axis[1] + colors[i][2] * axis[2];
+		if (projection < min_projection) {
+			min_projection = projection;
+			min_texel = i;
+		}
+		if (projection > max_projection) {
+			max_projection = projection;
+			max_texel = i;
+		}
+	}
+
+	uint16_t color0 = pack_rgb565(colors[max_texel][0], colors[max_texel][1], colors[max_texel][2]);
+	uint16_t color1 = pack_rgb565(colors[min_texel][0], colors[min_texel][1], colors[min_texel][2]);
+	if (color0 < color1) {
+		uint16_t swap = color0;
+		color0 = color1;
+		color1 = swap;
+	}
+	uint32_t indices = 0;
+	bool collapsed = color0 == color1;
+	int error = collapsed ? 0 : bc1_select_indices(colors, color0, color1, &indices);
+
+	uint16_t refined0, refined1;
+	if (!collapsed && error > 0 && bc1_refine_endpoints(colors, indices, &refined0, &refined1)) {
+		if (refined0 < refined1) {
+			uint16_t swap = refined0;
+			refined0 = refined1;
+			refined1 = swap;
+		}
+		if (refined0 != refined1) {
+			uint32_t refined_indices;
+			int refined_error = bc1_select_indices(colors, refined0, refined1, &refined_indices);
+			if (refined_error < error) {
+				color0 = refined0;
+				color1 = refined1;
+				indices = refined_indices;
+				error = refined_error;
+			}
+		}
+	}
+
+	//a flat block, or end points that quantized to one color: the average color with all indices 0
+	if (collapsed) {
+		color0 = color1 = pack_rgb565((int)(mean[0] + 0.5f), (int)(mean[1] + 0.5f), (int)(mean[2] + 0.5f));
+	}
+	write_bc1_block(block, color0, color1, indices);
+}
+
+void decode_bc1_block(const uint8_t* block, uint32_t texels[16]) {
+	uint16_t color0 = (uint16_t)(block[0] | (block[1] << 8));
+	uint16_t color1 = (uint16_t)(block[2] | (block[3] << 8));
+	uint32_t indices;
+	memcpy(&indices, block + 4, sizeof(indices));
+
+	int palette[4][3];
+	bc1_palette(color0, color1, palette);
+	uint32_t packed[4];
+	for (int p = 0; p < 4; p++) {
+		packed[p] = 0xFF000000u | ((uint32_t)palette[p][0] << 16) | ((uint32_t)palette[p][1] << 8) | (uint32_t)palette[p][2];
+	}
+	for (int i = 0; i < 16; i++) {
+		texels[i] = packed[(indices >> (2 * i)) & 3];
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// BC4: the block spans the value range with 8 levels, a flat block uses the
+// 6 level mode with both end points equal
+///////////////////////////////////////////////////////////////////////////////
+static void bc4_palette(int value0, int value1, int palette[8]) {
+	palette[0] = value0;
+	palette[1] = value1;
+	if (value0 > value1) {
+		for (int i = 2; i < 8; i++) {
+			palette[i] = ((8 - i) * value0 + (i - 1) * value1 + 3) / 7;
+		}
+	}
+	else {
+		for (int i = 2; i < 6; i++) {
+			palette[i] = ((6 - i) * value0 + (i - 1) * value1 + 2) / 5;
+		}
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+}
+
+static void encode_bc4_channel(const uint32_t texels[16], int shift, uint8_t* block) {
+	int values[16];
+	int min_value = 255, max_value = 0;
+	for (int i = 0; i < 16; i++) {
+		values[i] = channel(texels[i], shift);
+		min_value = values[i] < min_value ? values[i] : min_value;
+		max_value = values[i] > max_value ? values[i] : max_value;
+	}
+
+	//level 0 is the maximum and level 7 the minimum, the levels between are palette entries 2 to 7
+	uint64_t indices = 0;
+	if (max_value > min_value) {
+		int range = max_value - min_value;
+		for (int i = 0; i < 16; i++) {
+			int level = ((max_value - values[i]) * 7 + range / 2) / range;
+			int index = level == 0 ? 0 : (level == 7 ? 1 : level + 1);
+			indices |= (uint64_t)index << (3 * i);
+		}
+	}
+
+	block[0] = (uint8_t)max_value;
+	block[1] = (uint8_t)min_value;
+	for (int i = 0; i < 6; i++) {
+		block[2 + i] = (uint8_t)(indices >> (8 * i));
+	}
+}
+
+static void decode_bc4_channel(const uint8_t* block, int values[16]) {
+	int palette[8];
+	bc4_palette(block[0], block[1], palette);
+
+	uint64_t indices = 0;
+	for (int i = 0; i < 6; i++) {
+		indices |= (uint64_t)block[2 + i] << (8 * i);
+	}
+	for (int i = 0; i < 16; i++) {
+		values[i] = palette[(indices >> (3 * i)) & 7];
+	}
+}
+
+void encode_bc4_block(const uint32_t texels[16], uint8_t* block) {
+	encode_bc4_channel(texels, 16, block);
+}
+
+void decode_bc4_block(const uint8_t* block, uint32_t texels[16]) {
+	int values[16];
+	decode_bc4_channel(block, values);
+	for (int i = 0; i < 16; i++) {
+		uint32_t value = (uint32_t)values[i];
+		texels[i] = 0xFF000000u | (value << 16) | (value << 8) | value;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// BC5: the two stored components of the unit normal give the third one
+///////////////////////////////////////////////////////////////////////////////
+void encode_bc5_block(const uint32_t texels[16], uint8_t* block) {
+	encode_bc4_channel(texels, 8, block);
+	encode_bc4_channel(texels, 0, block + BC4_BLOCK_SIZE);
+}
+
+void decode_bc5_block(const uint8_t* block, uint32_t texels[16]) {
+	int green[16], blue[16];
+	decode_bc4_channel(block, green);
+	decode_bc4_channel(block + BC4_BLOCK_SIZE, blue);
+	for (int i = 0; i < 16; i++) {
+		float y = green[i] * (2.0f / 255.0f) - 1.0f;
+		float z = blue[i] * (2.0f / 255.0f) - 1.0f;
+		float x = sqrtf(fmaxf(1.0f - y * y - z * z, 0.0f));
+		uint32_t red = (uint32_t)((x * 0.5f + 0.5f) * 255.0f + 0.5f);
+		texels[i] = 0xFF000000u | (red << 16) | ((uint32_t)green[i] << 8) | (uint32_t)blue[i];
+	}
+}
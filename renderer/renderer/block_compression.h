@@ -0,0 +1,27 @@
+#ifndef BLOCK_COMPRESSION_H
+#define BLOCK_COMPRESSION_H
+#include <stdint.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// BC1, BC4 and BC5 style compression of 4x4 texel blocks. The texels are the
+// packed 0xAARRGGBB colors the shaders unpack, listed row by row.
+// BC1: two RGB565 end points and a 2-bit index per texel, 8 bytes.
+// BC4: the red channel (the one the material maps are read from), two 8-bit
+//      end points and a 3-bit index per texel, 8 bytes. Decodes to gray.
+// BC5: the green and blue channels of a tangent space normal map as two BC4
+//      blocks, red is rebuilt as the positive unit normal component, 16 bytes.
+///////////////////////////////////////////////////////////////////////////////
+#define BC1_BLOCK_SIZE 8
+#define BC4_BLOCK_SIZE 8
+#define BC5_BLOCK_SIZE 16
+
+void encode_bc1_block(const uint32_t texels[16], uint8_t* block);
+void decode_bc1_block(const uint8_t* block, uint32_t texels[16]);
+
+void encode_bc4_block(const uint32_t texels[16], uint8_t* block);
+void decode_bc4_block(const uint8_t* block, uint32_t texels[16]);
+
+void encode_bc5_block(const uint32_t texels[16], uint8_t* block);
+void decode_bc5_block(const uint8_t* block, uint32_t texels[16]);
+
+#endif
@@ -3,6 +3,12 @@
 
 camera_t camera;
 
+//projection parameters needed to bring a screen pixel back into camera space
+static float inverse_proj_x = 1.0f;
+static float inverse_proj_y = 1.0f;
+static float half_screen_width = 1.0f;
+static float half_screen_height = 1.0f;
+
 void init_camera(vect3_t position, vect3_t direction, vect3_t fwd_velocity, float yaw, float pitch) {
 
 	camera.position = position;
@@ -87,3 +93,26 @@ vect3_t get_camera_look_at_target(void) {
 	return target;
 }
 
+
+void set_camera_projection(mat4_t projection, int screen_width, int screen_height) {
+	inverse_proj_x = 1.0f / projection.m[0][0];
+	inverse_proj_y = 1.0f / projection.m[1][1];
+	half_screen_width = screen_width / 2.0f;
+	half_screen_height = screen_height / 2.0f;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Undo the viewport mapping and perspective divide of a screen pixel
+///////////////////////////////////////////////////////////////////////////////
+// screen_x = ( x_view * m00 / w) * width/2  + width/2
+// screen_y = (-y_view * m11 / w) * height/2 + height/2
+// where w is the camera space depth of the pixel (the interpolated 1/(1/w))
+///////////////////////////////////////////////////////////////////////////////
+vect3_t screen_to_view_space(float screen_x, float screen_y, float view_w) {
+	vect3_t position = {
+		.x = (screen_x - half_screen_width) / half_screen_width * view_w * inverse_proj_x,
+		.y = -(screen_y - half_screen_height) / half_screen_height * view_w * inverse_proj_y,
+		.z = view_w
+	};
+	return position;
+}
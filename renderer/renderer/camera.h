@@ -1,6 +1,7 @@
 #ifndef CAMERA_H
 #define CAMERA_H
 #include "vector.h"
+#include "matrix.h"
 
 typedef struct {
 	vect3_t position;
@@ -29,5 +30,8 @@ void set_camera_position_z(float z);
 void set_camera_fwd_velocity(vect3_t fwd_velocity);
 void set_camera_yaw(float yaw);
 void set_camera_pitch(float pitch);
+
+void set_camera_projection(mat4_t projection, int screen_width, int screen_height);
+vect3_t screen_to_view_space(float screen_x, float screen_y, float view_w);
 #endif 
 
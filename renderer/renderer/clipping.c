@@ -1,5 +1,6 @@
 #include <math.h>
 #include "clipping.h"
+#include "stats.h"
 
 #define NUM_PLANES 6
 plane_t frustum_planes[NUM_PLANES];
@@ -97,7 +98,13 @@ void triangles_from_polygon(polygon_t* polygon, triangle_t triangles[], int* num
 	*num_triangles = polygon->num_vertices - 2;
 }
 
-void clip_polygon_against_plane(polygon_t* polygon, int plane ){ // parameter polygon work as out parameter
+// Returns true when the plane cut away part of the polygon
+bool clip_polygon_against_plane(polygon_t* polygon, int plane ){ // parameter polygon work as out parameter
+
+	//nothing left to clip once a previous plane rejected the whole polygon
+	if (polygon->num_vertices == 0) {
+		return false;
+	}
 	
 	vect3_t plane_point = frustum_planes[plane].point;
 	vect3_t plane_normal = frustum_planes[plane].normal;
@@ -107,6 +114,7 @@ void clip_polygon_against_plane(polygon_t* polygon, int plane ){ // parameter po
 	tex2_t inside_texcoords[MAX_NUM_POLY_VERTICES];
 	vect3_t inside_normals[MAX_NUM_POLY_VERTICES];
 	int num_inside_vertices = 0;
+	bool clipped = false;
 
 	//start the current vertex with the first polygon vertex and previous vertex with the last polygon vertex
 	vect3_t* current_vertex = &polygon->vertices[0];
@@ -172,6 +180,9 @@ void clip_polygon_against_plane(polygon_t* polygon, int plane ){ // parameter po
 
 			num_inside_vertices++;
 		}
+		else {
+			clipped = true;
+		}
 
 		//move to the next vertex and next texcoord
 		previous_dot = current_dot;
@@ -191,16 +202,63 @@ void clip_polygon_against_plane(polygon_t* polygon, int plane ){ // parameter po
 		polygon->normals[i] = vect3_clone(&inside_normals[i]);
 	}
 	polygon->num_vertices = num_inside_vertices;
+	return clipped;
 }
 
 void clip_polygon(polygon_t* polygon) {
-	clip_polygon_against_plane(polygon, LEFT_FRUSTUM_PLANE);
-	clip_polygon_against_plane(polygon, RIGHT_FRUSTUM_PLANE);
-	clip_polygon_against_plane(polygon, TOP_FRUSTUM_PLANE);
-	clip_polygon_against_plane(polygon, BOTTOM_FRUSTUM_PLANE);
-	clip_polygon_against_plane(polygon, NEAR_FRUSTUM_PLANE);
-	clip_polygon_against_plane(polygon, FAR_FRUSTUM_PLANE);
+	bool clipped = false;
+	clipped |= clip_polygon_against_plane(polygon, LEFT_FRUSTUM_PLANE);
+	clipped |= clip_polygon_against_plane(polygon, RIGHT_FRUSTUM_PLANE);
+	clipped |= clip_polygon_against_plane(polygon, TOP_FRUSTUM_PLANE);
+	clipped |= clip_polygon_against_plane(polygon, BOTTOM_FRUSTUM_PLANE);
+	clipped |= clip_polygon_against_plane(polygon, NEAR_FRUSTUM_PLANE);
+	clipped |= clip_polygon_against_plane(polygon, FAR_FRUSTUM_PLANE);
+
+	//count the clip outcome of the triangle for the pipeline statistics
+	if (polygon->num_vertices == 0) {
+		STAT_ADD(triangles_rejected, 1);
+	}
+	else if (clipped) {
+		STAT_ADD(triangles_clipped, 1);
+	}
+	else {
+		STAT_ADD(triangles_accepted, 1);
+	}
+}
 
 
-}
+///////////////////////////////////////////////////////////////////////////////
+// Clip a line segment against the near and far planes, the side planes are
+// left to the Cohen-Sutherland viewport clip of draw_line in screen space.
+// Returns false when the whole segment is outside.
+///////////////////////////////////////////////////////////////////////////////
+bool clip_line_depth(vect3_t* a, vect3_t* b) {
+	int planes[2] = { NEAR_FRUSTUM_PLANE, FAR_FRUSTUM_PLANE };
+
+	for (int i = 0; i < 2; i++) {
+		vect3_t plane_point = frustum_planes[planes[i]].point;
+		vect3_t plane_normal = frustum_planes[planes[i]].normal;
+
+		float dot_a = vect3_dot(plane_normal, vect3_sub(*a, plane_point));
+		float dot_b = vect3_dot(plane_normal, vect3_sub(*b, plane_point));
 
+		if (dot_a <= 0 && dot_b <= 0) {
+			return false;
+		}
+		if (dot_a * dot_b < 0) {
+			float interpolation_factor = dot_a / (dot_a - dot_b);
+			vect3_t intersection_point = {
+				.x = float_lerp(a->x, b->x, interpolation_factor),
+				.y = float_lerp(a->y, b->y, interpolation_factor),
+				.z = float_lerp(a->z, b->z, interpolation_factor)
+			};
+			if (dot_a < 0) {
+				*a = intersection_point;
+			}
+			else {
+				*b = intersection_point;
+			}
+		}
+	}
+	return true;
+}
@@ -1,5 +1,6 @@
 #ifndef CLIPPING_H
 #define	CLIPPING_H
+#include <stdbool.h>
 #include "triangle.h"
 #include "vector.h"
 
@@ -35,5 +36,6 @@ polygon_t polygon_from_triangle(
 	vect3_t n0, vect3_t n1, vect3_t n2);
 void triangles_from_polygon(polygon_t* polygon, triangle_t triangles[], int* num_triangles);
 void clip_polygon(polygon_t* polygon);
+bool clip_line_depth(vect3_t* a, vect3_t* b);
 
 #endif 
@@ -1,39 +1,110 @@
 
 #include "display.h"
-
-#define GAMMA 1.0
-#define INV_GAMMA (1.0 / GAMMA)
+#include "backend.h"
+#include "heatmap.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DISPLAY_SIMD_SSE2
+#endif
+
+#define MIN(a,b)(((a) < (b)) ? (a):(b))
+#define MAX(a,b)(((a) > (b)) ? (a):(b))
 #define CLAMP(x, lower, upper) ((x) < (lower) ? (lower) : ((x) > (upper) ? (upper) : (x)))
 
- static SDL_Window* window = NULL;
- static SDL_Renderer* renderer = NULL;
- static float* z_buffer = NULL;
- static uint32_t* color_buffer = NULL;
- static SDL_Texture* color_buffer_texture = NULL;
+ static void* z_buffer = NULL;         // float, uint16_t or uint32_t per pixel, see depth_format
 
  static int window_width = 800;
  static int window_height = 600;
 
+ static int cull_method = CULL_NONE;
+ static int render_method = RENDER_WIRE;
+
+ // Lazy clear: a tile flagged as pending still holds stale pixels and is only
+ // filled with the clear values the first time something writes into it
+ typedef struct {
+	 uint32_t* pixels;
+	 uint8_t* tile_pending;
+	 uint32_t clear_color;
+	 bool clear_with_grid;   // the background grid is part of the clear pattern
+ } color_target_t;
+
+ // Double buffered color: the raster stage draws one target while the present
+ // stage resolves the other, color_buffer and color_tile_pending alias the draw target
+ static color_target_t color_targets[2];
+ static color_target_t* draw_target = &color_targets[0];
+ static color_target_t* present_target = &color_targets[1];
+ static uint32_t* color_buffer = NULL;
+ static uint8_t* color_tile_pending = NULL;
+ static uint8_t* depth_tile_pending = NULL;
+ static int num_clear_tiles_x = 0;
+ static int num_clear_tiles_y = 0;
+
+ // Depth buffer storage format and its encoded clear value
+ static int depth_format = DEPTH_FORMAT_FLOAT;
+ static uint32_t clear_depth_encoded = 0;
+
+
+ ///////////////////////////////////////////////////////////////////////////////
+ // Color lookup tables, built once so decoding and encoding a channel is a
+ // single table lookup instead of a division or a pow() per channel
+ ///////////////////////////////////////////////////////////////////////////////
+ static float unorm8_to_float_table[256];     // i / 255
+ static float srgb_to_linear_table[256];      // sRGB encoded 8-bit -> linear [0, 1]
+ static uint8_t linear_to_srgb_table[LINEAR_TO_SRGB_TABLE_SIZE];  // linear [0, 1] -> sRGB encoded 8-bit
+ static bool color_tables_ready = false;
+
+ static float srgb_to_linear(float value) {
+	 return value <= 0.04045f ? value / 12.92f : powf((value + 0.055f) / 1.055f, 2.4f);
+ }
+
+ static float linear_to_srgb(float value) {
+	 return value <= 0.0031308f ? value * 12.92f : 1.055f * powf(value, 1.0f / 2.4f) - 0.055f;
+ }
+
+ void init_color_tables(void) {
+	 if (color_tables_ready) {
+		 return;
+	 }
+
+	 for (int i = 0; i < 256; i++) {
+		 unorm8_to_float_table[i] = i / 255.0;
+		 srgb_to_linear_table[i] = srgb_to_linear(i / 255.0f);
+	 }
+
+	 for (int i = 0; i < LINEAR_TO_SRGB_TABLE_SIZE; i++) {
+		 float encoded = linear_to_srgb(i / (float)(LINEAR_TO_SRGB_TABLE_SIZE - 1));
+		 linear_to_srgb_table[i] = (uint8_t)(CLAMP(encoded, 0.0f, 1.0f) * 255.0f + 0.5f);
+	 }
 
- float gamma_correct(float value, float gamma) {
-	 return pow(value, gamma);
+	 color_tables_ready = true;
  }
 
- vect4_t gamma_correct_color(vect4_t color, float gamma) {
+ // Decode an sRGB encoded channel in [0, 1] (quantized to 8 bits) to linear space
+ float gamma_correct(float value) {
+	 int index = (int)(CLAMP(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+	 return srgb_to_linear_table[index];
+ }
+
+ vect4_t gamma_correct_color(vect4_t color) {
 	 vect4_t corrected;
-	 corrected.x = gamma_correct(color.x, gamma);
-	 corrected.y = gamma_correct(color.y, gamma);
-	 corrected.z = gamma_correct(color.z, gamma);
+	 corrected.x = gamma_correct(color.x);
+	 corrected.y = gamma_correct(color.y);
+	 corrected.z = gamma_correct(color.z);
 	 corrected.w = color.w;  // Alpha is usually not gamma-corrected
 	 return corrected;
  }
 
 
 
+// Multiply two sRGB encoded colors in linear space, the result stays linear
 vect4_t mul_colors(vect4_t c1, vect4_t  c2) {
 
-	vect4_t corrected_c1 = gamma_correct_color(c1, INV_GAMMA);
-	vect4_t corrected_c2 = gamma_correct_color(c2, INV_GAMMA);
+	vect4_t corrected_c1 = gamma_correct_color(c1);
+	vect4_t corrected_c2 = gamma_correct_color(c2);
 
 	vect4_t  result;
 	 result.x = corrected_c1.x * corrected_c2.x;
@@ -65,11 +136,76 @@ vect4_t mul_colors(vect4_t c1, vect4_t  c2) {
  // Color unpacking function
  void unpack_color(uint32_t color, float* r, float* g, float* b, float* a) {
 
-	 *a = ((color >> 24) & 0xFF) / 255.0;
-	 *r = ((color >> 16) & 0xFF) / 255.0;
-	 *g = ((color >> 8) & 0xFF) / 255.0;
-	 *b = (color & 0xFF) / 255.0;
+	 *a = unorm8_to_float_table[(color >> 24) & 0xFF];
+	 *r = unorm8_to_float_table[(color >> 16) & 0xFF];
+	 *g = unorm8_to_float_table[(color >> 8) & 0xFF];
+	 *b = unorm8_to_float_table[color & 0xFF];
+
+ }
+
+ // Pack a linear color, encoding r, g, b to sRGB through the lookup table (alpha stays linear)
+ uint32_t pack_color_linear(float r, float g, float b, float a) {
+	 const float scale = LINEAR_TO_SRGB_TABLE_SIZE - 1;
+	 uint32_t color = 0;
+	 color |= ((uint32_t)(CLAMP(a, 0.0f, 1.0f) * 255.0f + 0.5f)) << 24;
+	 color |= (uint32_t)linear_to_srgb_table[(int)(CLAMP(r, 0.0f, 1.0f) * scale + 0.5f)] << 16;
+	 color |= (uint32_t)linear_to_srgb_table[(int)(CLAMP(g, 0.0f, 1.0f) * scale + 0.5f)] << 8;
+	 color |= (uint32_t)linear_to_srgb_table[(int)(CLAMP(b, 0.0f, 1.0f) * scale + 0.5f)];
+
+	 return color;
+ }
+
+ // Unpack an sRGB encoded color to linear r, g, b (alpha stays linear)
+ void unpack_color_linear(uint32_t color, float* r, float* g, float* b, float* a) {
+
+	 *a = unorm8_to_float_table[(color >> 24) & 0xFF];
+	 *r = srgb_to_linear_table[(color >> 16) & 0xFF];
+	 *g = srgb_to_linear_table[(color >> 8) & 0xFF];
+	 *b = srgb_to_linear_table[color & 0xFF];
+
+ }
+
+ ///////////////////////////////////////////////////////////////////////////////
+ // Fixed-point color math (SWAR). A packed color is spread into four 16-bit
+ // lanes 0x00AA00RR00GG00BB, so one 64-bit add, multiply or shift works on
+ // all four channels at once without carries crossing into the next lane
+ ///////////////////////////////////////////////////////////////////////////////
+ #define COLOR_LANES_MASK 0x00FF00FF00FF00FFull
+ #define COLOR_LANES_ONE  0x0001000100010001ull
+
+ uint64_t color_to_lanes(uint32_t color) {
+	 uint64_t lanes = color;
+	 lanes = (lanes | (lanes << 16)) & 0x0000FFFF0000FFFFull;
+	 lanes = (lanes | (lanes << 8)) & COLOR_LANES_MASK;
+	 return lanes;
+ }
+
+ uint32_t color_from_lanes(uint64_t lanes) {
+	 lanes &= COLOR_LANES_MASK;
+	 lanes = (lanes | (lanes >> 8)) & 0x0000FFFF0000FFFFull;
+	 return (uint32_t)(lanes | (lanes >> 16));
+ }
+
+ // Scale all four channels by a 8.8 fixed-point factor in [0, 256] with one multiply
+ uint32_t color_scale(uint32_t color, uint32_t factor) {
+	 factor = factor > 256 ? 256 : factor;
+	 return color_from_lanes((color_to_lanes(color) * factor) >> 8);
+ }
+
+ // Multiply two colors channel by channel (c1 * c2 / 255)
+ uint32_t color_modulate(uint32_t c1, uint32_t c2) {
+	 uint64_t lanes = color_to_lanes(c1);
+
+	 //every product is at most 255 * 255, so it stays inside its 16-bit lane
+	 uint64_t product =
+		 ((lanes & 0x00000000000000FFull) * ((c2      ) & 0xFF)) |
+		 ((lanes & 0x0000000000FF0000ull) * ((c2 >>  8) & 0xFF)) |
+		 ((lanes & 0x000000FF00000000ull) * ((c2 >> 16) & 0xFF)) |
+		 ((lanes & 0x00FF000000000000ull) * ((c2 >> 24) & 0xFF));
 
+	 //divide every lane by 255: x / 255 == (x + 1 + (x >> 8)) >> 8 for x < 65535
+	 product += COLOR_LANES_ONE + ((product >> 8) & COLOR_LANES_MASK);
+	 return color_from_lanes(product >> 8);
  }
 
  int get_window_width(void) {
@@ -113,7 +249,8 @@ vect4_t mul_colors(vect4_t c1, vect4_t  c2) {
  }
  bool should_render_aabb_texture_triangle(void) {
 	 return(
-		 render_method == RENDER_AABB_TEXTURED_TRIANGLE
+		 render_method == RENDER_AABB_TEXTURED_TRIANGLE ||
+		 render_method == RENDER_HEATMAP
 		 );
  }
 
@@ -130,90 +267,255 @@ vect4_t mul_colors(vect4_t c1, vect4_t  c2) {
 	 return(render_method == RENDER_WIRE_VERTEX);
  }
 
+ bool should_render_heatmap(void) {
+	 return(render_method == RENDER_HEATMAP);
+ }
+
 
 bool initialize_window(void){
-	if (SDL_Init(SDL_INIT_EVERYTHING) != 0){
-		fprintf(stderr, "Error initializing SDL. \n");
+	init_color_tables();
+
+	// The backend decides the frame size: fullscreen for SDL, configured for offscreen
+	if (!get_display_backend()->initialize(&window_width, &window_height)){
 		return false;
 	}
 
-	// Use SDL to query what is the fullscreen max. width and height
-	SDL_DisplayMode display_mode;
-	SDL_GetCurrentDisplayMode(0, &display_mode);
-	int fullscreen_width = display_mode.w;
-	int fullscreen_height = display_mode.h;
-	window_width = fullscreen_width / 1;
-	window_height = fullscreen_height / 1;
-
-	// Create a SDL window		
-	window = SDL_CreateWindow(
-		NULL,
-		SDL_WINDOWPOS_CENTERED,
-		SDL_WINDOWPOS_CENTERED,
-		fullscreen_width,
-		fullscreen_height,
-		SDL_WINDOW_BORDERLESS
-	);
-	if (!window){
-		fprintf(stderr, "Error creating SDL window. \n");
-		return false;
+	// Allocate the required memory in bytes to hold the color buffers and z buffer
+	z_buffer = malloc(sizeof(uint32_t) * window_width * window_height); //large enough for every depth format
+
+	// One pending flag per tile for each buffer, every tile starts out needing a clear
+	num_clear_tiles_x = (window_width + CLEAR_TILE_SIZE - 1) / CLEAR_TILE_SIZE;
+	num_clear_tiles_y = (window_height + CLEAR_TILE_SIZE - 1) / CLEAR_TILE_SIZE;
+	for (int i = 0; i < 2; i++) {
+		color_targets[i].pixels = (uint32_t*)malloc(sizeof(uint32_t) * window_width * window_height);
+		color_targets[i].tile_pending = (uint8_t*)malloc(num_clear_tiles_x * num_clear_tiles_y);
+		color_targets[i].clear_color = 0xFF000000;
+		color_targets[i].clear_with_grid = false;
+		memset(color_targets[i].tile_pending, 1, num_clear_tiles_x * num_clear_tiles_y);
 	}
+	color_buffer = draw_target->pixels;
+	color_tile_pending = draw_target->tile_pending;
+	depth_tile_pending = (uint8_t*)malloc(num_clear_tiles_x * num_clear_tiles_y);
+	memset(depth_tile_pending, 1, num_clear_tiles_x * num_clear_tiles_y);
+	set_depth_format(depth_format);
+
+	return true;
+}
 
-	// Create a SDL renderer
-	renderer = SDL_CreateRenderer(window, -1, 0);
+///////////////////////////////////////////////////////////////////////////////
+// Tile clear helpers
+///////////////////////////////////////////////////////////////////////////////
+static int clear_tile_index(int x, int y) {
+	return (y / CLEAR_TILE_SIZE) * num_clear_tiles_x + (x / CLEAR_TILE_SIZE);
+}
 
-	if (!renderer){
-		fprintf(stderr, "Error creating SDL renderer. \n");
-		return false;
+// Fill a row with one value, optionally with non-temporal stores that bypass the cache
+static void fill_row_u32(uint32_t* row, uint32_t value, int count, bool streaming) {
+	int i = 0;
+#if defined(DISPLAY_SIMD_SSE2)
+	if (streaming) {
+		for (; i < count && ((uintptr_t)(row + i) & 15) != 0; i++) {
+			row[i] = value;
+		}
+		__m128i values = _mm_set1_epi32((int)value);
+		for (; i + 4 <= count; i += 4) {
+			_mm_stream_si128((__m128i*)(row + i), values);
+		}
 	}
+#endif
+	for (; i < count; i++) {
+		row[i] = value;
+	}
+}
 
-	SDL_SetWindowFullscreen(window, SDL_WINDOW_FULLSCREEN);
+// Write the clear pattern (clear color plus the optional grid dots) of a rectangle
+static void write_clear_pattern(const color_target_t* target, uint32_t* destination, int pitch, int x0, int y0, int width, int height, bool streaming) {
+	for (int y = y0; y < y0 + height; y++) {
+		uint32_t* row = destination + (size_t)pitch * y;
+		fill_row_u32(row + x0, target->clear_color, width, streaming);
+
+		if (target->clear_with_grid && y % GRID_SPACING == 0) {
+			int first_x = (x0 + GRID_SPACING - 1) / GRID_SPACING * GRID_SPACING;
+			for (int x = first_x; x < x0 + width; x += GRID_SPACING) {
+				row[x] = GRID_COLOR;
+			}
+		}
+	}
+}
 
-	// Allocate the required memory in bytes to hold the color buffer and z buffer
-	color_buffer = (uint32_t*)malloc(sizeof(uint32_t) * window_width * window_height);
-	z_buffer = (float*)malloc(sizeof(float) * window_width * window_height);
+static void materialize_color_tile(int tile_index) {
+	int x0 = (tile_index % num_clear_tiles_x) * CLEAR_TILE_SIZE;
+	int y0 = (tile_index / num_clear_tiles_x) * CLEAR_TILE_SIZE;
+	int width = MIN(CLEAR_TILE_SIZE, window_width - x0);
+	int height = MIN(CLEAR_TILE_SIZE, window_height - y0);
 
-	// Creating a SDL texture that is used to display the color buffer
-	color_buffer_texture = SDL_CreateTexture(
-		renderer,
-		SDL_PIXELFORMAT_RGBA32,
-		SDL_TEXTUREACCESS_STREAMING,
-		window_width,
-		window_height
-	);
+	write_clear_pattern(draw_target, color_buffer, window_width, x0, y0, width, height, false);
+	color_tile_pending[tile_index] = 0;
+}
 
-	return true;
+static void materialize_depth_tile(int tile_index) {
+	int x0 = (tile_index % num_clear_tiles_x) * CLEAR_TILE_SIZE;
+	int y0 = (tile_index / num_clear_tiles_x) * CLEAR_TILE_SIZE;
+	int width = MIN(CLEAR_TILE_SIZE, window_width - x0);
+	int height = MIN(CLEAR_TILE_SIZE, window_height - y0);
+
+	for (int y = y0; y < y0 + height; y++) {
+		int index = window_width * y + x0;
+		if (depth_format == DEPTH_FORMAT_UNORM16) {
+			uint16_t* row = (uint16_t*)z_buffer + index;
+			for (int x = 0; x < width; x++) {
+				row[x] = (uint16_t)clear_depth_encoded;
+			}
+		}
+		else {
+			//float formats store their bit pattern, 24-bit depth lives in a 32-bit word
+			fill_row_u32((uint32_t*)z_buffer + index, clear_depth_encoded, width, false);
+		}
+	}
+	depth_tile_pending[tile_index] = 0;
 }
 
 void draw_pixel(int x, int y, uint32_t color){
 	if (x < 0 || x >= window_width || y < 0 || y >= window_height){
 		return;
 	}	
+	int tile_index = clear_tile_index(x, y);
+	if (color_tile_pending[tile_index]) {
+		materialize_color_tile(tile_index);
+	}
 	color_buffer[(window_width * y) + x] = color;
 }
 
-// this draw line function use the algorithm of DDA
-void draw_line(int x0, int y0, int x1, int y1, uint32_t color){
-	int delta_x = (x1 - x0);
-	int delta_y = (y1 - y0);
+///////////////////////////////////////////////////////////////////////////////
+// Cohen-Sutherland outcodes of a point against the viewport rectangle
+///////////////////////////////////////////////////////////////////////////////
+enum {
+	OUTCODE_INSIDE = 0,
+	OUTCODE_LEFT = 1,
+	OUTCODE_RIGHT = 2,
+	OUTCODE_TOP = 4,
+	OUTCODE_BOTTOM = 8
+};
+
+static int compute_outcode(long long x, long long y) {
+	int code = OUTCODE_INSIDE;
+	if (x < 0) code |= OUTCODE_LEFT;
+	else if (x >= window_width) code |= OUTCODE_RIGHT;
+	if (y < 0) code |= OUTCODE_TOP;
+	else if (y >= window_height) code |= OUTCODE_BOTTOM;
+	return code;
+}
 
-	int side_length = (abs(delta_x) >= abs(delta_y)) ? abs(delta_x) : abs(delta_y);
+// Clip a line to the viewport, returns false if nothing of the line is visible
+static bool clip_line_to_viewport(int* x0, int* y0, int* x1, int* y1) {
+	long long ax = *x0, ay = *y0, bx = *x1, by = *y1;
+	int code_a = compute_outcode(ax, ay);
+	int code_b = compute_outcode(bx, by);
 
-	float current_x = x0;
-	float current_y = y0;
+	while (code_a | code_b) {
+		//both end points share an outside region, the line can not cross the viewport
+		if (code_a & code_b) {
+			return false;
+		}
+
+		//move the outside end point onto the viewport edge it violates
+		int code = code_a ? code_a : code_b;
+		long long x, y;
+		if (code & OUTCODE_TOP) {
+			y = 0;
+			x = ax + (bx - ax) * (y - ay) / (by - ay);
+		}
+		else if (code & OUTCODE_BOTTOM) {
+			y = window_height - 1;
+			x = ax + (bx - ax) * (y - ay) / (by - ay);
+		}
+		else if (code & OUTCODE_LEFT) {
+			x = 0;
+			y = ay + (by - ay) * (x - ax) / (bx - ax);
+		}
+		else {
+			x = window_width - 1;
+			y = ay + (by - ay) * (x - ax) / (bx - ax);
+		}
+
+		if (code == code_a) {
+			ax = x; ay = y;
+			code_a = compute_outcode(ax, ay);
+		}
+		else {
+			bx = x; by = y;
+			code_b = compute_outcode(bx, by);
+		}
+	}
 
-	//find how much we should increment in both x and y of each step
-	float x_inc = delta_x / (float)side_length;
-	float y_inc = delta_y / (float)side_length;
+	*x0 = (int)ax; *y0 = (int)ay;
+	*x1 = (int)bx; *y1 = (int)by;
+	return true;
+}
 
-	for (int i = 0; i < side_length; i++){
-		draw_pixel(round(current_x),round(current_y), color);
+///////////////////////////////////////////////////////////////////////////////
+// Integer Bresenham line, clipped to the viewport first so off-screen parts
+// cost nothing. A depth tested line interpolates 1/w along its major axis,
+// 1/w is linear in screen space, and only reads the z-buffer: the bias pulls
+// the line in front of the faces it is an edge of.
+///////////////////////////////////////////////////////////////////////////////
+#define LINE_DEPTH_BIAS 0.01f
+
+static void rasterize_line(int x0, int y0, float reciprocal_w0, int x1, int y1, float reciprocal_w1, bool depth_tested, uint32_t color) {
+	//1/w steps along the unclipped line, the clip only moves its end points
+	bool x_major = abs(x1 - x0) >= abs(y1 - y0);
+	int major_origin = x_major ? x0 : y0;
+	int major_length = x_major ? x1 - x0 : y1 - y0;
+	float reciprocal_w_step = major_length != 0 ? (reciprocal_w1 - reciprocal_w0) / (float)major_length : 0.0f;
+
+	if (!clip_line_to_viewport(&x0, &y0, &x1, &y1)) {
+		return;
+	}
 
-		current_x += x_inc;
-		current_y += y_inc;
+	int delta_x = abs(x1 - x0);
+	int delta_y = -abs(y1 - y0);
+	int step_x = (x0 < x1) ? 1 : -1;
+	int step_y = (y0 < y1) ? 1 : -1;
+	int error = delta_x + delta_y;
+
+	//every pixel of the clipped line is on screen, only the tile clear is left to check
+	while (true) {
+		bool visible = true;
+		if (depth_tested) {
+			float reciprocal_w = reciprocal_w0 + (float)((x_major ? x0 : y0) - major_origin) * reciprocal_w_step;
+			visible = depth_test_at(x0, y0, reciprocal_w * (1.0f + LINE_DEPTH_BIAS));
+		}
+		if (visible) {
+			int tile_index = clear_tile_index(x0, y0);
+			if (color_tile_pending[tile_index]) {
+				materialize_color_tile(tile_index);
+			}
+			color_buffer[(window_width * y0) + x0] = color;
+		}
+
+		if (x0 == x1 && y0 == y1) {
+			break;
+		}
+		int error2 = 2 * error;
+		if (error2 >= delta_y) {
+			error += delta_y;
+			x0 += step_x;
+		}
+		if (error2 <= delta_x) {
+			error += delta_x;
+			y0 += step_y;
+		}
 	}
 }
 
+void draw_line(int x0, int y0, int x1, int y1, uint32_t color){
+	rasterize_line(x0, y0, 0.0f, x1, y1, 0.0f, false, color);
+}
+
+void draw_line_depth_tested(line_t line, uint32_t color) {
+	rasterize_line(line.x0, line.y0, line.reciprocal_w0, line.x1, line.y1, line.reciprocal_w1, true, color);
+}
+
 void draw_rect(int upper_left_pos_x, int upper_left_pos_y, int width, int height, uint32_t color){
 	for (int y = 0; y < height; y += 1){
 		for (int x = 0; x < width; x += 1){
@@ -227,59 +529,286 @@ void draw_rect(int upper_left_pos_x, int upper_left_pos_y, int width, int height
 
 void draw_grid(void){
 	//Draw a background grid that fills the entire window.
-	//Lines should be rendered at every row/col multiple of 10.
+	//Lines should be rendered at every row/col multiple of 20.
 
-	for (int y = 0; y < window_height; y += 20)
-		for (int x = 0; x < window_width; x += 20)
-			color_buffer[(window_width)*y + x] = 0xFF333333;
+	//Tiles still waiting for their clear get the grid with the clear pattern,
+	//only the tiles that were already drawn into need the dots now
+	draw_target->clear_with_grid = true;
+
+	for (int y = 0; y < window_height; y += GRID_SPACING)
+		for (int x = 0; x < window_width; x += GRID_SPACING)
+			if (!color_tile_pending[clear_tile_index(x, y)])
+				color_buffer[(window_width)*y + x] = GRID_COLOR;
 
 }
 
 
+///////////////////////////////////////////////////////////////////////////////
+// Clearing only flags the tiles, the buffers are written on first use
+///////////////////////////////////////////////////////////////////////////////
 void clear_color_buffer(uint32_t color){
-	for (int i = 0; i < window_width * window_height; i++) {
-		color_buffer[i] = color;
-	}
+	draw_target->clear_color = color;
+	draw_target->clear_with_grid = false;
+	memset(color_tile_pending, 1, num_clear_tiles_x * num_clear_tiles_y);
 }
 
 void clear_z_buffer(void) {
-	for (int i = 0; i < window_width * window_height; i++) {
-		z_buffer[i] = 1.0;
+	memset(depth_tile_pending, 1, num_clear_tiles_x * num_clear_tiles_y);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Depth formats. The rasterizers hand over the interpolated 1/w and every
+// format encodes it its own way:
+//   float          1 - 1/w, closer pixels have smaller values
+//   16/24-bit      1 - 1/w quantized to an unsigned integer
+//   reversed float 1/w itself, closer pixels have greater values and the
+//                  float precision is spent where 1/w gets small (far away)
+///////////////////////////////////////////////////////////////////////////////
+static inline uint32_t encode_depth(float reciprocal_w) {
+	return depth_encode(depth_format, reciprocal_w);
+}
+
+static inline uint32_t load_depth(int index) {
+	if (depth_format == DEPTH_FORMAT_UNORM16) {
+		return ((uint16_t*)z_buffer)[index];
+	}
+	return ((uint32_t*)z_buffer)[index];
+}
+
+void set_depth_format(int format) {
+	depth_format = format;
+	clear_depth_encoded = encode_depth(0.0f); //1/w = 0 is infinitely far away
+
+	//the stored values are meaningless in the new format
+	if (depth_tile_pending) {
+		clear_z_buffer();
+	}
+}
+
+int get_depth_format(void) {
+	return depth_format;
+}
+
+const char* get_depth_format_name(int format) {
+	switch (format) {
+	case DEPTH_FORMAT_FLOAT: return "float";
+	case DEPTH_FORMAT_UNORM16: return "unorm16";
+	case DEPTH_FORMAT_UNORM24: return "unorm24";
+	case DEPTH_FORMAT_FLOAT_REVERSED: return "reversed float";
+	default: return "unknown";
+	}
+}
+
+int get_depth_format_bytes(int format) {
+	return format == DEPTH_FORMAT_UNORM16 ? 2 : 4;
+}
+
+// Returns true if a pixel at 1/w = reciprocal_w passes the depth test
+bool depth_test_at(int x, int y, float reciprocal_w) {
+	if (x < 0 || x >= window_width || y < 0 || y >= window_height) {
+		return false;
+	}
+	//a pending tile reads as cleared without being materialized
+	uint32_t stored = depth_tile_pending[clear_tile_index(x, y)] ? clear_depth_encoded : load_depth(window_width * y + x);
+	return depth_is_closer(depth_format, encode_depth(reciprocal_w), stored);
+}
+
+void depth_write_at(int x, int y, float reciprocal_w) {
+	if (x < 0 || x >= window_width || y < 0 || y >= window_height) {
+		return;
+	}
+	int tile_index = clear_tile_index(x, y);
+	if (depth_tile_pending[tile_index]) {
+		materialize_depth_tile(tile_index);
+	}
+
+	int index = window_width * y + x;
+	uint32_t value = encode_depth(reciprocal_w);
+	if (depth_format == DEPTH_FORMAT_UNORM16) {
+		((uint16_t*)z_buffer)[index] = (uint16_t)value;
+	}
+	else {
+		((uint32_t*)z_buffer)[index] = value;
 	}
 }
 
+// Depth as 1 - 1/w in [0, 1] whatever the storage format is
 float get_z_buffer_at(int x, int y) {
 	if (x < 0 || x >= window_width || y < 0 || y >= window_height){
 		return 1.0;
 	}
-	return z_buffer[(window_width * y) + x];
+	uint32_t stored = depth_tile_pending[clear_tile_index(x, y)] ? clear_depth_encoded : load_depth(window_width * y + x);
+	switch (depth_format) {
+	case DEPTH_FORMAT_UNORM16:
+		return stored / 65535.0f;
+	case DEPTH_FORMAT_UNORM24:
+		return stored / 16777215.0f;
+	case DEPTH_FORMAT_FLOAT_REVERSED:
+		return 1.0f - depth_bits_to_float(stored);
+	default:
+		return depth_bits_to_float(stored);
+	}
 }
 
 void update_z_buffer_at(int x, int y, float value) {
-	if (x < 0 || x >= window_width || y < 0 || y >= window_height) {
-		return;
+	depth_write_at(x, y, 1.0f - value);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Span API: clamp a bounding box to the viewport and materialize the tiles it
+// covers once, so the rasterizer inner loops write through raw row pointers
+// without any bounds check, tile check or index computation per pixel
+///////////////////////////////////////////////////////////////////////////////
+bool begin_framebuffer_rect(int* x_min, int* y_min, int* x_max, int* y_max) {
+	*x_min = MAX(*x_min, 0);
+	*y_min = MAX(*y_min, 0);
+	*x_max = MIN(*x_max, window_width - 1);
+	*y_max = MIN(*y_max, window_height - 1);
+	if (*x_min > *x_max || *y_min > *y_max) {
+		return false;
+	}
+
+	for (int tile_y = *y_min / CLEAR_TILE_SIZE; tile_y <= *y_max / CLEAR_TILE_SIZE; tile_y++) {
+		for (int tile_x = *x_min / CLEAR_TILE_SIZE; tile_x <= *x_max / CLEAR_TILE_SIZE; tile_x++) {
+			int tile_index = tile_y * num_clear_tiles_x + tile_x;
+			if (color_tile_pending[tile_index]) {
+				materialize_color_tile(tile_index);
+			}
+			if (depth_tile_pending[tile_index]) {
+				materialize_depth_tile(tile_index);
+			}
+		}
+	}
+	return true;
+}
+
+// Only valid for rows inside a rect prepared by begin_framebuffer_rect
+framebuffer_row_t get_framebuffer_row(int y) {
+	framebuffer_row_t row;
+	row.color = color_buffer + (size_t)window_width * y;
+	row.depth_format = depth_format;
+	if (depth_format == DEPTH_FORMAT_UNORM16) {
+		row.depth = (uint16_t*)z_buffer + (size_t)window_width * y;
+	}
+	else {
+		row.depth = (uint32_t*)z_buffer + (size_t)window_width * y;
+	}
+	row.heat_depth_tests = get_heatmap_depth_test_row(y);
+	row.heat_shades = get_heatmap_shade_row(y);
+	row.heat_tile_cycles = get_heatmap_tile_cycle_row(y);
+	return row;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Time the depth test and write of every format over the full screen
+///////////////////////////////////////////////////////////////////////////////
+void benchmark_depth_formats(int passes, depth_format_timing_t* timings) {
+	int previous_format = depth_format;
+	int num_pixels = window_width * window_height;
+	memset(timings, 0, sizeof(depth_format_timing_t) * NUM_DEPTH_FORMATS);
+
+	for (int format = 0; format < NUM_DEPTH_FORMATS; format++) {
+		set_depth_format(format);
+
+		//the same row path as the rasterizers, the tile clears are paid before the timer
+		int x_min = 0, y_min = 0, x_max = window_width - 1, y_max = window_height - 1;
+		if (!begin_framebuffer_rect(&x_min, &y_min, &x_max, &y_max)) {
+			continue;
+		}
+
+		double start = platform_get_seconds();
+		for (int pass = 0; pass < passes; pass++) {
+			//every pass draws a slightly closer plane, so every pixel passes and is written
+			float reciprocal_w = 0.1f + 0.8f * (pass + 1) / (float)(passes + 1);
+			for (int y = y_min; y <= y_max; y++) {
+				framebuffer_row_t row = get_framebuffer_row(y);
+				row.heat_depth_tests = NULL;	//only the depth path is timed
+				for (int x = x_min; x <= x_max; x++) {
+					uint32_t encoded_depth;
+					if (row_depth_test(&row, x, reciprocal_w, &encoded_depth)) {
+						row_depth_write(&row, x, encoded_depth);
+					}
+				}
+			}
+		}
+		double seconds = platform_get_seconds() - start;
+
+		//one read and one write per pixel and pass
+		double bytes = 2.0 * get_depth_format_bytes(format) * (double)num_pixels * passes;
+		timings[format].ns_per_pixel = seconds * 1e9 / ((double)num_pixels * passes);
+		timings[format].gigabytes_per_second = bytes / seconds / 1e9;
+	}
+
+	set_depth_format(previous_format);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// The finished draw target becomes the one presented and the raster stage
+// continues in the other, only while nothing presents or draws
+///////////////////////////////////////////////////////////////////////////////
+void swap_color_buffers(void) {
+	color_target_t* finished = draw_target;
+	draw_target = present_target;
+	present_target = finished;
+	color_buffer = draw_target->pixels;
+	color_tile_pending = draw_target->tile_pending;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Copy the presented image into destination, the tiles nobody drew into are
+// written straight from the clear pattern with streaming stores
+///////////////////////////////////////////////////////////////////////////////
+void resolve_color_buffer(uint32_t* destination, int pitch) {
+	const color_target_t* target = present_target;
+
+	for (int tile_y = 0; tile_y < num_clear_tiles_y; tile_y++) {
+		int y0 = tile_y * CLEAR_TILE_SIZE;
+		int height = MIN(CLEAR_TILE_SIZE, window_height - y0);
+
+		for (int tile_x = 0; tile_x < num_clear_tiles_x; tile_x++) {
+			int x0 = tile_x * CLEAR_TILE_SIZE;
+			int width = MIN(CLEAR_TILE_SIZE, window_width - x0);
+
+			if (target->tile_pending[tile_y * num_clear_tiles_x + tile_x]) {
+				write_clear_pattern(target, destination, pitch, x0, y0, width, height, true);
+				continue;
+			}
+			if (destination == target->pixels) {
+				continue;
+			}
+			for (int y = y0; y < y0 + height; y++) {
+				memcpy(destination + (size_t)pitch * y + x0, target->pixels + (size_t)window_width * y + x0, width * sizeof(uint32_t));
+			}
+		}
 	}
-	z_buffer[(window_width * y) + x] = value;
+#if defined(DISPLAY_SIMD_SSE2)
+	_mm_sfence();
+#endif
+}
+
+// The caller writes every pixel, so no tile has to be filled with the clear pattern first
+uint32_t* get_color_buffer_for_overwrite(void) {
+	memset(color_tile_pending, 0, (size_t)num_clear_tiles_x * num_clear_tiles_y);
+	return color_buffer;
 }
 
+// Present stage: show the target handed over by the last swap_color_buffers()
 void render_color_buffer(void){
-	SDL_UpdateTexture(
-		color_buffer_texture,
-		NULL,
-		color_buffer,
-		(int)(window_width * sizeof(uint32_t))
-	);
-	SDL_RenderCopy(renderer, color_buffer_texture, NULL, NULL);
-	SDL_RenderPresent(renderer);
+	uint32_t* pixels = NULL;
+	int pitch = 0;
+	if (get_display_backend()->lock_frame(&pixels, &pitch)) {
+		resolve_color_buffer(pixels, pitch);
+		get_display_backend()->unlock_frame();
+	}
 }
 
 
 void destroy_window(void){
-	free(color_buffer);
+	for (int i = 0; i < 2; i++) {
+		free(color_targets[i].pixels);
+		free(color_targets[i].tile_pending);
+	}
 	free(z_buffer);
-	SDL_DestroyRenderer(renderer);
-	SDL_DestroyWindow(window);
-	SDL_Quit();
+	free(depth_tile_pending);
+	get_display_backend()->destroy();
 }
-
-
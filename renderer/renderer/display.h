@@ -4,18 +4,23 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
-#include <sdl.h>
+#include <string.h>
 #include"vector.h"
+#include "stats.h"
 
 #define FPS 60
 #define FRAME_TARGET_TIME (1000 / FPS) // this is delta time in miliseconds
+#define CLEAR_TILE_SIZE 32              // granularity of the lazy color and depth clears
+#define GRID_SPACING 20
+#define GRID_COLOR 0xFF333333
+#define LINEAR_TO_SRGB_TABLE_SIZE 4096   // linear values are quantized to 12 bits before sRGB encoding
 
 enum cull_method
 {
 	CULL_NONE,
 	CULL_BACKFACE
 
-}cull_method;
+};
 
 enum render_method
 {
@@ -26,9 +31,46 @@ enum render_method
 	RENDER_AABB_TEXTURED_TRIANGLE,
 	RENDER_FILL_TRIANGLE_WIRE,
 	RENDER_TEXTURED,
-	RENDER_TEXTURED_WIRE
+	RENDER_TEXTURED_WIRE,
+	RENDER_HEATMAP          // textured PBR pass shown as an overdraw/shading cost heatmap
 
-}render_method;
+};
+
+enum depth_format
+{
+	DEPTH_FORMAT_FLOAT,
+	DEPTH_FORMAT_UNORM16,
+	DEPTH_FORMAT_UNORM24,
+	DEPTH_FORMAT_FLOAT_REVERSED,
+	NUM_DEPTH_FORMATS
+};
+
+// Full screen depth test and write cost of one format
+typedef struct {
+	double ns_per_pixel;
+	double gigabytes_per_second;	// one read and one write per pixel
+} depth_format_timing_t;
+
+// One framebuffer row inside a rect prepared by begin_framebuffer_rect()
+typedef struct {
+	uint32_t* color;
+	void* depth;        // uint16_t* for DEPTH_FORMAT_UNORM16, uint32_t* otherwise
+	int depth_format;
+	uint16_t* heat_depth_tests;    // heatmap counters, NULL unless the heatmap is shown
+	uint16_t* heat_shades;
+	uint64_t* heat_tile_cycles;    // indexed by x / CLEAR_TILE_SIZE
+} framebuffer_row_t;
+
+// Screen space line, the end points are clipped to the viewport by draw_line()
+// and must stay within +-INT_MAX / 2 so the clip can not overflow
+typedef struct {
+	int x0;
+	int y0;
+	int x1;
+	int y1;
+	float reciprocal_w0;	// 1/w of the end points, for draw_line_depth_tested()
+	float reciprocal_w1;
+} line_t;
 
 typedef struct {
 	uint8_t r;
@@ -39,6 +81,7 @@ typedef struct {
 
 
 bool initialize_window(void);
+void destroy_window(void);
 int get_window_width(void);
 int get_window_height(void);
 
@@ -52,23 +95,131 @@ bool should_render_texture_triangle(void);
 bool should_render_aabb_texture_triangle(void);
 bool should_render_wireframe(void);
 bool should_render_wire_vertex(void);
+bool should_render_heatmap(void);
 
 
 void draw_pixel(int x, int y, uint32_t color);
 void draw_line(int x0, int y0, int x1, int y1, uint32_t color);
+void draw_line_depth_tested(line_t line, uint32_t color);
 void draw_rect(int upper_left_pos_x, int upper_left_pos_y, int width, int height, uint32_t color);
 void draw_grid(void);
 
 void clear_color_buffer(uint32_t color);
 void clear_z_buffer(void);
+void swap_color_buffers(void);
 void render_color_buffer(void);
+void resolve_color_buffer(uint32_t* destination, int pitch);
+uint32_t* get_color_buffer_for_overwrite(void);
 
 float get_z_buffer_at(int x, int y);
 void update_z_buffer_at(int x, int y, float value);
 
+void set_depth_format(int format);
+int get_depth_format(void);
+const char* get_depth_format_name(int format);
+int get_depth_format_bytes(int format);
+bool depth_test_at(int x, int y, float reciprocal_w);
+void depth_write_at(int x, int y, float reciprocal_w);
+// Fills timings[NUM_DEPTH_FORMATS], clears the depth buffer and keeps the current format
+void benchmark_depth_formats(int passes, depth_format_timing_t* timings);
+
+bool begin_framebuffer_rect(int* x_min, int* y_min, int* x_max, int* y_max);
+framebuffer_row_t get_framebuffer_row(int y);
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Per-format depth encoding, inlined into the rasterizer inner loops
+///////////////////////////////////////////////////////////////////////////////
+static inline uint32_t depth_float_to_bits(float value) {
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+static inline float depth_bits_to_float(uint32_t bits) {
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+static inline uint32_t depth_encode(int format, float reciprocal_w) {
+	float depth = 1.0f - reciprocal_w;
+	depth = depth < 0.0f ? 0.0f : (depth > 1.0f ? 1.0f : depth);
+	switch (format) {
+	case DEPTH_FORMAT_UNORM16:
+		return (uint32_t)(depth * 65535.0f);
+	case DEPTH_FORMAT_UNORM24:
+		return (uint32_t)(depth * 16777215.0f);
+	case DEPTH_FORMAT_FLOAT_REVERSED:
+		return depth_float_to_bits(reciprocal_w);
+	default:
+		return depth_float_to_bits(1.0f - reciprocal_w);
+	}
+}
+
+// true if the encoded depth a is closer to the camera than b
+static inline bool depth_is_closer(int format, uint32_t a, uint32_t b) {
+	switch (format) {
+	case DEPTH_FORMAT_FLOAT:
+		return depth_bits_to_float(a) < depth_bits_to_float(b);
+	case DEPTH_FORMAT_FLOAT_REVERSED:
+		return depth_bits_to_float(a) > depth_bits_to_float(b);
+	default:
+		return a < b;
+	}
+}
+
+// Depth test at column x of a row, returns the encoded depth through encoded_depth
+static inline bool row_depth_test(const framebuffer_row_t* row, int x, float reciprocal_w, uint32_t* encoded_depth) {
+	*encoded_depth = depth_encode(row->depth_format, reciprocal_w);
+	uint32_t stored = row->depth_format == DEPTH_FORMAT_UNORM16 ? ((uint16_t*)row->depth)[x] : ((uint32_t*)row->depth)[x];
+	bool closer = depth_is_closer(row->depth_format, *encoded_depth, stored);
+	STAT_ADD(pixels_tested, 1);
+	STAT_ADD(pixels_passed, closer);
+	if (row->heat_depth_tests != NULL) {
+		row->heat_depth_tests[x]++;
+	}
+	return closer;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Shading bookkeeping of the rasterizers: wrap the shading code of a pixel in
+// row_shade_clock() and row_count_shade() to feed the statistics and heatmap
+///////////////////////////////////////////////////////////////////////////////
+static inline uint64_t row_shade_clock(const framebuffer_row_t* row) {
+	return row->heat_tile_cycles != NULL ? read_cycle_counter() : 0;
+}
+
+static inline void row_count_shade(const framebuffer_row_t* row, int x, uint64_t shade_start) {
+	STAT_ADD(pixels_shaded, 1);
+	if (row->heat_shades != NULL) {
+		row->heat_shades[x]++;
+		row->heat_tile_cycles[x / CLEAR_TILE_SIZE] += read_cycle_counter() - shade_start;
+	}
+}
+
+static inline void row_depth_write(const framebuffer_row_t* row, int x, uint32_t encoded_depth) {
+	if (row->depth_format == DEPTH_FORMAT_UNORM16) {
+		((uint16_t*)row->depth)[x] = (uint16_t)encoded_depth;
+	}
+	else {
+		((uint32_t*)row->depth)[x] = encoded_depth;
+	}
+}
+
+void init_color_tables(void);
+float gamma_correct(float value);
+vect4_t gamma_correct_color(vect4_t color);
 vect4_t mul_colors(vect4_t c1, vect4_t  c2);
 uint32_t pack_color(float r, float g, float b, float a);
 void unpack_color(uint32_t color, float* r, float* g, float* b, float* a);
+uint32_t pack_color_linear(float r, float g, float b, float a);
+void unpack_color_linear(uint32_t color, float* r, float* g, float* b, float* a);
+
+uint64_t color_to_lanes(uint32_t color);
+uint32_t color_from_lanes(uint64_t lanes);
+uint32_t color_scale(uint32_t color, uint32_t factor);
+uint32_t color_modulate(uint32_t c1, uint32_t c2);
 
 #endif // !DISPLAY_H
 
@@ -0,0 +1,139 @@
+#include <stdlib.h>
+#include <string.h>
+#include "heatmap.h"
+#include "display.h"
+
+#define MIN(a,b)(((a) < (b)) ? (a):(b))
+#define CLAMP(x, lower, upper) ((x) < (lower) ? (lower) : ((x) > (upper) ? (upper) : (x)))
+
+///////////////////////////////////////////////////////////////////////////////
+// Debug counters of the heatmap render method: per pixel depth tests and
+// shading invocations, and shading cycles per CLEAR_TILE_SIZE screen tile
+///////////////////////////////////////////////////////////////////////////////
+static uint16_t* depth_tests = NULL;
+static uint16_t* shades = NULL;
+static uint64_t* tile_cycles = NULL;
+static int heatmap_width = 0;
+static int heatmap_height = 0;
+static int num_tiles_x = 0;
+static int num_tiles_y = 0;
+static int heatmap_view = HEATMAP_OVERDRAW;
+
+static const char* heatmap_view_names[NUM_HEATMAP_VIEWS] = {
+	"overdraw", "shading", "tile cycles"
+};
+
+void set_heatmap_view(int view) {
+	heatmap_view = view;
+}
+
+int get_heatmap_view(void) {
+	return heatmap_view;
+}
+
+const char* get_heatmap_view_name(int view) {
+	return heatmap_view_names[view];
+}
+
+bool is_heatmap_active(void) {
+	return should_render_heatmap() && depth_tests != NULL;
+}
+
+void free_heatmap(void) {
+	free(depth_tests);
+	free(shades);
+	free(tile_cycles);
+	depth_tests = NULL;
+	shades = NULL;
+	tile_cycles = NULL;
+}
+
+// Called at the start of every frame, the buffers are allocated the first time the heatmap is shown
+void clear_heatmap(void) {
+	if (!should_render_heatmap()) {
+		return;
+	}
+
+	int width = get_window_width();
+	int height = get_window_height();
+	if (depth_tests == NULL || width != heatmap_width || height != heatmap_height) {
+		free_heatmap();
+		heatmap_width = width;
+		heatmap_height = height;
+		num_tiles_x = (width + CLEAR_TILE_SIZE - 1) / CLEAR_TILE_SIZE;
+		num_tiles_y = (height + CLEAR_TILE_SIZE - 1) / CLEAR_TILE_SIZE;
+		depth_tests = (uint16_t*)malloc(sizeof(uint16_t) * width * height);
+		shades = (uint16_t*)malloc(sizeof(uint16_t) * width * height);
+		tile_cycles = (uint64_t*)malloc(sizeof(uint64_t) * num_tiles_x * num_tiles_y);
+		if (depth_tests == NULL || shades == NULL || tile_cycles == NULL) {
+			free_heatmap();
+			return;
+		}
+	}
+
+	memset(depth_tests, 0, sizeof(uint16_t) * heatmap_width * heatmap_height);
+	memset(shades, 0, sizeof(uint16_t) * heatmap_width * heatmap_height);
+	memset(tile_cycles, 0, sizeof(uint64_t) * num_tiles_x * num_tiles_y);
+}
+
+uint16_t* get_heatmap_depth_test_row(int y) {
+	return is_heatmap_active() ? depth_tests + (size_t)heatmap_width * y : NULL;
+}
+
+uint16_t* get_heatmap_shade_row(int y) {
+	return is_heatmap_active() ? shades + (size_t)heatmap_width * y : NULL;
+}
+
+// Indexed by x / CLEAR_TILE_SIZE
+uint64_t* get_heatmap_tile_cycle_row(int y) {
+	return is_heatmap_active() ? tile_cycles + (size_t)num_tiles_x * (y / CLEAR_TILE_SIZE) : NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// False color ramp: black, blue, cyan, green, yellow, red for t in [0, 1]
+///////////////////////////////////////////////////////////////////////////////
+static uint32_t heat_color(float t) {
+	static const uint8_t ramp[6][3] = {
+		{ 0, 0, 0 }, { 0, 0, 255 }, { 0, 255, 255 }, { 0, 255, 0 }, { 255, 255, 0 }, { 255, 0, 0 }
+	};
+	t = CLAMP(t, 0.0f, 1.0f) * 5.0f;
+	int index = MIN((int)t, 4);
+	float f = t - index;
+
+	uint32_t color = 0xFF000000;
+	for (int channel = 0; channel < 3; channel++) {
+		float value = ramp[index][channel] + (ramp[index + 1][channel] - ramp[index][channel]) * f;
+		color |= (uint32_t)(value + 0.5f) << (16 - 8 * channel);
+	}
+	return color;
+}
+
+void draw_heatmap(void) {
+	if (!is_heatmap_active()) {
+		return;
+	}
+	uint32_t* pixels = get_color_buffer_for_overwrite();
+
+	if (heatmap_view == HEATMAP_TILE_CYCLES) {
+		uint64_t max_cycles = 1;
+		for (int i = 0; i < num_tiles_x * num_tiles_y; i++) {
+			if (tile_cycles[i] > max_cycles) {
+				max_cycles = tile_cycles[i];
+			}
+		}
+		for (int y = 0; y < heatmap_height; y++) {
+			uint64_t* tile_row = tile_cycles + (size_t)num_tiles_x * (y / CLEAR_TILE_SIZE);
+			for (int x = 0; x < heatmap_width; x++) {
+				pixels[(size_t)heatmap_width * y + x] = heat_color((float)tile_row[x / CLEAR_TILE_SIZE] / max_cycles);
+			}
+		}
+		return;
+	}
+
+	//the per pixel views use a fixed scale so frames and assets stay comparable
+	const uint16_t* counts = heatmap_view == HEATMAP_SHADING ? shades : depth_tests;
+	float scale = 1.0f / (heatmap_view == HEATMAP_SHADING ? HEATMAP_MAX_SHADES : HEATMAP_MAX_OVERDRAW);
+	for (int i = 0; i < heatmap_width * heatmap_height; i++) {
+		pixels[i] = heat_color(counts[i] * scale);
+	}
+}
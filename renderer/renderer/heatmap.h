@@ -0,0 +1,34 @@
+#ifndef HEATMAP_H
+#define HEATMAP_H
+#include <stdint.h>
+#include <stdbool.h>
+
+#define HEATMAP_MAX_OVERDRAW 8      // depth tests per pixel shown at the top of the color ramp
+#define HEATMAP_MAX_SHADES 4        // shading invocations per pixel shown at the top of the color ramp
+
+enum heatmap_view
+{
+	HEATMAP_OVERDRAW,       // depth test attempts per pixel
+	HEATMAP_SHADING,        // shading invocations per pixel
+	HEATMAP_TILE_CYCLES,    // shading cycles per screen tile, relative to the busiest tile
+	NUM_HEATMAP_VIEWS
+};
+
+void set_heatmap_view(int view);
+int get_heatmap_view(void);
+const char* get_heatmap_view_name(int view);
+
+// Counters are only kept while the heatmap render method is active
+bool is_heatmap_active(void);
+void clear_heatmap(void);
+void free_heatmap(void);
+
+// Per row counter pointers for the span writers, NULL while the heatmap is off
+uint16_t* get_heatmap_depth_test_row(int y);
+uint16_t* get_heatmap_shade_row(int y);
+uint64_t* get_heatmap_tile_cycle_row(int y);
+
+// Replace the frame in the color buffer by the false color view
+void draw_heatmap(void);
+
+#endif
@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include "job.h"
+#include "thread.h"
+
+struct job {
+	job_function_t function;
+	void* argument;
+	int unfinished_dependencies;
+	job_t* dependents[MAX_JOB_DEPENDENTS];
+	int num_dependents;
+	unsigned int generation;		// bumped when the job finishes, older handles then read as finished
+};
+
+static job_t jobs[MAX_JOBS];
+static job_t* free_jobs[MAX_JOBS];		// slots of the finished jobs, every unfinished job holds one
+static int num_free_jobs = 0;
+
+//FIFO of the jobs whose dependencies are all finished
+static job_t* ready_jobs[MAX_JOBS];
+static int ready_head = 0;
+static int ready_count = 0;
+
+static thread_t threads[MAX_JOB_THREADS];
+static int num_threads = 0;
+static bool quit = false;
+
+static mutex_t job_mutex;
+static condition_t job_ready;			// a job entered the ready queue, or the workers have to quit
+static condition_t job_finished;
+
+static void push_ready_job(job_t* job) {
+	ready_jobs[(ready_head + ready_count) % MAX_JOBS] = job;
+	ready_count++;
+	condition_signal(&job_ready);
+}
+
+// Called with the mutex held
+static bool is_handle_finished(job_handle_t handle) {
+	return handle.job == NULL || handle.job->generation != handle.generation;
+}
+
+// Called with the mutex held, releases the jobs waiting on this one and recycles the slot
+static void finish_job(job_t* job) {
+	for (int i = 0; i < job->num_dependents; i++) {
+		job_t* dependent = job->dependents[i];
+		if (--dependent->unfinished_dependencies == 0) {
+			push_ready_job(dependent);
+		}
+	}
+	job->generation++;
+	free_jobs[num_free_jobs++] = job;
+	condition_broadcast(&job_finished);
+}
+
+static void job_thread_main(void* argument) {
+	(void)argument;
+	mutex_lock(&job_mutex);
+	for (;;) {
+		while (ready_count == 0 && !quit) {
+			condition_wait(&job_ready, &job_mutex);
+		}
+		if (ready_count == 0) {
+			break;
+		}
+		job_t* job = ready_jobs[ready_head];
+		ready_head = (ready_head + 1) % MAX_JOBS;
+		ready_count--;
+		mutex_unlock(&job_mutex);
+
+		job->function(job->argument);
+
+		mutex_lock(&job_mutex);
+		finish_job(job);
+	}
+	mutex_unlock(&job_mutex);
+}
+
+bool start_job_system(int requested_threads) {
+	if (num_threads > 0) {
+		return true;
+	}
+	int count = requested_threads > 0 ? requested_threads : get_num_cpu_cores();
+	count = count < MAX_JOB_THREADS ? count : MAX_JOB_THREADS;
+
+	mutex_init(&job_mutex);
+	condition_init(&job_ready);
+	condition_init(&job_finished);
+	quit = false;
+	for (int i = 0; i < MAX_JOBS; i++) {
+		free_jobs[i] = &jobs[MAX_JOBS - 1 - i];
+	}
+	num_free_jobs = MAX_JOBS;
+
+	for (int i = 0; i < count; i++) {
+		if (!thread_create(&threads[num_threads], job_thread_main, NULL)) {
+			fprintf(stderr, "Error creating job thread %d. \n", i);
+			break;
+		}
+		num_threads++;
+	}
+	if (num_threads == 0) {
+		mutex_destroy(&job_mutex);
+		condition_destroy(&job_ready);
+		condition_destroy(&job_finished);
+		return false;
+	}
+	return true;
+}
+
+void stop_job_system(void) {
+	if (num_threads == 0) {
+		return;
+	}
+	wait_for_all_jobs();
+
+	mutex_lock(&job_mutex);
+	quit = true;
+	condition_broadcast(&job_ready);
+	mutex_unlock(&job_mutex);
+
+	for (int i = 0; i < num_threads; i++) {
+		thread_join(threads[i]);
+	}
+	num_threads = 0;
+	mutex_destroy(&job_mutex);
+	condition_destroy(&job_ready);
+	condition_destroy(&job_finished);
+}
+
+job_handle_t submit_job(job_function_t function, void* argument, const job_handle_t* dependencies, int num_dependencies) {
+	if (num_threads == 0) {
+		function(argument);
+		return (job_handle_t){ NULL, 0 };
+	}
+
+	mutex_lock(&job_mutex);
+
+	//Every slot holds an unfinished job: let the queue drain and run this job inline,
+	//its dependencies are finished by then
+	if (num_free_jobs == 0) {
+		while (num_free_jobs < MAX_JOBS) {
+			condition_wait(&job_finished, &job_mutex);
+		}
+		mutex_unlock(&job_mutex);
+		function(argument);
+		return (job_handle_t){ NULL, 0 };
+	}
+
+	job_t* job = free_jobs[--num_free_jobs];
+	job->function = function;
+	job->argument = argument;
+	job->unfinished_dependencies = 0;
+	job->num_dependents = 0;
+	job_handle_t handle = { job, job->generation };
+
+	for (int i = 0; i < num_dependencies; i++) {
+		job_handle_t dependency = dependencies[i];
+		if (is_handle_finished(dependency)) {
+			continue;
+		}
+		//a dependency with too many dependents is waited for here instead
+		while (!is_handle_finished(dependency) && dependency.job->num_dependents == MAX_JOB_DEPENDENTS) {
+			condition_wait(&job_finished, &job_mutex);
+		}
+		if (!is_handle_finished(dependency)) {
+			dependency.job->dependents[dependency.job->num_dependents++] = job;
+			job->unfinished_dependencies++;
+		}
+	}
+	if (job->unfinished_dependencies == 0) {
+		push_ready_job(job);
+	}
+
+	mutex_unlock(&job_mutex);
+	return handle;
+}
+
+bool is_job_finished(job_handle_t job) {
+	if (job.job == NULL) {
+		return true;
+	}
+	mutex_lock(&job_mutex);
+	bool finished = is_handle_finished(job);
+	mutex_unlock(&job_mutex);
+	return finished;
+}
+
+void wait_for_job(job_handle_t job) {
+	if (job.job == NULL) {
+		return;
+	}
+	mutex_lock(&job_mutex);
+	while (!is_handle_finished(job)) {
+		condition_wait(&job_finished, &job_mutex);
+	}
+	mutex_unlock(&job_mutex);
+}
+
+void wait_for_all_jobs(void) {
+	if (num_threads == 0) {
+		return;
+	}
+	mutex_lock(&job_mutex);
+	while (num_free_jobs < MAX_JOBS) {
+		condition_wait(&job_finished, &job_mutex);
+	}
+	mutex_unlock(&job_mutex);
+}
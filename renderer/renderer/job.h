@@ -0,0 +1,37 @@
+#ifndef JOB_H
+#define JOB_H
+#include <stdbool.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Job system: a pool of worker threads runs each submitted job once all the
+// jobs it depends on are finished. The slot of a job is recycled as soon as
+// it finishes, the generation in a handle tells the job it was handed out for
+// from the later ones, so a handle never goes stale. The zero handle counts
+// as a finished job. Without started workers every job runs inline when it
+// is submitted.
+///////////////////////////////////////////////////////////////////////////////
+#define MAX_JOBS 1024
+#define MAX_JOB_THREADS 16
+#define MAX_JOB_DEPENDENTS 16		// jobs that can wait on the same job
+
+typedef void (*job_function_t)(void* argument);
+typedef struct job job_t;
+
+typedef struct {
+	job_t* job;
+	unsigned int generation;
+} job_handle_t;
+
+// 0 picks one worker per core
+bool start_job_system(int num_threads);
+void stop_job_system(void);
+
+// Runs the job inline once MAX_JOBS jobs are unfinished
+job_handle_t submit_job(job_function_t function, void* argument, const job_handle_t* dependencies, int num_dependencies);
+bool is_job_finished(job_handle_t job);
+void wait_for_job(job_handle_t job);
+
+// Waits until the queue is drained
+void wait_for_all_jobs(void);
+
+#endif
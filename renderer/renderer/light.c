@@ -1,4 +1,7 @@
 
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
 #include "light.h"
 #include "display.h"
 #include "mesh.h"
@@ -8,6 +11,22 @@
 
 light_t light;
 
+//list of point and spot lights in the scene
+static local_light_t local_lights[MAX_NUM_LIGHTS];
+static int num_local_lights = 0;
+
+//one bit per local light for every screen tile, rebuilt each frame by cull_lights_to_tiles
+static uint64_t* tile_light_masks = NULL;
+static int num_tiles_x = 0;
+static int num_tiles_y = 0;
+
+//copy published for the raster stage, so the next frame can be culled while this one is shaded
+static local_light_t shading_lights[MAX_NUM_LIGHTS];
+static int num_shading_lights = 0;
+static uint64_t* shading_tile_masks = NULL;
+static int num_shading_tiles_x = 0;
+static int num_shading_tiles_y = 0;
+
 /// <summary>
 /// Interpolate the color
 /// </summary>
@@ -33,15 +52,191 @@ float get_light_ambient_strgenth(void) {
 	return light.ambient_strength;
 }
 
+int add_point_light(vect3_t position, vect3_t color, float intensity, float range) {
+	if (num_local_lights >= MAX_NUM_LIGHTS) {
+		return -1;
+	}
+	local_light_t* local_light = &local_lights[num_local_lights];
+	local_light->type = LIGHT_POINT;
+	local_light->position = position;
+	local_light->direction = vect3_new(0.0f, 0.0f, 1.0f);
+	local_light->color = color;
+	local_light->intensity = intensity;
+	local_light->range = range;
+	local_light->cos_inner_cone = -1.0f;
+	local_light->cos_outer_cone = -1.0f;
+	return num_local_lights++;
+}
+
+int add_spot_light(vect3_t position, vect3_t direction, vect3_t color, float intensity, float range,
+	float inner_angle, float outer_angle) {
+	int index = add_point_light(position, color, intensity, range);
+	if (index < 0) {
+		return -1;
+	}
+	vect3_normalize(&direction);
+	local_lights[index].type = LIGHT_SPOT;
+	local_lights[index].direction = direction;
+	local_lights[index].cos_inner_cone = cosf(inner_angle);
+	local_lights[index].cos_outer_cone = cosf(outer_angle);
+	return index;
+}
+
+void clear_local_lights(void) {
+	num_local_lights = 0;
+}
+
+int get_num_local_lights(void) {
+	return num_local_lights;
+}
+
+local_light_t* get_local_light(int index) {
+	return &local_lights[index];
+}
+
+/// The lights as culled by the last published frame, read by the shading code
+const local_light_t* get_shading_light(int index) {
+	return &shading_lights[index];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Windowed inverse square falloff, reaches exactly zero at the light range
+///////////////////////////////////////////////////////////////////////////////
+// attenuation = clamp(1 - (d/range)^4, 0, 1)^2 / (d^2 + 1)
+///////////////////////////////////////////////////////////////////////////////
+float light_range_attenuation(float distance, float range) {
+	float ratio = distance / range;
+	float ratio4 = ratio * ratio * ratio * ratio;
+	float window = CLAMP(1.0f - ratio4, 0.0f, 1.0f);
+	return (window * window) / (distance * distance + 1.0f);
+}
+
+/// Smooth falloff between the inner and outer cone of a spot light (always 1 for point lights)
+float light_spot_attenuation(const local_light_t* local_light, vect3_t light_to_point) {
+	if (local_light->type != LIGHT_SPOT) {
+		return 1.0f;
+	}
+	vect3_normalize(&light_to_point);
+	float cos_angle = vect3_dot(light_to_point, local_light->view_direction);
+	float t = (cos_angle - local_light->cos_outer_cone) / fmaxf(local_light->cos_inner_cone - local_light->cos_outer_cone, 1e-4f);
+	t = CLAMP(t, 0.0f, 1.0f);
+	return t * t * (3.0f - 2.0f * t);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Assign every local light to the screen tiles its range sphere can touch
+///////////////////////////////////////////////////////////////////////////////
+// The sphere is bounded in camera space by the box [x-r, x+r] x [y-r, y+r] x [z-r, z+r];
+// the projected x/z and y/z are extreme at the corners of that box, so projecting
+// the near and far corners gives a conservative screen rectangle.
+// Spheres crossing the near plane cover the whole screen.
+///////////////////////////////////////////////////////////////////////////////
+void cull_lights_to_tiles(mat4_t view_matrix, mat4_t proj_matrix, int screen_width, int screen_height) {
+
+	int tiles_x = (screen_width + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+	int tiles_y = (screen_height + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+
+	if (tiles_x != num_tiles_x || tiles_y != num_tiles_y) {
+		free(tile_light_masks);
+		tile_light_masks = (uint64_t*)malloc(sizeof(uint64_t) * tiles_x * tiles_y);
+		num_tiles_x = tiles_x;
+		num_tiles_y = tiles_y;
+	}
+	memset(tile_light_masks, 0, sizeof(uint64_t) * tiles_x * tiles_y);
+
+	float half_width = screen_width / 2.0f;
+	float half_height = screen_height / 2.0f;
+
+	for (int i = 0; i < num_local_lights; i++) {
+		local_light_t* local_light = &local_lights[i];
+
+		//move the light to camera space where the shading happens
+		local_light->view_position = vect3_from_vect4(mat4_mul_vect4(view_matrix, vect4_from_vect3(local_light->position)));
+		local_light->view_direction = mat4_mul_vect3_no_translation(view_matrix, local_light->direction);
+
+		vect3_t p = local_light->view_position;
+		float r = local_light->range;
+
+		//the whole sphere is behind the camera
+		if (p.z + r <= 0.0f) {
+			continue;
+		}
+
+		int x_min = 0;
+		int y_min = 0;
+		int x_max = tiles_x - 1;
+		int y_max = tiles_y - 1;
+
+		if (p.z - r > 0.0f) {
+			float z_near = p.z - r;
+			float z_far = p.z + r;
+
+			float ndc_x_min = fminf((p.x - r) / z_near, (p.x - r) / z_far) * proj_matrix.m[0][0];
+			float ndc_x_max = fmaxf((p.x + r) / z_near, (p.x + r) / z_far) * proj_matrix.m[0][0];
+			float ndc_y_min = fminf((p.y - r) / z_near, (p.y - r) / z_far) * proj_matrix.m[1][1];
+			float ndc_y_max = fmaxf((p.y + r) / z_near, (p.y + r) / z_far) * proj_matrix.m[1][1];
+
+			//the screen y axis is flipped
+			float screen_x_min = ndc_x_min * half_width + half_width;
+			float screen_x_max = ndc_x_max * half_width + half_width;
+			float screen_y_min = -ndc_y_max * half_height + half_height;
+			float screen_y_max = -ndc_y_min * half_height + half_height;
+
+			if (screen_x_max < 0 || screen_y_max < 0 || screen_x_min >= screen_width || screen_y_min >= screen_height) {
+				continue;
+			}
+
+			x_min = (int)fmaxf(screen_x_min, 0.0f) / LIGHT_TILE_SIZE;
+			x_max = (int)fminf(screen_x_max, screen_width - 1.0f) / LIGHT_TILE_SIZE;
+			y_min = (int)fmaxf(screen_y_min, 0.0f) / LIGHT_TILE_SIZE;
+			y_max = (int)fminf(screen_y_max, screen_height - 1.0f) / LIGHT_TILE_SIZE;
+		}
+
+		uint64_t light_bit = (uint64_t)1 << i;
+		for (int ty = y_min; ty <= y_max; ty++) {
+			for (int tx = x_min; tx <= x_max; tx++) {
+				tile_light_masks[ty * tiles_x + tx] |= light_bit;
+			}
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Hand the culled lights to the raster stage, called while it is idle
+///////////////////////////////////////////////////////////////////////////////
+void publish_light_tiles(void) {
+	if (num_shading_tiles_x != num_tiles_x || num_shading_tiles_y != num_tiles_y) {
+		free(shading_tile_masks);
+		shading_tile_masks = (uint64_t*)malloc(sizeof(uint64_t) * num_tiles_x * num_tiles_y);
+		num_shading_tiles_x = num_tiles_x;
+		num_shading_tiles_y = num_tiles_y;
+	}
+	if (tile_light_masks != NULL) {
+		memcpy(shading_tile_masks, tile_light_masks, sizeof(uint64_t) * num_tiles_x * num_tiles_y);
+	}
+	memcpy(shading_lights, local_lights, sizeof(local_light_t) * num_local_lights);
+	num_shading_lights = num_local_lights;
+}
+
+/// Return the set of local lights that can affect the pixel (x,y), one bit per light
+uint64_t get_tile_light_mask(int x, int y) {
+	if (shading_tile_masks == NULL || num_shading_lights == 0) {
+		return 0;
+	}
+	int tx = x / LIGHT_TILE_SIZE;
+	int ty = y / LIGHT_TILE_SIZE;
+	if (tx < 0 || ty < 0 || tx >= num_shading_tiles_x || ty >= num_shading_tiles_y) {
+		return 0;
+	}
+	return shading_tile_masks[ty * num_shading_tiles_x + tx];
+}
+
 uint32_t light_apply_intensity(uint32_t original_color, float percentage_factor) {
 
-	uint32_t a = (original_color & 0xFF000000);
-	uint32_t r = (original_color & 0x00FF0000) * percentage_factor;
-	uint32_t g = (original_color & 0x0000FF00) * percentage_factor;
-	uint32_t b = (original_color & 0x000000FF) * percentage_factor;
-	
-	uint32_t new_color = a | (r & 0x00FF0000) | (g & 0x0000FF00) | (b & 0x000000FF) ;
-	return new_color;
+	//scale r, g, b with a 8.8 fixed-point factor and keep the original alpha
+	uint32_t factor = (uint32_t)(CLAMP(percentage_factor, 0.0f, 1.0f) * 256.0f + 0.5f);
+	uint32_t new_color = color_scale(original_color, factor);
+	return (original_color & 0xFF000000) | (new_color & 0x00FFFFFF);
 }
 
 /// <summary>
@@ -133,7 +328,7 @@ uint32_t phong_reflection(vect3_t normal, vect3_t tangent, vect3_t bitangent, ve
 	unpack_color(tangent_normal_data, &unpacked_normal.x, &unpacked_normal.y, &unpacked_normal.z, &unpacked_normal.w);
 
 	//transform tangent normal vector from [0, 1] to range [-1, 1] 
-	vect3_t tangent_space_normal = vect3_sub(vect3_mul(vect3_from_vect4(unpacked_normal), 2.0f), vect3_new(1.0f, 1.0f, 1.0f, 1.0f));
+	vect3_t tangent_space_normal = vect3_sub(vect3_mul(vect3_from_vect4(unpacked_normal), 2.0f), vect3_new(1.0f, 1.0f, 1.0f));
 	vect3_normalize(&tangent_space_normal);
 
 	///Transform the tangent space normal to worldspace and became perterbed normal
@@ -237,55 +432,71 @@ uint32_t phong_reflection(vect3_t normal, vect3_t tangent, vect3_t bitangent, ve
 
 
 /// <summary>
-/// Use the metallic and roughness maps to compute the reflectance properties of the material
+/// Decode the normal and material maps of a pixel once, for the directional light and the local lights.
 /// </summary>
-uint32_t pbr_reflection(vect3_t normal, vect3_t tangent, vect3_t bitangent, vect3_t light_direction,
-					vect3_t view_direction, uint32_t albedo_map, uint32_t normal_map, uint32_t metallic_map, 
-					uint32_t roughness_map, uint32_t ao_map) {
+pbr_surface_t decode_pbr_surface(vect3_t normal, vect3_t tangent, vect3_t bitangent, uint32_t albedo_map,
+					uint32_t normal_map, uint32_t metallic_map, uint32_t roughness_map, uint32_t ao_map) {
 
-	//Initialize light colors
-	vect3_t light_color = get_light_color();
+	pbr_surface_t surface;
 
 	//Normalize the input vector
-	vect3_normalize(&light_direction);
 	vect3_normalize(&normal);
 	vect3_normalize(&tangent);
 	vect3_normalize(&bitangent);
-	vect3_normalize(&view_direction);
-
-	//Calculate halfway direction
-	vect3_t halfway_direction = vect3_add(view_direction, vect3_mul(light_direction, -1.0f));
-	vect3_normalize(&halfway_direction);
-
 
 	//unpack the tangent space normal data from normalmap to temp variable of range [0, 1]
 	vect4_t unpacked_normal = vect4_new(0.0f, 0.0f, 0.0f, 0.0f);
 	unpack_color(normal_map, &unpacked_normal.x, &unpacked_normal.y, &unpacked_normal.z, &unpacked_normal.w);
 	
 	//transform tangent normal vector from [0, 1] to range [-1, 1] 
-	vect3_t tangent_space_normal = vect3_sub(vect3_mul(vect3_from_vect4(unpacked_normal), 2.0f), vect3_new(1.0f, 1.0f, 1.0f, 1.0f));
+	vect3_t tangent_space_normal = vect3_sub(vect3_mul(vect3_from_vect4(unpacked_normal), 2.0f), vect3_new(1.0f, 1.0f, 1.0f));
 	vect3_normalize(&tangent_space_normal);
 
 	///Transform the tangent space normal to worldspace and became perterbed normal
-	vect3_t perturbed_normal = transform_NBT_to_world(tangent, bitangent, normal, tangent_space_normal);
-	//vect3_t perturbed_normal = transform_TBN_to_world(tangent, bitangent, normal, tangent_space_normal);
+	surface.normal = transform_NBT_to_world(tangent, bitangent, normal, tangent_space_normal);
+	//surface.normal = transform_TBN_to_world(tangent, bitangent, normal, tangent_space_normal);
 
-	//unpack the material color 
+	//unpack the material color from sRGB to linear space
 	vect4_t albedo_color = vect4_new(0.0f, 0.0f, 0.0f, 0.0f);
-	unpack_color(albedo_map, &albedo_color.x, &albedo_color.y, &albedo_color.z, &albedo_color.w);
-	vect3_t albedo = {albedo_color.x, albedo_color.y, albedo_color.z};
+	unpack_color_linear(albedo_map, &albedo_color.x, &albedo_color.y, &albedo_color.z, &albedo_color.w);
+	surface.albedo = vect3_new(albedo_color.x, albedo_color.y, albedo_color.z);
 
 	vect4_t ao_color = vect4_new(0.0f, 0.0f, 0.0f, 0.0f);
 	unpack_color(ao_map, &ao_color.x, &ao_color.y, &ao_color.z, &ao_color.w);
-	float ao = ao_color.x;
+	surface.ao = ao_color.x;
 
 	vect4_t metallic_color = vect4_new(0.0f, 0.0f, 0.0f, 0.0f);
 	unpack_color(metallic_map, &metallic_color.x, &metallic_color.y, &metallic_color.z, &metallic_color.w);
-	vect3_t metallic = { metallic_color.x, metallic_color.y, metallic_color.z };
+	surface.metallic = vect3_new(metallic_color.x, metallic_color.y, metallic_color.z);
 
 	vect4_t roughness_color = vect4_new(0.0f, 0.0f, 0.0f, 0.0f);
 	unpack_color(roughness_map, &roughness_color.x, &roughness_color.y, &roughness_color.z, &roughness_color.w);
-	float roughness = roughness_color.x;
+	surface.roughness = roughness_color.x;
+
+	return surface;
+}
+
+/// <summary>
+/// Linear radiance of the directional light reflected by a decoded metallic-roughness surface, not clamped.
+/// The light visibility scales the radiance of the directional light (shadow map).
+/// </summary>
+vect3_t pbr_reflection(const pbr_surface_t* surface, vect3_t light_direction, vect3_t view_direction, float light_visibility) {
+
+	//Initialize light colors
+	vect3_t light_color = vect3_mul(get_light_color(), light_visibility);
+
+	//Normalize the input vector
+	vect3_normalize(&light_direction);
+	vect3_normalize(&view_direction);
+
+	//Calculate halfway direction
+	vect3_t halfway_direction = vect3_add(view_direction, vect3_mul(light_direction, -1.0f));
+	vect3_normalize(&halfway_direction);
+
+	vect3_t perturbed_normal = surface->normal;
+	vect3_t albedo = surface->albedo;
+	vect3_t metallic = surface->metallic;
+	float roughness = surface->roughness;
 	float roughness2 = roughness * roughness;
 
 	// Calculate dot product needed for the BRDF calculation
@@ -342,15 +553,10 @@ uint32_t pbr_reflection(vect3_t normal, vect3_t tangent, vect3_t bitangent, vect
 
 	};
 
-	// Clamp the results to [0, 1]
-	result.x = CLAMP(result.x, 0.0f, 1.0f);
-	result.y = CLAMP(result.y, 0.0f, 1.0f);
-	result.z = CLAMP(result.z, 0.0f, 1.0f);
-
 	//Apply ambient occlusion (AO) to the final color
-	/*result.x *= ao;
-	result.y *= ao;
-	result.z *= ao;*/
+	/*result.x *= surface->ao;
+	result.y *= surface->ao;
+	result.z *= surface->ao;*/
 
-	return pack_color(result.x, result.y, result.z, 1.0f);
+	return result;
 }
\ No newline at end of file
@@ -2,6 +2,10 @@
 #define LIGHT_H
 #include <stdint.h>
 #include "vector.h"
+#include "matrix.h"
+
+#define MAX_NUM_LIGHTS 64		//must fit in the 64-bit light mask of a tile
+#define LIGHT_TILE_SIZE 16		//screen tiles are LIGHT_TILE_SIZE x LIGHT_TILE_SIZE pixels
 
 typedef struct {
 
@@ -11,6 +15,36 @@ typedef struct {
 
 } light_t;
 
+enum light_type {
+	LIGHT_POINT,
+	LIGHT_SPOT
+};
+
+typedef struct {
+
+	int type;
+	vect3_t position;			//world space position
+	vect3_t direction;			//world space spot direction
+	vect3_t color;
+	float intensity;
+	float range;				//the light has no influence beyond this distance
+	float cos_inner_cone;		//spot light full intensity inside this cone
+	float cos_outer_cone;		//spot light falls off to zero at this cone
+	vect3_t view_position;		//camera space position, updated when the lights are culled
+	vect3_t view_direction;		//camera space spot direction, updated when the lights are culled
+
+} local_light_t;
+
+typedef struct {
+
+	vect3_t normal;				//normal perturbed by the normal map
+	vect3_t albedo;				//linear color
+	vect3_t metallic;
+	float roughness;
+	float ao;
+
+} pbr_surface_t;				//metallic-roughness inputs of a pixel, shared by every light
+
 
 void init_light(vect3_t direction, vect3_t color, float ambient);
 
@@ -18,6 +52,20 @@ vect3_t get_light_direction(void);
 vect3_t get_light_color(void);
 float get_light_ambient_strgenth(void);
 
+int add_point_light(vect3_t position, vect3_t color, float intensity, float range);
+int add_spot_light(vect3_t position, vect3_t direction, vect3_t color, float intensity, float range,
+	float inner_angle, float outer_angle);
+void clear_local_lights(void);
+int get_num_local_lights(void);
+local_light_t* get_local_light(int index);
+const local_light_t* get_shading_light(int index);
+float light_range_attenuation(float distance, float range);
+float light_spot_attenuation(const local_light_t* local_light, vect3_t light_to_point);
+
+void cull_lights_to_tiles(mat4_t view_matrix, mat4_t proj_matrix, int screen_width, int screen_height);
+void publish_light_tiles(void);
+uint64_t get_tile_light_mask(int x, int y);
+
 uint32_t light_apply_intensity(uint32_t original_color, float percentage_factor);
 
 uint32_t blinn_phong_reflection(vect3_t normal, vect3_t light_direction, vect3_t view_direction, 
@@ -26,9 +74,9 @@ uint32_t blinn_phong_reflection(vect3_t normal, vect3_t light_direction, vect3_t
 uint32_t phong_reflection(vect3_t normal, vect3_t tangent, vect3_t bitangent, vect3_t light_direction, vect3_t view_direction,
 	uint32_t color, uint32_t glowmap, uint32_t roughmap, uint32_t tangent_normal, float shininess);
 
-uint32_t pbr_reflection(vect3_t normal, vect3_t tangent, vect3_t bitangent, vect3_t light_direction,
-	vect3_t view_direction, uint32_t albedo_map, uint32_t normal_map, uint32_t metallic_map,
-	uint32_t roughness_map, uint32_t ao_map);
+pbr_surface_t decode_pbr_surface(vect3_t normal, vect3_t tangent, vect3_t bitangent, uint32_t albedo_map,
+	uint32_t normal_map, uint32_t metallic_map, uint32_t roughness_map, uint32_t ao_map);
+vect3_t pbr_reflection(const pbr_surface_t* surface, vect3_t light_direction, vect3_t view_direction, float light_visibility);
 
 #endif 
 
@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mapped_file.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+static bool read_whole_file(mapped_file_t* file, const char* filename) {
+	FILE* stream = fopen(filename, "rb");
+	if (stream == NULL) {
+		return false;
+	}
+	fseek(stream, 0, SEEK_END);
+	long size = ftell(stream);
+	fseek(stream, 0, SEEK_SET);
+
+	char* data = (char*)malloc(size > 0 ? (size_t)size : 1);
+	if (data == NULL || size < 0 || fread(data, 1, (size_t)size, stream) != (size_t)size) {
+		free(data);
+		fclose(stream);
+		return false;
+	}
+	fclose(stream);
+	file->data = data;
+	file->size = (size_t)size;
+	file->mapped = false;
+	return true;
+}
+
+bool map_file(mapped_file_t* file, const char* filename) {
+	memset(file, 0, sizeof(mapped_file_t));
+#if defined(_WIN32)
+	HANDLE handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (handle != INVALID_HANDLE_VALUE) {
+		LARGE_INTEGER size;
+		if (GetFileSizeEx(handle, &size) && size.QuadPart > 0) {
+			HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (mapping != NULL) {
+				file->data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+				if (file->data != NULL) {
+					file->size = (size_t)size.QuadPart;
+					file->mapped = true;
+					file->file = handle;
+					file->mapping = mapping;
+					return true;
+				}
+				CloseHandle(mapping);
+			}
+		}
+		CloseHandle(handle);
+	}
+#else
+	int descriptor = open(filename, O_RDONLY);
+	if (descriptor >= 0) {
+		struct stat info;
+		if (fstat(descriptor, &info) == 0 && info.st_size > 0) {
+			void* data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+			if (data != MAP_FAILED) {
+				madvise(data, (size_t)info.st_size, MADV_SEQUENTIAL);
+				close(descriptor);
+				file->data = (const char*)data;
+				file->size = (size_t)info.st_size;
+				file->mapped = true;
+				return true;
+			}
+		}
+		close(descriptor);
+	}
+#endif
+	//empty files can not be mapped, and some file systems do not support it
+	return read_whole_file(file, filename);
+}
+
+void unmap_file(mapped_file_t* file) {
+	if (file->data == NULL) {
+		return;
+	}
+	if (!file->mapped) {
+		free((void*)file->data);
+	}
+	else {
+#if defined(_WIN32)
+		UnmapViewOfFile(file->data);
+		CloseHandle((HANDLE)file->mapping);
+		CloseHandle((HANDLE)file->file);
+#else
+		munmap((void*)file->data, file->size);
+#endif
+	}
+	file->data = NULL;
+	file->size = 0;
+}
+
+// 64-bit multiply xorshift hash over whole words, the tail byte by byte
+uint64_t hash_bytes(const char* data, size_t size) {
+	uint64_t hash = 0xCBF29CE484222325ull ^ (uint64_t)size;
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8) {
+		uint64_t word;
+		memcpy(&word, data + i, sizeof(word));
+		hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+		hash ^= hash >> 29;
+	}
+	for (; i < size; i++) {
+		hash = (hash ^ (uint8_t)data[i]) * 0x100000001B3ull;
+	}
+	return hash;
+}
@@ -0,0 +1,25 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Read only view of a whole file, memory mapped when the platform allows it
+// and read into a heap buffer otherwise
+///////////////////////////////////////////////////////////////////////////////
+typedef struct {
+	const char* data;
+	size_t size;
+	bool mapped;
+	void* file;			// Win32 file and mapping handles
+	void* mapping;
+} mapped_file_t;
+
+bool map_file(mapped_file_t* file, const char* filename);
+void unmap_file(mapped_file_t* file);
+
+// Content hash of a file view, equal contents give equal hashes
+uint64_t hash_bytes(const char* data, size_t size);
+
+#endif
@@ -1,6 +1,15 @@
 #include <math.h>
 #include "matrix.h"
 
+//Pick the widest SIMD instruction set the compiler is allowed to emit for the batch transforms
+#if defined(__AVX__)
+#include <immintrin.h>
+#define MATRIX_SIMD_AVX
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define MATRIX_SIMD_SSE
+#endif
+
 mat4_t mat4_identity(void){
 	// | 1 0 0 0 |
 	// | 0 1 0 0 |
@@ -414,3 +423,105 @@ vect3_t transform_TBN_to_world(vect3_t tangent, vect3_t bitangent, vect3_t norma
 
 }
 
+
+
+// Function to keep only the upper 3x3 part of a matrix (drops translation and projection terms)
+mat4_t mat4_make_linear(mat4_t m) {
+	mat4_t result = m;
+	result.m[0][3] = 0;
+	result.m[1][3] = 0;
+	result.m[2][3] = 0;
+	result.m[3][0] = 0;
+	result.m[3][1] = 0;
+	result.m[3][2] = 0;
+	result.m[3][3] = 1;
+	return result;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+// Batch transform of a position stream (w = 1) by a 4x4 matrix
+//////////////////////////////////////////////////////////////////////////////////
+//  out.x[i] = m00*x[i] + m01*y[i] + m02*z[i] + m03
+//  out.y[i] = m10*x[i] + m11*y[i] + m12*z[i] + m13
+//  out.z[i] = m20*x[i] + m21*y[i] + m22*z[i] + m23
+//  out.w[i] = m30*x[i] + m31*y[i] + m32*z[i] + m33
+// Each matrix element is broadcast once, then 4 (SSE) or 8 (AVX) vertices are
+// transformed per iteration straight out of the x[], y[], z[] streams.
+//////////////////////////////////////////////////////////////////////////////////
+void mat4_mul_vect3_stream(mat4_t m, const vect3_stream_t* in, vect4_stream_t* out) {
+	vect4_stream_reserve(out, in->count);
+
+	//the streams are padded to whole SIMD lanes, so the loop runs over full lanes only
+	int count = (in->count + VECT_STREAM_LANES - 1) / VECT_STREAM_LANES * VECT_STREAM_LANES;
+	float* rows_out[4] = { out->x, out->y, out->z, out->w };
+
+	for (int r = 0; r < 4; r++) {
+		float* o = rows_out[r];
+#if defined(MATRIX_SIMD_AVX)
+		__m256 m0 = _mm256_set1_ps(m.m[r][0]);
+		__m256 m1 = _mm256_set1_ps(m.m[r][1]);
+		__m256 m2 = _mm256_set1_ps(m.m[r][2]);
+		__m256 m3 = _mm256_set1_ps(m.m[r][3]);
+		for (int i = 0; i < count; i += 8) {
+			__m256 result = _mm256_add_ps(_mm256_mul_ps(m0, _mm256_load_ps(in->x + i)), m3);
+			result = _mm256_add_ps(result, _mm256_mul_ps(m1, _mm256_load_ps(in->y + i)));
+			result = _mm256_add_ps(result, _mm256_mul_ps(m2, _mm256_load_ps(in->z + i)));
+			_mm256_store_ps(o + i, result);
+		}
+#elif defined(MATRIX_SIMD_SSE)
+		__m128 m0 = _mm_set1_ps(m.m[r][0]);
+		__m128 m1 = _mm_set1_ps(m.m[r][1]);
+		__m128 m2 = _mm_set1_ps(m.m[r][2]);
+		__m128 m3 = _mm_set1_ps(m.m[r][3]);
+		for (int i = 0; i < count; i += 4) {
+			__m128 result = _mm_add_ps(_mm_mul_ps(m0, _mm_load_ps(in->x + i)), m3);
+			result = _mm_add_ps(result, _mm_mul_ps(m1, _mm_load_ps(in->y + i)));
+			result = _mm_add_ps(result, _mm_mul_ps(m2, _mm_load_ps(in->z + i)));
+			_mm_store_ps(o + i, result);
+		}
+#else
+		for (int i = 0; i < count; i++) {
+			o[i] = m.m[r][0] * in->x[i] + m.m[r][1] * in->y[i] + m.m[r][2] * in->z[i] + m.m[r][3];
+		}
+#endif
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+// Batch transform of a direction stream (normals, tangents) by the upper 3x3 of a matrix
+//////////////////////////////////////////////////////////////////////////////////
+void mat4_mul_vect3_stream_no_translation(mat4_t m, const vect3_stream_t* in, vect3_stream_t* out) {
+	vect3_stream_reserve(out, in->count);
+
+	int count = (in->count + VECT_STREAM_LANES - 1) / VECT_STREAM_LANES * VECT_STREAM_LANES;
+	float* rows_out[3] = { out->x, out->y, out->z };
+
+	for (int r = 0; r < 3; r++) {
+		float* o = rows_out[r];
+#if defined(MATRIX_SIMD_AVX)
+		__m256 m0 = _mm256_set1_ps(m.m[r][0]);
+		__m256 m1 = _mm256_set1_ps(m.m[r][1]);
+		__m256 m2 = _mm256_set1_ps(m.m[r][2]);
+		for (int i = 0; i < count; i += 8) {
+			__m256 result = _mm256_mul_ps(m0, _mm256_load_ps(in->x + i));
+			result = _mm256_add_ps(result, _mm256_mul_ps(m1, _mm256_load_ps(in->y + i)));
+			result = _mm256_add_ps(result, _mm256_mul_ps(m2, _mm256_load_ps(in->z + i)));
+			_mm256_store_ps(o + i, result);
+		}
+#elif defined(MATRIX_SIMD_SSE)
+		__m128 m0 = _mm_set1_ps(m.m[r][0]);
+		__m128 m1 = _mm_set1_ps(m.m[r][1]);
+		__m128 m2 = _mm_set1_ps(m.m[r][2]);
+		for (int i = 0; i < count; i += 4) {
+			__m128 result = _mm_mul_ps(m0, _mm_load_ps(in->x + i));
+			result = _mm_add_ps(result, _mm_mul_ps(m1, _mm_load_ps(in->y + i)));
+			result = _mm_add_ps(result, _mm_mul_ps(m2, _mm_load_ps(in->z + i)));
+			_mm_store_ps(o + i, result);
+		}
+#else
+		for (int i = 0; i < count; i++) {
+			o[i] = m.m[r][0] * in->x[i] + m.m[r][1] * in->y[i] + m.m[r][2] * in->z[i];
+		}
+#endif
+	}
+}
@@ -26,6 +26,10 @@ mat4_t mat4_make_inverse(mat4_t m);
 vect3_t transform_NBT_to_world(vect3_t tangent, vect3_t bitangent, vect3_t normal, vect3_t tangent_normal);
 vect3_t transform_TBN_to_world(vect3_t tangent, vect3_t bitangent, vect3_t normal, vect3_t tangent_normal);
 
+mat4_t mat4_make_linear(mat4_t m);
+void mat4_mul_vect3_stream(mat4_t m, const vect3_stream_t* in, vect4_stream_t* out);
+void mat4_mul_vect3_stream_no_translation(mat4_t m, const vect3_stream_t* in, vect3_stream_t* out);
+
 
 
 #endif 
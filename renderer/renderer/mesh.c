@@ -3,129 +3,47 @@
 #include <stdlib.h>
 #include "array.h"
 #include "mesh.h"
-#include "material.h"
+#include "obj.h"
+#include "mesh_cache.h"
+#include "vertex_cache.h"
+#include "job.h"
+#include "texture_cache.h"
+#include "texture_stream.h"
 
 #define MAX_NUM_MESHES 10
 static mesh_t meshes[MAX_NUM_MESHES];
 static int mesh_count = 0;
 
-void load_mesh(char* obj_filename, char* png_filename, vect3_t scale, vect3_t translation, vect3_t rotation) {
-
-	load_mesh_obj_data(&meshes[mesh_count], obj_filename);
-	load_mesh_png_data(&meshes[mesh_count], png_filename);
-	meshes[mesh_count].scale = scale;
-	meshes[mesh_count].rotation = rotation;
-	meshes[mesh_count].translation = translation;
-	mesh_count++;
-}
-
-void load_mesh_with_normalmap(char* obj_filename, char* png_filename, char* normalmap_filename, 
-	char* glowmap_filename, char* metalmap_filename,
-	vect3_t scale, vect3_t translation, vect3_t rotation) {
-
-	load_mesh_obj_data(&meshes[mesh_count], obj_filename);
-	load_mesh_png_data(&meshes[mesh_count], png_filename);
-	load_mesh_normalmap_data(&meshes[mesh_count], normalmap_filename);
-	load_mesh_glowmap_data(&meshes[mesh_count], glowmap_filename);
-	load_mesh_roughmap_data(&meshes[mesh_count], metalmap_filename);
-	meshes[mesh_count].scale = scale;
-	meshes[mesh_count].rotation = rotation;
-	meshes[mesh_count].translation = translation;
-	mesh_count++;
-
-}
-
-
-void load_mesh_with_pbr(char* obj_filename, char* png_filename, char* normalmap_filename,
-	char* glowmap_filename, char* roughmap_filename, char* metalmap_filename, char* aomap_filename,
-	vect3_t scale, vect3_t translation, vect3_t rotation) {
-
-	load_mesh_obj_data(&meshes[mesh_count], obj_filename);
-	load_mesh_png_data(&meshes[mesh_count], png_filename);
-	load_mesh_normalmap_data(&meshes[mesh_count], normalmap_filename);
-	load_mesh_glowmap_data(&meshes[mesh_count], glowmap_filename);
-	load_mesh_metalmap_data(&meshes[mesh_count], metalmap_filename);
-	load_mesh_roughmap_data(&meshes[mesh_count], roughmap_filename);
-	load_mesh_aomap_data(&meshes[mesh_count], aomap_filename);
-	meshes[mesh_count].scale = scale;
-	meshes[mesh_count].rotation = rotation;
-	meshes[mesh_count].translation = translation;
-	mesh_count++;
-
-}
-
-
+//////////////////////////////////////////////////////////////////////////////////
+// Load the geometry of an OBJ file with its vertex normals, tangents and
+// bitangents, from the mesh cache when it is up to date
+//////////////////////////////////////////////////////////////////////////////////
 void load_mesh_obj_data(mesh_t* mesh, char* obj_filename){
-	FILE* file;
-	file = fopen(obj_filename, "r");
-	char line[1024];
-	
-	tex2_t* texcoords = NULL;
 	mesh->num_faces = 0;
 	mesh->num_vertices = 0;
 	mesh->num_model_normals = 0;
-	while (fgets(line, 1024, file))
-	{
-		//model vertex infomation
-		if (strncmp(line, "v ", 2) == 0){
-			vect3_t vertex;
-			sscanf(line, "v %f %f %f", &vertex.x, &vertex.y, &vertex.z);
-			array_push(mesh->vertices, vertex);
-			mesh->num_vertices++;
-		}
-
-		//model texture infomation
-		if (strncmp(line, "vt ", 3) == 0){
-
-			tex2_t texcoord;
-			sscanf(line, "vt %f %f", &texcoord.u, &texcoord.v);
-			array_push(texcoords, texcoord);
-		}
-
-		//model normal infomation
-		if (strncmp(line, "vn ", 3) == 0) {
-			vect3_t model_normal;
-			sscanf(line, "vn %f %f %f", &model_normal.x, &model_normal.y, &model_normal.z);
-			array_push(mesh->model_normals, model_normal);
-			mesh->num_model_normals++;
-		}
-
-		//face infomation
-		if (strncmp(line, "f ",2) == 0){
-			int vertex_indices[3];
-			int texture_indices[3];
-			int normal_indices[3];
-			
-			sscanf(
-				line, "f %d/%d/%d %d/%d/%d %d/%d/%d",
-				&vertex_indices[0], &texture_indices[0], &normal_indices[0],
-				&vertex_indices[1], &texture_indices[1], &normal_indices[1],
-				&vertex_indices[2], &texture_indices[2], &normal_indices[2]
-				);
-			
-			face_t face = {
-				.a = vertex_indices[0] - 1,
-				.b = vertex_indices[1] - 1,
-				.c = vertex_indices[2] - 1,
-				.n0 = normal_indices[0] - 1,
-				.n1 = normal_indices[1] - 1,
-				.n2 = normal_indices[2] - 1,
-				.a_uv = texcoords[texture_indices[0] - 1],
-				.b_uv = texcoords[texture_indices[1] - 1],
-				.c_uv = texcoords[texture_indices[2] - 1],
-				.color = get_material_color()
-			};
-
-			array_push(mesh->faces, face);
-			mesh->num_faces++;
-
-		}
+	if (load_mesh_cache(mesh, obj_filename)) {
+		return;
 	}
-
-	//Allocate memory
-	mesh->normals = (vect3_t*)calloc(mesh->num_faces, sizeof(vect3_t));
-	mesh->tangents = (vect3_t*)calloc(mesh->num_faces, sizeof(vect3_t));
-	mesh->bitangents = (vect3_t*)calloc(mesh->num_faces, sizeof(vect3_t));
+	load_obj_file(mesh, obj_filename);
+
+	//Reorder the faces and vertices for vertex reuse, the cache stores the optimized order
+	float acmr_before = calculate_acmr(mesh->faces, mesh->num_faces, mesh->num_vertices, ACMR_CACHE_SIZE);
+	optimize_mesh_vertex_order(mesh);
+	float acmr_after = calculate_acmr(mesh->faces, mesh->num_faces, mesh->num_vertices, ACMR_CACHE_SIZE);
+	//stderr, the benchmark report can go to stdout
+	fprintf(stderr, "%s: %d vertices, %d faces, ACMR %.3f -> %.3f\n",
+		obj_filename, mesh->num_vertices, mesh->num_faces, acmr_before, acmr_after);
+
+	//Allocate memory for the per vertex normals, tangents and bitangents
+	mesh->normals = (vect3_t*)calloc(mesh->num_vertices, sizeof(vect3_t));
+	mesh->tangents = (vect3_t*)calloc(mesh->num_vertices, sizeof(vect3_t));
+	mesh->bitangents = (vect3_t*)calloc(mesh->num_vertices, sizeof(vect3_t));
+
+	calculate_vertex_normal(mesh);
+	calculate_tangents_and_bitangents(mesh);
+	calculate_mesh_bounds(mesh);
+	write_mesh_cache(mesh, obj_filename);
 
 	/*for (size_t i = 0; i < mesh->num_vertices; i++)
 	{
@@ -134,69 +52,153 @@ void load_mesh_obj_data(mesh_t* mesh, char* obj_filename){
 }
 
 void load_mesh_png_data(mesh_t* mesh, char* png_filename){
-	upng_t* png_image = upng_new_from_file(png_filename);
-	if (png_image != NULL){
-		upng_decode(png_image);
-		if (upng_get_error(png_image) == UPNG_EOK){
-			mesh->textures = png_image;
-		}
-	}
+	mesh->textures = acquire_texture(png_filename, TEXTURE_FORMAT_BC1);
 }
 
 void load_mesh_normalmap_data(mesh_t* mesh, char* normalmap_filename) {
-	upng_t* normalmap_image = upng_new_from_file(normalmap_filename);
-	if (normalmap_image != NULL){
-		upng_decode(normalmap_image);
-		if (upng_get_error(normalmap_image) == UPNG_EOK){
-			mesh->normalmaps = normalmap_image;
-		}
-	}
+	mesh->normalmaps = acquire_texture(normalmap_filename, TEXTURE_FORMAT_BC5);
 }
 
 void load_mesh_glowmap_data(mesh_t* mesh, char* glowmap_filename) {
-	upng_t* glowmap_image = upng_new_from_file(glowmap_filename);
-	if (glowmap_image != NULL){
-		upng_decode(glowmap_image);
-		if (upng_get_error(glowmap_image) == UPNG_EOK){
-			mesh->glowmaps = glowmap_image;
-		}
-	}
+	mesh->glowmaps = acquire_texture(glowmap_filename, TEXTURE_FORMAT_BC1);
 }
 
 void load_mesh_roughmap_data(mesh_t* mesh, char* roughmap_filename) {
-	upng_t* roughmap_image = upng_new_from_file(roughmap_filename);
-	if (roughmap_image != NULL) {
-		upng_decode(roughmap_image);
-		if (upng_get_error(roughmap_image) == UPNG_EOK) {
-			mesh->roughmaps = roughmap_image;
-		}
-	}
+	mesh->roughmaps = acquire_texture(roughmap_filename, TEXTURE_FORMAT_BC4);
 }
 
-
 void load_mesh_metalmap_data(mesh_t* mesh, char* metalmap_filename) {
-	upng_t* metalmap_image = upng_new_from_file(metalmap_filename);
-	if (metalmap_image != NULL) {
-		upng_decode(metalmap_image);
-		if (upng_get_error(metalmap_image) == UPNG_EOK) {
-			mesh->metallic = metalmap_image;
-		}
-	}
+	mesh->metallic = acquire_texture(metalmap_filename, TEXTURE_FORMAT_BC4);
 }
 
-
 void load_mesh_aomap_data(mesh_t* mesh, char* aomap_filename) {
-	upng_t* aomap_image = upng_new_from_file(aomap_filename);
-	if (aomap_image != NULL) {
-		upng_decode(aomap_image);
-		if (upng_get_error(aomap_image) == UPNG_EOK) {
-			mesh->ao = aomap_image;
-		}
+	mesh->ao = acquire_texture(aomap_filename, TEXTURE_FORMAT_BC4);
+}
+
+//Maps that failed to load are replaced by the fallback image, the PBR rasterizer samples all of them
+void load_missing_mesh_maps(mesh_t* mesh, char* fallback_filename) {
+	if (mesh->textures == NULL) load_mesh_png_data(mesh, fallback_filename);
+	if (mesh->normalmaps == NULL) load_mesh_normalmap_data(mesh, fallback_filename);
+	if (mesh->glowmaps == NULL) load_mesh_glowmap_data(mesh, fallback_filename);
+	if (mesh->roughmaps == NULL) load_mesh_roughmap_data(mesh, fallback_filename);
+	if (mesh->metallic == NULL) load_mesh_metalmap_data(mesh, fallback_filename);
+	if (mesh->ao == NULL) load_mesh_aomap_data(mesh, fallback_filename);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Asynchronous loading: the OBJ and every map of a mesh are separate jobs, the
+// vertex streams and edges wait on the geometry and the last job waits on all
+// of them. The mesh is drawn once its last job is finished.
+//////////////////////////////////////////////////////////////////////////////////
+enum mesh_map {
+	MESH_MAP_TEXTURE,
+	MESH_MAP_NORMAL,
+	MESH_MAP_GLOW,
+	MESH_MAP_ROUGHNESS,
+	MESH_MAP_METALLIC,
+	MESH_MAP_AO,
+	NUM_MESH_MAPS
+};
+
+typedef struct {
+	texture_t** texture;		//map field of the mesh the job fills
+	char* filename;
+	texture_format_t format;
+} mesh_map_load_t;
+
+typedef struct {
+	mesh_t* mesh;
+	char* obj_filename;
+	char* fallback_filename;
+	mesh_map_load_t maps[NUM_MESH_MAPS];
+} mesh_load_t;
+
+static mesh_load_t mesh_loads[MAX_NUM_MESHES];
+
+static void load_geometry_job(void* argument) {
+	mesh_load_t* load = (mesh_load_t*)argument;
+	load_mesh_obj_data(load->mesh, load->obj_filename);
+}
+
+static void prepare_geometry_job(void* argument) {
+	mesh_load_t* load = (mesh_load_t*)argument;
+
+	//split the vertex attributes into SoA streams for the batch vertex transform
+	build_mesh_vertex_streams(load->mesh);
+
+	//unique edge list for the wireframe modes
+	build_mesh_edges(load->mesh);
+}
+
+static void load_map_job(void* argument) {
+	mesh_map_load_t* map = (mesh_map_load_t*)argument;
+	*map->texture = acquire_texture(map->filename, map->format);
+}
+
+static void finish_mesh_job(void* argument) {
+	mesh_load_t* load = (mesh_load_t*)argument;
+
+	//every map the textured rasterizers sample must exist
+	load_missing_mesh_maps(load->mesh, load->fallback_filename);
+}
+
+void load_mesh_with_pbr_async(char* obj_filename, char* png_filename, char* normalmap_filename,
+	char* glowmap_filename, char* roughmap_filename, char* metalmap_filename, char* aomap_filename,
+	char* fallback_filename, vect3_t scale, vect3_t translation, vect3_t rotation) {
+
+	mesh_t* mesh = &meshes[mesh_count];
+	mesh_load_t* load = &mesh_loads[mesh_count];
+	mesh->scale = scale;
+	mesh->rotation = rotation;
+	mesh->translation = translation;
+	mesh_count++;
+
+	load->mesh = mesh;
+	load->obj_filename = obj_filename;
+	load->fallback_filename = fallback_filename;
+	load->maps[MESH_MAP_TEXTURE] = (mesh_map_load_t){ &mesh->textures, png_filename, TEXTURE_FORMAT_BC1 };
+	load->maps[MESH_MAP_NORMAL] = (mesh_map_load_t){ &mesh->normalmaps, normalmap_filename, TEXTURE_FORMAT_BC5 };
+	load->maps[MESH_MAP_GLOW] = (mesh_map_load_t){ &mesh->glowmaps, glowmap_filename, TEXTURE_FORMAT_BC1 };
+	load->maps[MESH_MAP_ROUGHNESS] = (mesh_map_load_t){ &mesh->roughmaps, roughmap_filename, TEXTURE_FORMAT_BC4 };
+	load->maps[MESH_MAP_METALLIC] = (mesh_map_load_t){ &mesh->metallic, metalmap_filename, TEXTURE_FORMAT_BC4 };
+	load->maps[MESH_MAP_AO] = (mesh_map_load_t){ &mesh->ao, aomap_filename, TEXTURE_FORMAT_BC4 };
+
+	//the final job waits on the geometry preprocessing and every map
+	job_handle_t dependencies[NUM_MESH_MAPS + 1];
+	job_handle_t geometry_job = submit_job(load_geometry_job, load, NULL, 0);
+	dependencies[0] = submit_job(prepare_geometry_job, load, &geometry_job, 1);
+	for (int i = 0; i < NUM_MESH_MAPS; i++) {
+		dependencies[i + 1] = submit_job(load_map_job, &load->maps[i], NULL, 0);
 	}
+	mesh->load_job = submit_job(finish_mesh_job, load, dependencies, NUM_MESH_MAPS + 1);
 }
 
+//Only called by the thread that submitted the loads, the finished job makes the mesh data visible
+bool is_mesh_loaded(mesh_t* mesh) {
+	if (!mesh->loaded && is_job_finished(mesh->load_job)) {
+		mesh->loaded = true;
+	}
+	return mesh->loaded;
+}
 
+void wait_for_meshes_loaded(void) {
+	wait_for_all_jobs();
+	finish_texture_streams();
+	for (int i = 0; i < mesh_count; i++) {
+		meshes[i].loaded = true;
+		meshes[i].load_job = (job_handle_t){ NULL, 0 };
+	}
+}
 
+void prioritize_mesh_textures(mesh_t* mesh, float screen_area) {
+	prioritize_texture(mesh->textures, screen_area);
+	prioritize_texture(mesh->normalmaps, screen_area);
+	prioritize_texture(mesh->glowmaps, screen_area);
+	prioritize_texture(mesh->roughmaps, screen_area);
+	prioritize_texture(mesh->metallic, screen_area);
+	prioritize_texture(mesh->ao, screen_area);
+}
 
 int get_num_meshes(void){
 	return mesh_count;
@@ -280,10 +282,14 @@ void calculate_tangents_and_bitangents(mesh_t* mesh) {
 		vect3_t edge1 = vect3_sub(v1, v0);
 		vect3_t edge2 = vect3_sub(v2, v0);
 
-		float delta_u1 = mesh_face.b_uv.u - mesh_face.a_uv.u;
-		float delta_v1 = mesh_face.b_uv.v - mesh_face.a_uv.v;
-		float delta_u2 = mesh_face.c_uv.u - mesh_face.a_uv.u;
-		float delta_v2 = mesh_face.c_uv.v - mesh_face.a_uv.v;
+		tex2_t uv0 = mesh->texcoords[mesh_face.a];
+		tex2_t uv1 = mesh->texcoords[mesh_face.b];
+		tex2_t uv2 = mesh->texcoords[mesh_face.c];
+
+		float delta_u1 = uv1.u - uv0.u;
+		float delta_v1 = uv1.v - uv0.v;
+		float delta_u2 = uv2.u - uv0.u;
+		float delta_v2 = uv2.v - uv0.v;
 
 		float f = 1.0f / (delta_u1 * delta_v2 - delta_u2 * delta_v1); 
 
@@ -333,9 +339,10 @@ void calculate_tangents_and_bitangents(mesh_t* mesh) {
 	// Orthogonalize and normalize tangents and bitangents
 	for (int i = 0; i < mesh->num_vertices; i++) {
 
-
-		mesh->bitangents[i] = vect3_cross(mesh->model_normals[i], mesh->tangents[i]);
-		mesh->tangents[i] = vect3_cross(mesh->model_normals[i], mesh->bitangents[i]);
+		//every welded vertex carries its own model normal
+		vect3_t normal = mesh->model_normals[i];
+		mesh->bitangents[i] = vect3_cross(normal, mesh->tangents[i]);
+		mesh->tangents[i] = vect3_cross(normal, mesh->bitangents[i]);
 
 		//mesh->bitangents[i] = vect3_cross(mesh->tangents[i], mesh->model_normals[i]);
 		//mesh->tangents[i] = vect3_cross(mesh->bitangents[i], mesh->model_normals[i]);
@@ -370,42 +377,140 @@ void calculate_tangents_and_bitangents(mesh_t* mesh) {
  }
 
 
-void free_meshes(void) {
-	for (int i = 0; i < mesh_count; i++){
+/// Object space bounding box of the mesh vertices
+void calculate_mesh_bounds(mesh_t* mesh) {
+	if (mesh->num_vertices == 0) {
+		mesh->bounds_min = vect3_new(0.0f, 0.0f, 0.0f);
+		mesh->bounds_max = vect3_new(0.0f, 0.0f, 0.0f);
+		return;
+	}
+	mesh->bounds_min = mesh->vertices[0];
+	mesh->bounds_max = mesh->vertices[0];
+	for (int i = 1; i < mesh->num_vertices; i++) {
+		vect3_t v = mesh->vertices[i];
+		if (v.x < mesh->bounds_min.x) mesh->bounds_min.x = v.x;
+		if (v.y < mesh->bounds_min.y) mesh->bounds_min.y = v.y;
+		if (v.z < mesh->bounds_min.z) mesh->bounds_min.z = v.z;
+		if (v.x > mesh->bounds_max.x) mesh->bounds_max.x = v.x;
+		if (v.y > mesh->bounds_max.y) mesh->bounds_max.y = v.y;
+		if (v.z > mesh->bounds_max.z) mesh->bounds_max.z = v.z;
+	}
+}
 
-		free(meshes[i].normals);
-		free(meshes[i].tangents);
-		free(meshes[i].bitangents);
+/// Split the vertex attributes into x[], y[], z[] streams for the batch vertex transform
+void build_mesh_vertex_streams(mesh_t* mesh) {
+	vect3_stream_from_array(&mesh->vertex_stream, mesh->vertices, mesh->num_vertices);
+	vect3_stream_from_array(&mesh->model_normal_stream, mesh->model_normals, mesh->num_model_normals);
+	vect3_stream_from_array(&mesh->tangent_stream, mesh->tangents, mesh->num_vertices);
+	vect3_stream_from_array(&mesh->bitangent_stream, mesh->bitangents, mesh->num_vertices);
+}
 
-		if (meshes[i].textures != NULL){
-			upng_free(meshes[i].textures);
-		}
+//////////////////////////////////////////////////////////////////////////////////
+// Build the unique edge list of the mesh, every edge shared by two faces is
+// stored once, found through an open addressing hash table keyed on the sorted
+// pair of OBJ positions, so the vertices welded apart at UV or normal seams
+// still share their edge
+//////////////////////////////////////////////////////////////////////////////////
+static uint32_t hash_edge(int a, int b) {
+	uint32_t hash = (uint32_t)a * 0x9E3779B1u;
+	hash ^= (uint32_t)b + 0x7F4A7C15u + (hash << 6) + (hash >> 2);
+	return hash;
+}
 
-		if (meshes[i].normalmaps != NULL){
-			upng_free(meshes[i].normalmaps);
-		}
+void build_mesh_edges(mesh_t* mesh) {
+	int num_faces = mesh->num_faces;
+	int max_edges = num_faces * 3;
 
-		if (meshes[i].glowmaps != NULL) {
-			upng_free(meshes[i].glowmaps);
+	//keep the table at most half full
+	int table_size = 16;
+	while (table_size < max_edges * 2) {
+		table_size *= 2;
+	}
+	int* table = (int*)malloc(sizeof(int) * table_size);
+	memset(table, 0xFF, sizeof(int) * table_size);
+
+	mesh->edges = (edge_t*)malloc(sizeof(edge_t) * (max_edges > 0 ? max_edges : 1));
+	mesh->face_edges = (int*)malloc(sizeof(int) * (max_edges > 0 ? max_edges : 1));
+	mesh->num_edges = 0;
+
+	for (int i = 0; i < num_faces; i++) {
+		int vertex_indices[3] = { mesh->faces[i].a, mesh->faces[i].b, mesh->faces[i].c };
+
+		for (int j = 0; j < 3; j++) {
+			int a = vertex_indices[j];
+			int b = vertex_indices[(j + 1) % 3];
+			if (mesh->vertex_positions[a] > mesh->vertex_positions[b]) {
+				int temp = a;
+				a = b;
+				b = temp;
+			}
+			int position_a = mesh->vertex_positions[a];
+			int position_b = mesh->vertex_positions[b];
+
+			uint32_t slot = hash_edge(position_a, position_b) & (table_size - 1);
+			while (table[slot] >= 0 &&
+				(mesh->vertex_positions[mesh->edges[table[slot]].a] != position_a ||
+				 mesh->vertex_positions[mesh->edges[table[slot]].b] != position_b)) {
+				slot = (slot + 1) & (table_size - 1);
+			}
+			if (table[slot] < 0) {
+				table[slot] = mesh->num_edges;
+				mesh->edges[mesh->num_edges].a = a;
+				mesh->edges[mesh->num_edges].b = b;
+				mesh->num_edges++;
+			}
+			mesh->face_edges[i * 3 + j] = table[slot];
 		}
+	}
+	free(table);
 
-		if (meshes[i].roughmaps != NULL) {
-			upng_free(meshes[i].roughmaps);
-		}
+	mesh->visible_edges = (uint8_t*)calloc(mesh->num_edges > 0 ? mesh->num_edges : 1, sizeof(uint8_t));
+}
 
-		if (meshes[i].metallic != NULL) {
-			upng_free(meshes[i].metallic);
-		}
 
-		if (meshes[i].ao != NULL) {
-			upng_free(meshes[i].ao);
-		}
+void free_meshes(void) {
+	//no load job may still write into the meshes, the levels still waiting are dropped by release_texture
+	wait_for_all_jobs();
 
-		array_free(meshes[i].vertices);
-		array_free(meshes[i].faces);
-		array_free(meshes[i].model_normals);
+	for (int i = 0; i < mesh_count; i++){
+
+		vect3_stream_free(&meshes[i].vertex_stream);
+		vect3_stream_free(&meshes[i].model_normal_stream);
+		vect3_stream_free(&meshes[i].tangent_stream);
+		vect3_stream_free(&meshes[i].bitangent_stream);
+
+		free(meshes[i].edges);
+		free(meshes[i].face_edges);
+		free(meshes[i].visible_edges);
+
+		//the maps can be shared with other meshes and slots, the cache frees each image once
+		release_texture(meshes[i].textures);
+		release_texture(meshes[i].normalmaps);
+		release_texture(meshes[i].glowmaps);
+		release_texture(meshes[i].roughmaps);
+		release_texture(meshes[i].metallic);
+		release_texture(meshes[i].ao);
+
+		//cached geometry lives in the mapped cache file
+		if (meshes[i].cache != NULL) {
+			free_mesh_cache(&meshes[i]);
+		}
+		else {
+			free(meshes[i].normals);
+			free(meshes[i].tangents);
+			free(meshes[i].bitangents);
+			array_free(meshes[i].vertices);
+			array_free(meshes[i].faces);
+			array_free(meshes[i].model_normals);
+			array_free(meshes[i].texcoords);
+			array_free(meshes[i].vertex_positions);
+		}
 
 	}
+
+	//the mesh slots can be reused by the next scene
+	memset(meshes, 0, sizeof(meshes));
+	mesh_count = 0;
 }
 
 
@@ -2,45 +2,71 @@
 #define MESH_H
 #include "vector.h"
 #include "triangle.h"
-#include "upng.h"
+#include "texture.h"
+#include "mapped_file.h"
+#include "job.h"
 
 
 //////////////////////////////////////////////////////////////////////////////////
-// Define a struct for dynamic size of mesh for array of vertices and faces
+// Unique mesh edge, shared by all the faces that reference both vertices
 //////////////////////////////////////////////////////////////////////////////////
 typedef struct {
-	vect3_t* vertices;			//mesh dynamic array of vertices
-	vect3_t* model_normals;		//mesh dynamic array of model normals
+	int a;			//vertex with the smaller OBJ position index
+	int b;			//vertex with the larger OBJ position index
+} edge_t;
+
+//////////////////////////////////////////////////////////////////////////////////
+// Define a struct for dynamic size of mesh for array of vertices and faces.
+// Vertices are welded: every distinct (position, uv, normal) triple of the OBJ
+// file is one vertex and all per vertex arrays are indexed by the face indices.
+//////////////////////////////////////////////////////////////////////////////////
+typedef struct {
+	vect3_t* vertices;			//mesh dynamic array of vertex positions
+	vect3_t* model_normals;		//mesh dynamic array of model normals, one per vertex
+	tex2_t* texcoords;			//mesh dynamic array of texture coordinates, one per vertex
+	int* vertex_positions;		//OBJ position index of each vertex, shared by the vertices split at seams
 	face_t* faces;				//mesh dynamic array of faces
 	vect3_t* normals;			//mesh dynamic array of calculated vertex normals from face normal
 	vect3_t* tangents;
 	vect3_t* bitangents;
-	upng_t* textures;			//mesh dynamic array of textures
-	upng_t* normalmaps;			//mesh dynamic array of normalmaps
-	upng_t* glowmaps;			//mesh dynamic array of glowmaps
-	upng_t* roughmaps;
-	upng_t* metallic;
-	upng_t* ao;
+	texture_t* textures;		//diffuse texture, BC1 when compressed
+	texture_t* normalmaps;		//tangent space normal map, BC5 when compressed
+	texture_t* glowmaps;		//glow map, BC1 when compressed
+	texture_t* roughmaps;		//roughness, metallic and ao maps, BC4 when compressed
+	texture_t* metallic;
+	texture_t* ao;
 	vect3_t rotation;			//mesh rotation with x, y, and z values
 	vect3_t scale;				//mesh scale with x, y, and z values
 	vect3_t translation;		//mesh translation with x, y, and z values
+	vect3_t bounds_min;			//object space bounding box of the vertices
+	vect3_t bounds_max;
+	mapped_file_t* cache;		//mesh cache the geometry arrays point into, NULL when the arrays are owned
+	vect3_stream_t vertex_stream;		//SoA copy of vertices for the batch vertex transform
+	vect3_stream_t model_normal_stream;	//SoA copy of model normals
+	vect3_stream_t tangent_stream;		//SoA copy of tangents
+	vect3_stream_t bitangent_stream;	//SoA copy of bitangents
+	edge_t* edges;				//unique edges, each one is drawn once in the wireframe modes
+	int* face_edges;			//three edge indices per face (ab, bc, ca)
+	uint8_t* visible_edges;		//per frame flag, set when a face using the edge survives culling
+	int num_edges;
 	int num_vertices;
 	int num_faces;
 	int num_model_normals;
+	job_handle_t load_job;		//last loading job of the mesh, zero once wait_for_meshes_loaded returned
+	bool loaded;				//all loading jobs are finished and the mesh can be drawn
 } mesh_t;
 
 
-void load_mesh(char* obj_filename, char* png_filename, vect3_t scale,
-	vect3_t translation, vect3_t rotation);
-
-void load_mesh_with_normalmap(char* obj_filename, char* png_filename, char* normalmap_filename, 
-	char* glowmap_filename, char* roughmap_filename,
-	vect3_t scale, vect3_t translation, vect3_t rotation);
-
-void load_mesh_with_pbr(char* obj_filename, char* png_filename, char* normalmap_filename,
+// Schedules the OBJ, every map and the preprocessing as jobs and returns right away,
+// maps that fail to load are replaced by the fallback image
+void load_mesh_with_pbr_async(char* obj_filename, char* png_filename, char* normalmap_filename,
 	char* glowmap_filename, char* roughmap_filename, char* metalmap_filename, char* aomap_filename,
-	vect3_t scale, vect3_t translation, vect3_t rotation);
+	char* fallback_filename, vect3_t scale, vect3_t translation, vect3_t rotation);
+bool is_mesh_loaded(mesh_t* mesh);
+void wait_for_meshes_loaded(void);
 
+// Streams the finer levels of the mesh maps first when the mesh covers a larger part of the screen
+void prioritize_mesh_textures(mesh_t* mesh, float screen_area);
 
 void load_mesh_obj_data(mesh_t* mesh, char* obj_filename);
 void load_mesh_png_data(mesh_t* mesh, char* png_filename);
@@ -51,6 +77,7 @@ void load_mesh_roughmap_data(mesh_t* mesh, char* roughmap_filename);
 void load_mesh_metalmap_data(mesh_t* mesh,char* metalmap_filename);
 
 void load_mesh_aomap_data(mesh_t* mesh, char* aomap_filename);
+void load_missing_mesh_maps(mesh_t* mesh, char* fallback_filename);
 
 
 int get_num_meshes(void);
@@ -58,6 +85,9 @@ mesh_t* get_mesh(int mesh_index);
 
 void calculate_vertex_normal(mesh_t* mesh);
 void calculate_tangents_and_bitangents(mesh_t* mesh);
+void calculate_mesh_bounds(mesh_t* mesh);
+void build_mesh_vertex_streams(mesh_t* mesh);
+void build_mesh_edges(mesh_t* mesh);
 
 void free_meshes(void);
 #endif 
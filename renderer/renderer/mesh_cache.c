@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mesh_cache.h"
+#include "material.h"
+
+static bool mesh_cache_enabled = true;
+
+void set_mesh_cache_enabled(bool enabled) {
+	mesh_cache_enabled = enabled;
+}
+
+bool is_mesh_cache_enabled(void) {
+	return mesh_cache_enabled;
+}
+
+static void get_cache_filename(char* cache_filename, size_t size, const char* obj_filename) {
+	snprintf(cache_filename, size, "%s%s", obj_filename, MESH_CACHE_EXTENSION);
+}
+
+static bool hash_source_file(const char* obj_filename, uint64_t* size, uint64_t* hash) {
+	mapped_file_t source;
+	if (!map_file(&source, obj_filename)) {
+		return false;
+	}
+	*size = source.size;
+	*hash = hash_bytes(source.data, source.size);
+	unmap_file(&source);
+	return true;
+}
+
+static size_t get_cache_size(const mesh_cache_header_t* header) {
+	return sizeof(mesh_cache_header_t) +
+		sizeof(vect3_t) * ((size_t)header->num_vertices * 4 + (size_t)header->num_model_normals) +
+		(sizeof(tex2_t) + sizeof(int)) * (size_t)header->num_vertices +
+		sizeof(face_t) * (size_t)header->num_faces;
+}
+
+bool load_mesh_cache(mesh_t* mesh, const char* obj_filename) {
+	if (!mesh_cache_enabled) {
+		return false;
+	}
+	char cache_filename[512];
+	get_cache_filename(cache_filename, sizeof(cache_filename), obj_filename);
+
+	mapped_file_t* cache = (mapped_file_t*)malloc(sizeof(mapped_file_t));
+	if (cache == NULL || !map_file(cache, cache_filename)) {
+		free(cache);
+		return false;
+	}
+
+	//a stale or foreign cache is ignored and rewritten after the OBJ is parsed
+	mesh_cache_header_t header;
+	uint64_t source_size = 0, source_hash = 0;
+	bool valid = cache->size >= sizeof(header);
+	if (valid) {
+		memcpy(&header, cache->data, sizeof(header));
+		valid = header.magic == MESH_CACHE_MAGIC &&
+			header.version == MESH_CACHE_VERSION &&
+			header.vertex_size == sizeof(vect3_t) &&
+			header.face_size == sizeof(face_t) &&
+			header.face_color == get_material_color() &&
+			header.num_vertices >= 0 && header.num_model_normals >= 0 && header.num_faces >= 0 &&
+			get_cache_size(&header) == cache->size &&
+			hash_source_file(obj_filename, &source_size, &source_hash) &&
+			header.source_size == source_size &&
+			header.source_hash == source_hash;
+	}
+	if (!valid) {
+		unmap_file(cache);
+		free(cache);
+		return false;
+	}
+
+	//zero copy: the arrays point straight into the mapped file
+	const char* data = cache->data + sizeof(mesh_cache_header_t);
+	mesh->vertices = (vect3_t*)data;
+	data += sizeof(vect3_t) * header.num_vertices;
+	mesh->model_normals = (vect3_t*)data;
+	data += sizeof(vect3_t) * header.num_model_normals;
+	mesh->texcoords = (tex2_t*)data;
+	data += sizeof(tex2_t) * header.num_vertices;
+	mesh->vertex_positions = (int*)data;
+	data += sizeof(int) * header.num_vertices;
+	mesh->faces = (face_t*)data;
+	data += sizeof(face_t) * header.num_faces;
+	mesh->normals = (vect3_t*)data;
+	data += sizeof(vect3_t) * header.num_vertices;
+	mesh->tangents = (vect3_t*)data;
+	data += sizeof(vect3_t) * header.num_vertices;
+	mesh->bitangents = (vect3_t*)data;
+
+	mesh->num_vertices = header.num_vertices;
+	mesh->num_model_normals = header.num_model_normals;
+	mesh->num_faces = header.num_faces;
+	mesh->bounds_min = header.bounds_min;
+	mesh->bounds_max = header.bounds_max;
+	mesh->cache = cache;
+	return true;
+}
+
+// Written to a temporary file first, so an interrupted write never leaves a truncated cache
+void write_mesh_cache(const mesh_t* mesh, const char* obj_filename) {
+	if (!mesh_cache_enabled || mesh->cache != NULL) {
+		return;
+	}
+
+	mesh_cache_header_t header;
+	memset(&header, 0, sizeof(header));
+	header.magic = MESH_CACHE_MAGIC;
+	header.version = MESH_CACHE_VERSION;
+	header.vertex_size = sizeof(vect3_t);
+	header.face_size = sizeof(face_t);
+	header.face_color = get_material_color();
+	header.num_vertices = mesh->num_vertices;
+	header.num_model_normals = mesh->num_model_normals;
+	header.num_faces = mesh->num_faces;
+	header.bounds_min = mesh->bounds_min;
+	header.bounds_max = mesh->bounds_max;
+	if (!hash_source_file(obj_filename, &header.source_size, &header.source_hash)) {
+		return;
+	}
+
+	char cache_filename[512];
+	char temporary_filename[520];
+	get_cache_filename(cache_filename, sizeof(cache_filename), obj_filename);
+	snprintf(temporary_filename, sizeof(temporary_filename), "%s.tmp", cache_filename);
+
+	FILE* file = fopen(temporary_filename, "wb");
+	if (file == NULL) {
+		return;		// read only asset folder, the OBJ is parsed every time
+	}
+	size_t num_vertices = (size_t)mesh->num_vertices;
+	bool written =
+		fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(mesh->vertices, sizeof(vect3_t), num_vertices, file) == num_vertices &&
+		fwrite(mesh->model_normals, sizeof(vect3_t), (size_t)mesh->num_model_normals, file) == (size_t)mesh->num_model_normals &&
+		fwrite(mesh->texcoords, sizeof(tex2_t), num_vertices, file) == num_vertices &&
+		fwrite(mesh->vertex_positions, sizeof(int), num_vertices, file) == num_vertices &&
+		fwrite(mesh->faces, sizeof(face_t), (size_t)mesh->num_faces, file) == (size_t)mesh->num_faces &&
+		fwrite(mesh->normals, sizeof(vect3_t), num_vertices, file) == num_vertices &&
+		fwrite(mesh->tangents, sizeof(vect3_t), num_vertices, file) == num_vertices &&
+		fwrite(mesh->bitangents, sizeof(vect3_t), num_vertices, file) == num_vertices;
+	written = (fclose(file) == 0) && written;
+
+	if (written) {
+		remove(cache_filename);
+		written = rename(temporary_filename, cache_filename) == 0;
+	}
+	if (!written) {
+		fprintf(stderr, "Error writing the mesh cache %s. \n", cache_filename);
+		remove(temporary_filename);
+	}
+}
+
+void free_mesh_cache(mesh_t* mesh) {
+	if (mesh->cache == NULL) {
+		return;
+	}
+	unmap_file(mesh->cache);
+	free(mesh->cache);
+	mesh->cache = NULL;
+}
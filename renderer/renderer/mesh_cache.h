@@ -0,0 +1,46 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "mesh.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Binary mesh cache written next to the OBJ file (name.obj.cache) after the
+// first load. It holds the finished geometry in vertex cache order: the
+// welded vertex attributes, the face indices, the vertex normals, tangents and
+// bitangents and the bounds. Later loads map it and the mesh arrays point into
+// the mapping.
+// A cache is used only if its version, layout, face color and the size and
+// hash of the OBJ file it was built from all match.
+///////////////////////////////////////////////////////////////////////////////
+#define MESH_CACHE_MAGIC 0x4853454Du		// "MESH"
+#define MESH_CACHE_VERSION 3
+#define MESH_CACHE_EXTENSION ".cache"
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vertex_size;		// sizeof(vect3_t)
+	uint32_t face_size;			// sizeof(face_t)
+	uint64_t source_size;
+	uint64_t source_hash;
+	uint32_t face_color;		// material color the faces were loaded with
+	int32_t num_vertices;
+	int32_t num_model_normals;
+	int32_t num_faces;
+	vect3_t bounds_min;
+	vect3_t bounds_max;
+} mesh_cache_header_t;
+
+// Followed by vertices[num_vertices], model_normals[num_model_normals],
+// texcoords[num_vertices], vertex_positions[num_vertices], faces[num_faces],
+// normals[num_vertices], tangents[num_vertices] and bitangents[num_vertices]
+
+void set_mesh_cache_enabled(bool enabled);
+bool is_mesh_cache_enabled(void);
+
+bool load_mesh_cache(mesh_t* mesh, const char* obj_filename);
+void write_mesh_cache(const mesh_t* mesh, const char* obj_filename);
+void free_mesh_cache(mesh_t* mesh);
+
+#endif
@@ -0,0 +1,581 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <float.h>
+#include "obj.h"
+#include "array.h"
+#include "material.h"
+#include "thread.h"
+#include "mapped_file.h"
+
+#define MIN(a,b)(((a) < (b)) ? (a):(b))
+#define MAX(a,b)(((a) > (b)) ? (a):(b))
+
+static int obj_parse_threads = 0;
+
+void set_obj_parse_threads(int num_threads) {
+	obj_parse_threads = MAX(num_threads, 0);
+}
+
+int get_obj_parse_threads(void) {
+	return obj_parse_threads;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Tokenizer, every scan stops at the end of the line it is given
+///////////////////////////////////////////////////////////////////////////////
+static bool is_blank(char c) {
+	return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static bool is_digit(char c) {
+	return c >= '0' && c <= '9';
+}
+
+static const char* skip_blanks(const char* text, const char* end) {
+	while (text < end && is_blank(*text)) {
+		text++;
+	}
+	return text;
+}
+
+// Same result as strtol(text, &text, 10), no digits leave the position unchanged
+static int scan_int(const char** text, const char* end) {
+	const char* p = skip_blanks(*text, end);
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = (*p == '-');
+		p++;
+	}
+	if (p >= end || !is_digit(*p)) {
+		return 0;
+	}
+	long long value = 0;
+	while (p < end && is_digit(*p)) {
+		value = value * 10 + (*p - '0');
+		if (value > INT32_MAX) {
+			value = INT32_MAX;
+		}
+		p++;
+	}
+	*text = p;
+	return (int)(negative ? -value : value);
+}
+
+static const double powers_of_ten[23] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Tokens the fast path can not round exactly go through strtof, like sscanf("%f") does
+static float scan_float_slow(const char* token, const char* end, const char** next) {
+	char buffer[64];
+	const char* p = token;
+	while (p < end && !is_blank(*p) && p - token < (int)sizeof(buffer) - 1) {
+		p++;
+	}
+	size_t length = (size_t)(p - token);
+	memcpy(buffer, token, length);
+	buffer[length] = '\0';
+
+	char* parsed = buffer;
+	float value = strtof(buffer, &parsed);
+	*next = token + (parsed - buffer);
+	return value;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Decimal to float with the same rounding as strtof: up to 19 significant
+// digits and a power of ten up to 1e22 are exact in double arithmetic, so the
+// single multiply or divide is correctly rounded. Rounding that double to
+// float is exact too unless it lies on a float halfway point.
+///////////////////////////////////////////////////////////////////////////////
+static bool scan_float(const char** text, const char* end, float* result) {
+	const char* token = skip_blanks(*text, end);
+	const char* p = token;
+	if (p >= end) {
+		return false;
+	}
+
+	bool negative = false;
+	if (*p == '-' || *p == '+') {
+		negative = (*p == '-');
+		p++;
+	}
+
+	uint64_t mantissa = 0;
+	int num_digits = 0;
+	int exponent = 0;
+	bool exact = true;
+	bool any_digit = false;
+
+	for (; p < end && is_digit(*p); p++) {
+		any_digit = true;
+		if (num_digits < 19) {
+			mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+			num_digits += (mantissa != 0);
+		}
+		else {
+			exact = false;
+		}
+	}
+	if (p < end && *p == '.') {
+		for (p++; p < end && is_digit(*p); p++) {
+			any_digit = true;
+			if (num_digits < 19) {
+				mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+				num_digits += (mantissa != 0);
+				exponent--;
+			}
+			else {
+				exact = false;
+			}
+		}
+	}
+	if (any_digit && p < end && (*p == 'e' || *p == 'E')) {
+		const char* q = p + 1;
+		bool negative_exponent = false;
+		if (q < end && (*q == '-' || *q == '+')) {
+			negative_exponent = (*q == '-');
+			q++;
+		}
+		if (q < end && is_digit(*q)) {
+			int value = 0;
+			for (; q < end && is_digit(*q); q++) {
+				value = MIN(value * 10 + (*q - '0'), 100000);
+			}
+			exponent += negative_exponent ? -value : value;
+			p = q;
+		}
+	}
+
+	//inf, nan, hexadecimal floats and anything glued to the number
+	if (!any_digit || (p < end && !is_blank(*p))) {
+		const char* next = token;
+		float value = scan_float_slow(token, end, &next);
+		if (next == token) {
+			return false;
+		}
+		*text = next;
+		*result = value;
+		return true;
+	}
+
+	if (mantissa == 0) {
+		*text = p;
+		*result = negative ? -0.0f : 0.0f;
+		return true;
+	}
+
+	if (exact && mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22) {
+		double value = (double)mantissa;
+		value = exponent < 0 ? value / powers_of_ten[-exponent] : value * powers_of_ten[exponent];
+
+		uint64_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		bool halfway = (bits & 0x1FFFFFFFull) == 0x10000000ull;
+		if (!halfway && value >= FLT_MIN && value <= FLT_MAX) {
+			*text = p;
+			*result = (float)(negative ? -value : value);
+			return true;
+		}
+	}
+
+	const char* next = token;
+	*result = scan_float_slow(token, end, &next);
+	*text = next;
+	return true;
+}
+
+// Scans up to count floats like sscanf("%f %f %f"), the missing ones are 0
+static void scan_floats(const char* text, const char* end, float* values, int count) {
+	for (int i = 0; i < count; i++) {
+		values[i] = 0.0f;
+	}
+	for (int i = 0; i < count; i++) {
+		if (!scan_float(&text, end, &values[i])) {
+			break;
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+// Parse the vertex references of an OBJ face line ("v", "v/vt", "v//vn" or
+// "v/vt/vn"), missing texture or normal indices are returned as 0
+//////////////////////////////////////////////////////////////////////////////////
+static int parse_obj_face(const char* text, const char* end, int vertex_indices[], int texture_indices[], int normal_indices[]) {
+	int count = 0;
+	while (count < MAX_OBJ_FACE_VERTICES) {
+		while (text < end && (*text == ' ' || *text == '\t')) {
+			text++;
+		}
+		if (text >= end || !is_digit(*text)) {
+			break;
+		}
+		vertex_indices[count] = scan_int(&text, end);
+		texture_indices[count] = 0;
+		normal_indices[count] = 0;
+		if (text < end && *text == '/') {
+			text++;
+			if (text < end && *text != '/') {
+				texture_indices[count] = scan_int(&text, end);
+			}
+			if (text < end && *text == '/') {
+				text++;
+				normal_indices[count] = scan_int(&text, end);
+			}
+		}
+		count++;
+	}
+	return count;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Line classification, only lines starting with "v ", "vt ", "vn " or "f "
+// carry data, everything else (comments, groups, materials) is skipped
+///////////////////////////////////////////////////////////////////////////////
+enum obj_line_type
+{
+	OBJ_LINE_OTHER,
+	OBJ_LINE_VERTEX,
+	OBJ_LINE_TEXCOORD,
+	OBJ_LINE_NORMAL,
+	OBJ_LINE_FACE
+};
+
+static int classify_line(const char* line, const char* end, const char** data) {
+	size_t length = (size_t)(end - line);
+	if (length >= 2 && line[0] == 'v' && line[1] == ' ') {
+		*data = line + 2;
+		return OBJ_LINE_VERTEX;
+	}
+	if (length >= 3 && line[0] == 'v' && line[1] == 't' && line[2] == ' ') {
+		*data = line + 3;
+		return OBJ_LINE_TEXCOORD;
+	}
+	if (length >= 3 && line[0] == 'v' && line[1] == 'n' && line[2] == ' ') {
+		*data = line + 3;
+		return OBJ_LINE_NORMAL;
+	}
+	if (length >= 2 && line[0] == 'f' && line[1] == ' ') {
+		*data = line + 2;
+		return OBJ_LINE_FACE;
+	}
+	return OBJ_LINE_OTHER;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Raw OBJ data: the attribute lists as they appear in the file and three
+// corners per triangle, each corner with its own position, texture
+// coordinate and normal reference (0 based, -1 for none)
+///////////////////////////////////////////////////////////////////////////////
+typedef struct {
+	int position;
+	int texcoord;
+	int normal;
+} obj_corner_t;
+
+typedef struct {
+	vect3_t* positions;
+	tex2_t* texcoords;
+	vect3_t* normals;
+	obj_corner_t* corners;
+	int num_positions;
+	int num_texcoords;
+	int num_normals;
+	int num_faces;
+} obj_data_t;
+
+///////////////////////////////////////////////////////////////////////////////
+// Chunk of whole lines, counted first and then parsed into its own ranges of
+// the attribute and corner arrays, so the chunks never share an output element
+///////////////////////////////////////////////////////////////////////////////
+typedef struct {
+	const char* begin;
+	const char* end;
+	int num_positions;
+	int num_texcoords;
+	int num_normals;
+	int num_faces;
+	int first_position;
+	int first_texcoord;
+	int first_normal;
+	int first_face;
+	obj_data_t* data;
+	bool parse;					// false counts the lines, true parses them
+} obj_chunk_t;
+
+static void process_obj_chunk(void* argument) {
+	obj_chunk_t* chunk = (obj_chunk_t*)argument;
+	obj_data_t* obj = chunk->data;
+	int position = chunk->first_position;
+	int texcoord = chunk->first_texcoord;
+	int normal = chunk->first_normal;
+	int face_index = chunk->first_face;
+
+	int vertex_indices[MAX_OBJ_FACE_VERTICES];
+	int texture_indices[MAX_OBJ_FACE_VERTICES];
+	int normal_indices[MAX_OBJ_FACE_VERTICES];
+
+	const char* line = chunk->begin;
+	while (line < chunk->end) {
+		const char* line_end = (const char*)memchr(line, '\n', (size_t)(chunk->end - line));
+		if (line_end == NULL) {
+			line_end = chunk->end;
+		}
+
+		const char* data = NULL;
+		int type = classify_line(line, line_end, &data);
+		if (!chunk->parse) {
+			if (type == OBJ_LINE_VERTEX) chunk->num_positions++;
+			else if (type == OBJ_LINE_TEXCOORD) chunk->num_texcoords++;
+			else if (type == OBJ_LINE_NORMAL) chunk->num_normals++;
+			else if (type == OBJ_LINE_FACE) {
+				int count = parse_obj_face(data, line_end, vertex_indices, texture_indices, normal_indices);
+				chunk->num_faces += MAX(count - 2, 0);
+			}
+		}
+		else if (type == OBJ_LINE_VERTEX) {
+			scan_floats(data, line_end, &obj->positions[position++].x, 3);
+		}
+		else if (type == OBJ_LINE_TEXCOORD) {
+			scan_floats(data, line_end, &obj->texcoords[texcoord++].u, 2);
+		}
+		else if (type == OBJ_LINE_NORMAL) {
+			scan_floats(data, line_end, &obj->normals[normal++].x, 3);
+		}
+		else if (type == OBJ_LINE_FACE) {
+			//polygons are split into a triangle fan
+			int count = parse_obj_face(data, line_end, vertex_indices, texture_indices, normal_indices);
+			for (int i = 1; i + 1 < count; i++) {
+				int corners[3] = { 0, i, i + 1 };
+				for (int j = 0; j < 3; j++) {
+					obj_corner_t* corner = &obj->corners[face_index * 3 + j];
+					corner->position = vertex_indices[corners[j]] - 1;
+					corner->texcoord = texture_indices[corners[j]] - 1;
+					corner->normal = normal_indices[corners[j]] - 1;
+				}
+				face_index++;
+			}
+		}
+		line = line_end + 1;
+	}
+}
+
+// Runs every chunk, the first one on the calling thread
+static void run_obj_chunks(obj_chunk_t* chunks, int num_chunks) {
+	thread_t threads[MAX_OBJ_PARSE_THREADS];
+	bool started[MAX_OBJ_PARSE_THREADS] = { false };
+	for (int i = 1; i < num_chunks; i++) {
+		started[i] = thread_create(&threads[i], process_obj_chunk, &chunks[i]);
+	}
+	process_obj_chunk(&chunks[0]);
+	for (int i = 1; i < num_chunks; i++) {
+		if (started[i]) {
+			thread_join(threads[i]);
+		}
+		else {
+			process_obj_chunk(&chunks[i]);
+		}
+	}
+}
+
+// Split the file into chunks of whole lines
+static int split_obj_chunks(const mapped_file_t* file, obj_chunk_t* chunks) {
+	int num_chunks = obj_parse_threads > 0 ? obj_parse_threads : get_num_cpu_cores();
+	num_chunks = MIN(num_chunks, (int)(file->size / OBJ_MIN_CHUNK_BYTES));
+	num_chunks = MAX(MIN(num_chunks, MAX_OBJ_PARSE_THREADS), 1);
+
+	const char* end = file->data + file->size;
+	const char* begin = file->data;
+	int count = 0;
+	for (int i = 0; i < num_chunks && begin < end; i++) {
+		const char* split = (i == num_chunks - 1) ? end : file->data + file->size / num_chunks * (i + 1);
+		if (split < begin) {
+			split = begin;
+		}
+		const char* newline = (split < end) ? (const char*)memchr(split, '\n', (size_t)(end - split)) : NULL;
+		const char* chunk_end = newline != NULL ? newline + 1 : end;
+
+		memset(&chunks[count], 0, sizeof(obj_chunk_t));
+		chunks[count].begin = begin;
+		chunks[count].end = chunk_end;
+		count++;
+		begin = chunk_end;
+	}
+	return count;
+}
+
+static bool parse_obj_data(obj_data_t* obj, const char* obj_filename) {
+	mapped_file_t file;
+	if (!map_file(&file, obj_filename)) {
+		fprintf(stderr, "Error reading the OBJ file %s. \n", obj_filename);
+		return false;
+	}
+
+	obj_chunk_t chunks[MAX_OBJ_PARSE_THREADS];
+	int num_chunks = split_obj_chunks(&file, chunks);
+
+	//Counting pass, then every chunk gets its offsets into the exactly sized arrays
+	run_obj_chunks(chunks, num_chunks);
+
+	memset(obj, 0, sizeof(obj_data_t));
+	for (int i = 0; i < num_chunks; i++) {
+		chunks[i].first_position = obj->num_positions;
+		chunks[i].first_texcoord = obj->num_texcoords;
+		chunks[i].first_normal = obj->num_normals;
+		chunks[i].first_face = obj->num_faces;
+		chunks[i].data = obj;
+		chunks[i].parse = true;
+		obj->num_positions += chunks[i].num_positions;
+		obj->num_texcoords += chunks[i].num_texcoords;
+		obj->num_normals += chunks[i].num_normals;
+		obj->num_faces += chunks[i].num_faces;
+	}
+
+	//every face may need a flat normal appended to the file normals
+	obj->positions = (vect3_t*)malloc(sizeof(vect3_t) * MAX(obj->num_positions, 1));
+	obj->texcoords = (tex2_t*)malloc(sizeof(tex2_t) * MAX(obj->num_texcoords, 1));
+	obj->normals = (vect3_t*)malloc(sizeof(vect3_t) * MAX(obj->num_normals + obj->num_faces, 1));
+	obj->corners = (obj_corner_t*)malloc(sizeof(obj_corner_t) * 3 * MAX(obj->num_faces, 1));
+
+	//Parsing pass
+	run_obj_chunks(chunks, num_chunks);
+	unmap_file(&file);
+	return true;
+}
+
+static void free_obj_data(obj_data_t* obj) {
+	free(obj->positions);
+	free(obj->texcoords);
+	free(obj->normals);
+	free(obj->corners);
+}
+
+// Faces without (or with dangling) normal references get their flat face normal
+static void add_flat_normals(obj_data_t* obj) {
+	int num_file_normals = obj->num_normals;
+	for (int i = 0; i < obj->num_faces; i++) {
+		obj_corner_t* corners = &obj->corners[i * 3];
+		bool missing = false;
+		for (int j = 0; j < 3; j++) {
+			if (corners[j].normal < 0 || corners[j].normal >= num_file_normals) {
+				corners[j].normal = -1;
+				missing = true;
+			}
+		}
+		if (!missing) {
+			continue;
+		}
+		vect3_t ab = vect3_sub(obj->positions[corners[1].position], obj->positions[corners[0].position]);
+		vect3_t ac = vect3_sub(obj->positions[corners[2].position], obj->positions[corners[0].position]);
+		vect3_t face_normal = vect3_cross(ab, ac);
+		vect3_normalize(&face_normal);
+
+		int normal_index = obj->num_normals++;
+		obj->normals[normal_index] = face_normal;
+		for (int j = 0; j < 3; j++) {
+			if (corners[j].normal < 0) {
+				corners[j].normal = normal_index;
+			}
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Vertex welding: every distinct (position, uv, normal) triple becomes one
+// vertex, found through an open addressing hash table keyed on the triple
+///////////////////////////////////////////////////////////////////////////////
+typedef struct {
+	int position;
+	int normal;
+	tex2_t uv;		// faces without texture coordinates map to the texture origin
+} obj_vertex_key_t;
+
+static obj_vertex_key_t get_corner_key(const obj_data_t* obj, const obj_corner_t* corner) {
+	obj_vertex_key_t key;
+	key.position = corner->position;
+	key.normal = corner->normal;
+	bool textured = corner->texcoord >= 0 && corner->texcoord < obj->num_texcoords;
+	key.uv = textured ? obj->texcoords[corner->texcoord] : (tex2_t){ 0, 0 };
+	return key;
+}
+
+static uint32_t hash_vertex_key(const obj_vertex_key_t* key) {
+	uint32_t words[4];
+	memcpy(words, key, sizeof(words));
+	uint32_t hash = 2166136261u;
+	for (int i = 0; i < 4; i++) {
+		hash = (hash ^ words[i]) * 16777619u;
+		hash ^= hash >> 15;
+	}
+	return hash;
+}
+
+static void weld_obj_vertices(const obj_data_t* obj, mesh_t* mesh) {
+	int num_corners = obj->num_faces * 3;
+
+	//keep the table at most half full
+	int table_size = 16;
+	while (table_size < num_corners * 2) {
+		table_size *= 2;
+	}
+	int* table = (int*)malloc(sizeof(int) * table_size);
+	memset(table, 0xFF, sizeof(int) * table_size);
+	obj_vertex_key_t* keys = (obj_vertex_key_t*)malloc(sizeof(obj_vertex_key_t) * MAX(num_corners, 1));
+	int* indices = (int*)malloc(sizeof(int) * MAX(num_corners, 1));
+	int num_vertices = 0;
+
+	for (int i = 0; i < num_corners; i++) {
+		obj_vertex_key_t key = get_corner_key(obj, &obj->corners[i]);
+		uint32_t slot = hash_vertex_key(&key) & (uint32_t)(table_size - 1);
+		while (table[slot] >= 0 && memcmp(&keys[table[slot]], &key, sizeof(key)) != 0) {
+			slot = (slot + 1) & (uint32_t)(table_size - 1);
+		}
+		if (table[slot] < 0) {
+			keys[num_vertices] = key;
+			table[slot] = num_vertices++;
+		}
+		indices[i] = table[slot];
+	}
+
+	//Parallel per vertex attribute arrays, in order of first use
+	mesh->num_vertices = num_vertices;
+	mesh->num_model_normals = num_vertices;
+	mesh->vertices = num_vertices > 0 ? (vect3_t*)array_hold(NULL, num_vertices, sizeof(vect3_t)) : NULL;
+	mesh->model_normals = num_vertices > 0 ? (vect3_t*)array_hold(NULL, num_vertices, sizeof(vect3_t)) : NULL;
+	mesh->texcoords = num_vertices > 0 ? (tex2_t*)array_hold(NULL, num_vertices, sizeof(tex2_t)) : NULL;
+	mesh->vertex_positions = num_vertices > 0 ? (int*)array_hold(NULL, num_vertices, sizeof(int)) : NULL;
+	for (int i = 0; i < num_vertices; i++) {
+		mesh->vertices[i] = obj->positions[keys[i].position];
+		mesh->model_normals[i] = obj->normals[keys[i].normal];
+		mesh->texcoords[i] = keys[i].uv;
+		mesh->vertex_positions[i] = keys[i].position;
+	}
+
+	uint32_t face_color = get_material_color();
+	mesh->num_faces = obj->num_faces;
+	mesh->faces = obj->num_faces > 0 ? (face_t*)array_hold(NULL, obj->num_faces, sizeof(face_t)) : NULL;
+	for (int i = 0; i < obj->num_faces; i++) {
+		mesh->faces[i].a = indices[i * 3 + 0];
+		mesh->faces[i].b = indices[i * 3 + 1];
+		mesh->faces[i].c = indices[i * 3 + 2];
+		mesh->faces[i].color = face_color;
+	}
+
+	free(table);
+	free(keys);
+	free(indices);
+}
+
+bool load_obj_file(mesh_t* mesh, const char* obj_filename) {
+	obj_data_t obj;
+	if (!parse_obj_data(&obj, obj_filename)) {
+		return false;
+	}
+	add_flat_normals(&obj);
+	weld_obj_vertices(&obj, mesh);
+	free_obj_data(&obj);
+	return true;
+}
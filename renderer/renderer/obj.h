@@ -0,0 +1,24 @@
+#ifndef OBJ_H
+#define OBJ_H
+#include <stdbool.h>
+#include "mesh.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Wavefront OBJ loader: the file is memory mapped, a counting pass sizes the
+// mesh arrays exactly and a second pass parses the v, vt, vn and f lines into
+// them. Large files are split into line aligned chunks parsed in parallel.
+///////////////////////////////////////////////////////////////////////////////
+#define MAX_OBJ_FACE_VERTICES 64
+#define MAX_OBJ_PARSE_THREADS 16
+#define OBJ_MIN_CHUNK_BYTES (256 * 1024)	// smaller files are parsed on the calling thread
+
+// Fills the welded vertices (positions, model normals, texture coordinates and
+// OBJ position indices) and the faces of the mesh, polygons are split into a
+// triangle fan. Returns false if the file can not be read.
+bool load_obj_file(mesh_t* mesh, const char* obj_filename);
+
+// 0 picks one thread per core (the default), 1 parses on the calling thread only
+void set_obj_parse_threads(int num_threads);
+int get_obj_parse_threads(void);
+
+#endif
@@ -1,9 +1,15 @@
+#include <math.h>
+#include <float.h>
 #include "pbr.h"
 #include "light.h"
 #include "display.h"
 #include "mesh.h"
 #include "matrix.h"
 
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 #define CLAMP(x, lower, upper) ((x) < (lower) ? (lower) : ((x) > (upper) ? (upper) : (x)))
 
 vect3_t lerp(vect3_t a, vect3_t b, float t) {
@@ -23,7 +29,7 @@ float GeometrySchlickGGX(float NdotV, float roughness) {
     float numerator = NdotV;
     float denominator = NdotV * (1.0f - k) + k;
 
-    return numerator / fmaxf(denominator, SDL_FLT_EPSILON);
+    return numerator / fmaxf(denominator, FLT_EPSILON);
 }
 
 // Function to compute the combined geometric attenuation factor
@@ -42,7 +48,7 @@ float GGX_Distribution(float NdotH, float roughness) {
     float denominator = (NdotH2 * (alpha2 - 1.0f) + 1.0f);
     denominator = M_PI * denominator * denominator;
 
-    return alpha2 / fmaxf(denominator, SDL_FLT_EPSILON);
+    return alpha2 / fmaxf(denominator, FLT_EPSILON);
 }
 
 
@@ -76,16 +82,16 @@ uint32_t BRDF_PBR_MetallicRoughness(vect3_t normal, vect3_t tangent, vect3_t bit
     unpack_color(normal_map, &unpacked_normal.x, &unpacked_normal.y, &unpacked_normal.z, &unpacked_normal.w);
 
     //transform tangent normal vector from [0, 1] to range [-1, 1] 
-    vect3_t tangent_space_normal = vect3_sub(vect3_mul(vect3_from_vect4(unpacked_normal), 2.0f), vect3_new(1.0f, 1.0f, 1.0f, 1.0f));
+    vect3_t tangent_space_normal = vect3_sub(vect3_mul(vect3_from_vect4(unpacked_normal), 2.0f), vect3_new(1.0f, 1.0f, 1.0f));
     vect3_normalize(&tangent_space_normal);
 
     ///Transform the tangent space normal to worldspace and became perterbed normal
     vect3_t perturbed_normal = transform_NBT_to_world(tangent, bitangent, normal, tangent_space_normal);
     //vect3_t perturbed_normal = transform_TBN_to_world(tangent, bitangent, normal, tangent_space_normal);
 
-    //unpack the material color 
+    //unpack the material color from sRGB to linear space
     vect4_t albedo_color = vect4_new(0.0f, 0.0f, 0.0f, 0.0f);
-    unpack_color(albedo_map, &albedo_color.x, &albedo_color.y, &albedo_color.z, &albedo_color.w);
+    unpack_color_linear(albedo_map, &albedo_color.x, &albedo_color.y, &albedo_color.z, &albedo_color.w);
     vect3_t albedo = { albedo_color.x, albedo_color.y, albedo_color.z };
 
     vect4_t ao_color = vect4_new(0.0f, 0.0f, 0.0f, 0.0f);
@@ -123,7 +129,7 @@ uint32_t BRDF_PBR_MetallicRoughness(vect3_t normal, vect3_t tangent, vect3_t bit
     // Calculate the specular term
     vect3_t numerator = vect3_mul(F, D * G);
     float denominator = 4.0f * NdotV * NdotL;
-    vect3_t specular = vect3_div(numerator, fmaxf(denominator, SDL_FLT_EPSILON));
+    vect3_t specular = vect3_div(numerator, fmaxf(denominator, FLT_EPSILON));
 
     // Calculate the diffuse term
     vect3_t kS = F; // Fresnel term represents the specular reflection
@@ -165,7 +171,7 @@ uint32_t BRDF_PBR_MetallicRoughness(vect3_t normal, vect3_t tangent, vect3_t bit
     result.z *= ao;*/
 
 
-    return pack_color(result.x, result.y, result.z, 1.0f);
+    return pack_color_linear(result.x, result.y, result.z, 1.0f);
 
 }
 
@@ -197,16 +203,16 @@ uint32_t BRDF_PBR_SpecularGlossiness(vect3_t normal, vect3_t tangent, vect3_t bi
   
 
     //transform tangent normal vector from [0, 1] to range [-1, 1] 
-    vect3_t tangent_space_normal = vect3_sub(vect3_mul(vect3_from_vect4(unpacked_normal), 2.0f), vect3_new(1.0f, 1.0f, 1.0f, 1.0f));
+    vect3_t tangent_space_normal = vect3_sub(vect3_mul(vect3_from_vect4(unpacked_normal), 2.0f), vect3_new(1.0f, 1.0f, 1.0f));
     vect3_normalize(&tangent_space_normal);
 
     ///Transform the tangent space normal to worldspace and became perterbed normal
     vect3_t perturbed_normal = transform_NBT_to_world(tangent, bitangent, normal, tangent_space_normal);
     //vect3_t perturbed_normal = transform_TBN_to_world(tangent, bitangent, normal, tangent_space_normal);
 
-    //unpack the material color 
+    //unpack the material color from sRGB to linear space
     vect4_t albedo_color = vect4_new(0.0f, 0.0f, 0.0f, 0.0f);
-    unpack_color(albedo_map, &albedo_color.x, &albedo_color.y, &albedo_color.z, &albedo_color.w);
+    unpack_color_linear(albedo_map, &albedo_color.x, &albedo_color.y, &albedo_color.z, &albedo_color.w);
     vect3_t albedo = { albedo_color.x, albedo_color.y, albedo_color.z };
 
     vect4_t ao_color = vect4_new(0.0f, 0.0f, 0.0f, 0.0f);
@@ -214,7 +220,7 @@ uint32_t BRDF_PBR_SpecularGlossiness(vect3_t normal, vect3_t tangent, vect3_t bi
     float ao = ao_color.x;
 
     vect4_t specular_color = vect4_new(0.0f, 0.0f, 0.0f, 0.0f);
-    unpack_color(specular_map, &specular_color.x, &specular_color.y, &specular_color.z, &specular_color.w);
+    unpack_color_linear(specular_map, &specular_color.x, &specular_color.y, &specular_color.z, &specular_color.w);
 
     vect3_t specular_col = vect3_from_vect4(specular_color);
 
@@ -243,7 +249,7 @@ uint32_t BRDF_PBR_SpecularGlossiness(vect3_t normal, vect3_t tangent, vect3_t bi
     // Calculate the specular term
     vect3_t numerator = vect3_mul(F, D * G);
     float denominator = 4.0f * NdotV * NdotL;
-    vect3_t specular = vect3_div(numerator, fmaxf(denominator, SDL_FLT_EPSILON));
+    vect3_t specular = vect3_div(numerator, fmaxf(denominator, FLT_EPSILON));
 
     // Calculate the diffuse term
     vect3_t diffuse = {
@@ -269,7 +275,84 @@ uint32_t BRDF_PBR_SpecularGlossiness(vect3_t normal, vect3_t tangent, vect3_t bi
     result.z *= ao;*/
 
 
-    return pack_color(result.x, result.y, result.z, 1.0f);
+    return pack_color_linear(result.x, result.y, result.z, 1.0f);
+
+}
+
+
+
 
+// Index of the lowest set bit of a tile light mask (mask must not be zero)
+static int light_mask_first_index(uint64_t mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return (int)index;
+#else
+    return __builtin_ctzll(mask);
+#endif
 }
 
+// Add the point and spot lights of the current screen tile to the linear radiance of a decoded surface
+// (metallic-roughness workflow), the ambient occlusion of the surface scales their contribution
+vect3_t BRDF_PBR_LocalLights(vect3_t radiance, const pbr_surface_t* surface, uint64_t light_mask, vect3_t position) {
+
+    //The camera sits at the origin of camera space
+    vect3_t view_direction = vect3_mul(position, -1.0f);
+    vect3_normalize(&view_direction);
+
+    vect3_t perturbed_normal = surface->normal;
+    vect3_t albedo = surface->albedo;
+    float metallic = surface->metallic.x;
+    float roughness = surface->roughness;
+
+    vect3_t F0 = lerp((vect3_t) { 0.04f, 0.04f, 0.04f }, albedo, metallic);
+    float NdotV = fmaxf(vect3_dot(perturbed_normal, view_direction), 0.0f);
+
+    vect3_t radiance_sum = { 0.0f, 0.0f, 0.0f };
+
+    //Only the lights assigned to this tile are visited
+    while (light_mask != 0) {
+        int light_index = light_mask_first_index(light_mask);
+        light_mask &= light_mask - 1;
+
+        const local_light_t* local_light = get_shading_light(light_index);
+
+        vect3_t light_vector = vect3_sub(local_light->view_position, position);
+        float distance = vect3_length(light_vector);
+        if (distance >= local_light->range || distance <= 0.0f) {
+            continue;
+        }
+        vect3_t light_direction = vect3_div(light_vector, distance);
+
+        float NdotL = fmaxf(vect3_dot(perturbed_normal, light_direction), 0.0f);
+        if (NdotL <= 0.0f) {
+            continue;
+        }
+
+        float attenuation = light_range_attenuation(distance, local_light->range) *
+            light_spot_attenuation(local_light, vect3_mul(light_direction, -1.0f));
+        if (attenuation <= 0.0f) {
+            continue;
+        }
+
+        vect3_t halfway_direction = vect3_add(view_direction, light_direction);
+        vect3_normalize(&halfway_direction);
+        float NdotH = fmaxf(vect3_dot(perturbed_normal, halfway_direction), 0.0f);
+        float VdotH = fmaxf(vect3_dot(view_direction, halfway_direction), 0.0f);
+
+        float D = GGX_Distribution(NdotH, roughness);
+        float G = GeometrySmith(NdotV, NdotL, roughness);
+        vect3_t F = FresnelSchlick(VdotH, F0);
+
+        vect3_t specular = vect3_div(vect3_mul(F, D * G), fmaxf(4.0f * NdotV * NdotL, FLT_EPSILON));
+        vect3_t kD = vect3_mul(vect3_sub((vect3_t) { 1.0f, 1.0f, 1.0f }, F), 1.0f - metallic);
+
+        float light_scale = local_light->intensity * attenuation * NdotL;
+        radiance_sum.x += (kD.x * albedo.x / M_PI + specular.x) * local_light->color.x * light_scale;
+        radiance_sum.y += (kD.y * albedo.y / M_PI + specular.y) * local_light->color.y * light_scale;
+        radiance_sum.z += (kD.z * albedo.z / M_PI + specular.z) * local_light->color.z * light_scale;
+    }
+
+    return vect3_add(radiance, vect3_mul(radiance_sum, surface->ao));
+}
@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include "vector.h"
+#include "light.h"
 
 
 vect3_t lerp(vect3_t a, vect3_t b, float t);
@@ -20,6 +21,7 @@ uint32_t BRDF_PBR_SpecularGlossiness(vect3_t normal, vect3_t tangent, vect3_t bi
     uint32_t glossiness_map, uint32_t ao_map);
 
 
+vect3_t BRDF_PBR_LocalLights(vect3_t radiance, const pbr_surface_t* surface, uint64_t light_mask, vect3_t position);
 
 #endif // !PBR_H
 
@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include "pipeline.h"
+#include "thread.h"
+#include "stats.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// A stage worker runs its function once per kick, the caller waits for it
+// before touching anything the stage reads
+///////////////////////////////////////////////////////////////////////////////
+typedef struct {
+	const char* name;
+	thread_t thread;
+	mutex_t mutex;
+	condition_t condition;
+	pipeline_stage_t function;
+	bool count_stats;		// the stage adds to the pipeline statistics
+	bool started;
+	bool registered;
+	bool pending;			// a frame was kicked and is not finished yet
+	bool quit;
+} stage_worker_t;
+
+static stage_worker_t raster_worker = { .name = "raster", .count_stats = true };
+static stage_worker_t present_worker = { .name = "present", .count_stats = false };
+
+static void stage_thread_main(void* argument) {
+	stage_worker_t* worker = (stage_worker_t*)argument;
+
+	mutex_lock(&worker->mutex);
+	if (worker->count_stats) {
+		register_stats_thread();
+	}
+	worker->registered = true;
+	condition_broadcast(&worker->condition);
+
+	for (;;) {
+		while (!worker->pending && !worker->quit) {
+			condition_wait(&worker->condition, &worker->mutex);
+		}
+		if (worker->quit) {
+			break;
+		}
+		mutex_unlock(&worker->mutex);
+
+		worker->function();
+
+		mutex_lock(&worker->mutex);
+		worker->pending = false;
+		condition_broadcast(&worker->condition);
+	}
+	mutex_unlock(&worker->mutex);
+}
+
+static bool start_stage_worker(stage_worker_t* worker, pipeline_stage_t stage) {
+	worker->function = stage;
+	worker->pending = false;
+	worker->quit = false;
+	worker->registered = false;
+	mutex_init(&worker->mutex);
+	condition_init(&worker->condition);
+
+	if (worker->count_stats) {
+		register_stats_thread();
+	}
+	if (!thread_create(&worker->thread, stage_thread_main, worker)) {
+		fprintf(stderr, "Error creating the %s thread. \n", worker->name);
+		mutex_destroy(&worker->mutex);
+		condition_destroy(&worker->condition);
+		return false;
+	}
+
+	//the worker registers its statistics before the first frame can be counted
+	mutex_lock(&worker->mutex);
+	while (!worker->registered) {
+		condition_wait(&worker->condition, &worker->mutex);
+	}
+	mutex_unlock(&worker->mutex);
+
+	worker->started = true;
+	return true;
+}
+
+static void kick_stage_worker(stage_worker_t* worker) {
+	if (!worker->started) {
+		worker->function();
+		return;
+	}
+	mutex_lock(&worker->mutex);
+	worker->pending = true;
+	condition_broadcast(&worker->condition);
+	mutex_unlock(&worker->mutex);
+}
+
+static void wait_stage_worker(stage_worker_t* worker) {
+	if (!worker->started) {
+		return;
+	}
+	mutex_lock(&worker->mutex);
+	while (worker->pending) {
+		condition_wait(&worker->condition, &worker->mutex);
+	}
+	mutex_unlock(&worker->mutex);
+}
+
+static void stop_stage_worker(stage_worker_t* worker) {
+	if (!worker->started) {
+		return;
+	}
+	wait_stage_worker(worker);
+
+	mutex_lock(&worker->mutex);
+	worker->quit = true;
+	condition_broadcast(&worker->condition);
+	mutex_unlock(&worker->mutex);
+
+	thread_join(worker->thread);
+	mutex_destroy(&worker->mutex);
+	condition_destroy(&worker->condition);
+	worker->started = false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Raster stage
+///////////////////////////////////////////////////////////////////////////////
+bool start_raster_thread(pipeline_stage_t raster_stage) {
+	return start_stage_worker(&raster_worker, raster_stage);
+}
+
+void kick_raster_stage(void) {
+	kick_stage_worker(&raster_worker);
+}
+
+void wait_raster_stage(void) {
+	wait_stage_worker(&raster_worker);
+}
+
+void stop_raster_thread(void) {
+	stop_stage_worker(&raster_worker);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Present stage, one completed frame at most is queued behind the raster
+///////////////////////////////////////////////////////////////////////////////
+// Without a thread the kicks present inline, for backends bound to the main thread
+bool start_present_thread(pipeline_stage_t present_stage, bool threaded) {
+	if (!threaded) {
+		present_worker.function = present_stage;
+		return true;
+	}
+	return start_stage_worker(&present_worker, present_stage);
+}
+
+void kick_present_stage(void) {
+	kick_stage_worker(&present_worker);
+}
+
+void wait_present_stage(void) {
+	wait_stage_worker(&present_worker);
+}
+
+void stop_present_thread(void) {
+	stop_stage_worker(&present_worker);
+}
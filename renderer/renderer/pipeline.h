@@ -0,0 +1,25 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+#include <stdbool.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Three stage frame pipeline: the raster stage of frame N runs on a worker
+// thread while the calling thread runs the geometry stage of frame N+1 and
+// frame N-1 is presented from the other color buffer. Everything the raster
+// stage reads has to be published (double buffered) while the worker is idle,
+// between wait_raster_stage() and kick_raster_stage(), and the color buffers
+// are only swapped between wait_present_stage() and kick_present_stage().
+///////////////////////////////////////////////////////////////////////////////
+typedef void (*pipeline_stage_t)(void);
+
+bool start_raster_thread(pipeline_stage_t raster_stage);
+void kick_raster_stage(void);
+void wait_raster_stage(void);
+void stop_raster_thread(void);
+
+bool start_present_thread(pipeline_stage_t present_stage, bool threaded);
+void kick_present_stage(void);
+void wait_present_stage(void);
+void stop_present_thread(void);
+
+#endif
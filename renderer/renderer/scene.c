@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <string.h>
+#include "scene.h"
+#include "mesh.h"
+
+//////////////////////////////////////////////////////////////////////////////////
+// Named scenes covering every mesh in ./assets. Maps that a set does not ship
+// (or ships only as RGB/grey PNG, which the samplers can not read) are left
+// NULL and replaced by the scene texture or FALLBACK_TEXTURE when loading.
+//////////////////////////////////////////////////////////////////////////////////
+static const scene_mesh_t scene_meshes[] = {
+	//name        obj                           texture                          normalmap                         glowmap                          roughmap                           metalmap                          aomap                            scale                    translation               rotation
+	{ "lighter",  "./assets/Lighter.obj",       "./assets/Lighter_B.png",        "./assets/Lighter_N.png",         "./assets/Lighter_B.png",        "./assets/Lighter_R.png",          "./assets/Lighter_M.png",         "./assets/Lighter_B.png",        { 1, 1, 1 },             { 0, 0, 3 },              { 0, 1.3f, 0 } },
+	{ "dolphin",  "./assets/Dolphin.obj",       "./assets/Dolphin@2.png",        "./assets/Dolphin_Normal.png",    "./assets/Dolphin_Glow@1.png",   "./assets/Dolphin_Roughness.png",  NULL,                             NULL,                            { 1, 1, 1 },             { 0, 0, 2.5f },           { -1, 0, 0 } },
+	{ "gun",      "./assets/gun.obj",           "./assets/gun.png",              "./assets/gun_normal.png",        "./assets/gun_metallic.png",     "./assets/gun_roughness.png",      "./assets/gun_metallic.png",      "./assets/gun.png",              { 1, 1, 1 },             { 0, 0, 6 },              { 0, 0, 0 } },
+	{ "helmet",   "./assets/helmet.obj",        "./assets/helmet_D.png",         "./assets/helmet_N.png",          "./assets/helmet_D.png",         "./assets/helmet_R.png",           "./assets/helmet_M.png",          "./assets/helmet_D.png",         { 1, 1, 1 },             { 0, 0, 5 },              { 0, -1, 0 } },
+	{ "rivet",    "./assets/rivet.obj",         NULL,                            "./assets/rivet_normal.png",      NULL,                            "./assets/rivet_roughness.png",    "./assets/rivet_metallic.png",    NULL,                            { 1, 1, 1 },             { 0, 0, 3.5f },           { 0.3f, 1.8f, 0.3f } },
+	{ "snowman",  "./assets/snowman.obj",       "./assets/snowman_Diffuse.png",  "./assets/snowman_Normal.png",    "./assets/snowman_Metallic.png", "./assets/snowman_Roughness.png",  "./assets/snowman_Metallic.png",  "./assets/snowman_AO.png",       { 1, 1, 1 },             { 0, 0, 3.2f },           { 0, 0, 0 } },
+	{ "ironman",  "./assets/ironman.obj",       "./assets/ironman_A.png",        NULL,                             NULL,                            "./assets/ironman_R.png",          "./assets/ironman_M.png",         "./assets/ironman_A.png",        { 1, 1, 1 },             { 0, 0, 2 },              { 0, 3.2f, 0 } },
+	{ "hover_car","./assets/hover_car.obj",     NULL,                            NULL,                             "./assets/car_G.png",            "./assets/car_R.png",              NULL,                             "./assets/car_O.png",            { 1, 1, 1 },             { 0, 0, 4 },              { 0, 2.5f, 0 } },
+	{ "fighters", "./assets/runway.obj",        "./assets/runway.png",           NULL,                             NULL,                            NULL,                              NULL,                             NULL,                            { 1, 1, 1 },             { 0, -1.5f, 23 },         { 0, 0, 0 } },
+	{ "fighters", "./assets/f22.obj",           "./assets/f22.png",              NULL,                             NULL,                            NULL,                              NULL,                             NULL,                            { 1, 1, 1 },             { 0, -1.3f, 5 },          { 0, -1.5707963f, 0 } },
+	{ "fighters", "./assets/efa.obj",           "./assets/efa.png",              NULL,                             NULL,                            NULL,                              NULL,                             NULL,                            { 1, 1, 1 },             { -2, -1.3f, 9 },         { 0, -1.5707963f, 0 } },
+	{ "fighters", "./assets/f117.obj",          "./assets/f117.png",             NULL,                             NULL,                            NULL,                              NULL,                             NULL,                            { 1, 1, 1 },             { 2, -1.3f, 9 },          { 0, -1.5707963f, 0 } },
+	{ "crab",     "./assets/crab.obj",          "./assets/crab.png",             NULL,                             NULL,                            NULL,                              NULL,                             NULL,                            { 1, 1, 1 },             { 0, 0, 5 },              { 0, 0, 0 } },
+	{ "drone",    "./assets/drone.obj",         "./assets/drone.png",            NULL,                             NULL,                            NULL,                              NULL,                             NULL,                            { 1, 1, 1 },             { 0, 0, 5 },              { 0, 0, 0 } },
+	{ "shiba",    "./assets/shiba.obj",         "./assets/shiba_diffuse.png",    NULL,                             NULL,                            NULL,                              NULL,                             NULL,                            { 1, 1, 1 },             { 0, 0, 5 },              { 0, 0, 0 } },
+	{ "ak47",     "./assets/ak47.obj",          "./assets/cube.png",             NULL,                             NULL,                            NULL,                              NULL,                             NULL,                            { 2, 2, 2 },             { 0, 0, 3 },              { 0, 0, 0 } },
+	{ "cube",     "./assets/cube.obj",          "./assets/cube.png",             NULL,                             NULL,                            NULL,                              NULL,                             NULL,                            { 1, 1, 1 },             { 0, 0, 5 },              { 0, 0, 0 } },
+	{ "sphere",   "./assets/sphere.obj",        "./assets/pikuma.png",           NULL,                             NULL,                            NULL,                              NULL,                             NULL,                            { 0.65f, 0.65f, 0.65f }, { 0, 0, 4 },              { 0, 0, 0 } },
+	{ "mine",     "./assets/mine.obj",          NULL,                            "./assets/Landmine_small_n.png",  NULL,                            NULL,                              NULL,                             NULL,                            { 12, 12, 12 },          { 0, 0, 4 },              { 0.5f, 0, 0 } },
+	{ "samus",    "./assets/samus.obj",         "./assets/suit.png",             NULL,                             NULL,                            NULL,                              NULL,                             NULL,                            { 0.3f, 0.3f, 0.3f },    { 0, -1.25f, 4 },         { 0, 3.1415926f, 0 } },
+	{ "link",     "./assets/link.obj",          NULL,                            NULL,                             NULL,                            NULL,                              NULL,                             NULL,                            { 0.7f, 0.7f, 0.7f },    { 0, 0.35f, 4 },          { 0, 3.1415926f, 0 } },
+	{ "miku",     "./assets/miku.obj",          NULL,                            NULL,                             NULL,                            NULL,                              NULL,                             NULL,                            { 0.0175f, 0.0175f, 0.0175f }, { 0, -1.3f, 4 },    { 0, 3.1415926f, 0 } },
+	{ "girl",     "./assets/girl.obj",          NULL,                            NULL,                             NULL,                            NULL,                              NULL,                             NULL,                            { 0.23f, 0.23f, 0.23f }, { 0, 0.25f, 4 },          { 0, 3.1415926f, 0 } },
+	{ "robot",    "./assets/robot.obj",         NULL,                            NULL,                             NULL,                            NULL,                              NULL,                             NULL,                            { 0.17f, 0.17f, 0.17f }, { 0, -1.3f, 4 },          { 0, 3.1415926f, 0 } },
+	{ "mc",       "./assets/mc.obj",            NULL,                            NULL,                             NULL,                            NULL,                              NULL,                             NULL,                            { 0.85f, 0.85f, 0.85f }, { 0, -1.3f, 4 },          { 0, 3.1415926f, 0 } },
+	{ "cyborg",   "./assets/Cyborg.obj",        NULL,                            NULL,                             NULL,                            NULL,                              NULL,                             NULL,                            { 0.125f, 0.125f, 0.125f }, { 0, 0, 4 },           { 0, 3.1415926f, 0 } },
+	{ "bunny",    "./assets/bunny.obj",         NULL,                            NULL,                             NULL,                            NULL,                              NULL,                             NULL,                            { 16, 16, 16 },          { 0, -1.8f, 4 },          { 0, 0, 0 } },
+	{ "ateneal",  "./assets/ateneal.obj",       NULL,                            NULL,                             NULL,                            NULL,                              NULL,                             NULL,                            { 0.0004f, 0.0004f, 0.0004f }, { 0, -0.5f, 4 },    { 0, 0, 0 } },
+};
+
+#define NUM_SCENE_MESHES ((int)(sizeof(scene_meshes) / sizeof(scene_meshes[0])))
+
+//the scene names in table order, each name once
+int get_num_scenes(void) {
+	int count = 0;
+	for (int i = 0; i < NUM_SCENE_MESHES; i++) {
+		if (i == 0 || strcmp(scene_meshes[i].scene, scene_meshes[i - 1].scene) != 0) {
+			count++;
+		}
+	}
+	return count;
+}
+
+const char* get_scene_name(int scene_index) {
+	int count = 0;
+	for (int i = 0; i < NUM_SCENE_MESHES; i++) {
+		if (i == 0 || strcmp(scene_meshes[i].scene, scene_meshes[i - 1].scene) != 0) {
+			if (count == scene_index) {
+				return scene_meshes[i].scene;
+			}
+			count++;
+		}
+	}
+	return NULL;
+}
+
+static char* map_or_texture(char* map_filename, const scene_mesh_t* entry) {
+	if (map_filename != NULL) {
+		return map_filename;
+	}
+	return entry->texture_filename != NULL ? entry->texture_filename : FALLBACK_TEXTURE;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+// Schedule the loading and load time preprocessing of all meshes of the scene,
+// every mesh is drawn as soon as its own jobs are finished
+//////////////////////////////////////////////////////////////////////////////////
+bool load_scene(const char* name) {
+	int first_mesh = get_num_meshes();
+
+	for (int i = 0; i < NUM_SCENE_MESHES; i++) {
+		const scene_mesh_t* entry = &scene_meshes[i];
+		if (strcmp(entry->scene, name) != 0) {
+			continue;
+		}
+
+		load_mesh_with_pbr_async(
+			entry->obj_filename,
+			map_or_texture(entry->texture_filename, entry),
+			map_or_texture(entry->normalmap_filename, entry),
+			map_or_texture(entry->glowmap_filename, entry),
+			map_or_texture(entry->roughmap_filename, entry),
+			map_or_texture(entry->metalmap_filename, entry),
+			map_or_texture(entry->aomap_filename, entry),
+			FALLBACK_TEXTURE,
+			entry->scale,
+			entry->translation,
+			entry->rotation
+		);
+	}
+
+	if (get_num_meshes() == first_mesh) {
+		fprintf(stderr, "Unknown scene '%s'. \n", name);
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,30 @@
+#ifndef SCENE_H
+#define SCENE_H
+#include <stdbool.h>
+#include "vector.h"
+
+#define DEFAULT_SCENE "lighter"
+#define FALLBACK_TEXTURE "./assets/cube.png"	// used for every map a scene does not provide
+
+//////////////////////////////////////////////////////////////////////////////////
+// One mesh of a named scene, consecutive entries with the same name form a scene
+//////////////////////////////////////////////////////////////////////////////////
+typedef struct {
+	const char* scene;
+	char* obj_filename;
+	char* texture_filename;
+	char* normalmap_filename;
+	char* glowmap_filename;
+	char* roughmap_filename;
+	char* metalmap_filename;
+	char* aomap_filename;
+	vect3_t scale;
+	vect3_t translation;
+	vect3_t rotation;
+} scene_mesh_t;
+
+int get_num_scenes(void);
+const char* get_scene_name(int scene_index);
+bool load_scene(const char* name);
+
+#endif
@@ -0,0 +1,276 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "shadow.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SHADOW_SIMD_SSE2
+#endif
+
+#define SHADOW_DEPTH_BIAS 0.004f	//normalized depth offset against shadow acne
+#define SHADOW_MAP_BORDER 2.0f		//texels kept free around the fitted casters
+
+static uint16_t* shadow_map = NULL;	//16-bit unorm depth, half the bandwidth of float
+static int shadow_map_size = 0;
+static int requested_shadow_map_size = DEFAULT_SHADOW_MAP_RESOLUTION;
+static bool shadows_enabled = true;
+static bool shadow_pcf_enabled = true;
+static bool shadow_map_ready = false;
+
+//light space triangles of the shadow casters of one frame (9 floats per triangle) and their bounds
+typedef struct {
+	mat4_t light_view_matrix;	//rotation from camera space into light space, the light looks down its +z axis
+	float* triangles;
+	int num_triangles;
+	int capacity;
+	vect3_t bounds_min;
+	vect3_t bounds_max;
+} shadow_casters_t;
+
+//the geometry stage fills one list while the raster stage draws the other one
+static shadow_casters_t caster_lists[2];
+static shadow_casters_t* submitted_casters = &caster_lists[0];
+static shadow_casters_t* published_casters = &caster_lists[1];
+static vect4_stream_t light_space_vertices;
+
+//light view of the published casters, used to sample the map
+static mat4_t light_view_matrix;
+
+//orthographic fit from light space to shadow map texels and normalized depth
+static float texel_scale_x = 1.0f;
+static float texel_scale_y = 1.0f;
+static float texel_offset_x = 0.0f;
+static float texel_offset_y = 0.0f;
+static float depth_scale = 1.0f;
+static float depth_offset = 0.0f;
+
+
+void init_shadow_map(int resolution) {
+	set_shadow_map_resolution(resolution);
+}
+
+/// The map is reallocated lazily by the next shadow pass
+void set_shadow_map_resolution(int resolution) {
+	if (resolution < 16) {
+		resolution = 16;
+	}
+	requested_shadow_map_size = resolution;
+}
+
+int get_shadow_map_resolution(void) {
+	return requested_shadow_map_size;
+}
+
+void set_shadows_enabled(bool enabled) {
+	shadows_enabled = enabled;
+}
+
+bool is_shadows_enabled(void) {
+	return shadows_enabled;
+}
+
+void set_shadow_pcf(bool enabled) {
+	shadow_pcf_enabled = enabled;
+}
+
+bool is_shadow_pcf_enabled(void) {
+	return shadow_pcf_enabled;
+}
+
+bool is_shadow_map_ready(void) {
+	return shadow_map_ready;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Start collecting shadow casters for a new frame
+///////////////////////////////////////////////////////////////////////////////
+void begin_shadow_pass(vect3_t light_direction) {
+	vect3_normalize(&light_direction);
+
+	//avoid a degenerated basis when the light points straight up or down
+	vect3_t up = vect3_new(0, 1, 0);
+	if (fabsf(vect3_dot(light_direction, up)) > 0.99f) {
+		up = vect3_new(1, 0, 0);
+	}
+	submitted_casters->light_view_matrix = mat4_look_at(vect3_new(0, 0, 0), light_direction, up);
+
+	submitted_casters->num_triangles = 0;
+	submitted_casters->bounds_min = vect3_new(FLT_MAX, FLT_MAX, FLT_MAX);
+	submitted_casters->bounds_max = vect3_new(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Hand the submitted casters to the raster stage, called while it is idle
+///////////////////////////////////////////////////////////////////////////////
+void publish_shadow_casters(void) {
+	shadow_casters_t* casters = published_casters;
+	published_casters = submitted_casters;
+	submitted_casters = casters;
+	shadow_map_ready = false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Move the camera space vertices of a mesh to light space and record its faces
+///////////////////////////////////////////////////////////////////////////////
+void submit_shadow_casters(const vect4_stream_t* view_vertices, face_t* faces, int num_faces) {
+
+	//the camera space positions are affine (w = 1), so the x, y, z streams are enough
+	vect3_stream_t positions = {
+		.x = view_vertices->x,
+		.y = view_vertices->y,
+		.z = view_vertices->z,
+		.count = view_vertices->count,
+		.capacity = view_vertices->capacity
+	};
+	shadow_casters_t* casters = submitted_casters;
+	mat4_mul_vect3_stream(casters->light_view_matrix, &positions, &light_space_vertices);
+
+	if (casters->num_triangles + num_faces > casters->capacity) {
+		int capacity = casters->capacity * 2;
+		if (capacity < casters->num_triangles + num_faces) {
+			capacity = casters->num_triangles + num_faces;
+		}
+		casters->triangles = (float*)realloc(casters->triangles, sizeof(float) * 9 * capacity);
+		casters->capacity = capacity;
+	}
+
+	vect3_t bounds_min = casters->bounds_min;
+	vect3_t bounds_max = casters->bounds_max;
+	for (int i = 0; i < num_faces; i++) {
+		int indices[3] = { faces[i].a, faces[i].b, faces[i].c };
+		float* triangle = &casters->triangles[(casters->num_triangles + i) * 9];
+
+		for (int j = 0; j < 3; j++) {
+			float x = light_space_vertices.x[indices[j]];
+			float y = light_space_vertices.y[indices[j]];
+			float z = light_space_vertices.z[indices[j]];
+			triangle[j * 3 + 0] = x;
+			triangle[j * 3 + 1] = y;
+			triangle[j * 3 + 2] = z;
+
+			bounds_min.x = fminf(bounds_min.x, x);
+			bounds_min.y = fminf(bounds_min.y, y);
+			bounds_min.z = fminf(bounds_min.z, z);
+			bounds_max.x = fmaxf(bounds_max.x, x);
+			bounds_max.y = fmaxf(bounds_max.y, y);
+			bounds_max.z = fmaxf(bounds_max.z, z);
+		}
+	}
+	casters->bounds_min = bounds_min;
+	casters->bounds_max = bounds_max;
+	casters->num_triangles += num_faces;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Depth-only pass: fit an orthographic projection around all casters and
+// rasterize them into the shadow map
+///////////////////////////////////////////////////////////////////////////////
+void render_shadow_map(void) {
+	const shadow_casters_t* casters = published_casters;
+	if (casters->num_triangles == 0) {
+		return;
+	}
+	light_view_matrix = casters->light_view_matrix;
+
+	if (shadow_map_size != requested_shadow_map_size) {
+		free(shadow_map);
+		shadow_map_size = requested_shadow_map_size;
+		shadow_map = (uint16_t*)malloc(sizeof(uint16_t) * shadow_map_size * shadow_map_size);
+	}
+
+	for (int i = 0; i < shadow_map_size * shadow_map_size; i++) {
+		shadow_map[i] = 0xFFFF;
+	}
+
+	//fit the caster bounds into the map, keeping a small border for the PCF kernel
+	float usable = shadow_map_size - 2.0f * SHADOW_MAP_BORDER;
+	float extent_x = fmaxf(casters->bounds_max.x - casters->bounds_min.x, 1e-4f);
+	float extent_y = fmaxf(casters->bounds_max.y - casters->bounds_min.y, 1e-4f);
+	float extent_z = fmaxf(casters->bounds_max.z - casters->bounds_min.z, 1e-4f);
+
+	texel_scale_x = usable / extent_x;
+	texel_scale_y = -usable / extent_y; //map rows grow downwards like the screen
+	texel_offset_x = SHADOW_MAP_BORDER - casters->bounds_min.x * texel_scale_x;
+	texel_offset_y = SHADOW_MAP_BORDER + casters->bounds_max.y * usable / extent_y;
+	depth_scale = 65535.0f / extent_z;
+	depth_offset = -casters->bounds_min.z * depth_scale;
+
+	for (int i = 0; i < casters->num_triangles; i++) {
+		const float* t = &casters->triangles[i * 9];
+		draw_shadow_triangle(
+			t[0] * texel_scale_x + texel_offset_x, t[1] * texel_scale_y + texel_offset_y, t[2] * depth_scale + depth_offset,
+			t[3] * texel_scale_x + texel_offset_x, t[4] * texel_scale_y + texel_offset_y, t[5] * depth_scale + depth_offset,
+			t[6] * texel_scale_x + texel_offset_x, t[7] * texel_scale_y + texel_offset_y, t[8] * depth_scale + depth_offset,
+			shadow_map, shadow_map_size
+		);
+	}
+
+	shadow_map_ready = true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Return how much of the directional light reaches a camera space position
+// (1 = fully lit, 0 = fully in shadow)
+///////////////////////////////////////////////////////////////////////////////
+float sample_shadow_visibility(vect3_t view_position) {
+	if (!shadow_map_ready) {
+		return 1.0f;
+	}
+
+	vect3_t p = mat4_mul_vect3_no_translation(light_view_matrix, view_position);
+
+	float tx = p.x * texel_scale_x + texel_offset_x;
+	float ty = p.y * texel_scale_y + texel_offset_y;
+	int depth = (int)(p.z * depth_scale + depth_offset - SHADOW_DEPTH_BIAS * 65535.0f);
+
+	//receivers outside of the fitted casters can't be occluded
+	if (tx < 0.0f || ty < 0.0f || tx >= shadow_map_size || ty >= shadow_map_size) {
+		return 1.0f;
+	}
+
+	if (!shadow_pcf_enabled) {
+		return depth <= shadow_map[(int)ty * shadow_map_size + (int)tx] ? 1.0f : 0.0f;
+	}
+
+	///Percentage closer filtering over a 4x4 texel footprint
+	int x0 = (int)tx - 1;
+	int y0 = (int)ty - 1;
+	x0 = x0 < 0 ? 0 : (x0 > shadow_map_size - 4 ? shadow_map_size - 4 : x0);
+	y0 = y0 < 0 ? 0 : (y0 > shadow_map_size - 4 ? shadow_map_size - 4 : y0);
+
+	const uint16_t* row = &shadow_map[y0 * shadow_map_size + x0];
+	int lit_taps = 16;
+
+#if defined(SHADOW_SIMD_SSE2)
+	//one row of four taps per compare, widened to 32 bits since SSE2 has no unsigned 16-bit compare
+	static const int bit_count[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+	__m128i reference = _mm_set1_epi32(depth);
+	__m128i zero = _mm_setzero_si128();
+	for (int r = 0; r < 4; r++) {
+		__m128i taps = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)(row + r * shadow_map_size)), zero);
+		lit_taps -= bit_count[_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(reference, taps)))];
+	}
+#else
+	lit_taps = 0;
+	for (int r = 0; r < 4; r++) {
+		for (int c = 0; c < 4; c++) {
+			lit_taps += depth <= row[r * shadow_map_size + c];
+		}
+	}
+#endif
+
+	return lit_taps / 16.0f;
+}
+
+void free_shadow_map(void) {
+	free(shadow_map);
+	for (int i = 0; i < 2; i++) {
+		free(caster_lists[i].triangles);
+		memset(&caster_lists[i], 0, sizeof(caster_lists[i]));
+	}
+	vect4_stream_free(&light_space_vertices);
+	shadow_map = NULL;
+	shadow_map_size = 0;
+}
@@ -0,0 +1,29 @@
+#ifndef SHADOW_H
+#define SHADOW_H
+
+#include <stdbool.h>
+#include "vector.h"
+#include "matrix.h"
+#include "triangle.h"
+
+#define DEFAULT_SHADOW_MAP_RESOLUTION 1024
+
+void init_shadow_map(int resolution);
+void set_shadow_map_resolution(int resolution);
+int get_shadow_map_resolution(void);
+
+void set_shadows_enabled(bool enabled);
+bool is_shadows_enabled(void);
+void set_shadow_pcf(bool enabled);
+bool is_shadow_pcf_enabled(void);
+
+void begin_shadow_pass(vect3_t light_direction);
+void submit_shadow_casters(const vect4_stream_t* view_vertices, face_t* faces, int num_faces);
+void publish_shadow_casters(void);
+void render_shadow_map(void);
+bool is_shadow_map_ready(void);
+float sample_shadow_visibility(vect3_t view_position);
+
+void free_shadow_map(void);
+
+#endif // !SHADOW_H
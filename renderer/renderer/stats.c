@@ -0,0 +1,57 @@
+#include <string.h>
+#include "stats.h"
+
+STATS_THREAD_LOCAL pipeline_stats_t thread_stats;
+
+static STATS_THREAD_LOCAL int thread_registered = 0;
+static pipeline_stats_t* registered_stats[MAX_STATS_THREADS];
+static int num_registered_stats = 0;
+
+static const char* texture_map_names[NUM_TEXTURE_MAPS] = {
+	"texture", "normal", "glow", "roughness", "metallic", "ao"
+};
+
+const char* get_texture_map_name(int map) {
+	return texture_map_names[map];
+}
+
+void register_stats_thread(void) {
+	if (thread_registered || num_registered_stats == MAX_STATS_THREADS) {
+		return;
+	}
+	thread_registered = 1;
+	registered_stats[num_registered_stats++] = &thread_stats;
+}
+
+// Start counting a new frame, called while no other thread is counting
+void reset_pipeline_stats(void) {
+	register_stats_thread();
+	for (int i = 0; i < num_registered_stats; i++) {
+		memset(registered_stats[i], 0, sizeof(pipeline_stats_t));
+	}
+}
+
+void add_pipeline_stats(pipeline_stats_t* total, const pipeline_stats_t* stats) {
+	total->faces_processed += stats->faces_processed;
+	total->faces_culled += stats->faces_culled;
+	total->triangles_accepted += stats->triangles_accepted;
+	total->triangles_clipped += stats->triangles_clipped;
+	total->triangles_rejected += stats->triangles_rejected;
+	total->triangles_emitted += stats->triangles_emitted;
+	total->pixels_tested += stats->pixels_tested;
+	total->pixels_passed += stats->pixels_passed;
+	total->pixels_shaded += stats->pixels_shaded;
+	for (int map = 0; map < NUM_TEXTURE_MAPS; map++) {
+		total->texture_fetches[map] += stats->texture_fetches[map];
+	}
+}
+
+// Sum of all thread accumulators since the last reset
+pipeline_stats_t get_pipeline_stats(void) {
+	pipeline_stats_t total;
+	memset(&total, 0, sizeof(total));
+	for (int i = 0; i < num_registered_stats; i++) {
+		add_pipeline_stats(&total, registered_stats[i]);
+	}
+	return total;
+}
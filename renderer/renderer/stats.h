@@ -0,0 +1,83 @@
+#ifndef STATS_H
+#define STATS_H
+#include <stdint.h>
+
+// Set PIPELINE_STATS to 0 to compile the counters out completely
+#ifndef PIPELINE_STATS
+#define PIPELINE_STATS 1
+#endif
+
+#if defined(_MSC_VER)
+#define STATS_THREAD_LOCAL __declspec(thread)
+#else
+#define STATS_THREAD_LOCAL _Thread_local
+#endif
+
+//A time stamp counter read is much cheaper than the OS clock, so the per pixel and per face timers use it
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define STATS_HAS_CYCLE_COUNTER
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define STATS_HAS_CYCLE_COUNTER
+#endif
+
+// Always 0 without a time stamp counter
+static inline uint64_t read_cycle_counter(void) {
+#if defined(STATS_HAS_CYCLE_COUNTER)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+#define MAX_STATS_THREADS 64
+
+enum texture_map
+{
+	MAP_TEXTURE,
+	MAP_NORMAL,
+	MAP_GLOW,
+	MAP_ROUGHNESS,
+	MAP_METALLIC,
+	MAP_AO,
+	NUM_TEXTURE_MAPS
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Counts of one frame. The pixel counts cover the main view rasterizers, the
+// shadow map pass and the wireframe lines are not counted.
+///////////////////////////////////////////////////////////////////////////////
+typedef struct {
+	uint64_t faces_processed;		// faces entering process_graphic_pipeline_stages
+	uint64_t faces_culled;			// faces dropped by the backface test
+	uint64_t triangles_accepted;	// completely inside the frustum, clip_polygon left them alone
+	uint64_t triangles_clipped;		// cut by at least one frustum plane
+	uint64_t triangles_rejected;	// completely outside the frustum
+	uint64_t triangles_emitted;		// triangles stored for the rasterizer
+	uint64_t pixels_tested;			// depth tests
+	uint64_t pixels_passed;			// depth tests passed
+	uint64_t pixels_shaded;			// pixels that ran the shading code
+	uint64_t texture_fetches[NUM_TEXTURE_MAPS];
+} pipeline_stats_t;
+
+// Every thread increments its own accumulator, so counting needs no atomics
+extern STATS_THREAD_LOCAL pipeline_stats_t thread_stats;
+
+#if PIPELINE_STATS
+#define STAT_ADD(counter, amount) (thread_stats.counter += (uint64_t)(amount))
+#define STAT_FETCH(map, amount) (thread_stats.texture_fetches[map] += (uint64_t)(amount))
+#else
+#define STAT_ADD(counter, amount) ((void)0)
+#define STAT_FETCH(map, amount) ((void)0)
+#endif
+
+// Threads that count have to register once before their first frame
+void register_stats_thread(void);
+
+void reset_pipeline_stats(void);
+pipeline_stats_t get_pipeline_stats(void);
+void add_pipeline_stats(pipeline_stats_t* total, const pipeline_stats_t* stats);
+const char* get_texture_map_name(int map);
+
+#endif
@@ -1,8 +1,335 @@
-
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
 #include "texture.h"
+#include "block_compression.h"
+
+#if defined(_MSC_VER)
+#define TEXTURE_THREAD_LOCAL __declspec(thread)
+#else
+#define TEXTURE_THREAD_LOCAL _Thread_local
+#endif
 
+#define BLOCK_CACHE_BITS 8			// 256 decoded blocks per thread, 17 KB
+#define MAX_NORMAL_REBUILD_ERROR 16.0	// error of the rebuilt BC5 component a texel may have, in 8-bit steps
+#define MAX_GRAY_DIFFERENCE 8			// channel difference a BC4 texel may have, in 8-bit steps
+#define MAX_CHECK_MISSES 100			// texels out of 10000 allowed above those limits
+#define CHECK_STRIDE 7					// texels between the ones the checks look at
+#define TEXTURE_PAGE_SIZE 4096			// stride of the reads that page in a mapped level
 
 tex2_t tex2_clone(tex2_t* t) {
     tex2_t result = {t->u, t->v};
     return result;
-}
\ No newline at end of file
+}
+
+typedef void (*block_encoder_t)(const uint32_t texels[16], uint8_t* block);
+typedef void (*block_decoder_t)(const uint8_t* block, uint32_t texels[16]);
+
+typedef struct {
+	int block_size;
+	block_encoder_t encode;
+	block_decoder_t decode;
+} block_format_t;
+
+static const block_format_t block_formats[] = {
+	[TEXTURE_FORMAT_BC1] = { BC1_BLOCK_SIZE, encode_bc1_block, decode_bc1_block },
+	[TEXTURE_FORMAT_BC4] = { BC4_BLOCK_SIZE, encode_bc4_block, decode_bc4_block },
+	[TEXTURE_FORMAT_BC5] = { BC5_BLOCK_SIZE, encode_bc5_block, decode_bc5_block },
+};
+
+// BC5 only keeps two components of a unit normal. Maps where the third one can not be rebuilt,
+// like a color texture standing in for a missing normal map or one whose normals are not unit
+// length, are compressed as BC1 instead. A few bad texels already show up as dark speckles.
+static bool can_rebuild_normals(const uint32_t* texels, size_t count) {
+	size_t misses = 0;
+	size_t samples = 0;
+	for (size_t i = 0; i < count; i += CHECK_STRIDE) {
+		float x = (float)((texels[i] >> 16) & 0xFF) * (2.0f / 255.0f) - 1.0f;
+		float y = (float)((texels[i] >> 8) & 0xFF) * (2.0f / 255.0f) - 1.0f;
+		float z = (float)(texels[i] & 0xFF) * (2.0f / 255.0f) - 1.0f;
+		if (fabsf(sqrtf(fmaxf(1.0f - y * y - z * z, 0.0f)) - x) * 127.5f > MAX_NORMAL_REBUILD_ERROR) {
+			misses++;
+		}
+		samples++;
+	}
+	return misses * 10000 <= MAX_CHECK_MISSES * samples;
+}
+
+// BC4 decodes to gray. That suits roughness and ao maps that are read through one channel, but the
+// metallic map is read as a color and the maps can be color textures standing in for missing ones.
+static bool is_grayscale(const uint32_t* texels, size_t count) {
+	size_t misses = 0;
+	size_t samples = 0;
+	for (size_t i = 0; i < count; i += CHECK_STRIDE) {
+		int r = (int)((texels[i] >> 16) & 0xFF);
+		int g = (int)((texels[i] >> 8) & 0xFF);
+		int b = (int)(texels[i] & 0xFF);
+		if (abs(r - g) > MAX_GRAY_DIFFERENCE || abs(r - b) > MAX_GRAY_DIFFERENCE) {
+			misses++;
+		}
+		samples++;
+	}
+	return misses * 10000 <= MAX_CHECK_MISSES * samples;
+}
+
+// 8-bit images in the layout the shaders unpack, the R, G, B and A bytes of a texel in memory order
+static uint32_t* convert_to_rgba8(upng_t* image, int width, int height) {
+	size_t count = (size_t)width * height;
+	const uint8_t* pixels = (const uint8_t*)upng_get_buffer(image);
+	upng_format format = upng_get_format(image);
+	if (format != UPNG_RGBA8 && format != UPNG_RGB8 && format != UPNG_LUMINANCE8 && format != UPNG_LUMINANCE_ALPHA8) {
+		return NULL;
+	}
+	uint32_t* texels = (uint32_t*)malloc(count * sizeof(uint32_t));
+	if (texels == NULL) {
+		return NULL;
+	}
+	for (size_t i = 0; i < count; i++) {
+		uint32_t r, g, b, a;
+		switch (format) {
+		case UPNG_RGBA8:
+			r = pixels[i * 4]; g = pixels[i * 4 + 1]; b = pixels[i * 4 + 2]; a = pixels[i * 4 + 3];
+			break;
+		case UPNG_RGB8:
+			r = pixels[i * 3]; g = pixels[i * 3 + 1]; b = pixels[i * 3 + 2]; a = 0xFF;
+			break;
+		case UPNG_LUMINANCE_ALPHA8:
+			r = g = b = pixels[i * 2]; a = pixels[i * 2 + 1];
+			break;
+		default:
+			r = g = b = pixels[i]; a = 0xFF;
+			break;
+		}
+		texels[i] = (a << 24) | (b << 16) | (g << 8) | r;
+	}
+	return texels;
+}
+
+// Every texel of the next level averages the 2x2 texels it covers, odd sizes repeat the last row or column
+static void downsample_level(const uint32_t* source, int width, int height, uint32_t* destination) {
+	int next_width = width > 1 ? width / 2 : 1;
+	int next_height = height > 1 ? height / 2 : 1;
+	for (int y = 0; y < next_height; y++) {
+		const uint32_t* row0 = source + (size_t)(y * 2) * width;
+		const uint32_t* row1 = source + (size_t)(y * 2 + 1 < height ? y * 2 + 1 : y * 2) * width;
+		for (int x = 0; x < next_width; x++) {
+			int x0 = x * 2;
+			int x1 = x * 2 + 1 < width ? x * 2 + 1 : x * 2;
+			uint32_t texel = 0;
+			for (int shift = 0; shift < 32; shift += 8) {
+				uint32_t sum = ((row0[x0] >> shift) & 0xFF) + ((row0[x1] >> shift) & 0xFF) +
+					((row1[x0] >> shift) & 0xFF) + ((row1[x1] >> shift) & 0xFF);
+				texel |= ((sum + 2) / 4) << shift;
+			}
+			destination[(size_t)y * next_width + x] = texel;
+		}
+	}
+}
+
+// Blocks on the right and bottom edges repeat the last texel column and row
+static void encode_level(texture_format_t format, const uint32_t* texels, const texture_level_t* level, uint8_t* data) {
+	if (format == TEXTURE_FORMAT_RGBA8) {
+		memcpy(data, texels, level->size);
+		return;
+	}
+	const block_format_t* block_format = &block_formats[format];
+	int width = level->width;
+	int height = level->height;
+	int block_rows = (height + 3) / 4;
+	uint8_t* block = data;
+	for (int block_y = 0; block_y < block_rows; block_y++) {
+		for (int block_x = 0; block_x < level->blocks_per_row; block_x++) {
+			uint32_t block_texels[16];
+			for (int y = 0; y < 4; y++) {
+				int texel_y = block_y * 4 + y < height ? block_y * 4 + y : height - 1;
+				for (int x = 0; x < 4; x++) {
+					int texel_x = block_x * 4 + x < width ? block_x * 4 + x : width - 1;
+					block_texels[y * 4 + x] = texels[(size_t)texel_y * width + texel_x];
+				}
+			}
+			block_format->encode(block_texels, block);
+			block += block_format->block_size;
+		}
+	}
+}
+
+size_t layout_texture_levels(texture_t* texture, const uint8_t* data) {
+	texture->block_size = texture->format == TEXTURE_FORMAT_RGBA8 ? 0 : block_formats[texture->format].block_size;
+	int width = texture->width;
+	int height = texture->height;
+	size_t offset = 0;
+	int num_levels = 0;
+	while (num_levels < MAX_TEXTURE_LEVELS) {
+		texture_level_t* level = &texture->levels[num_levels++];
+		level->width = width;
+		level->height = height;
+		if (texture->format == TEXTURE_FORMAT_RGBA8) {
+			level->blocks_per_row = 0;
+			level->size = (size_t)width * height * sizeof(uint32_t);
+		}
+		else {
+			level->blocks_per_row = (width + 3) / 4;
+			level->size = (size_t)level->blocks_per_row * ((height + 3) / 4) * texture->block_size;
+		}
+		level->data = data != NULL ? data + offset : NULL;
+		offset += level->size;
+		if (width == 1 && height == 1) {
+			break;
+		}
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+	texture->num_levels = num_levels;
+	texture->size = offset;
+	return offset;
+}
+
+// RGBA8 texels of a level in the source chain, the levels follow each other like the texture levels
+static uint32_t* get_source_texels(const texture_t* texture, int level_index) {
+	size_t offset = 0;
+	for (int i = 0; i < level_index; i++) {
+		offset += (size_t)texture->levels[i].width * texture->levels[i].height;
+	}
+	return texture->source + offset;
+}
+
+int get_texture_tail_level(const texture_t* texture) {
+	for (int i = 0; i < texture->num_levels; i++) {
+		const texture_level_t* level = &texture->levels[i];
+		if (level->width <= TEXTURE_TAIL_SIZE && level->height <= TEXTURE_TAIL_SIZE) {
+			return i;
+		}
+	}
+	return texture->num_levels - 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Create a texture and its mip chain from a decoded PNG. Every level is
+// filtered from the uncompressed level above, only the tail is compressed
+// here and the larger levels are left to load_texture_level.
+///////////////////////////////////////////////////////////////////////////////
+texture_t* create_texture(upng_t* image, texture_format_t format) {
+	if (image == NULL) {
+		return NULL;
+	}
+	int width = (int)upng_get_width(image);
+	int height = (int)upng_get_height(image);
+	uint32_t* texels = width > 0 && height > 0 ? convert_to_rgba8(image, width, height) : NULL;
+	upng_free(image);
+	texture_t* texture = texels != NULL ? (texture_t*)calloc(1, sizeof(texture_t)) : NULL;
+	if (texture == NULL) {
+		free(texels);
+		return NULL;
+	}
+
+	//both checks run for every compressed map, the texture can then serve requests in any format
+	if (format != TEXTURE_FORMAT_RGBA8) {
+		if (is_grayscale(texels, (size_t)width * height)) {
+			texture->traits |= TEXTURE_TRAIT_GRAYSCALE;
+		}
+		if (can_rebuild_normals(texels, (size_t)width * height)) {
+			texture->traits |= TEXTURE_TRAIT_NORMALS;
+		}
+	}
+	texture->width = width;
+	texture->height = height;
+	texture->format = resolve_texture_format(format, texture->traits);
+	size_t size = layout_texture_levels(texture, NULL);
+
+	//the source chain grows the converted image by the filtered levels
+	size_t source_count = 0;
+	for (int i = 0; i < texture->num_levels; i++) {
+		source_count += (size_t)texture->levels[i].width * texture->levels[i].height;
+	}
+	uint8_t* storage = (uint8_t*)malloc(size);
+	uint32_t* source = (uint32_t*)realloc(texels, source_count * sizeof(uint32_t));
+	if (storage == NULL || source == NULL) {
+		free(storage);
+		free(source != NULL ? source : texels);
+		free(texture);
+		return NULL;
+	}
+	layout_texture_levels(texture, storage);
+	texture->storage = storage;
+	texture->source = source;
+
+	for (int i = 1; i < texture->num_levels; i++) {
+		const texture_level_t* parent = &texture->levels[i - 1];
+		downsample_level(get_source_texels(texture, i - 1), parent->width, parent->height, get_source_texels(texture, i));
+	}
+	int tail_level = get_texture_tail_level(texture);
+	for (int i = tail_level; i < texture->num_levels; i++) {
+		load_texture_level(texture, i);
+	}
+	texture->resident_level = tail_level;
+	return texture;
+}
+
+texture_format_t resolve_texture_format(texture_format_t format, uint32_t traits) {
+	if (format == TEXTURE_FORMAT_BC5 && (traits & TEXTURE_TRAIT_NORMALS) == 0) {
+		return TEXTURE_FORMAT_BC1;
+	}
+	if (format == TEXTURE_FORMAT_BC4 && (traits & TEXTURE_TRAIT_GRAYSCALE) == 0) {
+		return TEXTURE_FORMAT_BC1;
+	}
+	return format;
+}
+
+void load_texture_level(texture_t* texture, int level_index) {
+	const texture_level_t* level = &texture->levels[level_index];
+	if (texture->source != NULL) {
+		encode_level(texture->format, get_source_texels(texture, level_index), level, (uint8_t*)level->data);
+		return;
+	}
+	//mapped levels are paged in now, so the samplers do not wait on the disk
+	const volatile uint8_t* data = level->data;
+	for (size_t offset = 0; offset < level->size; offset += TEXTURE_PAGE_SIZE) {
+		(void)data[offset];
+	}
+}
+
+void finish_texture_levels(texture_t* texture) {
+	free(texture->source);
+	texture->source = NULL;
+}
+
+void free_texture(texture_t* texture) {
+	if (texture == NULL) {
+		return;
+	}
+	if (texture->file != NULL) {
+		unmap_file(texture->file);
+		free(texture->file);
+	}
+	free(texture->source);
+	free(texture->storage);
+	free(texture);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Direct mapped cache of decoded blocks, keyed by the address of the
+// compressed block so every texture can share it
+///////////////////////////////////////////////////////////////////////////////
+typedef struct {
+	const uint8_t* block;		// compressed block the texels were decoded from
+	uint32_t texels[16];
+} decoded_block_t;
+
+static TEXTURE_THREAD_LOCAL decoded_block_t block_cache[1 << BLOCK_CACHE_BITS];
+
+void flush_texture_block_cache(void) {
+	memset(block_cache, 0, sizeof(block_cache));
+}
+
+uint32_t fetch_block_texel(const texture_t* texture, const texture_level_t* level, int x, int y) {
+	const uint8_t* block = level->data +
+		(size_t)((y >> 2) * level->blocks_per_row + (x >> 2)) * texture->block_size;
+
+	uint32_t slot = (uint32_t)(((uint64_t)(uintptr_t)block * 0x9E3779B97F4A7C15ull) >> (64 - BLOCK_CACHE_BITS));
+	decoded_block_t* decoded = &block_cache[slot];
+	if (decoded->block != block) {
+		block_formats[texture->format].decode(block, decoded->texels);
+		decoded->block = block;
+	}
+	return decoded->texels[(y & 3) * 4 + (x & 3)];
+}
@@ -1,5 +1,9 @@
 #ifndef TEXTURE_H
 #define TEXTURE_H
+#include <stdint.h>
+#include <stdlib.h>
+#include "upng.h"
+#include "mapped_file.h"
 
 typedef struct {
 	float u;
@@ -8,5 +12,85 @@ typedef struct {
 
 tex2_t tex2_clone(tex2_t* t);
 
-#endif 
+///////////////////////////////////////////////////////////////////////////////
+// Texture maps as the rasterizer samples them: a chain of mip levels that
+// hold 32-bit texels, or 4x4 blocks compressed at load time (see
+// block_compression.h) that are decoded when they are fetched
+///////////////////////////////////////////////////////////////////////////////
+typedef enum {
+	TEXTURE_FORMAT_RGBA8,		// uncompressed, 4 bytes per texel
+	TEXTURE_FORMAT_BC1,			// color maps, 0.5 byte per texel
+	TEXTURE_FORMAT_BC4,			// gray material maps, 0.5 byte per texel
+	TEXTURE_FORMAT_BC5			// tangent space normal maps, 1 byte per texel
+} texture_format_t;
 
+// What the BC4 and BC5 requests check the image for, kept with a compressed texture so a request
+// in another format can tell which format it would get from the same image
+#define TEXTURE_TRAIT_GRAYSCALE 0x1u
+#define TEXTURE_TRAIT_NORMALS 0x2u
+
+#define MAX_TEXTURE_LEVELS 16		// mip chain of a 32768 texel wide texture
+#define TEXTURE_TAIL_SIZE 64		// levels up to this size are loaded with the texture, the rest streams
+
+typedef struct {
+	int width;
+	int height;
+	int blocks_per_row;
+	const uint8_t* data;		// RGBA8 texels or compressed blocks, row by row
+	size_t size;
+} texture_level_t;
+
+typedef struct {
+	int width;					// size of level 0
+	int height;
+	texture_format_t format;
+	uint32_t traits;			// TEXTURE_TRAIT_ bits of the image, 0 for RGBA8
+	int block_size;				// bytes per block, 0 for RGBA8
+	int num_levels;
+	texture_level_t levels[MAX_TEXTURE_LEVELS];		// level 0 and the mip chain down to 1x1
+	int resident_level;			// finest level the samplers read, only changed between frames
+	size_t size;				// bytes of every level together
+	uint8_t* storage;			// owned level data, NULL when the levels live in the file
+	uint32_t* source;			// RGBA8 texels of every level while the storage is being filled
+	mapped_file_t* file;		// preprocessed texture file the levels point into
+} texture_t;
+
+// Builds the mip chain of the decoded image and frees it, only the tail levels are resident yet.
+// 8-bit gray and RGB images are expanded to RGBA, other bit depths are not loaded. BC4 and BC5
+// requests for maps those formats can not hold are compressed as BC1.
+texture_t* create_texture(upng_t* image, texture_format_t format);
+// Format a request gets for an image with the traits
+texture_format_t resolve_texture_format(texture_format_t format, uint32_t traits);
+void free_texture(texture_t* texture);
+
+// Lays the levels of a texture with its size and format set out one after the other, starting at
+// data (NULL only sizes them). Returns the bytes of all levels, the layout of the texture files.
+size_t layout_texture_levels(texture_t* texture, const uint8_t* data);
+
+// The levels finer than the resident ones, filled from the source texels or paged in from the file
+int get_texture_tail_level(const texture_t* texture);
+void load_texture_level(texture_t* texture, int level_index);
+void finish_texture_levels(texture_t* texture);
+
+uint32_t fetch_block_texel(const texture_t* texture, const texture_level_t* level, int x, int y);
+
+// The decoded blocks are kept per thread and looked up by address, the raster stage drops
+// them at the start of every frame because freed textures can be replaced by new ones
+void flush_texture_block_cache(void);
+
+static inline uint32_t fetch_texel(const texture_t* texture, const texture_level_t* level, int x, int y) {
+	if (texture->format == TEXTURE_FORMAT_RGBA8) {
+		return ((const uint32_t*)level->data)[level->width * y + x];
+	}
+	return fetch_block_texel(texture, level, x, y);
+}
+
+// Nearest texel of the finest resident level at the uv coordinates, repeating the texture
+static inline uint32_t sample_texture(const texture_t* texture, float u, float v) {
+	const texture_level_t* level = &texture->levels[texture->resident_level];
+	int x = abs((int)(u * level->width)) % level->width;
+	int y = abs((int)(v * level->height)) % level->height;
+	return fetch_texel(texture, level, x, y);
+}
+
+#endif
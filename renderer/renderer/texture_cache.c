@@ -0,0 +1,291 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include "texture_cache.h"
+#include "mapped_file.h"
+#include "texture_file.h"
+#include "texture_stream.h"
+#include "thread.h"
+
+typedef struct {
+	texture_t* texture;
+	uint64_t source_size;		// size and hash of the PNG file the texture was created from
+	uint64_t source_hash;
+	int ref_count;				// 0 marks a free slot
+} cached_texture_t;
+
+typedef struct {
+	char path[TEXTURE_PATH_LENGTH];		// canonical path, empty marks a free slot
+	cached_texture_t* texture;			// NULL while the file is being loaded
+} texture_path_t;
+
+static cached_texture_t textures[MAX_CACHED_TEXTURES];
+static texture_path_t paths[MAX_TEXTURE_PATHS];
+static bool initialized = false;
+static bool compression_enabled = true;
+
+static mutex_t texture_mutex;
+static condition_t texture_loaded;		// a path finished loading, or failed and was removed
+
+void init_texture_cache(void) {
+	if (initialized) {
+		return;
+	}
+	memset(textures, 0, sizeof(textures));
+	memset(paths, 0, sizeof(paths));
+	mutex_init(&texture_mutex);
+	condition_init(&texture_loaded);
+	initialized = true;
+}
+
+void free_texture_cache(void) {
+	if (!initialized) {
+		return;
+	}
+	//textures that were never released
+	for (int i = 0; i < MAX_CACHED_TEXTURES; i++) {
+		if (textures[i].ref_count > 0) {
+			stop_texture_stream(textures[i].texture);
+			free_texture(textures[i].texture);
+		}
+	}
+	memset(textures, 0, sizeof(textures));
+	memset(paths, 0, sizeof(paths));
+	mutex_destroy(&texture_mutex);
+	condition_destroy(&texture_loaded);
+	initialized = false;
+}
+
+void set_texture_compression_enabled(bool enabled) {
+	compression_enabled = enabled;
+}
+
+bool is_texture_compression_enabled(void) {
+	return compression_enabled;
+}
+
+// Absolute path with the . and .. parts and links resolved, so every spelling of a file is one key
+static bool get_canonical_path(char* path, const char* filename) {
+#if defined(_WIN32)
+	return _fullpath(path, filename, TEXTURE_PATH_LENGTH) != NULL;
+#else
+	char resolved[PATH_MAX];
+	if (realpath(filename, resolved) == NULL || strlen(resolved) >= TEXTURE_PATH_LENGTH) {
+		return false;
+	}
+	strcpy(path, resolved);
+	return true;
+#endif
+}
+
+static upng_t* decode_png(const mapped_file_t* source) {
+	upng_t* image = upng_new_from_bytes((const unsigned char*)source->data, (unsigned long)source->size);
+	if (image != NULL) {
+		upng_decode(image);
+		if (upng_get_error(image) != UPNG_EOK) {
+			upng_free(image);
+			image = NULL;
+		}
+	}
+	return image;
+}
+
+// The preprocessed texture file when it is up to date, otherwise the PNG is decoded. Either way only
+// the mip tail is resident, stream_texture fills the other levels and writes the file for the next run.
+static texture_t* load_texture(const mapped_file_t* source, const char* png_filename, texture_format_t format, uint64_t source_hash) {
+	texture_t* texture = load_texture_file(png_filename, format, source->size, source_hash);
+	if (texture == NULL) {
+		texture = create_texture(decode_png(source), format);
+	}
+	return texture;
+}
+
+static texture_t* load_uncached_texture(const char* png_filename, texture_format_t format) {
+	mapped_file_t source;
+	if (!map_file(&source, png_filename)) {
+		return NULL;
+	}
+	uint64_t source_size = source.size;
+	uint64_t source_hash = hash_bytes(source.data, source.size);
+	texture_t* texture = load_texture(&source, png_filename, format, source_hash);
+	unmap_file(&source);
+	if (texture != NULL) {
+		stream_texture(texture, png_filename, source_size, source_hash);
+	}
+	return texture;
+}
+
+// A texture serves every request that would have created it from the same image
+static bool is_texture_for_format(const texture_t* texture, texture_format_t format) {
+	return resolve_texture_format(format, texture->traits) == texture->format;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Lookups, called with the mutex held
+///////////////////////////////////////////////////////////////////////////////
+static texture_path_t* find_path(const char* path) {
+	for (int i = 0; i < MAX_TEXTURE_PATHS; i++) {
+		if (paths[i].path[0] != '\0' && strcmp(paths[i].path, path) == 0) {
+			return &paths[i];
+		}
+	}
+	return NULL;
+}
+
+static texture_path_t* add_path(const char* path) {
+	for (int i = 0; i < MAX_TEXTURE_PATHS; i++) {
+		if (paths[i].path[0] == '\0') {
+			strcpy(paths[i].path, path);
+			paths[i].texture = NULL;
+			return &paths[i];
+		}
+	}
+	return NULL;
+}
+
+static cached_texture_t* find_texture(texture_format_t format, uint64_t source_size, uint64_t source_hash) {
+	for (int i = 0; i < MAX_CACHED_TEXTURES; i++) {
+		if (textures[i].ref_count > 0 && textures[i].source_size == source_size &&
+			textures[i].source_hash == source_hash && is_texture_for_format(textures[i].texture, format)) {
+			return &textures[i];
+		}
+	}
+	return NULL;
+}
+
+static cached_texture_t* add_texture(texture_t* texture, uint64_t source_size, uint64_t source_hash) {
+	for (int i = 0; i < MAX_CACHED_TEXTURES; i++) {
+		if (textures[i].ref_count == 0) {
+			textures[i] = (cached_texture_t){ texture, source_size, source_hash, 1 };
+			return &textures[i];
+		}
+	}
+	return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// The first request of a path loads the file while later requests of the same
+// path wait for it, whatever format they ask for: a BC4 or BC5 map that falls
+// back to BC1 is the same texture as the BC1 map of the image. A file whose
+// contents are already loaded under another name or in the format a request
+// resolves to only costs the read and the hash.
+///////////////////////////////////////////////////////////////////////////////
+texture_t* acquire_texture(const char* png_filename, texture_format_t format) {
+	if (!compression_enabled) {
+		format = TEXTURE_FORMAT_RGBA8;
+	}
+	char path[TEXTURE_PATH_LENGTH];
+	if (!initialized || !get_canonical_path(path, png_filename)) {
+		return load_uncached_texture(png_filename, format);
+	}
+
+	mutex_lock(&texture_mutex);
+	texture_path_t* entry;
+	while ((entry = find_path(path)) != NULL && entry->texture == NULL) {
+		condition_wait(&texture_loaded, &texture_mutex);
+	}
+	if (entry != NULL && is_texture_for_format(entry->texture->texture, format)) {
+		entry->texture->ref_count++;
+		texture_t* texture = entry->texture->texture;
+		mutex_unlock(&texture_mutex);
+		return texture;
+	}
+	//claim the path, NULL when the table is full or the path holds the image in another format,
+	//then the texture is only shared by its contents
+	entry = entry == NULL ? add_path(path) : NULL;
+	mutex_unlock(&texture_mutex);
+
+	texture_t* texture = NULL;
+	cached_texture_t* cached = NULL;
+	uint64_t source_size = 0;
+	uint64_t source_hash = 0;
+	mapped_file_t source;
+	if (map_file(&source, png_filename)) {
+		source_size = source.size;
+		source_hash = hash_bytes(source.data, source.size);
+
+		mutex_lock(&texture_mutex);
+		cached = find_texture(format, source_size, source_hash);
+		if (cached != NULL) {
+			cached->ref_count++;
+		}
+		mutex_unlock(&texture_mutex);
+
+		if (cached == NULL) {
+			texture = load_texture(&source, png_filename, format, source_hash);
+		}
+		unmap_file(&source);
+	}
+
+	texture_t* loaded = NULL;		// loaded by this call, streamed with or without a cache slot
+	mutex_lock(&texture_mutex);
+	if (texture != NULL) {
+		//the same contents may have been loaded under another name meanwhile
+		cached = find_texture(format, source_size, source_hash);
+		if (cached != NULL) {
+			free_texture(texture);
+			cached->ref_count++;
+		}
+		else {
+			//a full cache returns the texture uncached, it streams like the ones of
+			//load_uncached_texture() and release_texture() stops its stream
+			cached = add_texture(texture, source_size, source_hash);
+			loaded = texture;
+		}
+	}
+	if (cached != NULL) {
+		texture = cached->texture;
+	}
+	if (entry != NULL) {
+		//a failed load drops the path, the waiting requests try again on their own
+		if (cached != NULL) {
+			entry->texture = cached;
+		}
+		else {
+			entry->path[0] = '\0';
+		}
+		condition_broadcast(&texture_loaded);
+	}
+	mutex_unlock(&texture_mutex);
+
+	//the caller's reference keeps the texture alive while its levels stream in
+	if (loaded != NULL) {
+		stream_texture(loaded, png_filename, source_size, source_hash);
+	}
+	return texture;
+}
+
+void release_texture(texture_t* texture) {
+	if (texture == NULL) {
+		return;
+	}
+	if (initialized) {
+		mutex_lock(&texture_mutex);
+		for (int i = 0; i < MAX_CACHED_TEXTURES; i++) {
+			cached_texture_t* cached = &textures[i];
+			if (cached->ref_count == 0 || cached->texture != texture) {
+				continue;
+			}
+			if (--cached->ref_count == 0) {
+				for (int j = 0; j < MAX_TEXTURE_PATHS; j++) {
+					if (paths[j].texture == cached) {
+						paths[j].path[0] = '\0';
+						paths[j].texture = NULL;
+					}
+				}
+				stop_texture_stream(cached->texture);
+				free_texture(cached->texture);
+				cached->texture = NULL;
+			}
+			mutex_unlock(&texture_mutex);
+			return;
+		}
+		mutex_unlock(&texture_mutex);
+	}
+	//loaded without a cache slot
+	stop_texture_stream(texture);
+	free_texture(texture);
+}
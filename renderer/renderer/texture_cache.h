@@ -0,0 +1,31 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+#include <stdbool.h>
+#include "texture.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Textures shared between all the maps that use them. A texture is found by
+// the canonical path of its PNG file, or by the size and hash of the file
+// contents when the same PNG is stored under another name, and serves every
+// format that resolves to its own (see resolve_texture_format). It is freed
+// when its last reference is released. Textures that are not in memory
+// are mapped from their preprocessed texture files (see texture_file.h) when
+// those are up to date.
+// acquire_texture and release_texture can be called from the job threads.
+///////////////////////////////////////////////////////////////////////////////
+#define MAX_CACHED_TEXTURES 64
+#define MAX_TEXTURE_PATHS 128
+#define TEXTURE_PATH_LENGTH 512
+
+void init_texture_cache(void);
+void free_texture_cache(void);
+
+// Off keeps every texture as uncompressed RGBA8, whatever format is asked for
+void set_texture_compression_enabled(bool enabled);
+bool is_texture_compression_enabled(void);
+
+// Texture of the PNG file with one more reference, NULL if it can not be loaded
+texture_t* acquire_texture(const char* png_filename, texture_format_t format);
+void release_texture(texture_t* texture);
+
+#endif
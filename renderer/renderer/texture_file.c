@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "texture_file.h"
+
+static bool texture_file_enabled = true;
+
+static const char* format_names[] = {
+	[TEXTURE_FORMAT_RGBA8] = "rgba8",
+	[TEXTURE_FORMAT_BC1] = "bc1",
+	[TEXTURE_FORMAT_BC4] = "bc4",
+	[TEXTURE_FORMAT_BC5] = "bc5",
+};
+
+void set_texture_file_enabled(bool enabled) {
+	texture_file_enabled = enabled;
+}
+
+bool is_texture_file_enabled(void) {
+	return texture_file_enabled;
+}
+
+static void get_texture_filename(char* texture_filename, size_t size, const char* png_filename, texture_format_t format) {
+	snprintf(texture_filename, size, "%s.%s%s", png_filename, format_names[format], TEXTURE_FILE_EXTENSION);
+}
+
+static texture_t* map_texture_file(const char* png_filename, texture_format_t stored_format, texture_format_t format,
+	uint64_t source_size, uint64_t source_hash) {
+	char texture_filename[512];
+	get_texture_filename(texture_filename, sizeof(texture_filename), png_filename, stored_format);
+
+	mapped_file_t* file = (mapped_file_t*)malloc(sizeof(mapped_file_t));
+	texture_t* texture = (texture_t*)calloc(1, sizeof(texture_t));
+	if (file == NULL || texture == NULL || !map_file(file, texture_filename)) {
+		free(file);
+		free(texture);
+		return NULL;
+	}
+
+	//a stale or foreign file is ignored and rewritten after the PNG is decoded
+	texture_file_header_t header;
+	bool valid = file->size >= sizeof(header);
+	if (valid) {
+		memcpy(&header, file->data, sizeof(header));
+		valid = header.magic == TEXTURE_FILE_MAGIC &&
+			header.version == TEXTURE_FILE_VERSION &&
+			header.source_size == source_size &&
+			header.source_hash == source_hash &&
+			header.format == (uint32_t)stored_format &&
+			resolve_texture_format(format, header.traits) == stored_format &&
+			header.width > 0 && header.height > 0;
+	}
+	if (valid) {
+		texture->width = header.width;
+		texture->height = header.height;
+		texture->format = stored_format;
+		texture->traits = header.traits;
+		valid = sizeof(header) + layout_texture_levels(texture, NULL) == file->size &&
+			texture->num_levels == header.num_levels;
+	}
+	if (!valid) {
+		unmap_file(file);
+		free(file);
+		free(texture);
+		return NULL;
+	}
+
+	//zero copy: the levels point straight into the mapped file
+	layout_texture_levels(texture, (const uint8_t*)file->data + sizeof(header));
+	texture->resident_level = get_texture_tail_level(texture);
+	texture->file = file;
+	return texture;
+}
+
+// The format a BC4 or BC5 request gets depends on the image, so its own file and the BC1 file are
+// tried. The traits in the header tell whether the request resolves to the stored format.
+texture_t* load_texture_file(const char* png_filename, texture_format_t format, uint64_t source_size, uint64_t source_hash) {
+	if (!texture_file_enabled) {
+		return NULL;
+	}
+	texture_t* texture = map_texture_file(png_filename, format, format, source_size, source_hash);
+	if (texture == NULL && format != TEXTURE_FORMAT_RGBA8 && format != TEXTURE_FORMAT_BC1) {
+		texture = map_texture_file(png_filename, TEXTURE_FORMAT_BC1, format, source_size, source_hash);
+	}
+	return texture;
+}
+
+// Written to a temporary file first, so an interrupted write never leaves a truncated file
+void write_texture_file(const texture_t* texture, const char* png_filename, uint64_t source_size, uint64_t source_hash) {
+	if (!texture_file_enabled || texture->file != NULL) {
+		return;
+	}
+
+	texture_file_header_t header;
+	memset(&header, 0, sizeof(header));
+	header.magic = TEXTURE_FILE_MAGIC;
+	header.version = TEXTURE_FILE_VERSION;
+	header.source_size = source_size;
+	header.source_hash = source_hash;
+	header.format = (uint32_t)texture->format;
+	header.traits = texture->traits;
+	header.width = texture->width;
+	header.height = texture->height;
+	header.num_levels = texture->num_levels;
+
+	char texture_filename[512];
+	char temporary_filename[520];
+	get_texture_filename(texture_filename, sizeof(texture_filename), png_filename, texture->format);
+	snprintf(temporary_filename, sizeof(temporary_filename), "%s.tmp", texture_filename);
+
+	FILE* file = fopen(temporary_filename, "wb");
+	if (file == NULL) {
+		return;		// read only asset folder, the PNG is decoded every time
+	}
+	bool written =
+		fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(texture->storage, 1, texture->size, file) == texture->size;
+	written = (fclose(file) == 0) && written;
+
+	if (written) {
+		remove(texture_filename);
+		written = rename(temporary_filename, texture_filename) == 0;
+	}
+	if (!written) {
+		fprintf(stderr, "Error writing the texture file %s. \n", texture_filename);
+		remove(temporary_filename);
+	}
+}
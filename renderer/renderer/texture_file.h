@@ -0,0 +1,43 @@
+#ifndef TEXTURE_FILE_H
+#define TEXTURE_FILE_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "texture.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Preprocessed texture file written next to the PNG file after it is first
+// decoded, one per format it is stored in (name.png.bc1.cache). It holds every
+// mip level in that format, in the layout of layout_texture_levels, and the
+// traits of the image, so a BC4 or BC5 request that falls back to BC1 finds
+// the file a BC1 request wrote. Later loads map it and the levels point into
+// the mapping.
+// A file is used only if its version and the size and hash of the PNG file it
+// was built from match.
+///////////////////////////////////////////////////////////////////////////////
+#define TEXTURE_FILE_MAGIC 0x52584554u		// "TEXR"
+#define TEXTURE_FILE_VERSION 2
+#define TEXTURE_FILE_EXTENSION ".cache"
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t source_size;
+	uint64_t source_hash;
+	uint32_t format;			// format the levels are stored in, part of the file name
+	uint32_t traits;			// TEXTURE_TRAIT_ bits of the image
+	int32_t width;
+	int32_t height;
+	int32_t num_levels;
+	uint32_t padding;			// keeps the level data 8 byte aligned
+} texture_file_header_t;
+
+// Followed by the levels, largest first
+
+void set_texture_file_enabled(bool enabled);
+bool is_texture_file_enabled(void);
+
+// Texture in the format the request resolves to, NULL when there is no up to date file of it
+texture_t* load_texture_file(const char* png_filename, texture_format_t format, uint64_t source_size, uint64_t source_hash);
+void write_texture_file(const texture_t* texture, const char* png_filename, uint64_t source_size, uint64_t source_hash);
+
+#endif
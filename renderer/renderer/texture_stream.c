@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "texture_stream.h"
+#include "texture_file.h"
+#include "job.h"
+#include "thread.h"
+
+typedef struct {
+	texture_t* texture;			// NULL marks a free slot
+	int next_level;				// next level to fill, -1 once every level is claimed
+	int ready_level;			// finest level whose coarser levels are all filled
+	uint32_t filled_levels;		// bit per filled level
+	int loading;				// levels being filled, or the texture file being written
+	float priority;				// screen area of the last built frame
+	float next_priority;		// screen area of the frame being built
+	char png_filename[STREAM_FILENAME_LENGTH];
+	uint64_t source_size;
+	uint64_t source_hash;
+} texture_stream_t;
+
+static texture_stream_t streams[MAX_STREAMED_TEXTURES];
+static int num_stream_jobs = 0;			// level jobs submitted and not finished
+static int num_queued_jobs = 0;			// level jobs that have not picked their level yet
+static int max_stream_jobs = 1;
+static bool initialized = false;
+
+static mutex_t stream_mutex;
+static condition_t stream_idle;			// a stream has no level in progress
+
+void init_texture_streaming(void) {
+	if (initialized) {
+		return;
+	}
+	memset(streams, 0, sizeof(streams));
+	num_stream_jobs = 0;
+	num_queued_jobs = 0;
+	max_stream_jobs = get_num_cpu_cores();
+	mutex_init(&stream_mutex);
+	condition_init(&stream_idle);
+	initialized = true;
+}
+
+// Called after the job system is stopped, no level is in progress any more
+void free_texture_streaming(void) {
+	if (!initialized) {
+		return;
+	}
+	memset(streams, 0, sizeof(streams));
+	mutex_destroy(&stream_mutex);
+	condition_destroy(&stream_idle);
+	initialized = false;
+}
+
+static void finish_texture(texture_t* texture, const char* png_filename, uint64_t source_size, uint64_t source_hash) {
+	write_texture_file(texture, png_filename, source_size, source_hash);
+	finish_texture_levels(texture);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// A stream job fills a single level, the next level of the stream with the
+// highest priority when the job starts. The jobs are submitted by the main
+// thread between frames, a few at a time, so they queue behind the mesh loads
+// instead of holding a job thread until every texture is complete.
+///////////////////////////////////////////////////////////////////////////////
+static texture_stream_t* pick_stream(void) {
+	texture_stream_t* picked = NULL;
+	for (int i = 0; i < MAX_STREAMED_TEXTURES; i++) {
+		texture_stream_t* stream = &streams[i];
+		if (stream->texture != NULL && stream->next_level >= 0 &&
+			(picked == NULL || stream->priority > picked->priority)) {
+			picked = stream;
+		}
+	}
+	return picked;
+}
+
+static void stream_level_job(void* argument) {
+	(void)argument;
+	mutex_lock(&stream_mutex);
+	num_queued_jobs--;
+	texture_stream_t* stream = pick_stream();
+	if (stream != NULL) {
+		int level = stream->next_level--;
+		stream->loading++;
+		mutex_unlock(&stream_mutex);
+
+		load_texture_level(stream->texture, level);
+
+		mutex_lock(&stream_mutex);
+		stream->filled_levels |= 1u << level;
+		int ready_level = stream->ready_level;
+		while (ready_level > 0 && (stream->filled_levels & (1u << (ready_level - 1))) != 0) {
+			ready_level--;
+		}
+		//the job that completes the chain writes the texture file, still counted as loading
+		if (ready_level == 0 && stream->ready_level != 0) {
+			stream->ready_level = 0;
+			mutex_unlock(&stream_mutex);
+			finish_texture(stream->texture, stream->png_filename, stream->source_size, stream->source_hash);
+			mutex_lock(&stream_mutex);
+		}
+		stream->ready_level = ready_level;
+		if (--stream->loading == 0) {
+			condition_broadcast(&stream_idle);
+		}
+	}
+	num_stream_jobs--;
+	mutex_unlock(&stream_mutex);
+}
+
+// Main thread only. Never called with the stream mutex held, a submit can run the job inline.
+static void submit_stream_jobs(int max_jobs) {
+	mutex_lock(&stream_mutex);
+	int waiting_levels = 0;
+	for (int i = 0; i < MAX_STREAMED_TEXTURES; i++) {
+		if (streams[i].texture != NULL) {
+			waiting_levels += streams[i].next_level + 1;
+		}
+	}
+	int count = waiting_levels - num_queued_jobs;
+	if (count > max_jobs - num_stream_jobs) {
+		count = max_jobs - num_stream_jobs;
+	}
+	if (count < 0) {
+		count = 0;
+	}
+	num_stream_jobs += count;
+	num_queued_jobs += count;
+	mutex_unlock(&stream_mutex);
+
+	for (int i = 0; i < count; i++) {
+		submit_job(stream_level_job, NULL, NULL, 0);
+	}
+}
+
+void stream_texture(texture_t* texture, const char* png_filename, uint64_t source_size, uint64_t source_hash) {
+	texture_stream_t* stream = NULL;
+	if (initialized && texture->resident_level > 0) {
+		mutex_lock(&stream_mutex);
+		for (int i = 0; i < MAX_STREAMED_TEXTURES && stream == NULL; i++) {
+			if (streams[i].texture == NULL) {
+				stream = &streams[i];
+			}
+		}
+		if (stream != NULL) {
+			memset(stream, 0, sizeof(texture_stream_t));
+			stream->texture = texture;
+			stream->next_level = texture->resident_level - 1;
+			stream->ready_level = texture->resident_level;
+			snprintf(stream->png_filename, sizeof(stream->png_filename), "%s", png_filename);
+			stream->source_size = source_size;
+			stream->source_hash = source_hash;
+		}
+		mutex_unlock(&stream_mutex);
+	}
+	if (stream == NULL) {
+		//no streaming or no free slot, the texture is not drawn yet so its levels can change here
+		for (int i = texture->resident_level - 1; i >= 0; i--) {
+			load_texture_level(texture, i);
+		}
+		texture->resident_level = 0;
+		finish_texture(texture, png_filename, source_size, source_hash);
+	}
+}
+
+void stop_texture_stream(texture_t* texture) {
+	if (!initialized || texture == NULL) {
+		return;
+	}
+	mutex_lock(&stream_mutex);
+	for (int i = 0; i < MAX_STREAMED_TEXTURES; i++) {
+		texture_stream_t* stream = &streams[i];
+		if (stream->texture != texture) {
+			continue;
+		}
+		stream->next_level = -1;
+		while (stream->texture == texture && stream->loading > 0) {
+			condition_wait(&stream_idle, &stream_mutex);
+		}
+		if (stream->texture == texture) {
+			stream->texture = NULL;
+		}
+		break;
+	}
+	mutex_unlock(&stream_mutex);
+}
+
+void prioritize_texture(texture_t* texture, float screen_area) {
+	if (!initialized || texture == NULL || texture->resident_level == 0) {
+		return;
+	}
+	mutex_lock(&stream_mutex);
+	for (int i = 0; i < MAX_STREAMED_TEXTURES; i++) {
+		if (streams[i].texture == texture) {
+			streams[i].next_priority += screen_area;
+			break;
+		}
+	}
+	mutex_unlock(&stream_mutex);
+}
+
+void publish_texture_levels(void) {
+	if (!initialized) {
+		return;
+	}
+	mutex_lock(&stream_mutex);
+	for (int i = 0; i < MAX_STREAMED_TEXTURES; i++) {
+		texture_stream_t* stream = &streams[i];
+		if (stream->texture == NULL) {
+			continue;
+		}
+		stream->texture->resident_level = stream->ready_level;
+		stream->priority = stream->next_priority;
+		stream->next_priority = 0.0f;
+		if (stream->ready_level == 0 && stream->loading == 0) {
+			stream->texture = NULL;
+		}
+	}
+	mutex_unlock(&stream_mutex);
+
+	submit_stream_jobs(max_stream_jobs);
+}
+
+void finish_texture_streams(void) {
+	if (!initialized) {
+		return;
+	}
+	submit_stream_jobs(MAX_STREAMED_TEXTURES * MAX_TEXTURE_LEVELS);
+	wait_for_all_jobs();
+	publish_texture_levels();
+}
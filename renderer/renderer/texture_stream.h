@@ -0,0 +1,36 @@
+#ifndef TEXTURE_STREAM_H
+#define TEXTURE_STREAM_H
+#include <stdint.h>
+#include "texture.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Texture streaming: a texture is drawn with its mip tail as soon as it is
+// loaded and the finer levels are filled on the job threads, coarse to fine,
+// the textures covering the largest screen area first. The samplers only move
+// to finer levels in publish_texture_levels(), while the raster stage is idle,
+// so every frame samples a single level of each texture.
+///////////////////////////////////////////////////////////////////////////////
+#define MAX_STREAMED_TEXTURES 64
+#define STREAM_FILENAME_LENGTH 512
+
+void init_texture_streaming(void);
+void free_texture_streaming(void);
+
+// Fills the levels finer than the resident ones. A texture built from the PNG file is written to
+// its texture file once its last level is in. Without streaming the levels are filled right away.
+void stream_texture(texture_t* texture, const char* png_filename, uint64_t source_size, uint64_t source_hash);
+
+// Drops the levels that are not started and waits for the ones in progress, before the texture is freed
+void stop_texture_stream(texture_t* texture);
+
+// Main thread only: screen area a mesh covers with the texture in the frame being built
+void prioritize_texture(texture_t* texture, float screen_area);
+
+// Main thread only, while the raster stage is idle: moves the samplers to the levels that arrived,
+// orders the waiting levels by the screen areas of the frame that was just built and starts the next ones
+void publish_texture_levels(void);
+
+// Main thread only, once the loads are finished: fills every waiting level and moves the samplers to them
+void finish_texture_streams(void);
+
+#endif
@@ -0,0 +1,141 @@
+#include <stdlib.h>
+#include "thread.h"
+
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+// The platform entry points take a different signature, so the function and its argument travel together
+typedef struct {
+	thread_function_t function;
+	void* argument;
+} thread_start_t;
+
+#if defined(_WIN32)
+static DWORD WINAPI thread_entry(LPVOID parameter) {
+#else
+static void* thread_entry(void* parameter) {
+#endif
+	thread_start_t start = *(thread_start_t*)parameter;
+	free(parameter);
+	start.function(start.argument);
+	return 0;
+}
+
+bool thread_create(thread_t* thread, thread_function_t function, void* argument) {
+	thread_start_t* start = (thread_start_t*)malloc(sizeof(thread_start_t));
+	if (start == NULL) {
+		return false;
+	}
+	start->function = function;
+	start->argument = argument;
+
+#if defined(_WIN32)
+	*thread = CreateThread(NULL, 0, thread_entry, start, 0, NULL);
+	if (*thread == NULL) {
+		free(start);
+		return false;
+	}
+#else
+	if (pthread_create(thread, NULL, thread_entry, start) != 0) {
+		free(start);
+		return false;
+	}
+#endif
+	return true;
+}
+
+void thread_join(thread_t thread) {
+#if defined(_WIN32)
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+#else
+	pthread_join(thread, NULL);
+#endif
+}
+
+int get_num_cpu_cores(void) {
+#if defined(_WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int)info.dwNumberOfProcessors;
+#else
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	return cores > 0 ? (int)cores : 1;
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Mutex and condition variable
+///////////////////////////////////////////////////////////////////////////////
+void mutex_init(mutex_t* mutex) {
+#if defined(_WIN32)
+	InitializeCriticalSection(mutex);
+#else
+	pthread_mutex_init(mutex, NULL);
+#endif
+}
+
+void mutex_destroy(mutex_t* mutex) {
+#if defined(_WIN32)
+	DeleteCriticalSection(mutex);
+#else
+	pthread_mutex_destroy(mutex);
+#endif
+}
+
+void mutex_lock(mutex_t* mutex) {
+#if defined(_WIN32)
+	EnterCriticalSection(mutex);
+#else
+	pthread_mutex_lock(mutex);
+#endif
+}
+
+void mutex_unlock(mutex_t* mutex) {
+#if defined(_WIN32)
+	LeaveCriticalSection(mutex);
+#else
+	pthread_mutex_unlock(mutex);
+#endif
+}
+
+void condition_init(condition_t* condition) {
+#if defined(_WIN32)
+	InitializeConditionVariable(condition);
+#else
+	pthread_cond_init(condition, NULL);
+#endif
+}
+
+void condition_destroy(condition_t* condition) {
+#if defined(_WIN32)
+	(void)condition;	// Win32 condition variables need no cleanup
+#else
+	pthread_cond_destroy(condition);
+#endif
+}
+
+void condition_wait(condition_t* condition, mutex_t* mutex) {
+#if defined(_WIN32)
+	SleepConditionVariableCS(condition, mutex, INFINITE);
+#else
+	pthread_cond_wait(condition, mutex);
+#endif
+}
+
+void condition_signal(condition_t* condition) {
+#if defined(_WIN32)
+	WakeConditionVariable(condition);
+#else
+	pthread_cond_signal(condition);
+#endif
+}
+
+void condition_broadcast(condition_t* condition) {
+#if defined(_WIN32)
+	WakeAllConditionVariable(condition);
+#else
+	pthread_cond_broadcast(condition);
+#endif
+}
@@ -0,0 +1,38 @@
+#ifndef THREAD_H
+#define THREAD_H
+#include <stdbool.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Minimal thread, mutex and condition variable wrappers over Win32 and pthreads
+///////////////////////////////////////////////////////////////////////////////
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+typedef HANDLE thread_t;
+typedef CRITICAL_SECTION mutex_t;
+typedef CONDITION_VARIABLE condition_t;
+#else
+#include <pthread.h>
+typedef pthread_t thread_t;
+typedef pthread_mutex_t mutex_t;
+typedef pthread_cond_t condition_t;
+#endif
+
+typedef void (*thread_function_t)(void* argument);
+
+bool thread_create(thread_t* thread, thread_function_t function, void* argument);
+void thread_join(thread_t thread);
+int get_num_cpu_cores(void);
+
+void mutex_init(mutex_t* mutex);
+void mutex_destroy(mutex_t* mutex);
+void mutex_lock(mutex_t* mutex);
+void mutex_unlock(mutex_t* mutex);
+
+void condition_init(condition_t* condition);
+void condition_destroy(condition_t* condition);
+void condition_wait(condition_t* condition, mutex_t* mutex);
+void condition_signal(condition_t* condition);
+void condition_broadcast(condition_t* condition);
+
+#endif
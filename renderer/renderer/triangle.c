@@ -1,3 +1,5 @@
+#include <stdlib.h>
+#include <math.h>
 #include "triangle.h"
 #include "display.h"
 #include "swap.h"
@@ -5,6 +7,7 @@
 #include "light.h"
 #include "material.h"
 #include "pbr.h"
+#include "shadow.h"
 
 #define MIN(a,b)(((a) < (b)) ? (a):(b))
 #define MAX(a,b)(((a) > (b)) ? (a):(b))
@@ -155,7 +158,7 @@ void draw_triangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t colo
 ///////////////////////////////////////////////////////////////////////////////
 
 void draw_triangle_pixel(
-	int x, int y, 
+	int x, int y, framebuffer_row_t* row,
 	vect4_t point_a, vect4_t point_b, vect4_t point_c,
 	vect3_t n0, vect3_t n1, vect3_t n2,
 	vect3_t c0, vect3_t c1, vect3_t c2,
@@ -189,17 +192,17 @@ void draw_triangle_pixel(
 	vect3_t view_direction = vect3_sub(get_camera_position(), target_position);
 
 
-	//adjust the value of 1/w so the pixels that are closer to the camera with smaller values
-	interpolated_reciprocal_w = 1.0 - interpolated_reciprocal_w;
 
-	// Only draw the pixel if the depth value is less than the one previously stored in the z-buffer
-	if (interpolated_reciprocal_w < get_z_buffer_at(x ,y)) {
+	// Only draw the pixel if it is closer than the one previously stored in the z-buffer (in its depth format)
+	uint32_t encoded_depth;
+	if (row_depth_test(row, x, interpolated_reciprocal_w, &encoded_depth)) {
 
 		// Draw a pixel at position (x,y) with a solid color
-		draw_pixel(x, y, flat_color);
+		row->color[x] = flat_color;
+		row_count_shade(row, x, row_shade_clock(row));
 
 		// Update the z-buffer value with the 1/w of this current pixel
-		update_z_buffer_at(x,y,interpolated_reciprocal_w);
+		row_depth_write(row, x, encoded_depth);
 	}
 }
 
@@ -208,7 +211,7 @@ void draw_triangle_pixel(
 ///////////////////////////////////////////////////////////////////////////////
 
 void draw_triangle_texel(
-	int x, int y, upng_t* texture, 
+	int x, int y, framebuffer_row_t* row, texture_t* texture, 
 	vect4_t point_a, vect4_t point_b, vect4_t point_c, 
 	tex2_t a_uv, tex2_t b_uv, tex2_t c_uv,
 	vect3_t n0, vect3_t n1, vect3_t n2,
@@ -241,15 +244,6 @@ void draw_triangle_texel(
 	interpolated_u /= interpolated_reciprocal_w;
 	interpolated_v /= interpolated_reciprocal_w;
 
-	int texture_width = upng_get_width(texture);
-	int texture_height = upng_get_height(texture);
-
-	//map the uv coordinates to the full texture width and height
-	int tex_x = abs((int)(interpolated_u * texture_width)) % texture_width;
-	int tex_y = abs((int)(interpolated_v * texture_height)) % texture_height;
-
-	//* adjust the value of 1/w so the pixels that are closer to the camera with smaller values
-	interpolated_reciprocal_w = 1.0 - interpolated_reciprocal_w;
 
 	//interpolate accumulated vertex normals
 	vect3_t interpolated_normal = vect3_add(vect3_mul(n0, alpha), vect3_add(vect3_mul(n1, beta), vect3_mul(n2, gamma)));
@@ -273,23 +267,18 @@ void draw_triangle_texel(
 		get_material_color(), get_material_shininess(), get_light_ambient_strgenth(), get_material_specular_strength());*/
 
 
-	//only draw the pixel if the depth value is less than the one perviously stored in the z-buffer
-	if (interpolated_reciprocal_w < get_z_buffer_at(x,y)) {
+	//only draw the pixel if it is closer than the one perviously stored in the z-buffer (in its depth format)
+	uint32_t encoded_depth;
+	if (row_depth_test(row, x, interpolated_reciprocal_w, &encoded_depth)) {
+		uint64_t shade_start = row_shade_clock(row);
 		
-		uint32_t* texture_buffer =(uint32_t*)upng_get_buffer(texture);
-
-		uint32_t texture_pixel = texture_buffer[(texture_width * tex_y) + tex_x];
-
-		////unpack the texture pixel to pixel color 
-		vect4_t pixel_color = vect4_new(0.0, 0.0, 0.0, 0.0);
-		unpack_color(texture_pixel, &pixel_color.x, &pixel_color.y, &pixel_color.z, &pixel_color.w);
+		//map the uv coordinates to the full texture width and height
+		uint32_t texture_pixel = sample_texture(texture, interpolated_u, interpolated_v);
+		STAT_FETCH(MAP_TEXTURE, 1);
 
 		//vect4_t phong_shading = vect4_new(0.0, 0.0, 0.0, 0.0);
 		//unpack_color(phong_color, &phong_shading.x, &phong_shading.y, &phong_shading.z, &phong_shading.w);
 
-		vect4_t flat_shading = vect4_new(0.0, 0.0, 0.0, 0.0);
-		unpack_color(flat_color, &flat_shading.x, &flat_shading.y, &flat_shading.z, &flat_shading.w);
-
 
 		//vect4_t diffuse_light = vect4_new(0.0, 0.0, 0.0, 0.0); 
 		//vect4_t ambient_light = vect4_new(0.0, 0.0, 0.0, 0.0);
@@ -312,17 +301,13 @@ void draw_triangle_texel(
 
 		//vect4_t result = mul_colors(pixel_color, flat_shading);
 
-		vect4_t result = {
-			pixel_color.x * flat_shading.x,
-			pixel_color.y * flat_shading.y,
-			pixel_color.z * flat_shading.z,
-		};
-
-		uint32_t shaded_texture_pixel = pack_color(result.x, result.y, result.z, result.w);	
-		draw_pixel(x, y, shaded_texture_pixel);
+		//modulate the texel by the flat shading color in fixed point
+		uint32_t shaded_texture_pixel = color_modulate(texture_pixel, flat_color);
+		row->color[x] = shaded_texture_pixel;
+		row_count_shade(row, x, shade_start);
 
 		//update the z-buffer value with the 1/w value of this current pixel
-		update_z_buffer_at(x,y,interpolated_reciprocal_w);
+		row_depth_write(row, x, encoded_depth);
 	}
 	
 }
@@ -384,6 +369,14 @@ void draw_filled_triangle(
 	vect4_t point_b = { x1, y1, z1, w1 };
 	vect4_t point_c = { x2, y2, z2, w2 };
 
+	//Clamp the bounding box to the viewport, the scanlines then write straight into the rows
+	int rect_x_min = MIN(MIN(x0, x1), x2);
+	int rect_x_max = MAX(MAX(x0, x1), x2);
+	int rect_y_min = y0;
+	int rect_y_max = y2;
+	if (!begin_framebuffer_rect(&rect_x_min, &rect_y_min, &rect_x_max, &rect_y_max)) {
+		return;
+	}
 
 	////////////////////////////////////////////////////////////////////////////
 	//render the upper part of the triangle (flat-bottom)
@@ -397,7 +390,8 @@ void draw_filled_triangle(
 
 	if (y1 != y0) {
 		//Loop all scanlines from top to bottom (y0 to y2)
-		for (int y = y0; y <= y1; y++) {
+		for (int y = MAX(y0, rect_y_min); y <= MIN(y1, rect_y_max); y++) {
+			framebuffer_row_t row = get_framebuffer_row(y);
 
 			//based on the slope value increment x_start and x_end for the next scanline
 			int x_start = x1 + (y - y1) * inverse_slope_1;
@@ -407,9 +401,11 @@ void draw_filled_triangle(
 				int_swap(&x_start, &x_end); //swap the position if x_end at the left of x_start
 			}
 
+			x_start = MAX(x_start, rect_x_min);
+			x_end = MIN(x_end, rect_x_max + 1);
 			for (int x = x_start; x < x_end; x++){
 				//Draw our pixel with the color from left to right
-				draw_triangle_pixel(x, y, point_a, point_b, point_c, n0, n1, n2, c0, c1, c2, color);
+				draw_triangle_pixel(x, y, &row, point_a, point_b, point_c, n0, n1, n2, c0, c1, c2, color);
 			}
 		}
 	}
@@ -427,7 +423,8 @@ void draw_filled_triangle(
 	if (y1 != y2) {
 
 		//Loop all scanlines from bottom to top (y2 to y1)
-		for (int y = y1; y <= y2; y++) {
+		for (int y = MAX(y1, rect_y_min); y <= MIN(y2, rect_y_max); y++) {
+			framebuffer_row_t row = get_framebuffer_row(y);
 
 			//based on the slope value increment x_start and x_end for the next scanline
 			int x_start = x1 + (y - y1) * inverse_slope_1;
@@ -437,10 +434,12 @@ void draw_filled_triangle(
 				int_swap(&x_start, &x_end); //swap the position if x_end at the left of x_start
 			}
 
+			x_start = MAX(x_start, rect_x_min);
+			x_end = MIN(x_end, rect_x_max + 1);
 			for (int x = x_start; x < x_end; x++) {
 
 				//Draw our pixel with the solid color from left to right
-				draw_triangle_pixel(x, y, point_a, point_b, point_c, n0, n1, n2, c0, c1, c2, color);
+				draw_triangle_pixel(x, y, &row, point_a, point_b, point_c, n0, n1, n2, c0, c1, c2, color);
 
 			}
 		}
@@ -475,7 +474,7 @@ void draw_textured_triangle(
 	int x1, int y1, float z1, float w1, float u1, float v1,
 	int x2, int y2, float z2, float w2, float u2, float v2,
 	vect3_t n0, vect3_t n1, vect3_t n2,
-	upng_t* texture, float light_intensity_factor, uint32_t color) {
+	texture_t* texture, float light_intensity_factor, uint32_t color) {
 
 	//TODO:
 	//loop all the pixels of the triangle to render them based on the 
@@ -524,6 +523,15 @@ void draw_textured_triangle(
 	tex2_t b_uv = { u1, v1 };
 	tex2_t c_uv = { u2, v2 };
 
+	//Clamp the bounding box to the viewport, the scanlines then write straight into the rows
+	int rect_x_min = MIN(MIN(x0, x1), x2);
+	int rect_x_max = MAX(MAX(x0, x1), x2);
+	int rect_y_min = y0;
+	int rect_y_max = y2;
+	if (!begin_framebuffer_rect(&rect_x_min, &rect_y_min, &rect_x_max, &rect_y_max)) {
+		return;
+	}
+
 	////////////////////////////////////////////////////////////////////////////
 	//render the upper part of the triangle (flat-bottom)
 	////////////////////////////////////////////////////////////////////////////
@@ -536,7 +544,8 @@ void draw_textured_triangle(
 
 	if (y1 != y0){
 		//Loop all scanlines from top to bottom (y0 to y2)
-		for (int y = y0; y <= y1; y++){
+		for (int y = MAX(y0, rect_y_min); y <= MIN(y1, rect_y_max); y++){
+			framebuffer_row_t row = get_framebuffer_row(y);
 
 			//based on the slope value increment x_start and x_end for the next scanline
 			int x_start = x1 + (y - y1) * inverse_slope_1;
@@ -547,10 +556,12 @@ void draw_textured_triangle(
 				int_swap(&x_start, &x_end); //swap the position if x_end at the left of x_start
 			}
 
+			x_start = MAX(x_start, rect_x_min);
+			x_end = MIN(x_end, rect_x_max + 1);
 			for (int x = x_start; x < x_end; x++)
 			{
 				//Draw our pixel with the color that comes from the texture
-				draw_triangle_texel(x, y, texture, point_a, point_b, point_c, a_uv, b_uv, c_uv, n0, n1, n2, light_intensity_factor, color);
+				draw_triangle_texel(x, y, &row, texture, point_a, point_b, point_c, a_uv, b_uv, c_uv, n0, n1, n2, light_intensity_factor, color);
 			}
 		}
 	}
@@ -567,7 +578,8 @@ void draw_textured_triangle(
 	if (y1 != y2) {
 
 		//Loop all scanlines from bottom to top (y2 to y1)
-		for (int y = y1; y <= y2; y++) {
+		for (int y = MAX(y1, rect_y_min); y <= MIN(y2, rect_y_max); y++) {
+			framebuffer_row_t row = get_framebuffer_row(y);
 
 			//based on the slope value increment x_start and x_end for the next scanline
 			int x_start = x1 + (y - y1) * inverse_slope_1;
@@ -576,9 +588,11 @@ void draw_textured_triangle(
 			if (x_end < x_start){
 				int_swap(&x_start, &x_end); //swap the position if x_end at the left of x_start
 			}
+			x_start = MAX(x_start, rect_x_min);
+			x_end = MIN(x_end, rect_x_max + 1);
 			for (int x = x_start; x < x_end; x++){
 				//Draw our pixel with the color that comes from the texture
-				draw_triangle_texel(x, y, texture, point_a, point_b, point_c, a_uv, b_uv, c_uv, n0, n1, n2, light_intensity_factor, color);
+				draw_triangle_texel(x, y, &row, texture, point_a, point_b, point_c, a_uv, b_uv, c_uv, n0, n1, n2, light_intensity_factor, color);
 			}
 		}
 	}
@@ -623,6 +637,11 @@ void draw_aabb_triangle(
 	int x_max = MAX(MAX(v0.x, v1.x), v2.x);
 	int y_max = MAX(MAX(v0.y, v1.y), v2.y);
 
+	//Clamp it to the viewport so the loop below can write straight into the rows
+	if (!begin_framebuffer_rect(&x_min, &y_min, &x_max, &y_max)) {
+		return;
+	}
+
 
 	//Finds the areas of entire triangle / paralellogram
 	int area = edge_cross(&v0, &v1, &v2);
@@ -633,6 +652,7 @@ void draw_aabb_triangle(
 
 	//Loop all candidate pixels inside the bounding box
 	for (int y = y_min; y <= y_max; y++){
+		framebuffer_row_t row = get_framebuffer_row(y);
 	
 		for (int x = x_min; x <= x_max; x++){
 			vect2_t p = {x, y};
@@ -641,7 +661,7 @@ void draw_aabb_triangle(
 			float w1 = edge_cross(&v2, &v0, &p) + bias1;
 			float w2 = edge_cross(&v0, &v1, &p) + bias2;
 
-			bool is_inside = w0 >= 0 && w1 >= 0 & w2 >= 0;
+			bool is_inside = w0 >= 0 && w1 >= 0 && w2 >= 0;
 
 			if(is_inside){
 
@@ -657,38 +677,94 @@ void draw_aabb_triangle(
 				vect3_t interpolated_normal = vect3_add(vect3_mul(n0, alpha), vect3_add(vect3_mul(n1, beta), vect3_mul(n2, gamma)));
 				vect3_normalize(&interpolated_normal);
 
-				//adjust the value of 1/w so the pixels that are closer to the camera with smaller values
-				interpolated_reciprocal_w = 1.0 - interpolated_reciprocal_w;
 
 				//vect3_t target_position = vect3_new(x, y, interpolated_reciprocal_w);
 				vect3_t target_position = vect3_new(0.0f, 0.0f, 1.0f);
 
 				vect3_t view_direction = vect3_sub(get_camera_position(), target_position);
 
-				//Phong shading
+				//Phong shading, done for every covered pixel ahead of the depth test
+				uint64_t shade_start = row_shade_clock(&row);
 				uint32_t phong_color = blinn_phong_reflection(interpolated_normal, get_light_direction(), view_direction,
 					get_material_color(), get_material_shininess(), get_light_ambient_strgenth(), get_material_specular_strength());
+				row_count_shade(&row, x, shade_start);
 
-				//Interpolate vertex colors
-				vect3_t interpolated_color = vect3_add(vect3_mul(c0, alpha), vect3_add(vect3_mul(c1, beta), vect3_mul(c2, gamma)));
-
-				//Pack the final color into uint32_t
-				uint32_t gouraud_color = pack_color(interpolated_color.x, interpolated_color.y, interpolated_color.z, 1.0); //Assuming full opacity;
-
-				// Only draw the pixel if the depth value is less than the one previously stored in the z-buffer
-				if (interpolated_reciprocal_w < get_z_buffer_at(x, y)) {
+				// Only draw the pixel if it is closer than the one previously stored in the z-buffer (in its depth format)
+				uint32_t encoded_depth;
+				if (row_depth_test(&row, x, interpolated_reciprocal_w, &encoded_depth)) {
 
 					// Draw a pixel at position (x,y) with a color
-					draw_pixel(x, y, phong_color);
+					row.color[x] = phong_color;
 
 					// Update the z-buffer value with the 1/w of this current pixel
-					update_z_buffer_at(x, y, interpolated_reciprocal_w);
+					row_depth_write(&row, x, encoded_depth);
 				}	
 			}
 		}
 	}
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// Depth-only triangle for the shadow map pass. The shadow map uses an
+// orthographic projection, so the depth is interpolated linearly and the
+// triangles are drawn whatever their winding is. The vertex depths are
+// already scaled to the 16-bit unorm range of the map
+///////////////////////////////////////////////////////////////////////////////
+void draw_shadow_triangle(
+	float x0, float y0, float z0,
+	float x1, float y1, float z1,
+	float x2, float y2, float z2,
+	uint16_t* depth_buffer, int buffer_size
+) {
+	vect2_t a0 = { (int)x0, (int)y0 };
+	vect2_t a1 = { (int)x1, (int)y1 };
+	vect2_t a2 = { (int)x2, (int)y2 };
+
+	int area = edge_cross(&a0, &a1, &a2);
+	if (area == 0) {
+		return;
+	}
+
+	//flip counter clock wise triangles so the edge functions stay positive inside
+	if (area < 0) {
+		vect2_t a = a1;
+		a1 = a2;
+		a2 = a;
+		float_swap(&z1, &z2);
+		area = -area;
+	}
+
+	//Clamp the bounding box to the shadow map
+	int x_min = MAX(MIN(MIN(a0.x, a1.x), a2.x), 0);
+	int y_min = MAX(MIN(MIN(a0.y, a1.y), a2.y), 0);
+	int x_max = MIN(MAX(MAX(a0.x, a1.x), a2.x), buffer_size - 1);
+	int y_max = MIN(MAX(MAX(a0.y, a1.y), a2.y), buffer_size - 1);
+
+	int bias0 = is_top_left(&a1, &a2) ? 0 : -1;
+	int bias1 = is_top_left(&a2, &a0) ? 0 : -1;
+	int bias2 = is_top_left(&a0, &a1) ? 0 : -1;
+
+	for (int y = y_min; y <= y_max; y++) {
+		uint16_t* row = &depth_buffer[y * buffer_size];
+
+		for (int x = x_min; x <= x_max; x++) {
+			vect2_t p = { x, y };
+
+			int w0 = edge_cross(&a1, &a2, &p) + bias0;
+			int w1 = edge_cross(&a2, &a0, &p) + bias1;
+			int w2 = edge_cross(&a0, &a1, &p) + bias2;
+
+			if ((w0 | w1 | w2) >= 0) {
+				float depth = (z0 * w0 + z1 * w1 + z2 * w2) / (float)area;
+				uint16_t depth_unorm = (uint16_t)CLAMP(depth, 0.0f, 65535.0f);
+				if (depth_unorm < row[x]) {
+					row[x] = depth_unorm;
+				}
+			}
+		}
+	}
+}
+
 void draw_aabb_textured_triangle(
 	int x0, int y0, float z0, float w0, float u0, float v0,
 	int x1, int y1, float z1, float w1, float u1, float v1,
@@ -697,8 +773,8 @@ void draw_aabb_textured_triangle(
 	vect3_t t0, vect3_t t1, vect3_t t2,
 	vect3_t b0, vect3_t b1, vect3_t b2,
 	vect3_t c0, vect3_t c1, vect3_t c2,
-	upng_t* texture, upng_t* normalmap, upng_t* glowmap, upng_t* roughmap,
-	upng_t* metallic, upng_t* ao, 
+	texture_t* texture, texture_t* normalmap, texture_t* glowmap, texture_t* roughmap,
+	texture_t* metallic, texture_t* ao, 
 	uint32_t flat_color 
 
 ) {
@@ -728,6 +804,11 @@ void draw_aabb_textured_triangle(
 	int x_max = MAX(MAX(a0.x, a1.x), a2.x);
 	int y_max = MAX(MAX(a0.y, a1.y), a2.y);
 
+	//Clamp it to the viewport so the loop below can write straight into the rows
+	if (!begin_framebuffer_rect(&x_min, &y_min, &x_max, &y_max)) {
+		return;
+	}
+
 	//Finds the areas of entire triangle / paralellogram
 	int area = edge_cross(&a0, &a1, &a2);
 	int bias0 = is_top_left(&a1, &a2) ? 0 : -1;
@@ -736,6 +817,7 @@ void draw_aabb_textured_triangle(
 
 	//Loop all candidate pixels inside the bounding box
 	for (int y = y_min; y <= y_max; y++) {
+		framebuffer_row_t row = get_framebuffer_row(y);
 
 		for (int x = x_min; x <= x_max; x++) {
 			vect2_t p = { x, y };
@@ -744,7 +826,7 @@ void draw_aabb_textured_triangle(
 			float w1 = edge_cross(&a2, &a0, &p) + bias1;
 			float w2 = edge_cross(&a0, &a1, &p) + bias2;
 
-			bool is_inside = w0 >= 0 && w1 >= 0 & w2 >= 0;
+			bool is_inside = w0 >= 0 && w1 >= 0 && w2 >= 0;
 
 			if (is_inside) {
 
@@ -769,29 +851,6 @@ void draw_aabb_textured_triangle(
 				interpolated_u /= interpolated_reciprocal_w;
 				interpolated_v /= interpolated_reciprocal_w;
 
-				int texture_width = upng_get_width(texture);
-				int texture_height = upng_get_height(texture);
-				int normalmap_width = upng_get_width(normalmap);
-				int normalmap_height = upng_get_height(normalmap);
-				int roughmap_width = upng_get_width(roughmap);
-				int roughmap_height = upng_get_height(roughmap);
-
-
-				//map the uv coordinates to the full texture & normalmap width and height
-				int tex_x = abs((int)(interpolated_u * texture_width)) % texture_width;
-				int tex_y = abs((int)(interpolated_v * texture_height)) % texture_height;
-
-				int normalmap_x = abs((int)(interpolated_u * normalmap_width)) % normalmap_width;
-				int normalmap_y = abs((int)(interpolated_v * normalmap_height)) % normalmap_height;
-
-				int roughmap_x = abs((int)(interpolated_u * roughmap_width)) % roughmap_width;
-				int roughmap_y = abs((int)(interpolated_v * roughmap_height)) % roughmap_height;
-
-
-				//* adjust the value of 1/w so the pixels that are closer to the camera with smaller values
-				interpolated_reciprocal_w = 1.0 - interpolated_reciprocal_w;
-
-
 				///******************** Normal Mapping ************************///
 				//interpolate vertex tangent
 				vect3_t interpolated_tangent = vect3_add(vect3_mul(t0, alpha), vect3_add(vect3_mul(t1, beta), vect3_mul(t2, gamma)));
@@ -812,49 +871,42 @@ void draw_aabb_textured_triangle(
 				vect3_t view_direction = vect3_sub(get_camera_position(), target_position);
 
 
-                ///********************* Gouraud Shading *********************///
-				//Interpolate vertex colors
-				vect3_t interpolated_color = vect3_add(vect3_mul(c0, alpha), vect3_add(vect3_mul(c1, beta), vect3_mul(c2, gamma)));
-
-				//Pack the final color into uint32_t
-				uint32_t gouraud_color = pack_color(interpolated_color.x, interpolated_color.y, interpolated_color.z, 1.0); //Assuming full opacity;
-
-
 				///********************* Draw Pixels ************************///
-				// Only draw the pixel if the depth value is less than the one previously stored in the z-buffer
-				if (interpolated_reciprocal_w < get_z_buffer_at(x, y)) {
+				// Only draw the pixel if it is closer than the one previously stored in the z-buffer (in its depth format)
+				uint32_t encoded_depth;
+				if (row_depth_test(&row, x, interpolated_reciprocal_w, &encoded_depth)) {
+
 
+					uint64_t shade_start = row_shade_clock(&row);
 
 					///Sample the texture maps
 					//get diffuse texture
 
 
-					uint32_t* texture_buffer = (uint32_t*)upng_get_buffer(texture);
-					uint32_t texture_pixel = texture_buffer[(texture_width * tex_y) + tex_x];
-					
+					//every map is sampled at its own size, so the maps of a mesh can differ in size and format
+					uint32_t texture_pixel = sample_texture(texture, interpolated_u, interpolated_v);
 
 					//get tangent normal from the normal map texture
-					uint32_t* normalmap_buffer = (uint32_t*)upng_get_buffer(normalmap);
-					uint32_t tangent_normal = normalmap_buffer[(normalmap_width)*normalmap_y + normalmap_x];
-					
+					uint32_t tangent_normal = sample_texture(normalmap, interpolated_u, interpolated_v);
 
 					//get glow texture
-					uint32_t* glowmap_buffer = (uint32_t*)upng_get_buffer(glowmap);
-					uint32_t glowmap_pixel = glowmap_buffer[(texture_width * tex_y) + tex_x];
-					
+					uint32_t glowmap_pixel = sample_texture(glowmap, interpolated_u, interpolated_v);
 
 					//get roughness texture
-					uint32_t* roughmap_buffer = (uint32_t*)upng_get_buffer(roughmap);
-					uint32_t roughmap_pixel = roughmap_buffer[(roughmap_width * roughmap_y) + roughmap_x];
-					
+					uint32_t roughmap_pixel = sample_texture(roughmap, interpolated_u, interpolated_v);
+
 					//get metallic texture
-					uint32_t* metallic_buffer = (uint32_t*)upng_get_buffer(metallic);
-					uint32_t metallic_pixel = metallic_buffer[(texture_width * tex_y) + tex_x];
-					
-					
+					uint32_t metallic_pixel = sample_texture(metallic, interpolated_u, interpolated_v);
+
 					//get ao texture
-					uint32_t* ao_buffer = (uint32_t*)upng_get_buffer(ao);
-					uint32_t ao_pixel = ao_buffer[(texture_width * tex_y) + tex_x];
+					uint32_t ao_pixel = sample_texture(ao, interpolated_u, interpolated_v);
+
+					STAT_FETCH(MAP_TEXTURE, 1);
+					STAT_FETCH(MAP_NORMAL, 1);
+					STAT_FETCH(MAP_GLOW, 1);
+					STAT_FETCH(MAP_ROUGHNESS, 1);
+					STAT_FETCH(MAP_METALLIC, 1);
+					STAT_FETCH(MAP_AO, 1);
 					
 					
 				
@@ -867,9 +919,6 @@ void draw_aabb_textured_triangle(
 					uint32_t blinn_phong_color = blinn_phong_reflection(interpolated_normal, get_light_direction(), view_direction,
 						texture_pixel, get_material_shininess(), get_light_ambient_strgenth(), get_material_specular_strength());
 
-					//PBR reflection model
-					uint32_t pbr_color = pbr_reflection(interpolated_normal, interpolated_tangent, interpolated_bitangent,
-						get_light_direction(), view_direction, texture_pixel, tangent_normal,  metallic_pixel, roughmap_pixel, ao_pixel);
 
 					uint32_t pbr_mr_color = BRDF_PBR_MetallicRoughness(interpolated_normal, interpolated_tangent, interpolated_bitangent,
 						get_light_direction(), view_direction, texture_pixel, tangent_normal, metallic_pixel, roughmap_pixel, ao_pixel);
@@ -877,6 +926,33 @@ void draw_aabb_textured_triangle(
 					uint32_t pbr_sg_color = BRDF_PBR_SpecularGlossiness(interpolated_normal, interpolated_tangent, interpolated_bitangent,
 						get_light_direction(), view_direction, texture_pixel, tangent_normal, metallic_pixel, roughmap_pixel, ao_pixel);
 
+					//Camera space position of the pixel, needed by the shadow map and the local lights
+					uint64_t tile_lights = get_tile_light_mask(x, y);
+					bool shadowed = is_shadow_map_ready();
+					vect3_t pixel_position = vect3_new(0.0f, 0.0f, 0.0f);
+					if (shadowed || tile_lights != 0) {
+						pixel_position = screen_to_view_space(x, y, 1.0f / interpolated_reciprocal_w);
+					}
+
+					//The shadow map attenuates the directional light only. The shader has no ambient term of its own,
+					//so the ambient strength stays as the floor of the light in the umbra.
+					float light_visibility = 1.0f;
+					if (shadowed) {
+						float ambient = get_light_ambient_strgenth();
+						light_visibility = ambient + (1.0f - ambient) * sample_shadow_visibility(pixel_position);
+					}
+
+					//PBR reflection model, the maps are decoded once and every light adds its linear radiance
+					pbr_surface_t surface = decode_pbr_surface(interpolated_normal, interpolated_tangent, interpolated_bitangent,
+						texture_pixel, tangent_normal, metallic_pixel, roughmap_pixel, ao_pixel);
+					vect3_t radiance = pbr_reflection(&surface, get_light_direction(), view_direction, light_visibility);
+
+					//Add the point and spot lights culled into this pixel's screen tile
+					if (tile_lights != 0) {
+						radiance = BRDF_PBR_LocalLights(radiance, &surface, tile_lights, pixel_position);
+					}
+					uint32_t pbr_color = pack_color_linear(radiance.x, radiance.y, radiance.z, 1.0f);
+
 					///unpack the texture pixel to pixel color 
 					//vect4_t pixel_color = vect4_new(0.0, 0.0, 0.0, 0.0);
 					//unpack_color(texture_pixel, &pixel_color.x, &pixel_color.y, &pixel_color.z, &pixel_color.w);
@@ -904,10 +980,11 @@ void draw_aabb_textured_triangle(
 						
 
 					// Draw a pixel at position (x,y) with a color
-					draw_pixel(x, y, pbr_color);
+					row.color[x] = pbr_color;
+					row_count_shade(&row, x, shade_start);
 
 					// Update the z-buffer value with the 1/w of this current pixel
-					update_z_buffer_at(x, y, interpolated_reciprocal_w);
+					row_depth_write(&row, x, encoded_depth);
 				}
 
 			}
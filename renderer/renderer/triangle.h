@@ -9,15 +9,9 @@
 
 
 typedef struct {
-	int a;         //model triangle face vertex index
+	int a;         //model triangle face vertex index, selects position, normal, uv and tangent
 	int b;
 	int c;
-	int n0;        //model triangle face vertex normal index
-	int n1;
-	int n2;
-	tex2_t a_uv;
-	tex2_t b_uv;
-	tex2_t c_uv;
 	uint32_t color;
 
 } face_t; // stores vertex index <--- it's a triangle face
@@ -31,12 +25,12 @@ typedef struct {
 	tex2_t texcoords[3];
 	vect3_t vertex_colors[3];
 	uint32_t color;
-	upng_t* texture;
-	upng_t* normalmap;
-	upng_t* glowmap;
-	upng_t* roughmap;
-	upng_t* metallic;
-	upng_t* ao;
+	texture_t* texture;
+	texture_t* normalmap;
+	texture_t* glowmap;
+	texture_t* roughmap;
+	texture_t* metallic;
+	texture_t* ao;
 	float light_intensity_factor;
 
 } triangle_t ; // stores actual vec2 points of the triangle in the screen
@@ -68,27 +62,32 @@ void draw_aabb_textured_triangle(
 	vect3_t t0, vect3_t t1, vect3_t t2,
 	vect3_t b0, vect3_t b1, vect3_t b2,
 	vect3_t c0, vect3_t c1, vect3_t c2,
-	upng_t* texture, upng_t* normalmap, upng_t* glowmap, upng_t* roughmap,
-	upng_t* metallic, upng_t* ao,
+	texture_t* texture, texture_t* normalmap, texture_t* glowmap, texture_t* roughmap,
+	texture_t* metallic, texture_t* ao,
 	uint32_t flat_color);
 
+void draw_shadow_triangle(
+	float x0, float y0, float z0,
+	float x1, float y1, float z1,
+	float x2, float y2, float z2,
+	uint16_t* depth_buffer, int buffer_size);
 
 void draw_textured_triangle(
 	int x0, int y0, float z0, float w0, float u0, float v0,
 	int x1, int y1, float z1, float w1, float u1, float v1,
 	int x2, int y2, float z2, float w2, float u2, float v2,
 	vect3_t n0, vect3_t n1, vect3_t n2,
-	upng_t* texture, float light_intensity_factor, uint32_t color);
+	texture_t* texture, float light_intensity_factor, uint32_t color);
 
 void draw_triangle_pixel( 
-	int x, int y,   
+	int x, int y, framebuffer_row_t* row,
 	vect4_t point_a, vect4_t point_b, vect4_t point_c,
 	vect3_t n0, vect3_t n1, vect3_t n2,
 	vect3_t c0, vect3_t c1, vect3_t c2,
 	uint32_t color  
 	);
 
-void draw_triangle_texel(int x, int y, upng_t* texture,
+void draw_triangle_texel(int x, int y, framebuffer_row_t* row, texture_t* texture,
 	vect4_t point_a, vect4_t point_b, vect4_t point_c,
 	tex2_t a_uv, tex2_t b_uv, tex2_t c_uv, 
 	vect3_t n0, vect3_t n1, vect3_t n2,
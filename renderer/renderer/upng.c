@@ -28,6 +28,7 @@ freely, subject to the following restrictions:
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <stdint.h>
 
 #include "upng.h"
 
@@ -46,15 +47,11 @@ freely, subject to the following restrictions:
 #define NUM_DISTANCE_SYMBOLS 32	/*the distance codes have their own symbols, 30 used, 2 unused */
 #define NUM_CODE_LENGTH_CODES 19	/*the code length codes. 0-15: code lengths, 16: copy previous 3-6 times, 17: 3-10 zeros, 18: 11-138 zeros */
 #define MAX_SYMBOLS 288 /* largest number of symbols used by any tree type */
+#define MAX_CODE_LENGTH 15	/* longest huffman code deflate allows */
 
-#define DEFLATE_CODE_BITLEN 15
-#define DISTANCE_BITLEN 15
-#define CODE_LENGTH_BITLEN 7
-#define MAX_BIT_LENGTH 30 /* largest bitlen used by any tree type */
-
-#define DEFLATE_CODE_BUFFER_SIZE (NUM_DEFLATE_CODE_SYMBOLS * 2)
-#define DISTANCE_BUFFER_SIZE (NUM_DISTANCE_SYMBOLS * 2)
-#define CODE_LENGTH_BUFFER_SIZE (NUM_DISTANCE_SYMBOLS * 2)
+#define HUFFMAN_FAST_BITS 10	/* codes up to this length are decoded with a single table lookup */
+#define HUFFMAN_FAST_SIZE (1 << HUFFMAN_FAST_BITS)
+#define HUFFMAN_FAST_SYMBOL_BITS 9	/* a fast table entry is (code length << 9) | symbol, 0 for longer codes */
 
 #define SET_ERROR(upng,code) do { (upng)->error = (code); (upng)->error_line = __LINE__; } while (0)
 
@@ -100,12 +97,6 @@ struct upng_t {
 	upng_source		source;
 };
 
-typedef struct huffman_tree {
-	unsigned* tree2d;
-	unsigned maxbitlen;	/*maximum number of bits a single code can get */
-	unsigned numcodes;	/*number of symbols in the alphabet = number of codes */
-} huffman_tree;
-
 static const unsigned LENGTH_BASE[29] = {	/*the base lengths represented by codes 257-285 */
 	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
 	67, 83, 99, 115, 131, 163, 195, 227, 258
@@ -129,206 +120,212 @@ static const unsigned DISTANCE_EXTRA[30] = {	/*the extra bits of backwards dista
 static const unsigned CLCL[NUM_CODE_LENGTH_CODES]	/*the order in which "code length alphabet code lengths" are stored, out of this the huffman tree of the dynamic huffman tree lengths is generated */
 = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
 
-static const unsigned FIXED_DEFLATE_CODE_TREE[NUM_DEFLATE_CODE_SYMBOLS * 2] = {
-	289, 370, 290, 307, 546, 291, 561, 292, 293, 300, 294, 297, 295, 296, 0, 1,
-	2, 3, 298, 299, 4, 5, 6, 7, 301, 304, 302, 303, 8, 9, 10, 11, 305, 306, 12,
-	13, 14, 15, 308, 339, 309, 324, 310, 317, 311, 314, 312, 313, 16, 17, 18,
-	19, 315, 316, 20, 21, 22, 23, 318, 321, 319, 320, 24, 25, 26, 27, 322, 323,
-	28, 29, 30, 31, 325, 332, 326, 329, 327, 328, 32, 33, 34, 35, 330, 331, 36,
-	37, 38, 39, 333, 336, 334, 335, 40, 41, 42, 43, 337, 338, 44, 45, 46, 47,
-	340, 355, 341, 348, 342, 345, 343, 344, 48, 49, 50, 51, 346, 347, 52, 53,
-	54, 55, 349, 352, 350, 351, 56, 57, 58, 59, 353, 354, 60, 61, 62, 63, 356,
-	363, 357, 360, 358, 359, 64, 65, 66, 67, 361, 362, 68, 69, 70, 71, 364,
-	367, 365, 366, 72, 73, 74, 75, 368, 369, 76, 77, 78, 79, 371, 434, 372,
-	403, 373, 388, 374, 381, 375, 378, 376, 377, 80, 81, 82, 83, 379, 380, 84,
-	85, 86, 87, 382, 385, 383, 384, 88, 89, 90, 91, 386, 387, 92, 93, 94, 95,
-	389, 396, 390, 393, 391, 392, 96, 97, 98, 99, 394, 395, 100, 101, 102, 103,
-	397, 400, 398, 399, 104, 105, 106, 107, 401, 402, 108, 109, 110, 111, 404,
-	419, 405, 412, 406, 409, 407, 408, 112, 113, 114, 115, 410, 411, 116, 117,
-	118, 119, 413, 416, 414, 415, 120, 121, 122, 123, 417, 418, 124, 125, 126,
-	127, 420, 427, 421, 424, 422, 423, 128, 129, 130, 131, 425, 426, 132, 133,
-	134, 135, 428, 431, 429, 430, 136, 137, 138, 139, 432, 433, 140, 141, 142,
-	143, 435, 483, 436, 452, 568, 437, 438, 445, 439, 442, 440, 441, 144, 145,
-	146, 147, 443, 444, 148, 149, 150, 151, 446, 449, 447, 448, 152, 153, 154,
-	155, 450, 451, 156, 157, 158, 159, 453, 468, 454, 461, 455, 458, 456, 457,
-	160, 161, 162, 163, 459, 460, 164, 165, 166, 167, 462, 465, 463, 464, 168,
-	169, 170, 171, 466, 467, 172, 173, 174, 175, 469, 476, 470, 473, 471, 472,
-	176, 177, 178, 179, 474, 475, 180, 181, 182, 183, 477, 480, 478, 479, 184,
-	185, 186, 187, 481, 482, 188, 189, 190, 191, 484, 515, 485, 500, 486, 493,
-	487, 490, 488, 489, 192, 193, 194, 195, 491, 492, 196, 197, 198, 199, 494,
-	497, 495, 496, 200, 201, 202, 203, 498, 499, 204, 205, 206, 207, 501, 508,
-	502, 505, 503, 504, 208, 209, 210, 211, 506, 507, 212, 213, 214, 215, 509,
-	512, 510, 511, 216, 217, 218, 219, 513, 514, 220, 221, 222, 223, 516, 531,
-	517, 524, 518, 521, 519, 520, 224, 225, 226, 227, 522, 523, 228, 229, 230,
-	231, 525, 528, 526, 527, 232, 233, 234, 235, 529, 530, 236, 237, 238, 239,
-	532, 539, 533, 536, 534, 535, 240, 241, 242, 243, 537, 538, 244, 245, 246,
-	247, 540, 543, 541, 542, 248, 249, 250, 251, 544, 545, 252, 253, 254, 255,
-	547, 554, 548, 551, 549, 550, 256, 257, 258, 259, 552, 553, 260, 261, 262,
-	263, 555, 558, 556, 557, 264, 265, 266, 267, 559, 560, 268, 269, 270, 271,
-	562, 565, 563, 564, 272, 273, 274, 275, 566, 567, 276, 277, 278, 279, 569,
-	572, 570, 571, 280, 281, 282, 283, 573, 574, 284, 285, 286, 287, 0, 0
-};
+/*code lengths of the fixed huffman codes (btype 1), see deflate spec 3.2.6 */
+static void get_fixed_code_lengths(unsigned char* bitlen, unsigned char* bitlenD)
+{
+	unsigned n;
+	for (n = 0; n < NUM_DEFLATE_CODE_SYMBOLS; n++) {
+		bitlen[n] = n < 144 ? 8 : n < 256 ? 9 : n < 280 ? 7 : 8;
+	}
+	for (n = 0; n < NUM_DISTANCE_SYMBOLS; n++) {
+		bitlenD[n] = 5;
+	}
+}
 
-static const unsigned FIXED_DISTANCE_TREE[NUM_DISTANCE_SYMBOLS * 2] = {
-	33, 48, 34, 41, 35, 38, 36, 37, 0, 1, 2, 3, 39, 40, 4, 5, 6, 7, 42, 45, 43,
-	44, 8, 9, 10, 11, 46, 47, 12, 13, 14, 15, 49, 56, 50, 53, 51, 52, 16, 17,
-	18, 19, 54, 55, 20, 21, 22, 23, 57, 60, 58, 59, 24, 25, 26, 27, 61, 62, 28,
-	29, 30, 31, 0, 0
-};
+/*
+ * Bit reader: up to 64 bits of input are kept in a buffer, least significant
+ * bit first. Refills load 8 bytes at a time while at least 8 input bytes are
+ * left, past the end of the input zero bytes are shifted in and the overrun is
+ * detected by comparing the bits consumed with the input size.
+ */
+typedef struct inflate_stream {
+	const unsigned char* in;
+	unsigned long insize;
+	unsigned long inpos;	/* next input byte to load into the buffer, runs past insize once the input is drained */
+	uint64_t bitbuf;
+	unsigned bitcount;	/* valid bits in bitbuf */
+
+	unsigned char* out;
+	unsigned long outsize;
+	unsigned long outpos;
+} inflate_stream;
+
+static uint64_t load_le64(const unsigned char* p)
+{
+	return (uint64_t)p[0] | ((uint64_t)p[1] << 8) | ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24) |
+		((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40) | ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+}
 
-static unsigned char read_bit(unsigned long *bitpointer, const unsigned char *bitstream)
+/*fills the buffer to at least 56 bits */
+static void refill_bits(inflate_stream* s)
 {
-	unsigned char result = (unsigned char)((bitstream[(*bitpointer) >> 3] >> ((*bitpointer) & 0x7)) & 1);
-	(*bitpointer)++;
-	return result;
+	if (s->inpos + 8 <= s->insize) {
+		/* the bytes that only partially fit are loaded again by the next refill, with the same bits in the same place */
+		s->bitbuf |= load_le64(s->in + s->inpos) << s->bitcount;
+		s->inpos += (63 - s->bitcount) >> 3;
+		s->bitcount |= 56;
+	} else {
+		while (s->bitcount <= 56) {
+			uint64_t byte = s->inpos < s->insize ? s->in[s->inpos] : 0;
+			s->bitbuf |= byte << s->bitcount;
+			s->inpos++;
+			s->bitcount += 8;
+		}
+	}
 }
 
-static unsigned read_bits(unsigned long *bitpointer, const unsigned char *bitstream, unsigned long nbits)
+/*true once more bits were consumed than the input holds */
+static int input_overrun(const inflate_stream* s)
 {
-	unsigned result = 0, i;
-	for (i = 0; i < nbits; i++)
-		result |= ((unsigned)read_bit(bitpointer, bitstream)) << i;
+	return s->inpos * 8 - s->bitcount > s->insize * 8;
+}
+
+/*the caller makes sure the buffer holds nbits (at most 32) */
+static unsigned consume_bits(inflate_stream* s, unsigned nbits)
+{
+	unsigned result = (unsigned)(s->bitbuf & (((uint64_t)1 << nbits) - 1));
+	s->bitbuf >>= nbits;
+	s->bitcount -= nbits;
 	return result;
 }
 
-/* the buffer must be numcodes*2 in size! */
-static void huffman_tree_init(huffman_tree* tree, unsigned* buffer, unsigned numcodes, unsigned maxbitlen)
+static unsigned read_bits(inflate_stream* s, unsigned nbits)
 {
-	tree->tree2d = buffer;
+	if (s->bitcount < nbits) {
+		refill_bits(s);
+	}
+	return consume_bits(s, nbits);
+}
 
-	tree->numcodes = numcodes;
-	tree->maxbitlen = maxbitlen;
+/*
+ * Canonical huffman decoding table. Codes of up to HUFFMAN_FAST_BITS bits are
+ * resolved by indexing fast[] with the next input bits, longer codes are found
+ * by comparing the next 16 bits (in code order) with the first code of each
+ * length.
+ */
+typedef struct huffman_table {
+	unsigned short fast[HUFFMAN_FAST_SIZE];
+	unsigned short first_code[MAX_CODE_LENGTH + 1];
+	unsigned short first_symbol[MAX_CODE_LENGTH + 1];
+	unsigned max_code[MAX_CODE_LENGTH + 2];	/* first code past each length, left aligned to 16 bits */
+	unsigned char lengths[MAX_SYMBOLS];	/* code length of each slot, in code order */
+	unsigned short symbols[MAX_SYMBOLS];	/* symbol of each slot, in code order */
+} huffman_table;
+
+static unsigned reverse_bits(unsigned code, unsigned nbits)
+{
+	unsigned result = 0, i;
+	for (i = 0; i < nbits; i++) {
+		result = (result << 1) | ((code >> i) & 1);
+	}
+	return result;
 }
 
-/*given the code lengths (as stored in the PNG file), generate the tree as defined by Deflate. maxbitlen is the maximum bits that a code in the tree can have. return value is error.*/
-static void huffman_tree_create_lengths(upng_t* upng, huffman_tree* tree, const unsigned *bitlen)
+/*given the code lengths (as stored in the PNG file), generate the decoding table as defined by Deflate */
+static void huffman_table_create_lengths(upng_t* upng, huffman_table* table, const unsigned char* bitlen, unsigned numcodes)
 {
-	unsigned tree1d[MAX_SYMBOLS];
-	unsigned blcount[MAX_BIT_LENGTH];
-	unsigned nextcode[MAX_BIT_LENGTH+1];
-	unsigned bits, n, i;
-	unsigned nodefilled = 0;	/*up to which node it is filled */
-	unsigned treepos = 0;	/*position in the tree (1 of the numcodes columns) */
-
-	/* initialize local vectors */
+	unsigned blcount[MAX_CODE_LENGTH + 1];
+	unsigned nextcode[MAX_CODE_LENGTH + 1];
+	unsigned code = 0, slot = 0;
+	unsigned bits, n;
+
 	memset(blcount, 0, sizeof(blcount));
-	memset(nextcode, 0, sizeof(nextcode));
+	memset(table->fast, 0, sizeof(table->fast));
 
 	/*step 1: count number of instances of each code length */
-	for (bits = 0; bits < tree->numcodes; bits++) {
-		blcount[bitlen[bits]]++;
+	for (n = 0; n < numcodes; n++) {
+		blcount[bitlen[n]]++;
 	}
-
-	/*step 2: generate the nextcode values */
-	for (bits = 1; bits <= tree->maxbitlen; bits++) {
-		nextcode[bits] = (nextcode[bits - 1] + blcount[bits - 1]) << 1;
-	}
-
-	/*step 3: generate all the codes */
-	for (n = 0; n < tree->numcodes; n++) {
-		if (bitlen[n] != 0) {
-			tree1d[n] = nextcode[bitlen[n]]++;
+	blcount[0] = 0;
+
+	/*step 2: generate the first code of each length, an oversubscribed set of lengths is an error */
+	for (bits = 1; bits <= MAX_CODE_LENGTH; bits++) {
+		nextcode[bits] = code;
+		table->first_code[bits] = (unsigned short)code;
+		table->first_symbol[bits] = (unsigned short)slot;
+		code += blcount[bits];
+		if (code > (1u << bits)) {
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return;
 		}
+		table->max_code[bits] = code << (16 - bits);
+		code <<= 1;
+		slot += blcount[bits];
 	}
-
-	/*convert tree1d[] to tree2d[][]. In the 2D array, a value of 32767 means uninited, a value >= numcodes is an address to another bit, a value < numcodes is a code. The 2 rows are the 2 possible bit values (0 or 1), there are as many columns as codes - 1
-	   a good huffmann tree has N * 2 - 1 nodes, of which N - 1 are internal nodes. Here, the internal nodes are stored (what their 0 and 1 option point to). There is only memory for such good tree currently, if there are more nodes (due to too long length codes), error 55 will happen */
-	for (n = 0; n < tree->numcodes * 2; n++) {
-		tree->tree2d[n] = 32767;	/*32767 here means the tree2d isn't filled there yet */
-	}
-
-	for (n = 0; n < tree->numcodes; n++) {	/*the codes */
-		for (i = 0; i < bitlen[n]; i++) {	/*the bits for this code */
-			unsigned char bit = (unsigned char)((tree1d[n] >> (bitlen[n] - i - 1)) & 1);
-			/* check if oversubscribed */
-			if (treepos > tree->numcodes - 2) {
-				SET_ERROR(upng, UPNG_EMALFORMED);
-				return;
-			}
-
-			if (tree->tree2d[2 * treepos + bit] == 32767) {	/*not yet filled in */
-				if (i + 1 == bitlen[n]) {	/*last bit */
-					tree->tree2d[2 * treepos + bit] = n;	/*put the current code in it */
-					treepos = 0;
-				} else {	/*put address of the next step in here, first that address has to be found of course (it's just nodefilled + 1)... */
-					nodefilled++;
-					tree->tree2d[2 * treepos + bit] = nodefilled + tree->numcodes;	/*addresses encoded with numcodes added to it */
-					treepos = nodefilled;
+	table->max_code[MAX_CODE_LENGTH + 1] = 0x10000;	/* sentinel */
+
+	/*step 3: assign the codes, deflate sends them most significant bit first so the fast index is bit reversed */
+	for (n = 0; n < numcodes; n++) {
+		unsigned length = bitlen[n];
+		if (length != 0) {
+			unsigned index = nextcode[length] - table->first_code[length] + table->first_symbol[length];
+			table->lengths[index] = (unsigned char)length;
+			table->symbols[index] = (unsigned short)n;
+			if (length <= HUFFMAN_FAST_BITS) {
+				unsigned short entry = (unsigned short)((length << HUFFMAN_FAST_SYMBOL_BITS) | n);
+				unsigned j;
+				for (j = reverse_bits(nextcode[length], length); j < HUFFMAN_FAST_SIZE; j += 1u << length) {
+					table->fast[j] = entry;
 				}
-			} else {
-				treepos = tree->tree2d[2 * treepos + bit] - tree->numcodes;
 			}
-		}
-	}
-
-	for (n = 0; n < tree->numcodes * 2; n++) {
-		if (tree->tree2d[n] == 32767) {
-			tree->tree2d[n] = 0;	/*remove possible remaining 32767's */
+			nextcode[length]++;
 		}
 	}
 }
 
-static unsigned huffman_decode_symbol(upng_t *upng, const unsigned char *in, unsigned long *bp, const huffman_tree* codetree, unsigned long inlength)
+static unsigned huffman_decode_slow(upng_t* upng, inflate_stream* s, const huffman_table* table)
 {
-	unsigned treepos = 0, ct;
-	unsigned char bit;
-	for (;;) {
-		/* error: end of input memory reached without endcode */
-		if (((*bp) & 0x07) == 0 && ((*bp) >> 3) > inlength) {
-			SET_ERROR(upng, UPNG_EMALFORMED);
-			return 0;
-		}
+	unsigned code = reverse_bits((unsigned)(s->bitbuf & 0xFFFF), 16);
+	unsigned length, index;
 
-		bit = read_bit(bp, in);
+	for (length = HUFFMAN_FAST_BITS + 1; code >= table->max_code[length]; length++);
 
-		ct = codetree->tree2d[(treepos << 1) | bit];
-		if (ct < codetree->numcodes) {
-			return ct;
-		}
+	/* a code the table does not have, only possible with incomplete code lengths */
+	if (length > MAX_CODE_LENGTH) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return 0;
+	}
+	index = (code >> (16 - length)) - table->first_code[length] + table->first_symbol[length];
+	if (index >= MAX_SYMBOLS || table->lengths[index] != length) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return 0;
+	}
+	consume_bits(s, length);
+	return table->symbols[index];
+}
 
-		treepos = ct - codetree->numcodes;
-		if (treepos >= codetree->numcodes) {
-			SET_ERROR(upng, UPNG_EMALFORMED);
-			return 0;
-		}
+/*the caller makes sure the buffer holds MAX_CODE_LENGTH bits */
+static unsigned huffman_decode_symbol(upng_t* upng, inflate_stream* s, const huffman_table* table)
+{
+	unsigned entry = table->fast[s->bitbuf & (HUFFMAN_FAST_SIZE - 1)];
+	if (entry != 0) {
+		consume_bits(s, entry >> HUFFMAN_FAST_SYMBOL_BITS);
+		return entry & ((1u << HUFFMAN_FAST_SYMBOL_BITS) - 1);
 	}
+	return huffman_decode_slow(upng, s, table);
 }
 
-/* get the tree of a deflated block with dynamic tree, the tree itself is also Huffman compressed with a known tree*/
-static void get_tree_inflate_dynamic(upng_t* upng, huffman_tree* codetree, huffman_tree* codetreeD, huffman_tree* codelengthcodetree, const unsigned char *in, unsigned long *bp, unsigned long inlength)
+/* get the tables of a deflated block with dynamic tree, the tree itself is also Huffman compressed with a known tree*/
+static void get_tree_inflate_dynamic(upng_t* upng, huffman_table* codetree, huffman_table* codetreeD, inflate_stream* s)
 {
-	unsigned codelengthcode[NUM_CODE_LENGTH_CODES];
-	unsigned bitlen[NUM_DEFLATE_CODE_SYMBOLS];
-	unsigned bitlenD[NUM_DISTANCE_SYMBOLS];
-	unsigned n, hlit, hdist, hclen, i;
+	huffman_table codelengthcodetree;
+	unsigned char codelengthcode[NUM_CODE_LENGTH_CODES];
+	unsigned char bitlen[NUM_DEFLATE_CODE_SYMBOLS + NUM_DISTANCE_SYMBOLS];	/* literal/length lengths followed by distance lengths */
+	unsigned hlit, hdist, hclen, i;
 
 	/*make sure that length values that aren't filled in will be 0, or a wrong tree will be generated */
-	/*C-code note: use no "return" between ctor and dtor of an uivector! */
-	if ((*bp) >> 3 >= inlength - 2) {
-		SET_ERROR(upng, UPNG_EMALFORMED);
-		return;
-	}
-
-	/* clear bitlen arrays */
 	memset(bitlen, 0, sizeof(bitlen));
-	memset(bitlenD, 0, sizeof(bitlenD));
+	memset(codelengthcode, 0, sizeof(codelengthcode));
 
-	/*the bit pointer is or will go past the memory */
-	hlit = read_bits(bp, in, 5) + 257;	/*number of literal/length codes + 257. Unlike the spec, the value 257 is added to it here already */
-	hdist = read_bits(bp, in, 5) + 1;	/*number of distance codes. Unlike the spec, the value 1 is added to it here already */
-	hclen = read_bits(bp, in, 4) + 4;	/*number of code length codes. Unlike the spec, the value 4 is added to it here already */
+	hlit = read_bits(s, 5) + 257;	/*number of literal/length codes + 257. Unlike the spec, the value 257 is added to it here already */
+	hdist = read_bits(s, 5) + 1;	/*number of distance codes. Unlike the spec, the value 1 is added to it here already */
+	hclen = read_bits(s, 4) + 4;	/*number of code length codes. Unlike the spec, the value 4 is added to it here already */
 
-	for (i = 0; i < NUM_CODE_LENGTH_CODES; i++) {
-		if (i < hclen) {
-			codelengthcode[CLCL[i]] = read_bits(bp, in, 3);
-		} else {
-			codelengthcode[CLCL[i]] = 0;	/*if not, it must stay 0 */
-		}
+	for (i = 0; i < hclen; i++) {
+		codelengthcode[CLCL[i]] = (unsigned char)read_bits(s, 3);
 	}
 
-	huffman_tree_create_lengths(upng, codelengthcodetree, codelengthcode);
-
-	/* bail now if we encountered an error earlier */
+	huffman_table_create_lengths(upng, &codelengthcodetree, codelengthcode, NUM_CODE_LENGTH_CODES);
 	if (upng->error != UPNG_EOK) {
 		return;
 	}
@@ -336,244 +333,204 @@ static void get_tree_inflate_dynamic(upng_t* upng, huffman_tree* codetree, huffm
 	/*now we can use this tree to read the lengths for the tree that this function will return */
 	i = 0;
 	while (i < hlit + hdist) {	/*i is the current symbol we're reading in the part that contains the code lengths of lit/len codes and dist codes */
-		unsigned code = huffman_decode_symbol(upng, in, bp, codelengthcodetree, inlength);
+		unsigned code, replength;
+		unsigned char value = 0;
+
+		if (s->bitcount < MAX_CODE_LENGTH + 7) {
+			refill_bits(s);
+		}
+		code = huffman_decode_symbol(upng, s, &codelengthcodetree);
 		if (upng->error != UPNG_EOK) {
-			break;
+			return;
 		}
 
 		if (code <= 15) {	/*a length code */
-			if (i < hlit) {
-				bitlen[i] = code;
-			} else {
-				bitlenD[i - hlit] = code;
-			}
-			i++;
-		} else if (code == 16) {	/*repeat previous */
-			unsigned replength = 3;	/*read in the 2 bits that indicate repeat length (3-6) */
-			unsigned value;	/*set value to the previous code */
-
-			if ((*bp) >> 3 >= inlength) {
+			bitlen[i++] = (unsigned char)code;
+			continue;
+		} else if (code == 16) {	/*repeat previous 3-6 times */
+			if (i == 0) {
 				SET_ERROR(upng, UPNG_EMALFORMED);
-				break;
-			}
-			/*error, bit pointer jumps past memory */
-			replength += read_bits(bp, in, 2);
-
-			if ((i - 1) < hlit) {
-				value = bitlen[i - 1];
-			} else {
-				value = bitlenD[i - hlit - 1];
-			}
-
-			/*repeat this value in the next lengths */
-			for (n = 0; n < replength; n++) {
-				/* i is larger than the amount of codes */
-				if (i >= hlit + hdist) {
-					SET_ERROR(upng, UPNG_EMALFORMED);
-					break;
-				}
-
-				if (i < hlit) {
-					bitlen[i] = value;
-				} else {
-					bitlenD[i - hlit] = value;
-				}
-				i++;
+				return;
 			}
+			value = bitlen[i - 1];
+			replength = 3 + consume_bits(s, 2);
 		} else if (code == 17) {	/*repeat "0" 3-10 times */
-			unsigned replength = 3;	/*read in the bits that indicate repeat length */
-			if ((*bp) >> 3 >= inlength) {
-				SET_ERROR(upng, UPNG_EMALFORMED);
-				break;
-			}
-
-			/*error, bit pointer jumps past memory */
-			replength += read_bits(bp, in, 3);
-
-			/*repeat this value in the next lengths */
-			for (n = 0; n < replength; n++) {
-				/* error: i is larger than the amount of codes */
-				if (i >= hlit + hdist) {
-					SET_ERROR(upng, UPNG_EMALFORMED);
-					break;
-				}
-
-				if (i < hlit) {
-					bitlen[i] = 0;
-				} else {
-					bitlenD[i - hlit] = 0;
-				}
-				i++;
-			}
-		} else if (code == 18) {	/*repeat "0" 11-138 times */
-			unsigned replength = 11;	/*read in the bits that indicate repeat length */
-			/* error, bit pointer jumps past memory */
-			if ((*bp) >> 3 >= inlength) {
-				SET_ERROR(upng, UPNG_EMALFORMED);
-				break;
-			}
-
-			replength += read_bits(bp, in, 7);
+			replength = 3 + consume_bits(s, 3);
+		} else {	/*repeat "0" 11-138 times */
+			replength = 11 + consume_bits(s, 7);
+		}
 
-			/*repeat this value in the next lengths */
-			for (n = 0; n < replength; n++) {
-				/* i is larger than the amount of codes */
-				if (i >= hlit + hdist) {
-					SET_ERROR(upng, UPNG_EMALFORMED);
-					break;
-				}
-				if (i < hlit)
-					bitlen[i] = 0;
-				else
-					bitlenD[i - hlit] = 0;
-				i++;
-			}
-		} else {
-			/* somehow an unexisting code appeared. This can never happen. */
+		/* error: i is larger than the amount of codes */
+		if (i + replength > hlit + hdist) {
 			SET_ERROR(upng, UPNG_EMALFORMED);
-			break;
+			return;
 		}
+		memset(bitlen + i, value, replength);
+		i += replength;
 	}
 
-	if (upng->error == UPNG_EOK && bitlen[256] == 0) {
+	if (input_overrun(s)) {
 		SET_ERROR(upng, UPNG_EMALFORMED);
+		return;
 	}
 
 	/*the length of the end code 256 must be larger than 0 */
+	if (bitlen[256] == 0) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return;
+	}
+
 	/*now we've finally got hlit and hdist, so generate the code trees, and the function is done */
+	huffman_table_create_lengths(upng, codetree, bitlen, hlit);
 	if (upng->error == UPNG_EOK) {
-		huffman_tree_create_lengths(upng, codetree, bitlen);
+		huffman_table_create_lengths(upng, codetreeD, bitlen + hlit, hdist);
 	}
-	if (upng->error == UPNG_EOK) {
-		huffman_tree_create_lengths(upng, codetreeD, bitlenD);
+}
+
+/*
+ * Copies a back reference of length bytes from distance bytes back. Matches at
+ * least 8 bytes back are copied 8 bytes at a time, possibly writing up to 7
+ * bytes past the match (they are overwritten by the following symbols), closer
+ * matches repeat the pattern in chunks that double in size.
+ */
+static void copy_match(inflate_stream* s, unsigned long distance, unsigned long length)
+{
+	unsigned char* dst = s->out + s->outpos;
+	const unsigned char* src = dst - distance;
+
+	s->outpos += length;
+
+	if (distance >= 8 && s->outpos + 8 <= s->outsize) {
+		unsigned char* end = dst + length;
+		do {
+			memcpy(dst, src, 8);
+			dst += 8;
+			src += 8;
+		} while (dst < end);
+	} else if (distance == 1) {
+		memset(dst, src[0], length);
+	} else {
+		while (length > 0) {
+			unsigned long chunk = (unsigned long)(dst - src);
+			if (chunk > length) {
+				chunk = length;
+			}
+			memcpy(dst, src, chunk);
+			dst += chunk;
+			length -= chunk;
+		}
 	}
 }
 
 /*inflate a block with dynamic of fixed Huffman tree*/
-static void inflate_huffman(upng_t* upng, unsigned char* out, unsigned long outsize, const unsigned char *in, unsigned long *bp, unsigned long *pos, unsigned long inlength, unsigned btype)
+static void inflate_huffman(upng_t* upng, inflate_stream* s, unsigned btype)
 {
-	unsigned codetree_buffer[DEFLATE_CODE_BUFFER_SIZE];
-	unsigned codetreeD_buffer[DISTANCE_BUFFER_SIZE];
-	unsigned done = 0;
-
-	huffman_tree codetree;
-	huffman_tree codetreeD;
+	huffman_table codetree;
+	huffman_table codetreeD;
 
 	if (btype == 1) {
 		/* fixed trees */
-		huffman_tree_init(&codetree, (unsigned*)FIXED_DEFLATE_CODE_TREE, NUM_DEFLATE_CODE_SYMBOLS, DEFLATE_CODE_BITLEN);
-		huffman_tree_init(&codetreeD, (unsigned*)FIXED_DISTANCE_TREE, NUM_DISTANCE_SYMBOLS, DISTANCE_BITLEN);
-	} else if (btype == 2) {
+		unsigned char bitlen[NUM_DEFLATE_CODE_SYMBOLS];
+		unsigned char bitlenD[NUM_DISTANCE_SYMBOLS];
+		get_fixed_code_lengths(bitlen, bitlenD);
+		huffman_table_create_lengths(upng, &codetree, bitlen, NUM_DEFLATE_CODE_SYMBOLS);
+		huffman_table_create_lengths(upng, &codetreeD, bitlenD, NUM_DISTANCE_SYMBOLS);
+	} else {
 		/* dynamic trees */
-		unsigned codelengthcodetree_buffer[CODE_LENGTH_BUFFER_SIZE];
-		huffman_tree codelengthcodetree;
-
-		huffman_tree_init(&codetree, codetree_buffer, NUM_DEFLATE_CODE_SYMBOLS, DEFLATE_CODE_BITLEN);
-		huffman_tree_init(&codetreeD, codetreeD_buffer, NUM_DISTANCE_SYMBOLS, DISTANCE_BITLEN);
-		huffman_tree_init(&codelengthcodetree, codelengthcodetree_buffer, NUM_CODE_LENGTH_CODES, CODE_LENGTH_BITLEN);
-		get_tree_inflate_dynamic(upng, &codetree, &codetreeD, &codelengthcodetree, in, bp, inlength);
+		get_tree_inflate_dynamic(upng, &codetree, &codetreeD, s);
+	}
+	if (upng->error != UPNG_EOK) {
+		return;
 	}
 
-	while (done == 0) {
-		unsigned code = huffman_decode_symbol(upng, in, bp, &codetree, inlength);
-		if (upng->error != UPNG_EOK) {
-			return;
-		}
+	for (;;) {
+		unsigned code, codeD;
+		unsigned long length, distance;
 
-		if (code == 256) {
-			/* end code */
-			done = 1;
-		} else if (code <= 255) {
-			/* literal symbol */
-			if ((*pos) >= outsize) {
+		/* one refill holds a whole length/distance pair: 15 + 5 + 15 + 13 bits */
+		if (s->bitcount < 48) {
+			refill_bits(s);
+			if (input_overrun(s)) {
 				SET_ERROR(upng, UPNG_EMALFORMED);
 				return;
 			}
+		}
 
-			/* store output */
-			out[(*pos)++] = (unsigned char)(code);
-		} else if (code >= FIRST_LENGTH_CODE_INDEX && code <= LAST_LENGTH_CODE_INDEX) {	/*length code */
-			/* part 1: get length base */
-			unsigned long length = LENGTH_BASE[code - FIRST_LENGTH_CODE_INDEX];
-			unsigned codeD, distance, numextrabitsD;
-			unsigned long start, forward, backward, numextrabits;
-
-			/* part 2: get extra bits and add the value of that to length */
-			numextrabits = LENGTH_EXTRA[code - FIRST_LENGTH_CODE_INDEX];
+		code = huffman_decode_symbol(upng, s, &codetree);
+		if (upng->error != UPNG_EOK) {
+			return;
+		}
 
-			/* error, bit pointer will jump past memory */
-			if (((*bp) >> 3) >= inlength) {
+		if (code <= 255) {
+			/* literal symbol */
+			if (s->outpos >= s->outsize) {
 				SET_ERROR(upng, UPNG_EMALFORMED);
 				return;
 			}
-			length += read_bits(bp, in, numextrabits);
-
-			/*part 3: get distance code */
-			codeD = huffman_decode_symbol(upng, in, bp, &codetreeD, inlength);
-			if (upng->error != UPNG_EOK) {
-				return;
-			}
+			s->out[s->outpos++] = (unsigned char)code;
+			continue;
+		}
 
-			/* invalid distance code (30-31 are never used) */
-			if (codeD > 29) {
-				SET_ERROR(upng, UPNG_EMALFORMED);
-				return;
-			}
+		if (code == 256) {
+			/* end code */
+			break;
+		}
 
-			distance = DISTANCE_BASE[codeD];
+		if (code > LAST_LENGTH_CODE_INDEX) {
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return;
+		}
 
-			/*part 4: get extra bits from distance */
-			numextrabitsD = DISTANCE_EXTRA[codeD];
+		/* length code: base plus extra bits, then the distance code and its extra bits */
+		length = LENGTH_BASE[code - FIRST_LENGTH_CODE_INDEX] + consume_bits(s, LENGTH_EXTRA[code - FIRST_LENGTH_CODE_INDEX]);
 
-			/* error, bit pointer will jump past memory */
-			if (((*bp) >> 3) >= inlength) {
-				SET_ERROR(upng, UPNG_EMALFORMED);
-				return;
-			}
+		codeD = huffman_decode_symbol(upng, s, &codetreeD);
+		if (upng->error != UPNG_EOK) {
+			return;
+		}
 
-			distance += read_bits(bp, in, numextrabitsD);
+		/* invalid distance code (30-31 are never used) */
+		if (codeD > 29) {
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return;
+		}
 
-			/*part 5: fill in all the out[n] values based on the length and dist */
-			start = (*pos);
-			backward = start - distance;
+		distance = DISTANCE_BASE[codeD] + consume_bits(s, DISTANCE_EXTRA[codeD]);
 
-			if ((*pos) + length >= outsize) {
-				SET_ERROR(upng, UPNG_EMALFORMED);
-				return;
-			}
+		/* the match has to start inside and end inside the output */
+		if (distance > s->outpos || s->outpos + length > s->outsize) {
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return;
+		}
 
-			for (forward = 0; forward < length; forward++) {
-				out[(*pos)++] = out[backward];
-				backward++;
+		copy_match(s, distance, length);
+	}
 
-				if (backward >= start) {
-					backward = start - distance;
-				}
-			}
-		}
+	if (input_overrun(s)) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
 	}
 }
 
-static void inflate_uncompressed(upng_t* upng, unsigned char* out, unsigned long outsize, const unsigned char *in, unsigned long *bp, unsigned long *pos, unsigned long inlength)
+static void inflate_uncompressed(upng_t* upng, inflate_stream* s)
 {
 	unsigned long p;
-	unsigned len, nlen, n;
+	unsigned len, nlen;
 
-	/* go to first boundary of byte */
-	while (((*bp) & 0x7) != 0) {
-		(*bp)++;
-	}
-	p = (*bp) / 8;		/*byte position */
+	/* go to first boundary of byte, then give the whole bytes left in the bit buffer back to the input */
+	consume_bits(s, s->bitcount & 7);
+	p = s->inpos - s->bitcount / 8;
+	s->bitbuf = 0;
+	s->bitcount = 0;
 
 	/* read len (2 bytes) and nlen (2 bytes) */
-	if (p >= inlength - 4) {
+	if (p + 4 > s->insize) {
 		SET_ERROR(upng, UPNG_EMALFORMED);
 		return;
 	}
 
-	len = in[p] + 256 * in[p + 1];
+	len = s->in[p] + 256 * s->in[p + 1];
 	p += 2;
-	nlen = in[p] + 256 * in[p + 1];
+	nlen = s->in[p] + 256 * s->in[p + 1];
 	p += 2;
 
 	/* check if 16-bit nlen is really the one's complement of len */
@@ -582,53 +539,58 @@ static void inflate_uncompressed(upng_t* upng, unsigned char* out, unsigned long
 		return;
 	}
 
-	if ((*pos) + len >= outsize) {
+	if (s->outpos + len > s->outsize) {
 		SET_ERROR(upng, UPNG_EMALFORMED);
 		return;
 	}
 
 	/* read the literal data: len bytes are now stored in the out buffer */
-	if (p + len > inlength) {
+	if (p + len > s->insize) {
 		SET_ERROR(upng, UPNG_EMALFORMED);
 		return;
 	}
 
-	for (n = 0; n < len; n++) {
-		out[(*pos)++] = in[p++];
-	}
-
-	(*bp) = p * 8;
+	memcpy(s->out + s->outpos, s->in + p, len);
+	s->outpos += len;
+	s->inpos = p + len;
 }
 
 /*inflate the deflated data (cfr. deflate spec); return value is the error*/
 static upng_error uz_inflate_data(upng_t* upng, unsigned char* out, unsigned long outsize, const unsigned char *in, unsigned long insize, unsigned long inpos)
 {
-	unsigned long bp = 0;	/*bit pointer in the "in" data, current byte is bp >> 3, current bit is bp & 0x7 (from lsb to msb of the byte) */
-	unsigned long pos = 0;	/*byte position in the out buffer */
-
+	inflate_stream s;
 	unsigned done = 0;
 
+	s.in = in + inpos;
+	s.insize = insize - inpos;
+	s.inpos = 0;
+	s.bitbuf = 0;
+	s.bitcount = 0;
+	s.out = out;
+	s.outsize = outsize;
+	s.outpos = 0;
+
 	while (done == 0) {
 		unsigned btype;
 
-		/* ensure next bit doesn't point past the end of the buffer */
-		if ((bp >> 3) >= insize) {
+		/* read block control bits, the final block flag first */
+		done = read_bits(&s, 1);
+		btype = read_bits(&s, 2);
+
+		/* ensure the block header didn't point past the end of the buffer */
+		if (input_overrun(&s)) {
 			SET_ERROR(upng, UPNG_EMALFORMED);
 			return upng->error;
 		}
 
-		/* read block control bits */
-		done = read_bit(&bp, &in[inpos]);
-		btype = read_bit(&bp, &in[inpos]) | (read_bit(&bp, &in[inpos]) << 1);
-
 		/* process control type appropriateyly */
 		if (btype == 3) {
 			SET_ERROR(upng, UPNG_EMALFORMED);
 			return upng->error;
 		} else if (btype == 0) {
-			inflate_uncompressed(upng, out, outsize, &in[inpos], &bp, &pos, insize);	/*no compression */
+			inflate_uncompressed(upng, &s);	/*no compression */
 		} else {
-			inflate_huffman(upng, out, outsize, &in[inpos], &bp, &pos, insize, btype);	/*compression, btype 01 or 10 */
+			inflate_huffman(upng, &s, btype);	/*compression, btype 01 or 10 */
 		}
 
 		/* stop if an error has occured */
@@ -1,6 +1,10 @@
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
 #include "vector.h"
 
+#define VECT_STREAM_ALIGNMENT 32
+
 
 //////////////////////////////////////////////////////////////////////////////////
 // Implementation of all vector 2d functions
@@ -201,4 +205,89 @@ vect3_t vect3_from_vect4(vect4_t v){
 vect2_t vect2_from_vect4(vect4_t v){
 	vect2_t result = { v.x, v.y };
 	return result;
-}
\ No newline at end of file
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+// Implementation of all vector stream functions
+//////////////////////////////////////////////////////////////////////////////////
+static float* stream_alloc(int capacity) {
+	size_t size = sizeof(float) * capacity;
+#if defined(_MSC_VER)
+	float* data = (float*)_aligned_malloc(size, VECT_STREAM_ALIGNMENT);
+#else
+	float* data = (float*)aligned_alloc(VECT_STREAM_ALIGNMENT, size);
+#endif
+	memset(data, 0, size);
+	return data;
+}
+
+static void stream_free(float* data) {
+#if defined(_MSC_VER)
+	_aligned_free(data);
+#else
+	free(data);
+#endif
+}
+
+//round the element count up to a whole number of SIMD lanes
+static int stream_padded_count(int count) {
+	return (count + VECT_STREAM_LANES - 1) / VECT_STREAM_LANES * VECT_STREAM_LANES;
+}
+
+void vect3_stream_reserve(vect3_stream_t* stream, int count) {
+	int capacity = stream_padded_count(count);
+	if (capacity > stream->capacity) {
+		vect3_stream_free(stream);
+		stream->x = stream_alloc(capacity);
+		stream->y = stream_alloc(capacity);
+		stream->z = stream_alloc(capacity);
+		stream->capacity = capacity;
+	}
+	stream->count = count;
+}
+
+void vect4_stream_reserve(vect4_stream_t* stream, int count) {
+	int capacity = stream_padded_count(count);
+	if (capacity > stream->capacity) {
+		vect4_stream_free(stream);
+		stream->x = stream_alloc(capacity);
+		stream->y = stream_alloc(capacity);
+		stream->z = stream_alloc(capacity);
+		stream->w = stream_alloc(capacity);
+		stream->capacity = capacity;
+	}
+	stream->count = count;
+}
+
+//split an array of vect3_t into separate x[], y[] and z[] streams
+void vect3_stream_from_array(vect3_stream_t* stream, vect3_t* array, int count) {
+	vect3_stream_reserve(stream, count);
+	for (int i = 0; i < count; i++) {
+		stream->x[i] = array[i].x;
+		stream->y[i] = array[i].y;
+		stream->z[i] = array[i].z;
+	}
+}
+
+void vect3_stream_free(vect3_stream_t* stream) {
+	if (stream->capacity > 0) {
+		stream_free(stream->x);
+		stream_free(stream->y);
+		stream_free(stream->z);
+	}
+	stream->x = stream->y = stream->z = NULL;
+	stream->count = 0;
+	stream->capacity = 0;
+}
+
+void vect4_stream_free(vect4_stream_t* stream) {
+	if (stream->capacity > 0) {
+		stream_free(stream->x);
+		stream_free(stream->y);
+		stream_free(stream->z);
+		stream_free(stream->w);
+	}
+	stream->x = stream->y = stream->z = stream->w = NULL;
+	stream->count = 0;
+	stream->capacity = 0;
+}
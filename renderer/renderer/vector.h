@@ -1,8 +1,9 @@
 #ifndef VECTOR_H
 #define VECTOR_H
 
-
-
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
 
 typedef struct{
 	float x, y;
@@ -16,6 +17,30 @@ typedef struct {
 	float x, y, z, w;
 }vect4_t;
 
+//////////////////////////////////////////////////////////////////////////////////
+// Structure-of-arrays vector streams for batch (SIMD) processing.
+// Every component array is 32-byte aligned and padded with zeros up to a
+// multiple of VECT_STREAM_LANES, so kernels never need a scalar tail loop.
+//////////////////////////////////////////////////////////////////////////////////
+#define VECT_STREAM_LANES 8
+
+typedef struct {
+	float* x;
+	float* y;
+	float* z;
+	int count;
+	int capacity;
+}vect3_stream_t;
+
+typedef struct {
+	float* x;
+	float* y;
+	float* z;
+	float* w;
+	int count;
+	int capacity;
+}vect4_stream_t;
+
 
 //////////////////////////////////////////////////////////////////////////////////
 // vector 2 functions
@@ -67,5 +92,14 @@ vect3_t vect3_rotate_z(vect3_t v, float angle);
 vect4_t vect4_from_vect3(vect3_t v);
 vect3_t vect3_from_vect4(vect4_t v);
 vect2_t vect2_from_vect4(vect4_t v);
+
+//////////////////////////////////////////////////////////////////////////////////
+// vector stream functions
+//////////////////////////////////////////////////////////////////////////////////
+void vect3_stream_reserve(vect3_stream_t* stream, int count);
+void vect4_stream_reserve(vect4_stream_t* stream, int count);
+void vect3_stream_from_array(vect3_stream_t* stream, vect3_t* array, int count);
+void vect3_stream_free(vect3_stream_t* stream);
+void vect4_stream_free(vect4_stream_t* stream);
 #endif // !VECTOR_H
 
@@ -0,0 +1,269 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include "vertex_cache.h"
+
+#define CACHE_DECAY_POWER 1.5f
+#define LAST_FACE_SCORE 0.75f			// the three vertices of the last face get a fixed score
+#define VALENCE_BOOST_SCALE 2.0f		// favours vertices with few faces left, so no lone faces are left behind
+#define VALENCE_BOOST_POWER 0.5f
+#define MAX_VALENCE_TABLE 64
+
+///////////////////////////////////////////////////////////////////////////////
+// Average cache miss ratio of a FIFO post transform cache
+///////////////////////////////////////////////////////////////////////////////
+float calculate_acmr(const face_t* faces, int num_faces, int num_vertices, int cache_size) {
+	if (num_faces <= 0) {
+		return 0.0f;
+	}
+
+	//a vertex is still cached while fewer than cache_size misses happened since it was loaded
+	int* loaded_at = (int*)malloc(sizeof(int) * (num_vertices > 0 ? num_vertices : 1));
+	for (int i = 0; i < num_vertices; i++) {
+		loaded_at[i] = -cache_size - 1;
+	}
+
+	int misses = 0;
+	for (int i = 0; i < num_faces; i++) {
+		int vertex_indices[3] = { faces[i].a, faces[i].b, faces[i].c };
+		for (int j = 0; j < 3; j++) {
+			int v = vertex_indices[j];
+			if (misses - loaded_at[v] > cache_size) {
+				loaded_at[v] = misses;
+				misses++;
+			}
+		}
+	}
+	free(loaded_at);
+
+	return (float)misses / (float)num_faces;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Forsyth vertex scores: recently used vertices score high so their faces are
+// emitted while they are still cached, and vertices with few faces left get a
+// boost so they are finished off instead of being reloaded later. The tables
+// belong to one optimizer call, meshes are optimized on several job threads.
+///////////////////////////////////////////////////////////////////////////////
+typedef struct {
+	float cache_scores[VERTEX_CACHE_SIZE];
+	float valence_scores[MAX_VALENCE_TABLE];
+} vertex_score_tables_t;
+
+static void init_vertex_scores(vertex_score_tables_t* tables) {
+	for (int i = 0; i < VERTEX_CACHE_SIZE; i++) {
+		if (i < 3) {
+			tables->cache_scores[i] = LAST_FACE_SCORE;
+		}
+		else {
+			float scale = 1.0f / (float)(VERTEX_CACHE_SIZE - 3);
+			tables->cache_scores[i] = powf(1.0f - (float)(i - 3) * scale, CACHE_DECAY_POWER);
+		}
+	}
+	tables->valence_scores[0] = 0.0f;
+	for (int i = 1; i < MAX_VALENCE_TABLE; i++) {
+		tables->valence_scores[i] = VALENCE_BOOST_SCALE * powf((float)i, -VALENCE_BOOST_POWER);
+	}
+}
+
+static float get_vertex_score(const vertex_score_tables_t* tables, int cache_position, int remaining_faces) {
+	if (remaining_faces == 0) {
+		return -1.0f;
+	}
+	float score = cache_position >= 0 ? tables->cache_scores[cache_position] : 0.0f;
+	if (remaining_faces < MAX_VALENCE_TABLE) {
+		score += tables->valence_scores[remaining_faces];
+	}
+	else {
+		score += VALENCE_BOOST_SCALE * powf((float)remaining_faces, -VALENCE_BOOST_POWER);
+	}
+	return score;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Greedy face ordering: the next face is the best scored face that touches
+// the simulated cache, or the next unused face in file order when none does
+///////////////////////////////////////////////////////////////////////////////
+static void optimize_face_order(face_t* faces, int num_faces, int num_vertices) {
+	vertex_score_tables_t tables;
+	init_vertex_scores(&tables);
+
+	//Faces of each vertex, the first remaining_faces[v] entries are the faces not emitted yet
+	int* face_offsets = (int*)calloc(num_vertices + 1, sizeof(int));
+	int* remaining_faces = (int*)calloc(num_vertices, sizeof(int));
+	int* vertex_faces = (int*)malloc(sizeof(int) * num_faces * 3);
+	for (int i = 0; i < num_faces; i++) {
+		remaining_faces[faces[i].a]++;
+		remaining_faces[faces[i].b]++;
+		remaining_faces[faces[i].c]++;
+	}
+	for (int v = 0; v < num_vertices; v++) {
+		face_offsets[v + 1] = face_offsets[v] + remaining_faces[v];
+		remaining_faces[v] = 0;
+	}
+	for (int i = 0; i < num_faces; i++) {
+		int vertex_indices[3] = { faces[i].a, faces[i].b, faces[i].c };
+		for (int j = 0; j < 3; j++) {
+			int v = vertex_indices[j];
+			vertex_faces[face_offsets[v] + remaining_faces[v]++] = i;
+		}
+	}
+
+	int* cache_positions = (int*)malloc(sizeof(int) * num_vertices);
+	float* vertex_scores = (float*)malloc(sizeof(float) * num_vertices);
+	for (int v = 0; v < num_vertices; v++) {
+		cache_positions[v] = -1;
+		vertex_scores[v] = get_vertex_score(&tables, -1, remaining_faces[v]);
+	}
+
+	float* face_scores = (float*)malloc(sizeof(float) * num_faces);
+	bool* face_emitted = (bool*)calloc(num_faces, sizeof(bool));
+	int best_face = 0;
+	for (int i = 0; i < num_faces; i++) {
+		face_scores[i] = vertex_scores[faces[i].a] + vertex_scores[faces[i].b] + vertex_scores[faces[i].c];
+		if (face_scores[i] > face_scores[best_face]) {
+			best_face = i;
+		}
+	}
+
+	//one face more than the cache, so the vertices pushed out get their scores lowered
+	int cache[VERTEX_CACHE_SIZE + 3];
+	int new_cache[VERTEX_CACHE_SIZE + 3];
+	int cache_count = 0;
+	int next_unused_face = 0;
+
+	face_t* ordered_faces = (face_t*)malloc(sizeof(face_t) * num_faces);
+
+	for (int output = 0; output < num_faces; output++) {
+		if (best_face < 0) {
+			while (face_emitted[next_unused_face]) {
+				next_unused_face++;
+			}
+			best_face = next_unused_face;
+		}
+
+		face_t face = faces[best_face];
+		ordered_faces[output] = face;
+		face_emitted[best_face] = true;
+
+		//Move the vertices of the face to the front of the cache and drop the face from their lists
+		int vertex_indices[3] = { face.a, face.b, face.c };
+		int new_count = 0;
+		for (int j = 0; j < 3; j++) {
+			int v = vertex_indices[j];
+			int* list = vertex_faces + face_offsets[v];
+			for (int k = 0; k < remaining_faces[v]; k++) {
+				if (list[k] == best_face) {
+					list[k] = list[remaining_faces[v] - 1];
+					remaining_faces[v]--;
+					break;
+				}
+			}
+
+			bool duplicate = false;
+			for (int k = 0; k < new_count; k++) {
+				duplicate |= new_cache[k] == v;
+			}
+			if (!duplicate) {
+				new_cache[new_count++] = v;
+			}
+		}
+		for (int k = 0; k < cache_count; k++) {
+			int v = cache[k];
+			if (v != face.a && v != face.b && v != face.c) {
+				new_cache[new_count++] = v;
+			}
+		}
+
+		//Rescore the cached vertices and the faces still waiting on them
+		for (int k = 0; k < new_count; k++) {
+			int v = new_cache[k];
+			cache_positions[v] = k < VERTEX_CACHE_SIZE ? k : -1;
+			vertex_scores[v] = get_vertex_score(&tables, cache_positions[v], remaining_faces[v]);
+		}
+
+		best_face = -1;
+		float best_score = -1.0f;
+		for (int k = 0; k < new_count; k++) {
+			int v = new_cache[k];
+			const int* list = vertex_faces + face_offsets[v];
+			for (int f = 0; f < remaining_faces[v]; f++) {
+				int face_index = list[f];
+				face_scores[face_index] = vertex_scores[faces[face_index].a] +
+					vertex_scores[faces[face_index].b] + vertex_scores[faces[face_index].c];
+				if (face_scores[face_index] > best_score) {
+					best_score = face_scores[face_index];
+					best_face = face_index;
+				}
+			}
+		}
+
+		cache_count = new_count < VERTEX_CACHE_SIZE ? new_count : VERTEX_CACHE_SIZE;
+		memcpy(cache, new_cache, sizeof(int) * cache_count);
+	}
+
+	memcpy(faces, ordered_faces, sizeof(face_t) * num_faces);
+
+	free(ordered_faces);
+	free(face_emitted);
+	free(face_scores);
+	free(vertex_scores);
+	free(cache_positions);
+	free(vertex_faces);
+	free(remaining_faces);
+	free(face_offsets);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Vertex fetch order: vertices are renumbered in order of first use by the
+// faces, unreferenced vertices are kept at the end
+///////////////////////////////////////////////////////////////////////////////
+static void permute_vertex_array(void* array, const int* remap, int count, int item_size) {
+	if (array == NULL) {
+		return;
+	}
+	char* source = (char*)malloc((size_t)count * item_size);
+	memcpy(source, array, (size_t)count * item_size);
+	for (int i = 0; i < count; i++) {
+		memcpy((char*)array + (size_t)remap[i] * item_size, source + (size_t)i * item_size, item_size);
+	}
+	free(source);
+}
+
+static void optimize_vertex_fetch(mesh_t* mesh) {
+	int num_vertices = mesh->num_vertices;
+	int* remap = (int*)malloc(sizeof(int) * num_vertices);
+	memset(remap, 0xFF, sizeof(int) * num_vertices);
+
+	int next_vertex = 0;
+	for (int i = 0; i < mesh->num_faces; i++) {
+		int* vertex_indices[3] = { &mesh->faces[i].a, &mesh->faces[i].b, &mesh->faces[i].c };
+		for (int j = 0; j < 3; j++) {
+			int v = *vertex_indices[j];
+			if (remap[v] < 0) {
+				remap[v] = next_vertex++;
+			}
+			*vertex_indices[j] = remap[v];
+		}
+	}
+	for (int v = 0; v < num_vertices; v++) {
+		if (remap[v] < 0) {
+			remap[v] = next_vertex++;
+		}
+	}
+
+	permute_vertex_array(mesh->vertices, remap, num_vertices, sizeof(vect3_t));
+	permute_vertex_array(mesh->model_normals, remap, num_vertices, sizeof(vect3_t));
+	permute_vertex_array(mesh->texcoords, remap, num_vertices, sizeof(tex2_t));
+	permute_vertex_array(mesh->vertex_positions, remap, num_vertices, sizeof(int));
+	free(remap);
+}
+
+void optimize_mesh_vertex_order(mesh_t* mesh) {
+	if (mesh->num_faces <= 0 || mesh->num_vertices <= 0) {
+		return;
+	}
+	optimize_face_order(mesh->faces, mesh->num_faces, mesh->num_vertices);
+	optimize_vertex_fetch(mesh);
+}
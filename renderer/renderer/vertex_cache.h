@@ -0,0 +1,23 @@
+#ifndef VERTEX_CACHE_H
+#define VERTEX_CACHE_H
+#include "mesh.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Load time reordering of the welded index buffer: the faces are sorted for
+// vertex reuse (Tom Forsyth's linear speed vertex cache optimization), then
+// the vertices are renumbered in the order the faces first use them so the
+// face loop gathers the transformed vertex streams mostly sequentially.
+///////////////////////////////////////////////////////////////////////////////
+#define VERTEX_CACHE_SIZE 32		// LRU cache simulated by the optimizer
+#define ACMR_CACHE_SIZE 16			// FIFO cache the ACMR report is measured with
+
+// Average cache miss ratio: vertices missed in a FIFO cache of cache_size
+// entries per face, 3.0 is the worst case and 0.5 the limit of a regular grid
+float calculate_acmr(const face_t* faces, int num_faces, int num_vertices, int cache_size);
+
+// Reorders the faces, then permutes the vertices, model normals, texture
+// coordinates and vertex positions of the mesh to match the new indices.
+// Must run before the normals, tangents and edges are calculated.
+void optimize_mesh_vertex_order(mesh_t* mesh);
+
+#endif